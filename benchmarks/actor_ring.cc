@@ -0,0 +1,89 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+// Message throughput of actor::system on a ring: each actor is a small
+// machine whose action passes a token to the next actor, and as many
+// tokens as asked for travel the ring at once. The report gives letters
+// per second for 1 to max-workers workers, with the steals and the
+// times an actor was held back by a full mailbox.
+//
+//   bench-actor_ring [max-workers] [actors] [tokens] [hops]
+
+#include "fsm_cxx/fsm-actor.hh"
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+  AWESOME_MAKE_ENUM(relay_state,
+                    Empty,
+                    Initial,
+                    Holding)
+
+  FSM_DEFINE_EVENT(token);
+
+  struct relay_context : public fsm_cxx::context_t<fsm_cxx::state_t<relay_state>> {
+    std::uint32_t hops{}; // of the token being handled
+  };
+
+  using M = fsm_cxx::machine_t<relay_state, fsm_cxx::event_t, void, fsm_cxx::payload_t, fsm_cxx::state_t<relay_state>, relay_context>;
+  using System = fsm_cxx::actor::system<M, std::uint32_t>;
+
+  struct result {
+    double per_sec;
+    unsigned long long stolen, blocked;
+  };
+
+  result run(std::size_t workers, std::uint32_t actors, std::uint32_t tokens, std::uint32_t hops) {
+    fsm_cxx::actor::options opt;
+    opt.workers = workers;
+    opt.mailbox = 256;
+    System sys{[](fsm_cxx::actor::address, M &m, std::uint32_t &h) { m.context().hops = h, m.step_by(token{}); }, opt};
+    for (std::uint32_t i = 0; i < actors; i++)
+      sys.spawn([&sys, next = fsm_cxx::actor::address{(i + 1) % actors}](fsm_cxx::actor::address, M &m) {
+        auto pass = [&sys, next](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+          if (c.hops) sys.send(next, c.hops - 1);
+        };
+        m.state().set(relay_state::Initial).as_initial().build();
+        m.transition().set(relay_state::Initial, token{}, relay_state::Holding).entry_action(pass).build();
+        m.transition().set(relay_state::Holding, token{}, relay_state::Holding).internal().entry_action(pass).build();
+      });
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::uint32_t t = 0; t < tokens; t++) sys.send(fsm_cxx::actor::address{static_cast<std::uint32_t>(std::uint64_t(t) * actors / tokens)}, hops);
+    sys.wait_idle();
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return result{double(sys.handled()) / secs, static_cast<unsigned long long>(sys.stolen()), static_cast<unsigned long long>(sys.blocked())};
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t max_workers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+  std::uint32_t actors = argc > 2 ? static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1000;
+  std::uint32_t tokens = argc > 3 ? static_cast<std::uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 1000;
+  std::uint32_t hops = argc > 4 ? static_cast<std::uint32_t>(std::strtoul(argv[4], nullptr, 10)) : 2000;
+
+  std::printf("%u actors, %u tokens of %u hops\n", actors, tokens, hops);
+  double base = 0;
+  for (std::size_t w = 1; w <= max_workers; w *= 2) {
+    auto r = run(w, actors, tokens, hops);
+    if (w == 1) base = r.per_sec;
+    std::printf("  %3zu workers %12.0f letters/s  x%.2f  (%llu stolen, %llu blocked)\n", w, r.per_sec, r.per_sec / base, r.stolen, r.blocked);
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+// frozen::batch over 16M instances of a guard-free ring of states,
+// stepped by the same tick with each instruction set the cpu supports.
+//
+//   bench-batch [instances] [rounds]
+
+#include "fsm_cxx/fsm-batch.hh"
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+  AWESOME_MAKE_ENUM(ring_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    S0, S1, S2, S3, S4, S5, S6, S7)
+
+  FSM_DEFINE_EVENT(tick);
+
+  using M = fsm_cxx::machine_t<ring_state>;
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::size_t{16} << 20;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+
+  M m;
+  m.state().set(ring_state::Initial).as_initial().build();
+  m.state().set(ring_state::Terminated).as_terminated().build();
+  m.state().set(ring_state::Error).as_error().build();
+  m.transition().set(ring_state::Initial, tick{}, ring_state::S0).build();
+  for (int i = 0; i < 8; i++)
+    m.transition().set(static_cast<ring_state>(int(ring_state::S0) + i), tick{}, static_cast<ring_state>(int(ring_state::S0) + (i + 1) % 8)).build();
+  fsm_cxx::frozen::model md;
+  fsm_cxx::frozen::registry<M> reg;
+  std::string err;
+  if (!fsm_cxx::frozen::freeze(m, md, &err)) return 1;
+  auto def = fsm_cxx::frozen::make(md.serialize(), reg, &err);
+  if (!def) return 1;
+  auto ev = def->table().event_index<tick>();
+
+  std::mt19937 rng{1};
+  std::vector<std::uint32_t> init(n);
+  for (auto &s : init) s = rng() % def->table().state_count();
+
+  // the baseline: definition::step() per instance
+  {
+    auto states = init;
+    M::Context ctx;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+      for (auto &s : states) def->step(s, ev, tick{}, ctx, M::Payload{});
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%-8s %10.1f M instance-steps/s\n", "step()", double(n) * rounds / secs / 1e6);
+  }
+
+  char const *names[] = {"auto", "scalar", "avx2", "avx512"};
+  for (auto isa : {fsm_cxx::frozen::simd::Scalar, fsm_cxx::frozen::simd::Avx2, fsm_cxx::frozen::simd::Avx512}) {
+    fsm_cxx::frozen::batch<M> b{def, isa};
+    if (b.isa() != isa) continue; // not supported here
+    auto states = init;
+    std::vector<std::uint64_t> mask(b.mask_words(n));
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) b.step(states.data(), n, ev, mask.data());
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%-8s %10.1f M instance-steps/s\n", names[static_cast<int>(isa)], double(n) * rounds / secs / 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+// the time to define a large machine: transition() one at a time, and
+// load() of a range of descriptors, copied or moved, with and without
+// sizing hints. Every transition carries a guard and an entry action
+// capturing a little state, as generated definitions do.
+//
+//   bench-construct [transitions...]       (default 1000 10000 100000)
+
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+  enum class node : std::uint32_t {};
+
+  template<int I>
+  struct tick : public fsm_cxx::event_type<tick<I>> {};
+
+  using M = fsm_cxx::machine_t<node>;
+  constexpr int events = 8;
+
+  std::string event_name(int k) {
+    static std::string const names[events] = {
+            std::string{fsm_cxx::debug::type_name<tick<0>>()}, std::string{fsm_cxx::debug::type_name<tick<1>>()},
+            std::string{fsm_cxx::debug::type_name<tick<2>>()}, std::string{fsm_cxx::debug::type_name<tick<3>>()},
+            std::string{fsm_cxx::debug::type_name<tick<4>>()}, std::string{fsm_cxx::debug::type_name<tick<5>>()},
+            std::string{fsm_cxx::debug::type_name<tick<6>>()}, std::string{fsm_cxx::debug::type_name<tick<7>>()}};
+    return names[k];
+  }
+
+  node target(std::size_t i, std::size_t states) { return node(static_cast<std::uint32_t>((i * 2654435761u) % states)); }
+
+  auto guard_for(std::size_t i) {
+    return [limit = static_cast<int>(i % 100)](M::Event const &, M::Context &, M::State const &, M::Payload const &) { return limit >= 0; };
+  }
+  auto action_for(std::size_t i) {
+    return [tag = "transition #" + std::to_string(i) + " of the generated definition"](M::Event const &, M::Context &, M::State const &, M::Payload const &) {
+      (void) tag;
+    };
+  }
+
+  // transition i leaves state i / events by event i % events
+  template<int K>
+  void define_one(M &m, std::size_t i, std::size_t states) {
+    if constexpr (K < events) {
+      if (static_cast<int>(i % events) != K) return define_one<K + 1>(m, i, states);
+      m.transition().set(node(static_cast<std::uint32_t>(i / events)), tick<K>{}, target(i, states)).guard(guard_for(i)).entry_action(action_for(i)).build();
+    }
+  }
+
+  std::vector<M::Descriptor> descriptors(std::size_t n, std::size_t states) {
+    std::vector<M::Descriptor> v;
+    v.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+      M::Descriptor d{node(static_cast<std::uint32_t>(i / events)), event_name(static_cast<int>(i % events)), target(i, states)};
+      d.guard = guard_for(i);
+      d.entry.update(action_for(i));
+      v.push_back(std::move(d));
+    }
+    return v;
+  }
+
+  template<typename F>
+  void run(char const *what, std::size_t n, int reps, F &&build) {
+    double secs = 0;
+    std::size_t check = 0;
+    for (int r = 0; r < reps; r++) {
+      M m;
+      secs += build(m);
+      check += m.transitions().size();
+    }
+    std::printf("  %-22s %9.1f ns/transition %10.3f ms/machine  (%zu states)\n", what, secs * 1e9 / double(n) / reps,
+                secs * 1e3 / reps, check / reps);
+  }
+
+  template<typename F>
+  double timed(F &&f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<std::size_t> sizes;
+  for (int i = 1; i < argc; i++) sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+  if (sizes.empty()) sizes = {1000, 10000, 100000};
+
+  for (auto n : sizes) {
+    auto const states = (n + events - 1) / events;
+    int const reps = n >= 100000 ? 3 : n >= 10000 ? 20 : 200;
+    std::printf("%zu transitions:\n", n);
+
+    run("transition()", n, reps, [&](M &m) {
+      return timed([&]() {
+        for (std::size_t i = 0; i < n; i++) define_one<0>(m, i, states);
+      });
+    });
+
+    auto const source = descriptors(n, states);
+    run("load(), copied", n, reps, [&](M &m) { return timed([&]() { m.load(source); }); });
+    run("load(), moved", n, reps, [&](M &m) {
+      auto v = source; // outside of the timing
+      return timed([&]() { m.load(std::move(v), {states, 0, 0}); });
+    });
+    run("load(), moved, hinted", n, reps, [&](M &m) {
+      auto v = source;
+      return timed([&]() { m.load(std::move(v), {states, n, events}); });
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+// mapping event names, as they arrive from text, to dense event ids:
+// a std::unordered_map<std::string> keyed lookup (what machine_t does
+// per state), a bisection of the sorted names, and the perfect hash of
+// a frozen definition.
+//
+//   bench-event_lookup [events] [lookups]
+
+#include "fsm_cxx/fsm-frozen.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+  template<typename F>
+  void run(char const *what, std::vector<std::string_view> const &queries, F &&lookup) {
+    std::uint64_t sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto q : queries) sum += lookup(q);
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%-14s %8.1f ns/lookup  (checksum %llu)\n", what, secs * 1e9 / double(queries.size()), static_cast<unsigned long long>(sum));
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+  std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+
+  // names shaped like the type names machine_t keys its table with
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < n; i++) names.push_back("app::protocol::events::command_" + std::to_string(i));
+  std::vector<std::string_view> views(names.begin(), names.end());
+
+  std::mt19937 rng{38};
+  std::vector<std::string> unknown;
+  for (std::size_t i = 0; i < 16; i++) unknown.push_back("app::protocol::events::unknown_" + std::to_string(i));
+  std::vector<std::string_view> queries(lookups);
+  for (auto &q : queries) q = rng() % 8 ? views[rng() % n] : std::string_view{unknown[rng() % unknown.size()]};
+
+  std::unordered_map<std::string, std::uint32_t> map;
+  for (std::uint32_t i = 0; i < n; i++) map.emplace(names[i], i);
+  run("unordered_map", queries, [&map](std::string_view q) -> std::uint32_t {
+    auto it = map.find(std::string{q}); // the std::string a dynamic step_by() is given
+    return it == map.end() ? 0 : it->second;
+  });
+
+  std::vector<std::uint32_t> by_name(n);
+  for (std::uint32_t i = 0; i < n; i++) by_name[i] = i;
+  std::sort(by_name.begin(), by_name.end(), [&views](std::uint32_t a, std::uint32_t b) { return views[a] < views[b]; });
+  run("bisection", queries, [&](std::string_view q) -> std::uint32_t {
+    auto it = std::lower_bound(by_name.begin(), by_name.end(), q, [&views](std::uint32_t i, std::string_view v) { return views[i] < v; });
+    return it != by_name.end() && views[*it] == q ? *it : 0;
+  });
+
+  std::uint32_t seed;
+  std::vector<std::uint32_t> disp, slots;
+  if (!fsm_cxx::frozen::detail::build_name_hash(views, seed, disp, slots)) return 1;
+  auto const count = static_cast<std::uint32_t>(n);
+  run("perfect hash", queries, [&](std::string_view q) -> std::uint32_t {
+    auto i = fsm_cxx::frozen::detail::lookup_name_hash(q, seed, disp.data(), slots.data(), count);
+    return views[i] == q ? i : 0;
+  });
+  return 0;
+}
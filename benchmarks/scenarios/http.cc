@@ -0,0 +1,221 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// An HTTP/1.1 request parser driven byte by byte: each byte is one step
+// of a machine_t, by its class (token, space, colon, CR, LF, control)
+// with the byte itself as the payload. Actions collect the method, the
+// target and the headers, and Content-Length decides how many body
+// bytes follow. The generator writes GET, HEAD, DELETE, POST and PUT
+// requests with browser-like headers and bodies of up to 2KB; one in a
+// hundred carries a control byte in a header, and is dropped at the
+// first refused byte, as a server would close the connection.
+
+#include "scenario.hh"
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <array>
+#include <cstdlib>
+#include <string>
+
+namespace scenarios {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(http_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Method,
+                    Target,
+                    Version,
+                    LineEnd,
+                    HeaderStart,
+                    HeaderName,
+                    HeaderValue,
+                    HeaderEnd,
+                    HeadEnd,
+                    Body,
+                    Done)
+
+  FSM_DEFINE_EVENT(tok);
+  FSM_DEFINE_EVENT(sp);
+  FSM_DEFINE_EVENT(colon);
+  FSM_DEFINE_EVENT(cr);
+  FSM_DEFINE_EVENT(lf);
+  FSM_DEFINE_EVENT(ctl);
+
+  struct byte : public fsm_cxx::payload_t {
+    char c{};
+  };
+
+  struct request_context : public fsm_cxx::context_t<fsm_cxx::state_t<http_state>, fsm_cxx::event_t, void, byte> {
+    std::string method{}, target{}, version{}, name{}, value{};
+    std::uint32_t headers{};
+    std::uint64_t remaining{}; // body bytes still to come
+    std::uint64_t body{};      // body bytes seen
+
+    void clear() {
+      method.clear(), target.clear(), version.clear(), name.clear(), value.clear();
+      headers = 0, remaining = body = 0;
+    }
+  };
+
+  using M = fsm_cxx::machine_t<http_state, fsm_cxx::event_t, void, byte, fsm_cxx::state_t<http_state>, request_context>;
+  using S = http_state;
+
+  bool iequals(std::string const &a, char const *b) {
+    std::size_t i = 0;
+    for (; i < a.size() && b[i]; i++)
+      if ((a[i] | 0x20) != (b[i] | 0x20)) return false;
+    return i == a.size() && !b[i];
+  }
+
+  template<typename Evt>
+  void define_body(M &m) {
+    auto more = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) -> bool { return c.remaining > 1; };
+    auto eat = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.remaining--, c.body++; };
+    m.transition().set(S::Body, Evt{}, S::Body).internal().guard(more).entry_action(eat).build();
+    m.transition().set(S::Body, Evt{}, S::Done).entry_action(eat).build();
+  }
+
+  void define(M &m) {
+    using A = void (*)(M::Event const &, M::Context &, M::State const &, M::Payload const &);
+    A method = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) { c.method += p.c; };
+    A target = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) { c.target += p.c; };
+    A version = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) { c.version += p.c; };
+    A name_first = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) { c.name.assign(1, p.c), c.value.clear(); };
+    A name = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) { c.name += p.c; };
+    A value = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &p) {
+      if (!c.value.empty() || p.c != ' ') c.value += p.c;
+    };
+    A header = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+      c.headers++;
+      if (iequals(c.name, "content-length")) c.remaining = std::strtoull(c.value.c_str(), nullptr, 10);
+    };
+    auto has_body = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) -> bool { return c.remaining > 0; };
+    auto http11 = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) -> bool { return c.version == "HTTP/1.1" || c.version == "HTTP/1.0"; };
+
+    m.state().set(S::Method).as_initial().build();
+    m.transition().set(S::Method, tok{}, S::Method).internal().entry_action(method).build();
+    m.transition().set(S::Method, sp{}, S::Target).build();
+    m.transition().set(S::Target, tok{}, S::Target).internal().entry_action(target).build();
+    m.transition().set(S::Target, colon{}, S::Target).internal().entry_action(target).build();
+    m.transition().set(S::Target, sp{}, S::Version).build();
+    m.transition().set(S::Version, tok{}, S::Version).internal().entry_action(version).build();
+    m.transition().set(S::Version, cr{}, S::LineEnd).guard(http11).build();
+    m.transition().set(S::LineEnd, lf{}, S::HeaderStart).build();
+    m.transition().set(S::HeaderStart, tok{}, S::HeaderName).entry_action(name_first).build();
+    m.transition().set(S::HeaderStart, cr{}, S::HeadEnd).build();
+    m.transition().set(S::HeaderName, tok{}, S::HeaderName).internal().entry_action(name).build();
+    m.transition().set(S::HeaderName, colon{}, S::HeaderValue).build();
+    m.transition().set(S::HeaderValue, tok{}, S::HeaderValue).internal().entry_action(value).build();
+    m.transition().set(S::HeaderValue, colon{}, S::HeaderValue).internal().entry_action(value).build();
+    m.transition().set(S::HeaderValue, sp{}, S::HeaderValue).internal().entry_action(value).build();
+    m.transition().set(S::HeaderValue, cr{}, S::HeaderEnd).entry_action(header).build();
+    m.transition().set(S::HeaderEnd, lf{}, S::HeaderStart).build();
+    m.transition().set(S::HeadEnd, lf{}, S::Body).guard(has_body).build();
+    m.transition().set(S::HeadEnd, lf{}, S::Done).build();
+    define_body<tok>(m);
+    define_body<sp>(m);
+    define_body<colon>(m);
+    define_body<cr>(m);
+    define_body<lf>(m);
+    define_body<ctl>(m);
+  }
+
+  enum cls : std::uint8_t { Tok, Sp, Colon, Cr, Lf, Ctl };
+
+  std::array<cls, 256> const classes = []() {
+    std::array<cls, 256> t{};
+    for (int c = 0; c < 256; c++) t[c] = c > 32 && c < 127 ? Tok : Ctl;
+    t[' '] = Sp, t[':'] = Colon, t['\r'] = Cr, t['\n'] = Lf;
+    return t;
+  }();
+
+  bool feed(M &m, char c) {
+    byte p;
+    p.c = c;
+    switch (classes[static_cast<unsigned char>(c)]) {
+      case Tok: return m.step_by(tok{}, p);
+      case Sp: return m.step_by(sp{}, p);
+      case Colon: return m.step_by(colon{}, p);
+      case Cr: return m.step_by(cr{}, p);
+      case Lf: return m.step_by(lf{}, p);
+      case Ctl: return m.step_by(ctl{}, p);
+    }
+    return false;
+  }
+
+  void generate(rng &r, std::string &out) {
+    static char const *const methods[] = {"GET", "GET", "GET", "HEAD", "DELETE", "POST", "PUT"};
+    static char const *const agents[] = {"Mozilla/5.0 (X11; Linux x86_64; rv:93.0) Gecko/20100101 Firefox/93.0",
+                                         "curl/7.79.1", "okhttp/4.9.2"};
+    out.clear();
+    auto const *m = methods[r.below(7)];
+    out += m;
+    out += " /api/v2/items/";
+    out += std::to_string(r.below(1000000));
+    if (r.chance(500)) out += "?page=" + std::to_string(r.below(100)) + "&sort=price:asc";
+    out += " HTTP/1.1\r\nHost: shop.example.com\r\nUser-Agent: ";
+    out += agents[r.below(3)];
+    out += "\r\nAccept: */*\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n";
+    if (r.chance(600)) {
+      out += "Cookie: session=";
+      for (auto k = 16 + r.below(96); k > 0; k--) out += static_cast<char>('a' + r.below(26));
+      out += "\r\n";
+    }
+    out += "X-Request-Id: " + std::to_string(r.next()) + "\r\n";
+    if (r.chance(10)) out += "X-Broken: \x01\r\n";
+    if (m[0] == 'P') {
+      auto n = r.below(2048);
+      out += "Content-Type: application/json\r\nContent-Length: " + std::to_string(n) + "\r\n\r\n";
+      for (; n > 0; n--) out += static_cast<char>(r.chance(20) ? '\n' : ' ' + r.below(95));
+    } else
+      out += "\r\n";
+  }
+
+} // namespace
+
+result http(double scale) {
+  auto const requests = static_cast<std::uint64_t>(200000 * scale);
+  rng r{1945};
+  M m;
+  define(m);
+  std::string req;
+  req.reserve(4096);
+
+  result res;
+  res.unit = "request";
+  std::uint64_t done = 0, body = 0;
+  for (std::uint64_t n = 0; n < requests; n++) {
+    generate(r, req);
+    std::size_t fed = 0;
+    bool ok = true;
+    timed(res, [&]() {
+      for (; fed < req.size() && ok; fed++) ok = feed(m, req[fed]);
+    });
+    res.events += fed;
+    res.rejected += !ok;
+    if (m.context().current() == M::State{S::Done}) {
+      done++, body += m.context().body;
+      res.check = mix(mix(res.check, m.context().headers), m.context().target.size());
+    }
+    m.reset();
+    m.context().clear();
+  }
+  res.check = mix(mix(res.check, done), body);
+  return res;
+}
+
+} // namespace scenarios
@@ -0,0 +1,102 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// Scenario benchmarks: machine_t in the shape it takes in services and
+// games, each fed by a deterministic generator.
+//
+//   tcp     RFC 793 connections, interleaved lifecycles   (per event)
+//   http    HTTP/1.1 requests parsed byte by byte          (per request)
+//   orders  limit orders, guards on the payload fields     (per event)
+//   npc     game NPCs with timers, 60 frames per second    (per frame)
+//
+// Each scenario runs in a process of its own, so that the peak RSS
+// reported is its own. Throughput counts the time spent in the timed
+// operations only, the generators left out; the latencies include the
+// two reads of the clock around each operation. The check column is a
+// digest of the final instances: it changes only with the definitions,
+// the generators or the library's semantics.
+//
+//   bench-scenarios [-s scale] [scenario...]
+
+#include "scenario.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+  struct entry {
+    char const *name;
+    scenarios::result (*run)(double scale);
+  };
+  entry const all[] = {{"tcp", scenarios::tcp}, {"http", scenarios::http}, {"orders", scenarios::orders}, {"npc", scenarios::npc}};
+
+  std::string duration(std::uint64_t ns) {
+    char buf[32];
+    if (ns < 10000) std::snprintf(buf, sizeof(buf), "%llu ns", (unsigned long long) ns);
+    else if (ns < 10000000) std::snprintf(buf, sizeof(buf), "%.1f us", double(ns) / 1e3);
+    else std::snprintf(buf, sizeof(buf), "%.1f ms", double(ns) / 1e6);
+    return buf;
+  }
+
+  void report(entry const &e, scenarios::result const &r) {
+    rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    auto const &h = r.latency;
+    std::printf("%-7s %9llu %-8s %12.0f %12.0f %10s %10s %10s %8.1f MB %9llu  %016llx\n", e.name,
+                (unsigned long long) h.count(), r.unit, double(h.count()) / r.secs, double(r.events) / r.secs,
+                duration(h.percentile(0.5)).c_str(), duration(h.percentile(0.99)).c_str(), duration(h.percentile(0.999)).c_str(),
+                double(ru.ru_maxrss) / 1024.0, (unsigned long long) r.rejected, (unsigned long long) r.check);
+    std::fflush(stdout);
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double scale = 1;
+  std::vector<entry> chosen;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-s") && i + 1 < argc) {
+      scale = std::strtod(argv[++i], nullptr);
+      continue;
+    }
+    bool known = false;
+    for (auto const &e : all)
+      if (!std::strcmp(argv[i], e.name)) chosen.push_back(e), known = true;
+    if (!known) {
+      std::fprintf(stderr, "usage: %s [-s scale] [tcp|http|orders|npc...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (chosen.empty()) chosen.assign(std::begin(all), std::end(all));
+
+  std::printf("%-7s %9s %-8s %12s %12s %10s %10s %10s %11s %9s  %s\n", "", "ops", "", "ops/s", "steps/s", "p50", "p99",
+              "p999", "peak RSS", "refused", "check");
+  std::fflush(stdout);
+  int rc = 0;
+  for (auto const &e : chosen) {
+    auto pid = ::fork();
+    if (pid == 0) {
+      report(e, e.run(scale));
+      ::_exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) rc = 1;
+  }
+  return rc;
+}
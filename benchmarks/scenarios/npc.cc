@@ -0,0 +1,176 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// Game NPCs, one machine_t each: idle, patrol, chase, attack, flee,
+// dead and respawn, with timers. Entry actions arm a deadline in the
+// context and the tick of every frame carries the game clock, so the
+// guards fire the timers (the end of a rest, an attack cooldown, a
+// chase given up, a respawn) as well as react to the distance to the
+// player. A world of NPCs is ticked at 60 frames per second of game
+// time; the player wanders, and now and then hits the NPCs close to
+// it. One operation is a whole frame.
+
+#include "scenario.hh"
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+
+namespace scenarios {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(npc_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Idle,
+                    Patrol,
+                    Chase,
+                    Attack,
+                    Flee,
+                    Dead)
+
+  FSM_DEFINE_EVENT(tick);
+  FSM_DEFINE_EVENT(hit);
+
+  struct world : public fsm_cxx::payload_t {
+    std::uint32_t now{};     // the game clock, ms
+    std::int32_t px{}, py{}; // where the player is
+    std::int32_t damage{};
+  };
+
+  struct npc_context : public fsm_cxx::context_t<fsm_cxx::state_t<npc_state>, fsm_cxx::event_t, void, world> {
+    std::uint32_t id{};
+    std::int32_t x{}, y{};
+    std::int32_t hp{100};
+    std::uint32_t deadline{}; // of the running timer
+    std::uint32_t attacks{}, deaths{};
+
+    std::int32_t dist(world const &p) const { return std::abs(x - p.px) + std::abs(y - p.py); }
+  };
+
+  using M = fsm_cxx::machine_t<npc_state, fsm_cxx::event_t, void, world, fsm_cxx::state_t<npc_state>, npc_context>;
+  using S = npc_state;
+  using C = M::Context;
+  using P = M::Payload;
+
+  constexpr std::int32_t side = 400; // of the square world
+
+  // arm the timer for ms, with a per-NPC jitter so that they drift apart
+  void arm(C &c, P const &p, std::uint32_t ms) { c.deadline = p.now + ms + (c.id * 7919u + p.now) % (ms / 2 + 1); }
+  std::int32_t clamp(std::int32_t v) { return std::min(side - 1, std::max(0, v)); }
+  std::int32_t toward(std::int32_t from, std::int32_t to) { return from < to ? 1 : from > to ? -1 : 0; }
+
+  void define(M &m) {
+    auto expired = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return p.now >= c.deadline; };
+    auto spotted = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.dist(p) < 30; };
+    auto in_reach = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.dist(p) <= 5; };
+    auto lost = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.dist(p) > 50 || p.now >= c.deadline; };
+    auto out_of_reach = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.dist(p) > 5; };
+    auto weak = [](M::Event const &, C &c, M::State const &, P const &) -> bool { return c.hp < 25; };
+    auto lethal = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.hp <= p.damage; };
+    auto timer = [](std::uint32_t ms) {
+      return [ms](M::Event const &, C &c, M::State const &, P const &p) { arm(c, p, ms); };
+    };
+
+    m.state().set(S::Idle).as_initial().entry_action(timer(3000)).build();
+    m.state().set(S::Patrol).entry_action(timer(8000)).build();
+    m.state().set(S::Chase).entry_action(timer(10000)).build();
+    m.state().set(S::Attack).entry_action(timer(0)).build(); // strike at once
+    m.state().set(S::Flee).entry_action(timer(5000)).build();
+    m.state().set(S::Dead).entry_action([](M::Event const &, C &c, M::State const &, P const &p) { c.deaths++, arm(c, p, 15000); }).build();
+
+    // ticks: the first enabled transition wins
+    m.transition().set(S::Idle, tick{}, S::Chase).guard(spotted).build();
+    m.transition().set(S::Idle, tick{}, S::Patrol).guard(expired).build();
+    m.transition().set(S::Patrol, tick{}, S::Chase).guard(spotted).build();
+    m.transition().set(S::Patrol, tick{}, S::Idle).guard(expired).build();
+    m.transition().set(S::Chase, tick{}, S::Attack).guard(in_reach).build();
+    m.transition().set(S::Chase, tick{}, S::Patrol).guard(lost).build();
+    m.transition().set(S::Attack, tick{}, S::Flee).guard(weak).build();
+    m.transition().set(S::Attack, tick{}, S::Chase).guard(out_of_reach).build();
+    m.transition().set(S::Attack, tick{}, S::Attack).internal().guard(expired).entry_action([](M::Event const &, C &c, M::State const &, P const &p) {
+      c.attacks++, arm(c, p, 800); // the cooldown
+    }).build();
+    m.transition().set(S::Flee, tick{}, S::Idle).guard(expired).entry_action([](M::Event const &, C &c, M::State const &, P const &) { c.hp = std::min(100, c.hp + 40); }).build();
+    m.transition().set(S::Dead, tick{}, S::Idle).guard(expired).entry_action([](M::Event const &, C &c, M::State const &, P const &) { c.hp = 100; }).build();
+    // otherwise the frame goes on in the same state: walk, run, wait
+    m.transition().set(S::Patrol, tick{}, S::Patrol).internal().entry_action([](M::Event const &, C &c, M::State const &, P const &p) {
+      c.x = clamp(c.x + static_cast<std::int32_t>((c.id + p.now / 1000) % 3) - 1);
+    }).build();
+    m.transition().set(S::Chase, tick{}, S::Chase).internal().entry_action([](M::Event const &, C &c, M::State const &, P const &p) {
+      c.x += 2 * toward(c.x, p.px), c.y += 2 * toward(c.y, p.py);
+    }).build();
+    m.transition().set(S::Flee, tick{}, S::Flee).internal().entry_action([](M::Event const &, C &c, M::State const &, P const &p) {
+      c.x = clamp(c.x - 2 * toward(c.x, p.px)), c.y = clamp(c.y - 2 * toward(c.y, p.py));
+    }).build();
+    for (auto st : {S::Idle, S::Attack, S::Dead}) m.transition().set(st, tick{}, st).internal().build();
+
+    // hits: lethal or not, and a hit NPC turns on the player
+    auto hurt = [](M::Event const &, C &c, M::State const &, P const &p) { c.hp -= p.damage; };
+    for (auto from : {S::Idle, S::Patrol, S::Chase, S::Attack, S::Flee}) {
+      m.transition().set(from, hit{}, S::Dead).guard(lethal).build();
+      if (from == S::Idle || from == S::Patrol) m.transition().set(from, hit{}, S::Chase).entry_action(hurt).build();
+      else m.transition().set(from, hit{}, from).internal().entry_action(hurt).build();
+    }
+  }
+
+} // namespace
+
+result npc(double scale) {
+  auto const count = static_cast<std::uint32_t>(2000 * scale) + 1;
+  auto const frames = static_cast<std::uint32_t>(3600 * scale) + 1; // a minute of game time
+  rng r{60};
+  std::deque<M> mobs(count);
+  std::uint32_t id = 0;
+  for (auto &m : mobs) {
+    define(m);
+    auto &c = m.context();
+    c.id = id++;
+    c.x = static_cast<std::int32_t>(r.below(side)), c.y = static_cast<std::int32_t>(r.below(side));
+  }
+
+  result res;
+  res.unit = "frame";
+  world p;
+  p.px = p.py = side / 2;
+  for (std::uint32_t f = 0; f < frames; f++) {
+    // the player wanders, on some frames hitting the NPCs within 5
+    p.now = f * 1000 / 60;
+    p.px = clamp(p.px + static_cast<std::int32_t>(r.below(7)) - 3);
+    p.py = clamp(p.py + static_cast<std::int32_t>(r.below(7)) - 3);
+    bool attack = r.chance(200);
+    p.damage = static_cast<std::int32_t>(10 + r.below(40));
+    timed(res, [&]() {
+      for (auto &m : mobs) {
+        if (attack && m.context().dist(p) <= 5) {
+          res.events++;
+          res.rejected += !m.step_by(hit{}, p);
+        }
+        res.events++;
+        res.rejected += !m.step_by(tick{}, p);
+      }
+    });
+  }
+
+  for (auto &m : mobs) {
+    auto const &c = m.context();
+    res.check = mix(mix(mix(res.check, static_cast<std::uint64_t>(c.current().t)), c.attacks), c.deaths);
+  }
+  return res;
+}
+
+} // namespace scenarios
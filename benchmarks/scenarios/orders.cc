@@ -0,0 +1,164 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// The lifecycle of limit orders, one machine_t per live order: submit,
+// amend, partial and complete fills, cancel, settle. Every event
+// carries its order data as the payload and the guards decide on its
+// fields: the credit check at submission, the fill price against the
+// limit, the filled quantity against the order. The generator keeps a
+// book of live orders and picks one at random for each event; a few
+// events are bad on purpose (no credit, a price through the limit, a
+// settlement of the wrong quantity) and are refused. Orders that end
+// are replaced by new ones.
+
+#include "scenario.hh"
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <algorithm>
+#include <deque>
+
+namespace scenarios {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(order_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    New,
+                    Accepted,
+                    Rejected,
+                    PartiallyFilled,
+                    Filled,
+                    Cancelled,
+                    Settled)
+
+  FSM_DEFINE_EVENT(submit);
+  FSM_DEFINE_EVENT(amend);
+  FSM_DEFINE_EVENT(fill);
+  FSM_DEFINE_EVENT(cancel);
+  FSM_DEFINE_EVENT(settle);
+
+  struct order_data : public fsm_cxx::payload_t {
+    std::uint32_t qty{};
+    std::int64_t price{};  // in ticks
+    std::int64_t credit{}; // of the account, at submission
+  };
+
+  struct order_context : public fsm_cxx::context_t<fsm_cxx::state_t<order_state>, fsm_cxx::event_t, void, order_data> {
+    std::uint32_t qty{}, filled{};
+    std::int64_t limit{}, notional{};
+    std::uint32_t fills{};
+  };
+
+  using M = fsm_cxx::machine_t<order_state, fsm_cxx::event_t, void, order_data, fsm_cxx::state_t<order_state>, order_context>;
+  using S = order_state;
+  using C = M::Context;
+  using P = M::Payload;
+
+  void define(M &m) {
+    auto credit_ok = [](M::Event const &, C &, M::State const &, P const &p) -> bool {
+      return p.qty > 0 && p.qty <= 100000 && p.price > 0 && std::int64_t(p.qty) * p.price <= p.credit;
+    };
+    auto accept = [](M::Event const &, C &c, M::State const &, P const &p) { c.qty = p.qty, c.limit = p.price; };
+    auto within_limit = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return p.qty > 0 && p.price <= c.limit; };
+    auto completes = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return c.filled + p.qty >= c.qty; };
+    auto partial = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return p.price <= c.limit && c.filled + p.qty < c.qty; };
+    auto execute = [](M::Event const &, C &c, M::State const &, P const &p) {
+      auto q = std::min(p.qty, c.qty - c.filled);
+      c.filled += q, c.notional += std::int64_t(q) * p.price, c.fills++;
+    };
+    auto amend_ok = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return p.qty > c.filled && p.price > 0; };
+    auto amended = [](M::Event const &, C &c, M::State const &, P const &p) { c.qty = p.qty, c.limit = p.price; };
+    auto settles = [](M::Event const &, C &c, M::State const &, P const &p) -> bool { return p.qty == c.filled; };
+
+    m.state().set(S::New).as_initial().build();
+    m.state().set(S::Filled).guard(within_limit).build();
+    m.transition().set(S::New, submit{}, S::Accepted).guard(credit_ok).entry_action(accept).build();
+    m.transition().set(S::New, submit{}, S::Rejected).build();
+    for (auto from : {S::Accepted, S::PartiallyFilled}) {
+      m.transition().set(from, fill{}, S::PartiallyFilled).guard(partial).entry_action(execute).build();
+      m.transition().set(from, fill{}, S::Filled).guard(completes).entry_action(execute).build();
+      m.transition().set(from, amend{}, from).internal().guard(amend_ok).entry_action(amended).build();
+      m.transition().set(from, cancel{}, S::Cancelled).build();
+    }
+    m.transition().set(S::Filled, settle{}, S::Settled).guard(settles).build();
+  }
+
+  struct order {
+    M m;
+    order() { define(m); }
+  };
+
+} // namespace
+
+result orders(double scale) {
+  auto const live = static_cast<std::uint32_t>(4096 * scale) + 1;
+  auto const events = static_cast<std::uint64_t>(2000000 * scale);
+  rng r{20211019};
+  std::deque<order> book(live);
+
+  result res;
+  std::uint64_t settled = 0, notional = 0;
+  for (std::uint64_t n = 0; n < events; n++) {
+    auto &o = book[r.below(live)];
+    auto &c = o.m.context();
+    auto const st = c.current().t;
+    if (st == S::Rejected || st == S::Cancelled || st == S::Settled) {
+      // a new order takes the place of the one that ended
+      if (st == S::Settled) settled++, notional += static_cast<std::uint64_t>(c.notional);
+      o.m.reset();
+      c.qty = c.filled = c.fills = 0, c.limit = c.notional = 0;
+    }
+
+    order_data p;
+    bool ok = false;
+    switch (o.m.context().current().t) {
+      case S::New:
+        p.qty = 1 + r.below(1000), p.price = 9000 + r.below(2000);
+        p.credit = r.chance(30) ? 0 : 20000000;
+        timed(res, [&]() { ok = o.m.step_by(submit{}, p); });
+        break;
+      case S::Accepted:
+      case S::PartiallyFilled: {
+        auto k = r.below(100);
+        p.price = c.limit - r.below(50) + (r.chance(30) ? 100 : 0);
+        if (k < 80) {
+          p.qty = 1 + r.below(std::max(1u, c.qty / 2));
+          timed(res, [&]() { ok = o.m.step_by(fill{}, p); });
+        } else if (k < 92) {
+          p.qty = c.filled + 1 + r.below(1000), p.price = c.limit + r.below(20);
+          timed(res, [&]() { ok = o.m.step_by(amend{}, p); });
+        } else
+          timed(res, [&]() { ok = o.m.step_by(cancel{}, p); });
+        break;
+      }
+      case S::Filled:
+        p.qty = r.chance(10) ? c.filled - 1 : c.filled;
+        timed(res, [&]() { ok = o.m.step_by(settle{}, p); });
+        break;
+      default:
+        break;
+    }
+    res.events++;
+    res.rejected += !ok;
+  }
+
+  for (auto &o : book)
+    res.check = mix(mix(res.check, static_cast<std::uint64_t>(o.m.context().current().t)), o.m.context().filled);
+  res.check = mix(mix(res.check, settled), notional);
+  return res;
+}
+
+} // namespace scenarios
@@ -0,0 +1,107 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+#ifndef __FSM_CXX_BENCH_SCENARIO_HH
+#define __FSM_CXX_BENCH_SCENARIO_HH
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// ----------------------------- scenarios
+namespace scenarios {
+
+  // splitmix64: the same sequence everywhere for one seed, so that every
+  // run of a scenario feeds its machines the same events
+  class rng {
+  public:
+    explicit rng(std::uint64_t seed) : _s(seed) {}
+    std::uint64_t next() {
+      auto z = (_s += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+    // in [0, n)
+    std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>((next() >> 32) * n >> 32); }
+    // true per_mille times in a thousand
+    bool chance(std::uint32_t per_mille) { return below(1000) < per_mille; }
+
+  private:
+    std::uint64_t _s;
+  };
+
+  // latencies in ns, 16 log-linear buckets per power of two: within 7%,
+  // in a fixed 8KB whatever the number of samples
+  class histogram {
+    static constexpr unsigned sub = 16;
+
+  public:
+    void add(std::uint64_t ns) {
+      _n[_bucket(ns)]++;
+      _count++;
+    }
+    std::uint64_t count() const { return _count; }
+    // the upper bound of the bucket holding the q-th quantile
+    std::uint64_t percentile(double q) const {
+      auto rank = static_cast<std::uint64_t>(q * double(_count));
+      std::uint64_t seen = 0;
+      for (std::size_t b = 0; b < _n.size(); b++)
+        if ((seen += _n[b]) > rank) return _upper(b);
+      return 0;
+    }
+
+  private:
+    static std::size_t _bucket(std::uint64_t v) {
+      if (v < sub) return static_cast<std::size_t>(v);
+      unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+      return (msb - 3) * sub + static_cast<std::size_t>(v >> (msb - 4) & (sub - 1));
+    }
+    static std::uint64_t _upper(std::size_t b) {
+      if (b < sub) return b;
+      auto msb = static_cast<unsigned>(b / sub + 3);
+      return ((std::uint64_t{sub} + b % sub + 1) << (msb - 4)) - 1;
+    }
+
+    std::array<std::uint64_t, 62 * sub> _n{};
+    std::uint64_t _count{0};
+  };
+
+  struct result {
+    char const *unit{"event"}; // what one timed operation is
+    histogram latency{};       // of each operation
+    double secs{};             // in the operations, the generator left out
+    std::uint64_t events{};    // the steps the operations took
+    std::uint64_t rejected{};  // the steps the machines refused
+    std::uint64_t check{};     // a digest of the final instances, equal from run to run
+  };
+
+  // time one operation into r
+  template<typename F>
+  inline void timed(result &r, F &&f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    r.latency.add(static_cast<std::uint64_t>(ns));
+    r.secs += double(ns) * 1e-9;
+  }
+
+  inline std::uint64_t mix(std::uint64_t h, std::uint64_t v) { return (h ^ v) * 0x100000001b3ull; }
+
+  // the scenarios, each scaled from its default workload
+  result tcp(double scale);
+  result http(double scale);
+  result orders(double scale);
+  result npc(double scale);
+
+} // namespace scenarios
+
+#endif // __FSM_CXX_BENCH_SCENARIO_HH
@@ -0,0 +1,173 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// The TCP connection state machine of RFC 793, one machine_t per
+// connection. Each connection plays scripted lifecycles one after the
+// other: client and server opens, active, passive and simultaneous
+// closes, resets, connect timeouts, with a random amount of data in
+// between; the connection to advance is drawn at random, so the
+// lifecycles interleave.
+
+#include "scenario.hh"
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <deque>
+#include <vector>
+
+namespace scenarios {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(tcp_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Closed,
+                    Listen,
+                    SynSent,
+                    SynReceived,
+                    Established,
+                    FinWait1,
+                    FinWait2,
+                    CloseWait,
+                    Closing,
+                    LastAck,
+                    TimeWait)
+
+  FSM_DEFINE_EVENT(passive_open);
+  FSM_DEFINE_EVENT(active_open);
+  FSM_DEFINE_EVENT(syn);
+  FSM_DEFINE_EVENT(syn_ack);
+  FSM_DEFINE_EVENT(ack);
+  FSM_DEFINE_EVENT(fin);
+  FSM_DEFINE_EVENT(close);
+  FSM_DEFINE_EVENT(timeout);
+  FSM_DEFINE_EVENT(rst);
+
+  struct tcp_context : public fsm_cxx::context_t<fsm_cxx::state_t<tcp_state>> {
+    std::uint32_t retries{};
+    std::uint64_t segments{}; // data segments acknowledged
+    std::uint64_t sessions{};
+  };
+
+  using M = fsm_cxx::machine_t<tcp_state, fsm_cxx::event_t, void, fsm_cxx::payload_t, fsm_cxx::state_t<tcp_state>, tcp_context>;
+  using S = tcp_state;
+
+  void define(M &m) {
+    auto established = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.sessions++, c.retries = 0; };
+    auto data = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.segments++; };
+    auto retry = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.retries++; };
+    auto retries_left = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) -> bool { return c.retries < 2; };
+    auto reset = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.retries = 0; };
+
+    m.state().set(S::Closed).as_initial().entry_action(reset).build();
+    m.state().set(S::Established).entry_action(established).build();
+
+    m.transition().set(S::Closed, passive_open{}, S::Listen).build();
+    m.transition().set(S::Closed, active_open{}, S::SynSent).build();
+    m.transition().set(S::Listen, syn{}, S::SynReceived).build();
+    m.transition().set(S::Listen, close{}, S::Closed).build();
+    m.transition().set(S::SynSent, syn_ack{}, S::Established).build();
+    m.transition().set(S::SynSent, syn{}, S::SynReceived).build();
+    m.transition().set(S::SynSent, close{}, S::Closed).build();
+    // the SYN is sent again twice before giving up
+    m.transition().set(S::SynSent, timeout{}, S::SynSent).internal().guard(retries_left).entry_action(retry).build();
+    m.transition().set(S::SynSent, timeout{}, S::Closed).build();
+    m.transition().set(S::SynReceived, ack{}, S::Established).build();
+    m.transition().set(S::SynReceived, rst{}, S::Listen).build();
+    m.transition().set(S::Established, ack{}, S::Established).internal().entry_action(data).build();
+    m.transition().set(S::Established, fin{}, S::CloseWait).build();
+    m.transition().set(S::Established, close{}, S::FinWait1).build();
+    m.transition().set(S::Established, rst{}, S::Closed).build();
+    m.transition().set(S::FinWait1, ack{}, S::FinWait2).build();
+    m.transition().set(S::FinWait1, fin{}, S::Closing).build();
+    m.transition().set(S::FinWait2, fin{}, S::TimeWait).build();
+    m.transition().set(S::CloseWait, close{}, S::LastAck).build();
+    m.transition().set(S::Closing, ack{}, S::TimeWait).build();
+    m.transition().set(S::LastAck, ack{}, S::Closed).build();
+    m.transition().set(S::TimeWait, timeout{}, S::Closed).build();
+  }
+
+  enum ev : std::uint8_t { PassiveOpen, ActiveOpen, Syn, SynAck, Ack, Fin, Close, Timeout, Rst, Data };
+
+  bool fire(M &m, ev e) {
+    switch (e) {
+      case PassiveOpen: return m.step_by(passive_open{});
+      case ActiveOpen: return m.step_by(active_open{});
+      case Syn: return m.step_by(syn{});
+      case SynAck: return m.step_by(syn_ack{});
+      case Ack:
+      case Data: return m.step_by(ack{});
+      case Fin: return m.step_by(fin{});
+      case Close: return m.step_by(close{});
+      case Timeout: return m.step_by(timeout{});
+      case Rst: return m.step_by(rst{});
+    }
+    return false;
+  }
+
+  // each lifecycle leaves the connection Closed; Data marks where the
+  // data segments go
+  std::vector<std::vector<ev>> const lifecycles{
+          {ActiveOpen, SynAck, Data, Close, Ack, Fin, Timeout},            // client, active close
+          {PassiveOpen, Syn, Ack, Data, Fin, Close, Ack},                  // server, passive close
+          {ActiveOpen, SynAck, Data, Close, Fin, Ack, Timeout},            // simultaneous close
+          {PassiveOpen, Syn, Ack, Data, Rst},                              // reset by the peer
+          {ActiveOpen, Syn, Ack, Data, Fin, Close, Ack},                   // simultaneous open
+          {ActiveOpen, Timeout, Timeout, Timeout},                         // nobody answers
+          {PassiveOpen, Syn, Rst, Close},                                  // half-open, then closed
+  };
+
+  struct connection {
+    M m;
+    std::vector<ev> script{};
+    std::size_t at{0};
+  };
+
+} // namespace
+
+result tcp(double scale) {
+  auto const conns = static_cast<std::uint32_t>(2048 * scale) + 1;
+  auto const events = static_cast<std::uint64_t>(2000000 * scale);
+  rng r{793};
+  std::deque<connection> pool(conns);
+  for (auto &c : pool) define(c.m);
+
+  result res;
+  for (std::uint64_t n = 0; n < events; n++) {
+    auto &c = pool[r.below(conns)];
+    if (c.at == c.script.size()) {
+      c.script.clear();
+      c.at = 0;
+      for (auto e : lifecycles[r.below(static_cast<std::uint32_t>(lifecycles.size()))]) {
+        if (e != Data) c.script.push_back(e);
+        else
+          for (auto k = r.below(12); k > 0; k--) c.script.push_back(Data);
+      }
+    }
+    auto e = c.script[c.at++];
+    bool ok = false;
+    timed(res, [&]() { ok = fire(c.m, e); });
+    res.rejected += !ok;
+  }
+
+  res.events = events;
+  for (auto &c : pool) {
+    auto const &x = c.m.context();
+    res.check = mix(mix(mix(res.check, static_cast<std::uint64_t>(x.current().t)), x.segments), x.sessions);
+  }
+  return res;
+}
+
+} // namespace scenarios
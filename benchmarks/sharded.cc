@@ -0,0 +1,99 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+// Throughput of sharded_executor as shards are added. Each run has as
+// many producer threads as shards, all posting to 64k door instances;
+// the report gives events per second and the speedup over one shard.
+//
+//   bench-sharded [max-shards] [events-per-producer]
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-shard.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+  AWESOME_MAKE_ENUM(door_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  using M = fsm_cxx::machine_t<door_state>;
+
+  void define(M &m) {
+    m.state().set(door_state::Initial).as_initial().build();
+    m.state().set(door_state::Terminated).as_terminated().build();
+    m.state().set(door_state::Error).as_error().build();
+    m.transition().set(door_state::Initial, open{}, door_state::Opened).build();
+    m.transition().set(door_state::Opened, close{}, door_state::Closed).build();
+    m.transition().set(door_state::Closed, open{}, door_state::Opened).build();
+  }
+
+  double run(std::size_t shards, std::uint64_t per_producer) {
+    constexpr std::uint64_t instances = 1 << 16;
+    fsm_cxx::sharded_executor<M, bool>::options opt;
+    opt.shards = shards;
+    fsm_cxx::sharded_executor<M, bool> ex{
+        [](std::uint64_t, M &m) { define(m); },
+        [](std::uint64_t, M &m, bool &opening) { opening ? m.step_by(open{}) : m.step_by(close{}); },
+        opt};
+
+    // warm up: create every instance
+    for (std::uint64_t id = 0; id < instances; id++) ex.post(id, true);
+    ex.drain();
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < shards; p++)
+      producers.emplace_back([&ex, p, per_producer]() {
+        std::uint64_t id = p * 7919;
+        for (std::uint64_t i = 0; i < per_producer; i++) {
+          id = (id + 40503) & (instances - 1);
+          ex.post(id, (i & 1) == 0);
+        }
+      });
+    for (auto &t : producers) t.join();
+    ex.drain();
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return double(per_producer * shards) / secs;
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto hw = std::max(1u, std::thread::hardware_concurrency());
+  std::size_t max_shards = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : hw;
+  std::uint64_t per = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+  if (max_shards * 2 > hw)
+    std::printf("note: %u hardware thread(s); with more than %u shard(s) shards and producers share cores\n", hw, std::max(1u, hw / 2));
+
+  std::printf("%8s %16s %10s\n", "shards", "events/s", "speedup");
+  double base = 0;
+  for (std::size_t n = 1; n <= max_shards; n *= 2) {
+    auto eps = run(n, per);
+    if (n == 1) base = eps;
+    std::printf("%8zu %16.0f %9.2fx\n", n, eps, eps / base);
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+// Steps per second of a frozen::shared_pool stepped by 1 to max-procs
+// processes at once, each picking instances at random: the claim of a
+// record is the only shared write, there is no message between the
+// processes. Fewer instances than processes make them contend.
+//
+//   bench-shm_pool [max-procs] [instances] [steps per process]
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-shm.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+  AWESOME_MAKE_ENUM(conn_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Open,
+                    Closed)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  struct conn {
+    std::uint64_t bytes;
+    std::uint32_t opens;
+  };
+
+  struct conn_context : fsm_cxx::context_t<fsm_cxx::state_t<conn_state>> {
+    conn *slot{nullptr};
+    void bind_slot(conn &s) { slot = &s; }
+  };
+
+  using M = fsm_cxx::machine_t<conn_state, fsm_cxx::event_t, void, fsm_cxx::payload_t, fsm_cxx::state_t<conn_state>, conn_context>;
+  using Pool = fsm_cxx::frozen::shared_pool<M, conn>;
+
+  fsm_cxx::frozen::registry<M> make(fsm_cxx::frozen::image *img) {
+    M m;
+    m.state().set(conn_state::Initial).as_initial().build();
+    m.state().set(conn_state::Open).entry_action_named("opened", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.slot->opens++; }).build();
+    m.state().set(conn_state::Closed).entry_action_named("closed", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.slot->bytes += 1500; }).build();
+    m.transition().set(conn_state::Initial, open{}, conn_state::Open).build();
+    m.transition().set(conn_state::Closed, open{}, conn_state::Open).build();
+    m.transition().set(conn_state::Open, close{}, conn_state::Closed).build();
+    fsm_cxx::frozen::registry<M> reg;
+    reg.collect(m);
+    fsm_cxx::frozen::model md;
+    if (img && fsm_cxx::frozen::freeze(m, md)) *img = md.serialize();
+    return reg;
+  }
+
+  int child(std::string const &name, unsigned k, std::uint64_t steps) {
+    auto pool = Pool::attach(name, make(nullptr));
+    if (!pool) return 2;
+    auto const &t = pool->def().table();
+    auto open_id = t.event_index<open>(), close_id = t.event_index<close>();
+    std::uint64_t x = 0x9e3779b97f4a7c15ull * (k + 1);
+    for (std::uint64_t j = 0; j < steps; j++) {
+      x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+      auto i = static_cast<std::size_t>(x % pool->size());
+      // one of the two succeeds, whatever the state
+      if (!pool->step_by(i, open_id, open{})) pool->step_by(i, close_id, close{});
+    }
+    return 0;
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned max_procs = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : std::max(1u, std::thread::hardware_concurrency());
+  std::size_t instances = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+  std::uint64_t steps = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2000000;
+
+  fsm_cxx::frozen::image img;
+  auto reg = make(&img);
+  std::printf("%zu instances, %llu steps per process\n", instances, (unsigned long long) steps);
+  double base = 0;
+  for (unsigned procs = 1; procs <= max_procs; procs *= 2) {
+    auto name = "/fsm_cxx_bench_" + std::to_string(::getpid());
+    std::string err;
+    auto pool = Pool::create(name, img, instances, reg, &err);
+    if (!pool) {
+      std::printf("  E. %s\n", err.c_str());
+      return 1;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<pid_t> pids;
+    for (unsigned k = 0; k < procs; k++)
+      if (auto pid = ::fork(); pid == 0) ::_exit(child(name, k, steps));
+      else pids.push_back(pid);
+    bool ok = true;
+    for (auto pid : pids) {
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    Pool::unlink(name);
+    if (!ok) return 1;
+    // the step that failed in each pair is counted too
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < pool->size(); i++) total += pool->sequence(i);
+    auto per_sec = double(total) / secs;
+    if (procs == 1) base = per_sec;
+    std::printf("  %3u processes %12.0f steps/s  x%.2f\n", procs, per_sec, per_sec / base);
+  }
+  return 0;
+}
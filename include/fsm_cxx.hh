@@ -20,9 +20,29 @@
 #include "fsm_cxx/fsm-debug.hh"
 
 #include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-seqlock.hh"
+#include "fsm_cxx/fsm-subscribers.hh"
 
 #include "fsm_cxx/fsm-sm.hh"
 
+#include "fsm_cxx/fsm-mmap.hh"
+#include "fsm_cxx/fsm-snapshot.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-optimize.hh"
+#include "fsm_cxx/fsm-batch.hh"
+#include "fsm_cxx/fsm-packed.hh"
+#include "fsm_cxx/fsm-spill.hh"
+#include "fsm_cxx/fsm-shm.hh"
+#include "fsm_cxx/fsm-journal.hh"
+#include "fsm_cxx/fsm-wire.hh"
+#include "fsm_cxx/fsm-reload.hh"
+#include "fsm_cxx/fsm-shard.hh"
+#include "fsm_cxx/fsm-actor.hh"
+#include "fsm_cxx/fsm-simulate.hh"
+#include "fsm_cxx/fsm-explore.hh"
+#include "fsm_cxx/fsm-dfa.hh"
+#include "fsm_cxx/fsm-spec.hh"
+
 #include "fsm_cxx/detail/fsm-if.hh"
 
 #endif // __FSM_CXX_HH
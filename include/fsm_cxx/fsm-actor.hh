@@ -0,0 +1,360 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_ACTOR_HH
+#define __FSM_CXX_FSM_ACTOR_HH
+
+#include "fsm-shard.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ----------------------------- actor::system
+namespace fsm_cxx::actor {
+
+  // where letters are sent: an actor of one system
+  struct address {
+    static constexpr std::uint32_t none = ~std::uint32_t(0);
+    std::uint32_t id{none};
+
+    bool valid() const { return id != none; }
+    bool operator==(address const &o) const { return id == o.id; }
+    bool operator!=(address const &o) const { return id != o.id; }
+  };
+
+  struct options {
+    std::size_t workers{0};      // 0 for one per hardware thread
+    std::size_t mailbox{1024};   // letters per actor, rounded up to a power of two
+    std::size_t capacity{65536}; // actors
+    std::uint32_t batch{64};     // letters an actor handles before it yields its worker
+    bool pin{false};             // pin worker i to cpu i
+  };
+
+  /**
+   * @brief machine instances exchanging messages through bounded
+   * mailboxes, run by a pool of workers.
+   * @details Each actor owns an instance (a machine_t, typically) and a
+   * lock-free mailbox; the handler turns a letter into steps of the
+   * instance. An actor is run by one worker at a time, so the instance
+   * needs no MutexT, and letters from one sender arrive in the order
+   * they were sent. Actions send() to other actors instead of stepping
+   * them: nothing nests, nothing is shared.
+   *
+   * An actor becomes ready with its first unread letter. Ready actors
+   * wait in the run queue of the worker that made them ready (or in a
+   * shared queue, for the letters sent from other threads); a worker
+   * runs them in turn for up to options::batch letters, and steals from
+   * the other workers when its own queue is empty.
+   *
+   * Backpressure: a send() from a handler to a full mailbox does not
+   * block. The letter waits in the outbox of the sender, which handles
+   * no more letters until its outbox is delivered; its own mailbox then
+   * fills in turn, and so on upstream. A send() from another thread
+   * waits for room. A cycle of actors whose mailboxes are all full, an
+   * actor sending to itself included, stalls: size the mailboxes for
+   * the letters a cycle may hold.
+   *
+   * @code{c++}
+   *   using M = fsm_cxx::machine_t<my_state>;   // MutexT = void
+   *   fsm_cxx::actor::system<M, int> sys{[](fsm_cxx::actor::address, M &m, int &n) { m.step_by(tick{}, ...); }};
+   *   auto a = sys.spawn([&sys](fsm_cxx::actor::address self, M &m) { define(m, sys, self); });
+   *   sys.send(a, 1);
+   *   sys.wait_idle();
+   * @endcode
+   *
+   * @tparam Instance default constructible, e.g. a machine_t
+   * @tparam Msg the letters, default constructible and movable
+   */
+  template<typename Instance, typename Msg>
+  class system {
+  public:
+    using Init = std::function<void(address self, Instance &)>;
+    using Handler = std::function<void(address self, Instance &, Msg &)>;
+
+    explicit system(Handler handler, options const &opt = options{})
+        : _handler(std::move(handler)), _opt(opt), _cells(new std::unique_ptr<cell>[opt.capacity]) {
+      if (!_opt.batch) _opt.batch = 1;
+      auto n = opt.workers ? opt.workers : std::max(1u, std::thread::hardware_concurrency());
+      _workers.reserve(n);
+      for (std::size_t i = 0; i < n; i++) _workers.emplace_back(std::make_unique<worker>());
+      for (std::size_t i = 0; i < n; i++) _workers[i]->thread = std::thread([this, i]() { _run(i); });
+    }
+    ~system() { stop(); }
+    system(system const &) = delete;
+    system &operator=(system const &) = delete;
+
+    /**
+     * @brief create an actor; init defines its instance before any
+     * letter can reach it.
+     * @return an invalid address once options::capacity actors exist
+     */
+    address spawn(Init const &init = nullptr) {
+      std::lock_guard<std::mutex> lk(_spawning);
+      auto id = _size.load(std::memory_order_relaxed);
+      if (id >= _opt.capacity) return address{};
+      _cells[id] = std::make_unique<cell>(_opt.mailbox, id);
+      if (init) init(address{id}, _cells[id]->instance);
+      _size.store(id + 1, std::memory_order_release);
+      return address{id};
+    }
+    std::size_t size() const { return _size.load(std::memory_order_acquire); }
+    std::size_t worker_count() const { return _workers.size(); }
+
+    /**
+     * @brief send msg to the actor at to.
+     * @details From a handler, never blocks: a letter for a full mailbox
+     * waits in the outbox of the sender. From other threads, waits while
+     * the mailbox is full.
+     * @return false for an unknown address
+     */
+    bool send(address to, Msg msg) {
+      if (!_known(to)) return false;
+      if (auto *self = _running(); self) {
+        t_worker->sent.fetch_add(1, std::memory_order_relaxed);
+        if (self->outbox.empty() && _push(to.id, msg)) return true;
+        self->outbox.emplace_back(to.id, std::move(msg));
+        return true;
+      }
+      _sent.fetch_add(1, std::memory_order_relaxed);
+      for (unsigned spins = 0; !_push(to.id, msg); spins++)
+        if (spins > 64) std::this_thread::yield();
+      return true;
+    }
+    /**
+     * @brief send msg unless the mailbox of to is full.
+     * @return false if it is full, or the address unknown, or (from a
+     * handler) letters sent before wait in the outbox
+     */
+    bool try_send(address to, Msg msg) {
+      if (!_known(to)) return false;
+      auto *self = _running();
+      if (self && !self->outbox.empty()) return false;
+      auto &sent = self ? t_worker->sent : _sent;
+      sent.fetch_add(1, std::memory_order_relaxed);
+      if (_push(to.id, msg)) return true;
+      sent.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    /**
+     * @brief wait until every letter sent, and every letter those sent in
+     * turn, is handled.
+     */
+    void wait_idle() const {
+      for (unsigned spins = 0; !_quiescent(); spins++)
+        if (spins < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    /**
+     * @brief handle what is sent, then join the workers. No send() from
+     * other threads may run concurrently with it.
+     */
+    void stop() {
+      if (_stopping.exchange(true)) return;
+      for (auto &w : _workers)
+        if (w->thread.joinable()) w->thread.join();
+    }
+
+    // the instance of an actor; only while the system is idle, or from
+    // the handler of that actor
+    Instance &instance(address a) { return _cells[a.id]->instance; }
+
+    std::uint64_t handled() const { return _sum(&worker::handled); }
+    // how many times an actor was held back by a full mailbox
+    std::uint64_t blocked() const { return _sum(&worker::blocked); }
+    // how many ready actors were taken from the queue of another worker
+    std::uint64_t stolen() const { return _sum(&worker::stolen); }
+
+  private:
+    struct cell {
+      cell(std::size_t capacity, std::uint32_t id_)
+          : mailbox(capacity), id(id_) {}
+      util::mpsc_ring<Msg> mailbox;
+      // the letters pushed and not yet handled, plus one while the outbox
+      // holds the actor back: the actor is ready, or running, while it is
+      // not zero, and the sender taking it from zero makes it ready
+      alignas(64) std::atomic<std::uint32_t> unread{0};
+      std::uint32_t id;
+      bool held{false};                                   // the outbox holds one unread
+      std::vector<std::pair<std::uint32_t, Msg>> outbox{}; // the worker running it only
+      Instance instance{};
+    };
+    struct worker {
+      std::mutex lock{};
+      std::deque<cell *> ready{};
+      alignas(64) std::atomic<std::uint64_t> sent{0};
+      alignas(64) std::atomic<std::uint64_t> handled{0};
+      std::atomic<std::uint64_t> blocked{0}, stolen{0};
+      std::uint32_t ticks{0};
+      std::thread thread{};
+    };
+
+    static inline thread_local system *t_system{nullptr};
+    static inline thread_local worker *t_worker{nullptr};
+    static inline thread_local cell *t_running{nullptr};
+
+    bool _known(address a) const { return a.id < _size.load(std::memory_order_acquire); }
+    cell *_running() const { return t_system == this ? t_running : nullptr; }
+
+    // moves msg only when delivered
+    bool _push(std::uint32_t id, Msg &msg) {
+      auto &c = *_cells[id];
+      if (!c.mailbox.try_push(std::move(msg))) return false;
+      if (c.unread.fetch_add(1, std::memory_order_acq_rel) == 0) _ready(&c);
+      return true;
+    }
+    void _ready(cell *c) {
+      if (t_system == this && t_worker) {
+        std::lock_guard<std::mutex> lk(t_worker->lock);
+        t_worker->ready.push_back(c);
+      } else {
+        std::lock_guard<std::mutex> lk(_shared_lock);
+        _shared.push_back(c);
+      }
+    }
+
+    cell *_take(std::mutex &lock, std::deque<cell *> &q) {
+      std::lock_guard<std::mutex> lk(lock);
+      if (q.empty()) return nullptr;
+      auto *c = q.front();
+      q.pop_front();
+      return c;
+    }
+
+    cell *_next(std::size_t i) {
+      auto &w = *_workers[i];
+      // now and then the shared queue first: an actor held back on one
+      // waiting there would otherwise keep its worker busy forever
+      if (++w.ticks % 61 == 0)
+        if (auto *c = _take(_shared_lock, _shared)) return c;
+      if (auto *c = _take(w.lock, w.ready)) return c;
+      if (auto *c = _take(_shared_lock, _shared)) return c;
+      // steal half of the queue of another worker, from its back
+      for (std::size_t k = 1; k < _workers.size(); k++) {
+        auto &v = *_workers[(i + k) % _workers.size()];
+        std::vector<cell *> taken;
+        {
+          std::lock_guard<std::mutex> lk(v.lock);
+          auto n = (v.ready.size() + 1) / 2;
+          for (std::size_t j = 0; j < n; j++) {
+            taken.push_back(v.ready.back());
+            v.ready.pop_back();
+          }
+        }
+        if (taken.empty()) continue;
+        w.stolen.fetch_add(taken.size(), std::memory_order_relaxed);
+        if (taken.size() > 1) {
+          std::lock_guard<std::mutex> lk(w.lock);
+          w.ready.insert(w.ready.end(), taken.rbegin() + 1, taken.rend());
+        }
+        return taken.back();
+      }
+      return nullptr;
+    }
+
+    // deliver the outbox in order, up to the first full mailbox
+    bool _flush(cell &c) {
+      std::size_t i = 0;
+      while (i < c.outbox.size() && _push(c.outbox[i].first, c.outbox[i].second)) i++;
+      c.outbox.erase(c.outbox.begin(), c.outbox.begin() + static_cast<std::ptrdiff_t>(i));
+      return c.outbox.empty();
+    }
+
+    void _step(worker &w, cell &c) {
+      auto const unread = c.unread.load(std::memory_order_acquire) - (c.held ? 1 : 0);
+      if (!_flush(c)) {
+        w.blocked.fetch_add(1, std::memory_order_relaxed);
+        _ready(&c);
+        return;
+      }
+      std::uint32_t n = 0;
+      auto const limit = std::min(unread, _opt.batch);
+      Msg m{};
+      t_running = &c;
+      while (n < limit && c.outbox.empty() && c.mailbox.try_pop(m)) {
+        _handler(address{c.id}, c.instance, m);
+        n++;
+      }
+      t_running = nullptr;
+      if (n) w.handled.fetch_add(n, std::memory_order_release);
+
+      auto done = n;
+      if (c.held && c.outbox.empty()) {
+        c.held = false;
+        done++;
+      } else if (!c.held && !c.outbox.empty()) {
+        c.held = true; // stay ready until the outbox is delivered
+        done--;
+      }
+      if (done == 0 || c.unread.fetch_sub(done, std::memory_order_acq_rel) != done) _ready(&c);
+    }
+
+    void _run(std::size_t i) {
+      auto &w = *_workers[i];
+      t_system = this;
+      t_worker = &w;
+      if (_opt.pin) util::pin_to_cpu(static_cast<unsigned>(i));
+      unsigned idle = 0;
+      for (;;) {
+        if (auto *c = _next(i)) {
+          _step(w, *c);
+          idle = 0;
+          continue;
+        }
+        if (_stopping.load(std::memory_order_acquire) && _quiescent()) break;
+        // back off: spin, then yield, then nap
+        if (++idle < 64) continue;
+        if (idle < 1024) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+      t_worker = nullptr;
+      t_system = nullptr;
+    }
+
+    // every letter counted as sent is counted as handled: the handled
+    // counts are read first, a letter is counted as sent before it is
+    // pushed, and as handled after the letters its handler sent
+    bool _quiescent() const {
+      auto handled = _sum(&worker::handled);
+      auto sent = _sent.load(std::memory_order_acquire) + _sum(&worker::sent);
+      return sent == handled;
+    }
+    std::uint64_t _sum(std::atomic<std::uint64_t> worker::*counter) const {
+      std::uint64_t n = 0;
+      for (auto const &w : _workers) n += ((*w).*counter).load(std::memory_order_acquire);
+      return n;
+    }
+
+  private:
+    Handler _handler;
+    options _opt;
+    std::unique_ptr<std::unique_ptr<cell>[]> _cells;
+    std::atomic<std::uint32_t> _size{0};
+    std::mutex _spawning{};
+    std::vector<std::unique_ptr<worker>> _workers{};
+    std::mutex _shared_lock{};
+    std::deque<cell *> _shared{};
+    alignas(64) std::atomic<std::uint64_t> _sent{0}; // from other threads
+    std::atomic<bool> _stopping{false};
+  };
+
+} // namespace fsm_cxx::actor
+
+#endif // __FSM_CXX_FSM_ACTOR_HH
@@ -0,0 +1,245 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#ifndef __FSM_CXX_FSM_BATCH_HH
+#define __FSM_CXX_FSM_BATCH_HH
+
+#include "fsm-frozen.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FSM_CXX_BATCH_X86 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// ----------------------------- batch kernels
+namespace fsm_cxx { namespace frozen {
+
+  enum class simd {
+    Auto,   // the widest the cpu supports
+    Scalar, // portable loop
+    Avx2,   // 8 lanes, vpgatherdd
+    Avx512, // 16 lanes, vpgatherdd with mask registers
+  };
+
+  // the outcome of one batch step
+  struct batch_result {
+    std::size_t stepped{};  // moved on the fast path
+    std::size_t slow{};     // left for the scalar path, flagged in the mask
+    std::size_t rejected{}; // no transition for the event, unchanged
+  };
+
+  namespace detail {
+    // a cell of the [event][state] table: the next state, or a flag
+    constexpr std::uint32_t batch_slow = 0x80000000u;
+    constexpr std::uint32_t batch_none = 0x40000000u;
+    constexpr std::uint32_t batch_flags = batch_slow | batch_none;
+
+    inline unsigned ctz64(std::uint64_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+      unsigned long i;
+      _BitScanForward64(&i, v);
+      return static_cast<unsigned>(i);
+#else
+      return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+    }
+
+    inline void batch_scalar(std::uint32_t const *col, std::uint32_t *states, std::size_t first, std::size_t n, std::uint64_t *mask, batch_result &r) {
+      for (std::size_t i = first; i < n; i++) {
+        auto c = col[states[i]];
+        if (!(c & batch_flags)) {
+          states[i] = c;
+          r.stepped++;
+        } else if (c & batch_slow) {
+          mask[i >> 6] |= std::uint64_t{1} << (i & 63);
+          r.slow++;
+        } else
+          r.rejected++;
+      }
+    }
+
+#if defined(FSM_CXX_BATCH_X86)
+    __attribute__((target("avx2,popcnt"))) inline std::size_t batch_avx2(std::uint32_t const *col, std::uint32_t *states, std::size_t n, std::uint64_t *mask, batch_result &r) {
+      auto const slow = _mm256_set1_epi32(static_cast<int>(batch_slow));
+      auto const none = _mm256_set1_epi32(static_cast<int>(batch_none));
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        auto cur = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(states + i));
+        auto next = _mm256_i32gather_epi32(reinterpret_cast<int const *>(col), cur, 4);
+        auto is_slow = _mm256_cmpeq_epi32(_mm256_and_si256(next, slow), slow);
+        auto is_none = _mm256_cmpeq_epi32(_mm256_and_si256(next, none), none);
+        auto keep = _mm256_or_si256(is_slow, is_none);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(states + i), _mm256_blendv_epi8(next, cur, keep));
+        auto ms = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(is_slow)));
+        auto mk = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(keep)));
+        mask[i >> 6] |= std::uint64_t{ms} << (i & 63);
+        auto s = static_cast<std::size_t>(_mm_popcnt_u32(ms)), k = static_cast<std::size_t>(_mm_popcnt_u32(mk));
+        r.slow += s;
+        r.rejected += k - s;
+        r.stepped += 8 - k;
+      }
+      return i;
+    }
+
+    __attribute__((target("avx512f,popcnt"))) inline std::size_t batch_avx512(std::uint32_t const *col, std::uint32_t *states, std::size_t n, std::uint64_t *mask, batch_result &r) {
+      auto const slow = _mm512_set1_epi32(static_cast<int>(batch_slow));
+      auto const none = _mm512_set1_epi32(static_cast<int>(batch_none));
+      std::size_t i = 0;
+      for (; i + 16 <= n; i += 16) {
+        auto cur = _mm512_loadu_si512(states + i);
+        // the masked form with an explicit source, which gcc does not
+        // flag as reading an uninitialized register
+        auto next = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, cur, col, 4);
+        __mmask16 ms = _mm512_test_epi32_mask(next, slow);
+        __mmask16 mk = static_cast<__mmask16>(ms | _mm512_test_epi32_mask(next, none));
+        _mm512_mask_storeu_epi32(states + i, static_cast<__mmask16>(~mk), next);
+        mask[i >> 6] |= std::uint64_t{ms} << (i & 63);
+        auto s = static_cast<std::size_t>(_mm_popcnt_u32(ms)), k = static_cast<std::size_t>(_mm_popcnt_u32(mk));
+        r.slow += s;
+        r.rejected += k - s;
+        r.stepped += 16 - k;
+      }
+      return i;
+    }
+#endif
+
+    inline simd batch_best() {
+#if defined(FSM_CXX_BATCH_X86)
+      static simd const best = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return simd::Avx512;
+        if (__builtin_cpu_supports("avx2")) return simd::Avx2;
+        return simd::Scalar;
+      }();
+      return best;
+#else
+      return simd::Scalar;
+#endif
+    }
+  } // namespace detail
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- batch
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief advance many instances of one definition by the same event.
+   * @details The instances are a contiguous array of dense state
+   * indices. For each event the definition is flattened into a column
+   * of next states, indexed by the current one; a cell is fast when the
+   * event has a single unguarded candidate, the target has no state
+   * guards, and neither the transition nor the states it leaves and
+   * enters have actions. step() gathers 8 (AVX2) or 16 (AVX-512) cells
+   * at a time and writes the fast ones back; the instances needing
+   * guards or actions are left untouched and flagged in a bit mask, one
+   * bit per instance, for run_slow() to finish on the scalar path.
+   *
+   * @code{c++}
+   *   frozen::batch<M> b{def};
+   *   std::vector<std::uint64_t> mask(b.mask_words(states.size()));
+   *   auto tick = def->table().event_index<tick_event>();
+   *   auto r = b.step(states.data(), states.size(), tick, mask.data());
+   *   if (r.slow) b.run_slow(states.data(), states.size(), mask.data(), tick, tick_event{},
+   *                          [&](std::size_t i) -> M::Context & { return contexts[i]; });
+   * @endcode
+   */
+  template<typename M>
+  class batch {
+  public:
+    using Definition = definition<M>;
+    using Event = typename M::Event;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+
+    explicit batch(std::shared_ptr<Definition const> def, simd isa = simd::Auto)
+        : _def(std::move(def)), _isa(isa == simd::Auto ? detail::batch_best() : isa) {
+      if (_isa == simd::Avx512 && detail::batch_best() != simd::Avx512) _isa = detail::batch_best();
+      if (_isa == simd::Avx2 && detail::batch_best() == simd::Scalar) _isa = simd::Scalar;
+      auto const &v = _def->table();
+      auto ns = v.state_count(), ne = v.event_count();
+      _cols.assign(std::size_t(ns) * ne, detail::batch_none);
+      for (std::uint32_t s = 0; s < ns; s++) {
+        auto const &st = v.state(s);
+        for (std::uint32_t k = 0; k < st.edge_count; k++) {
+          auto const &e = v.edge(st.edge_first + k);
+          if (e.slot_count == 0) continue;
+          auto const &sl = v.slot(e.slot_first);
+          auto const &to = v.state(sl.to);
+          bool fast = sl.guard == npos && to.guard_count == 0 &&
+                      sl.entry == npos && sl.exit == npos && st.exit == npos && to.entry == npos;
+          _cols[std::size_t(e.event) * ns + s] = fast ? sl.to : detail::batch_slow;
+        }
+      }
+    }
+
+    simd isa() const { return _isa; }
+    Definition const &def() const { return *_def; }
+    static std::size_t mask_words(std::size_t n) { return (n + 63) / 64; }
+
+    /**
+     * @brief advance states[0..n) by event on the fast path. Every state
+     * must be a valid dense index of the definition.
+     * @param mask mask_words(n) words, cleared here; bit i is set for
+     * the instances left to run_slow()
+     */
+    batch_result step(std::uint32_t *states, std::size_t n, std::uint32_t event, std::uint64_t *mask) const {
+      batch_result r;
+      for (std::size_t w = 0; w < mask_words(n); w++) mask[w] = 0;
+      if (event >= _def->table().event_count()) {
+        r.rejected = n;
+        return r;
+      }
+      auto const *col = _cols.data() + std::size_t(event) * _def->table().state_count();
+      std::size_t done = 0;
+#if defined(FSM_CXX_BATCH_X86)
+      if (_isa == simd::Avx512) done = detail::batch_avx512(col, states, n, mask, r);
+      else if (_isa == simd::Avx2)
+        done = detail::batch_avx2(col, states, n, mask, r);
+#endif
+      detail::batch_scalar(col, states, done, n, mask, r); // the tail
+      return r;
+    }
+
+    /**
+     * @brief finish the flagged instances with definition::step().
+     * @param ctx_of maps an instance index to its Context &
+     * @return the number of instances that moved
+     */
+    template<typename CtxOf>
+    std::size_t run_slow(std::uint32_t *states, std::size_t n, std::uint64_t const *mask, std::uint32_t event,
+                         Event const &ev, CtxOf &&ctx_of, Payload const &payload = Payload{}) const {
+      std::size_t moved = 0;
+      for (std::size_t w = 0; w < mask_words(n); w++) {
+        for (auto bits = mask[w]; bits; bits &= bits - 1) {
+          auto i = w * 64 + detail::ctz64(bits);
+          if (_def->step(states[i], event, ev, ctx_of(i), payload)) moved++;
+        }
+      }
+      return moved;
+    }
+
+  private:
+    std::shared_ptr<Definition const> _def;
+    simd _isa;
+    std::vector<std::uint32_t> _cols{}; // [event][state]
+  };
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_BATCH_HH
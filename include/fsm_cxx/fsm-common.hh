@@ -49,18 +49,18 @@ namespace fsm_cxx::util::cool {
 
   template<typename Function, typename Tuple, size_t... I>
   auto bind_N(Function &&f, Tuple &&t, std::index_sequence<I...>) {
-    return std::bind(f, std::get<I>(t)...);
+    return std::bind(std::forward<Function>(f), std::get<I>(t)...);
   }
   template<int N, typename Function, typename Tuple>
   auto bind_N(Function &&f, Tuple &&t) {
     // static constexpr auto size = std::tuple_size<Tuple>::value;
-    return bind_N(f, t, std::make_index_sequence<N>{});
+    return bind_N(std::forward<Function>(f), t, std::make_index_sequence<N>{});
   }
 
   template<int N, typename _Callable, typename... _Args,
            std::enable_if_t<!std::is_member_function_pointer_v<_Callable>, bool> = true>
   auto bind_tie(_Callable &&f, _Args &&...args) {
-    return bind_N<N>(f, std::make_tuple(args...));
+    return bind_N<N>(std::forward<_Callable>(f), std::make_tuple(std::forward<_Args>(args)...));
   }
 
   template<typename Function, typename _Instance, typename Tuple, size_t... I>
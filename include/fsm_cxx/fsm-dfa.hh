@@ -0,0 +1,349 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/14.
+//
+
+#ifndef __FSM_CXX_FSM_DFA_HH
+#define __FSM_CXX_FSM_DFA_HH
+
+#include "fsm-sm.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FSM_CXX_DFA_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// ----------------------------- byte_class
+namespace fsm_cxx {
+
+  /**
+   * @brief a set of byte values, the label of a byte_dfa_t transition.
+   * @details For examples:
+   * @code{c++}
+   *   auto digit = fsm_cxx::byte_class::range('0', '9');
+   *   auto space = fsm_cxx::byte_class::of(" \t");
+   *   auto other = ~(digit | space);
+   * @endcode
+   */
+  class byte_class {
+  public:
+    byte_class() = default;
+
+    static byte_class any() { return ~byte_class{}; }
+    static byte_class of(unsigned char c) {
+      byte_class b;
+      b.set(c);
+      return b;
+    }
+    static byte_class of(std::string_view chars) {
+      byte_class b;
+      for (auto c : chars) b.set(static_cast<unsigned char>(c));
+      return b;
+    }
+    static byte_class range(unsigned char lo, unsigned char hi) {
+      byte_class b;
+      for (unsigned c = lo; c <= hi; c++) b.set(static_cast<unsigned char>(c));
+      return b;
+    }
+
+    void set(unsigned char c) { _bits[c >> 6] |= std::uint64_t(1) << (c & 63); }
+    bool test(unsigned char c) const { return (_bits[c >> 6] >> (c & 63)) & 1; }
+    std::size_t count() const {
+      std::size_t n = 0;
+      for (unsigned c = 0; c < 256; c++) n += test(static_cast<unsigned char>(c));
+      return n;
+    }
+
+    byte_class operator|(byte_class const &o) const {
+      byte_class b;
+      for (int i = 0; i < 4; i++) b._bits[i] = _bits[i] | o._bits[i];
+      return b;
+    }
+    byte_class operator&(byte_class const &o) const {
+      byte_class b;
+      for (int i = 0; i < 4; i++) b._bits[i] = _bits[i] & o._bits[i];
+      return b;
+    }
+    byte_class operator~() const {
+      byte_class b;
+      for (int i = 0; i < 4; i++) b._bits[i] = ~_bits[i];
+      return b;
+    }
+
+  private:
+    std::uint64_t _bits[4]{};
+  };
+
+} // namespace fsm_cxx
+
+// ----------------------------- byte_dfa_t
+namespace fsm_cxx {
+
+  namespace detail {
+    inline unsigned ctz32(std::uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+      unsigned long i;
+      _BitScanForward(&i, v);
+      return static_cast<unsigned>(i);
+#else
+      return static_cast<unsigned>(__builtin_ctz(v));
+#endif
+    }
+
+    // how a state's run of self-loop bytes is skipped
+    struct dfa_skip_t {
+      enum kind_e : std::uint8_t { None,
+                                   Exit1,  // memchr for the single leaving byte
+                                   Exits,  // up to 4 leaving bytes
+                                   Range } // staying bytes are [lo, hi]
+      kind{None};
+      std::uint8_t n{0};
+      unsigned char b[4]{};
+    };
+
+    inline unsigned char const *dfa_skip(dfa_skip_t const &sk, unsigned char const *p, unsigned char const *end) {
+      switch (sk.kind) {
+      case dfa_skip_t::Exit1: {
+        auto q = std::memchr(p, sk.b[0], static_cast<std::size_t>(end - p));
+        return q ? static_cast<unsigned char const *>(q) : end;
+      }
+      case dfa_skip_t::Exits: {
+#if defined(FSM_CXX_DFA_SSE2)
+        __m128i const e0 = _mm_set1_epi8(static_cast<char>(sk.b[0])), e1 = _mm_set1_epi8(static_cast<char>(sk.b[1]));
+        __m128i const e2 = _mm_set1_epi8(static_cast<char>(sk.b[2])), e3 = _mm_set1_epi8(static_cast<char>(sk.b[3]));
+        for (; end - p >= 16; p += 16) {
+          __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+          __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, e0), _mm_cmpeq_epi8(v, e1)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, e2), _mm_cmpeq_epi8(v, e3)));
+          if (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(m)))
+            return p + ctz32(mask);
+        }
+#endif
+        for (; p < end; ++p)
+          if (*p == sk.b[0] || *p == sk.b[1] || *p == sk.b[2] || *p == sk.b[3]) break;
+        return p;
+      }
+      case dfa_skip_t::Range: {
+        auto const lo = sk.b[0], span = static_cast<unsigned char>(sk.b[1] - sk.b[0]);
+#if defined(FSM_CXX_DFA_SSE2)
+        __m128i const vlo = _mm_set1_epi8(static_cast<char>(lo)), vspan = _mm_set1_epi8(static_cast<char>(span));
+        __m128i const zero = _mm_setzero_si128();
+        for (; end - p >= 16; p += 16) {
+          __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+          // (v - lo) saturated-minus span is zero exactly for the bytes in [lo, hi]
+          __m128i in = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, vlo), vspan), zero);
+          if (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(in)) ^ 0xffffu)
+            return p + ctz32(mask);
+        }
+#endif
+        for (; p < end; ++p)
+          if (static_cast<unsigned char>(*p - lo) > span) break;
+        return p;
+      }
+      default:
+        return p;
+      }
+    }
+  } // namespace detail
+
+  /**
+   * @brief a byte-driven DFA compiled into a 256-entries-per-state table.
+   * @details It is the character-input mode of fsm-cxx, aimed at
+   * protocol tokenizers: transitions are labelled with byte classes,
+   * compile() flattens them into a table, and feed() consumes whole
+   * buffers in a tight loop. Runs of bytes a state loops on are skipped
+   * with SSE2 (or memchr) when the loop can be described cheaply.
+   *
+   * Rules are applied in declaration order, so a later rule overrides an
+   * earlier one for the bytes they share. A byte with no rule leads to
+   * the dead state, which stops feeding.
+   * @code{c++}
+   *   fsm_cxx::byte_dfa_t<tok> d;
+   *   d.initial(tok::Space)
+   *       .on(tok::Space, byte_class::any(), tok::Word)
+   *       .on(tok::Space, byte_class::of(" \t\r\n"), tok::Space)
+   *       .on(tok::Word, byte_class::any(), tok::Word)
+   *       .on(tok::Word, byte_class::of(" \t\r\n"), tok::Space)
+   *       .compile();
+   *   d.feed(buffer, [](tok from, tok to, std::size_t at) { ... });
+   * @endcode
+   */
+  template<typename S>
+  class byte_dfa_t {
+  public:
+    static constexpr std::uint16_t dead = 0xffff;
+
+    byte_dfa_t &initial(S s) {
+      _initial = _index_of(s);
+      return (*this);
+    }
+    byte_dfa_t &on(S from, byte_class const &cls, S to) {
+      _rules.push_back(rule{_index_of(from), cls, _index_of(to)});
+      _compiled = false;
+      return (*this);
+    }
+
+    /**
+     * @brief build the transition table and the skip plans.
+     * @return false if no initial state was given or there are too many states
+     */
+    bool compile() {
+      auto n = _ids.size();
+      if (_initial == dead || n >= dead) return false;
+      _tbl.assign(n * 256, dead);
+      for (auto const &r : _rules)
+        for (unsigned c = 0; c < 256; c++)
+          if (r.cls.test(static_cast<unsigned char>(c))) _tbl[r.from * 256 + c] = r.to;
+
+      _skip.assign(n, detail::dfa_skip_t{});
+      for (std::uint16_t s = 0; s < n; s++) _plan_skip(s);
+      _compiled = true;
+      reset();
+      return true;
+    }
+
+    void reset() {
+      _cur = _initial;
+      _offset = 0;
+    }
+
+    /**
+     * @brief consume buffer from the current state, stopping at the
+     * first byte that has no transition.
+     * @return the count of bytes consumed
+     */
+    std::size_t feed(std::string_view in) {
+      return feed(in, [](S, S, std::size_t) {});
+    }
+    /**
+     * @brief consume buffer, calling on_change(from, to, offset) for each
+     * transition that changes the state, offset being the position of the
+     * byte in the whole stream since reset().
+     */
+    template<typename OnChange>
+    std::size_t feed(std::string_view in, OnChange &&on_change) {
+      if (!_compiled || _cur == dead) return 0;
+      auto const *const tbl = _tbl.data();
+      auto const *const skip = _skip.data();
+      auto const *const begin = reinterpret_cast<unsigned char const *>(in.data());
+      auto const *const end = begin + in.size();
+      auto const *p = begin;
+      auto s = _cur;
+      while (p < end) {
+        if (skip[s].kind != detail::dfa_skip_t::None) {
+          p = detail::dfa_skip(skip[s], p, end);
+          if (p == end) break;
+        }
+        auto n = tbl[std::size_t(s) * 256 + *p];
+        if (n != s) {
+          if (n == dead) break;
+          on_change(_ids[s], _ids[n], _offset + static_cast<std::size_t>(p - begin));
+          s = n;
+        }
+        ++p;
+      }
+      auto consumed = static_cast<std::size_t>(p - begin);
+      _offset += consumed;
+      _cur = p < end ? dead : s;
+      if (_cur == dead) _last = s;
+      return consumed;
+    }
+
+    bool failed() const { return _cur == dead; }
+    /**
+     * @brief the current state; after a failure, the state that rejected the byte.
+     */
+    S current() const { return _ids[_cur == dead ? _last : _cur]; }
+    std::size_t offset() const { return _offset; }
+    std::size_t state_count() const { return _ids.size(); }
+    std::size_t table_bytes() const { return _tbl.size() * sizeof(std::uint16_t); }
+
+    /**
+     * @brief feed the whole stream, in blocks, until it ends or the DFA fails.
+     */
+    friend std::istream &operator>>(std::istream &is, byte_dfa_t &o) {
+      char buf[64 * 1024];
+      while (!o.failed() && is.read(buf, sizeof(buf)).gcount() > 0) {
+        auto n = static_cast<std::size_t>(is.gcount());
+        if (o.feed(std::string_view{buf, n}) < n) break;
+      }
+      return is;
+    }
+
+  private:
+    struct rule {
+      std::uint16_t from;
+      byte_class cls;
+      std::uint16_t to;
+    };
+
+    std::uint16_t _index_of(S s) {
+      auto id = static_cast<std::uint32_t>(s);
+      auto it = _index.find(id);
+      if (it != _index.end()) return it->second;
+      auto ix = static_cast<std::uint16_t>(_ids.size());
+      _ids.push_back(s);
+      _index.emplace(id, ix);
+      return ix;
+    }
+
+    void _plan_skip(std::uint16_t s) {
+      byte_class stay;
+      for (unsigned c = 0; c < 256; c++)
+        if (_tbl[s * 256 + c] == s) stay.set(static_cast<unsigned char>(c));
+      auto stays = stay.count();
+      auto &sk = _skip[s];
+      if (stays < 2) return;
+
+      if (256 - stays <= 4) {
+        for (unsigned c = 0; c < 256; c++)
+          if (!stay.test(static_cast<unsigned char>(c))) sk.b[sk.n++] = static_cast<unsigned char>(c);
+        if (sk.n == 0) return; // loops forever, nothing to find
+        for (auto i = sk.n; i < 4; i++) sk.b[i] = sk.b[0];
+        sk.kind = sk.n == 1 ? detail::dfa_skip_t::Exit1 : detail::dfa_skip_t::Exits;
+        return;
+      }
+
+      unsigned lo = 0;
+      while (!stay.test(static_cast<unsigned char>(lo))) lo++;
+      auto hi = lo + static_cast<unsigned>(stays) - 1;
+      if (hi > 255) return;
+      for (auto c = lo; c <= hi; c++)
+        if (!stay.test(static_cast<unsigned char>(c))) return;
+      sk.kind = detail::dfa_skip_t::Range;
+      sk.b[0] = static_cast<unsigned char>(lo);
+      sk.b[1] = static_cast<unsigned char>(hi);
+    }
+
+  private:
+    std::vector<S> _ids{};
+    std::unordered_map<std::uint32_t, std::uint16_t> _index{};
+    std::vector<rule> _rules{};
+    std::vector<std::uint16_t> _tbl{};
+    std::vector<detail::dfa_skip_t> _skip{};
+    std::uint16_t _initial{dead};
+    std::uint16_t _cur{dead};
+    std::uint16_t _last{0};
+    std::size_t _offset{0};
+    bool _compiled{false};
+  };
+
+} // namespace fsm_cxx
+
+#endif // __FSM_CXX_FSM_DFA_HH
@@ -0,0 +1,633 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_EXPLORE_HH
+#define __FSM_CXX_FSM_EXPLORE_HH
+
+#include "fsm-sm.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ----------------------------- product
+namespace fsm_cxx { namespace explore {
+
+  enum class guards {
+    abstract, // a guarded transition may or may not be taken
+    sample,   // the guards are evaluated once per state and event, on prototypes
+  };
+
+  /**
+   * @brief the events a component is sampled with, see guards::sample.
+   */
+  template<typename M>
+  class prototypes {
+  public:
+    using Event = typename M::Event;
+
+    template<typename Evt>
+    prototypes &event(Evt ev = Evt{}) {
+      _events[std::string{debug::type_name<Evt>()}] = std::make_shared<Evt const>(std::move(ev));
+      return (*this);
+    }
+    Event const *at(std::string const &name) const {
+      auto it = _events.find(name);
+      return it == _events.end() ? nullptr : it->second.get();
+    }
+
+  private:
+    std::unordered_map<std::string, std::shared_ptr<Event const>> _events{};
+  };
+
+  /**
+   * @brief the synchronous product of machine definitions, possibly of
+   * different types.
+   * @details Each machine added is reduced to a component graph over its
+   * states: the states of its transitions, plus its initial, terminated
+   * and error states. An event known to several components is taken by
+   * all of them together, in one step of the product; an event known to
+   * one component only is taken by it alone. A configuration is the
+   * tuple of the component states. The alphabet of a component is the
+   * events of its transition table, whether or not they are ever taken.
+   *
+   * With guards::abstract, the candidates of an event are kept up to and
+   * including the first unguarded one, as step_by() would try them; the
+   * state guards are ignored. With guards::sample, each (state, event)
+   * pair is decided once by stepping a copy of the machine, in
+   * skip_actions() mode, by the prototype of the event; the events
+   * without prototype are never taken.
+   *
+   * The composite states are flattened: a state takes the transitions of
+   * the composite states around it, and a transition into a composite
+   * state enters its default sub-states, or with guards::abstract any
+   * innermost state under it when it resumes a history.
+   *
+   * The completion transitions are not events of the alphabet: a step
+   * leads to where they come to rest, as step_by() takes them at once.
+   * With guards::abstract, each guarded one may or may not be taken.
+   */
+  class product {
+  public:
+    struct component {
+      std::string name{};
+      std::vector<std::string> states{};     // by dense index
+      std::vector<std::uint32_t> ids{};      // state_id() by dense index
+      std::vector<bool> bad{};               // by dense index
+      std::vector<bool> rest{};              // by dense index: no outgoing transition, or marked accepting()
+      std::uint32_t initial{0};
+      std::uint32_t bits{1};                 // to pack a dense index
+      std::vector<std::uint32_t> first{};    // [state * events + event], into targets
+      std::vector<std::uint32_t> targets{};
+    };
+
+    /**
+     * @brief add a machine; its error state is bad.
+     * @return the index of the component
+     */
+    template<typename M>
+    std::size_t add(M const &m, std::string name = {}, guards g = guards::abstract, prototypes<M> const *p = nullptr) {
+      using State = typename M::State;
+      using Item = typename M::Transition::Item;
+      auto const &table = m.transitions();
+      auto const &completion = M::completion_name();
+
+      // the composites are flattened as step_by() walks them: a state
+      // takes the transitions of the composite states around it, and a
+      // transition into a composite state enters its default sub-states
+      auto ancestors = [&m](State const &s) {
+        std::vector<State> v{s};
+        for (auto up = m.parent_of(s); up; up = m.parent_of(*up)) v.push_back(*up);
+        return v;
+      };
+      auto descend = [&m](State s) {
+        for (auto d = m.default_of(s); d; d = m.default_of(s)) s = *d;
+        return s;
+      };
+      // the candidates of ev from s, innermost first, up to the first
+      // unguarded one
+      auto candidates = [&table, &ancestors](State const &s, std::string const &ev) {
+        std::vector<Item const *> v;
+        for (auto const &a : ancestors(s))
+          if (auto tr = table.find(a); tr != table.end())
+            if (auto its = tr->second.m_.find(ev); its != tr->second.m_.end())
+              for (auto const &it : its->second) {
+                v.push_back(&it);
+                if (!it.pred) return v;
+              }
+        return v;
+      };
+
+      std::vector<State> ss;
+      auto add_state = [&ss](State const &s) {
+        if (std::find(ss.begin(), ss.end(), s) == ss.end()) ss.push_back(s);
+      };
+      add_state(m.initial_state());
+      add_state(m.terminated_state());
+      add_state(m.error_state());
+      for (auto const &[from, tr] : table) {
+        add_state(from);
+        for (auto const &[ev, items] : tr.m_)
+          for (auto const &it : items) add_state(it.to), add_state(descend(it.to));
+      }
+      std::sort(ss.begin(), ss.end(), [](State const &a, State const &b) { return state_id(a) < state_id(b); });
+
+      _pending.emplace_back();
+      auto &c = _pending.back();
+      c.name = name.empty() ? "m" + std::to_string(_pending.size() - 1) : std::move(name);
+      std::unordered_map<std::uint32_t, std::uint32_t> index;
+      for (auto const &s : ss) {
+        index.emplace(state_id(s), static_cast<std::uint32_t>(c.states.size()));
+        c.states.push_back(M::state_to_sting(s));
+        c.ids.push_back(state_id(s));
+      }
+      c.initial = index[state_id(m.initial_state())];
+      c.bad.assign(ss.size(), false);
+      c.bad[index[state_id(m.error_state())]] = true;
+      c.rest.assign(ss.size(), false);
+      while ((std::size_t(1) << c.bits) < ss.size()) c.bits++;
+
+      // where the candidate it from s leads: s itself if it is internal,
+      // else the default sub-states of its target, and for a history any
+      // innermost state under it, as each may have been the last active
+      auto targets = [&](State const &s, Item const &it) {
+        std::vector<State> v{it.internal ? s : descend(it.to)};
+        if (it.internal || it.history == history_kind::none) return v;
+        for (auto const &x : ss) {
+          auto up = ancestors(x);
+          if (!m.default_of(x) && !(x == v[0]) && std::find(up.begin() + 1, up.end(), it.to) != up.end()) v.push_back(x);
+        }
+        return v;
+      };
+      // where the completion transitions from s may come to rest: s
+      // itself unless an unguarded one leaves it, or where those lead;
+      // the states of a cycle without rest, as the completion limit cuts
+      auto settle = [&](State const &to) {
+        std::vector<State> seen{to}, stack{to};
+        std::vector<std::uint32_t> rests;
+        while (!stack.empty()) {
+          auto s = stack.back();
+          stack.pop_back();
+          auto cs = candidates(s, completion);
+          for (auto const *it : cs)
+            for (auto const &t : targets(s, *it))
+              if (std::find(seen.begin(), seen.end(), t) == seen.end()) seen.push_back(t), stack.push_back(t);
+          if (cs.empty() || cs.back()->pred) rests.push_back(index[state_id(s)]);
+        }
+        if (rests.empty())
+          for (auto const &s : seen) rests.push_back(index[state_id(s)]);
+        return rests;
+      };
+
+      for (auto const &[from, tr] : table)
+        for (auto const &[ev, items] : tr.m_)
+          if (ev != completion && std::find(c.alphabet.begin(), c.alphabet.end(), ev) == c.alphabet.end()) c.alphabet.push_back(ev);
+
+      // (from, event name, to), decided now while the machine is at hand
+      std::unique_ptr<M> probe;
+      for (auto const &from : ss) {
+        auto f = index[state_id(from)];
+        std::vector<std::string> events;
+        for (auto const &a : ancestors(from))
+          if (auto tr = table.find(a); tr != table.end())
+            for (auto const &[ev, items] : tr->second.m_)
+              if (ev != completion && std::find(events.begin(), events.end(), ev) == events.end()) events.push_back(ev);
+        for (auto const &ev : events) {
+          if (g == guards::abstract) {
+            for (auto const *it : candidates(from, ev))
+              for (auto const &t : targets(from, *it))
+                for (auto r : settle(t)) c.edges.emplace_back(f, ev, r);
+            continue;
+          }
+          auto const *proto = p ? p->at(ev) : nullptr;
+          if (!proto) continue;
+          if (!probe) {
+            probe = std::make_unique<M>(m);
+            probe->skip_actions(true);
+          }
+          probe->context().current(from);
+          if (probe->step_by(ev, *proto, typename M::Payload{}))
+            if (auto r = index.find(state_id(probe->context().current())); r != index.end()) c.edges.emplace_back(f, ev, r->second);
+        }
+      }
+      return _pending.size() - 1;
+    }
+
+    // mark one more state of a component as bad
+    template<typename StateT>
+    product &bad(std::size_t comp, StateT const &s) { return _mark(comp, state_id(s), &component::bad); }
+    // a component may rest in s: a configuration without successor is
+    // not a deadlock if all its components are at rest
+    template<typename StateT>
+    product &accepting(std::size_t comp, StateT const &s) { return _mark(comp, state_id(s), &component::rest); }
+
+    std::size_t size() const { return _pending.size(); }
+
+  private:
+    friend class explorer;
+    struct pending : component {
+      std::vector<std::string> alphabet{}; // the event names of the machine, taken or not
+      std::vector<std::tuple<std::uint32_t, std::string, std::uint32_t>> edges{};
+    };
+    product &_mark(std::size_t comp, std::uint32_t id, std::vector<bool> component::*which) {
+      auto &c = _pending[comp];
+      for (std::size_t i = 0; i < c.ids.size(); i++)
+        if (c.ids[i] == id) (c.*which)[i] = true;
+      return (*this);
+    }
+    std::vector<pending> _pending{};
+  };
+
+}} // namespace fsm_cxx::explore
+
+// ----------------------------- explorer
+namespace fsm_cxx { namespace explore {
+
+  struct options {
+    std::size_t threads{0};           // 0 for one per hardware thread
+    std::size_t capacity{1u << 22};   // of the visited set, rounded up to a power of two
+    bool compact{false};              // keep 64 bits fingerprints even when the configurations fit in 64 bits
+    std::uint32_t max_depth{0};       // 0 for no limit
+  };
+
+  struct step {
+    std::string event{};              // empty for the initial configuration
+    std::vector<std::string> states{};
+
+    friend std::ostream &operator<<(std::ostream &os, step const &s) {
+      if (!s.event.empty()) os << "-- " << s.event << " --> ";
+      os << '(';
+      for (std::size_t i = 0; i < s.states.size(); i++) os << (i ? ", " : "") << s.states[i];
+      return os << ')';
+    }
+  };
+  using trace = std::vector<step>;
+
+  struct report {
+    std::uint64_t configurations{};   // reached
+    std::uint64_t transitions{};      // of the product, between reached configurations
+    std::uint32_t depth{};            // of the breadth-first search
+    bool exact{true};                 // false with fingerprints: two configurations may have been merged
+    bool complete{true};              // false if the visited set filled up or max_depth cut the search
+    std::uint64_t deadlocks{};        // configurations without successor, with a component not at rest
+    std::uint64_t bad{};              // configurations with a component in a bad state
+    std::vector<std::vector<std::string>> reachable{};   // per component
+    std::vector<std::vector<std::string>> unreachable{}; // per component
+    std::optional<trace> first_deadlock{}, first_bad{};  // shortest counterexamples
+
+    bool ok() const { return complete && !deadlocks && !bad; }
+  };
+
+  namespace detail {
+    inline std::uint64_t fmix64(std::uint64_t k) {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdULL;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ULL;
+      k ^= k >> 33;
+      return k;
+    }
+
+    /**
+     * @brief an insert-only set of 64 bits keys with a parent link per
+     * key, open addressing over a fixed array. Inserting is lock-free;
+     * key 0 lives in an extra slot at the end.
+     */
+    class visited_set {
+    public:
+      static constexpr std::uint32_t none = 0xffffffffu;
+
+      explicit visited_set(std::size_t capacity) {
+        std::size_t n = 1024;
+        while (n < capacity) n <<= 1;
+        _mask = n - 1;
+        _keys.reset(new std::atomic<std::uint64_t>[n + 1]);
+        for (std::size_t i = 0; i <= n; i++) _keys[i].store(0, std::memory_order_relaxed);
+        _parents.assign(n + 1, none);
+        _events.assign(n + 1, 0);
+      }
+
+      enum class outcome { inserted, present, full };
+      // on inserted, slot is the new entry's; set parent and event there
+      outcome insert(std::uint64_t key, std::uint32_t &slot) {
+        if (key == 0) {
+          slot = static_cast<std::uint32_t>(_mask + 1);
+          if (_zero.exchange(true)) return outcome::present;
+          _count++;
+          return outcome::inserted;
+        }
+        if (_count.load(std::memory_order_relaxed) >= (_mask + 1) - (_mask + 1) / 8) return outcome::full;
+        for (std::size_t i = key & _mask, probes = 0; probes <= _mask; i = (i + 1) & _mask, probes++) {
+          auto k = _keys[i].load(std::memory_order_acquire);
+          if (k == 0) {
+            std::uint64_t expected = 0;
+            if (_keys[i].compare_exchange_strong(expected, key, std::memory_order_acq_rel)) {
+              _count++;
+              slot = static_cast<std::uint32_t>(i);
+              return outcome::inserted;
+            }
+            k = expected;
+          }
+          if (k == key) return outcome::present;
+        }
+        return outcome::full;
+      }
+      std::uint64_t key(std::uint32_t slot) const { return slot > _mask ? 0 : _keys[slot].load(std::memory_order_relaxed); }
+      std::uint32_t &parent(std::uint32_t slot) { return _parents[slot]; }
+      std::uint32_t &event(std::uint32_t slot) { return _events[slot]; }
+      std::uint64_t count() const { return _count.load(); }
+
+    private:
+      std::size_t _mask{};
+      std::unique_ptr<std::atomic<std::uint64_t>[]> _keys{};
+      std::vector<std::uint32_t> _parents{}, _events{};
+      std::atomic<bool> _zero{false};
+      std::atomic<std::uint64_t> _count{0};
+    };
+  } // namespace detail
+
+  /**
+   * @brief enumerate the reachable configurations of a product by a
+   * parallel, level-synchronous breadth-first search.
+   * @details The threads take the configurations of a level by chunks
+   * and insert their successors into a shared lock-free visited set;
+   * the ones inserted first make the next level. A configuration is
+   * packed into 64 bits, bits of dense state indices, and stored through
+   * a bijective mix, so that the set is exact. Products too wide for 64
+   * bits, or options::compact, store a 64 bits fingerprint instead (hash
+   * compaction): two configurations may then be merged, which the
+   * report says.
+   *
+   * Each entry keeps its parent and event, so that the shortest traces
+   * to the first deadlock and the first bad configuration are rebuilt
+   * by walking back, then forward again matching the keys.
+   *
+   * @code{c++}
+   *   fsm_cxx::explore::product p;
+   *   p.add(client, "client");
+   *   p.add(server, "server");
+   *   auto r = fsm_cxx::explore::explorer{p}.run();
+   *   if (r.first_deadlock)
+   *     for (auto const &s : *r.first_deadlock) std::cout << s << '\n';
+   * @endcode
+   */
+  class explorer {
+  public:
+    explicit explorer(product const &p) {
+      // the global alphabet
+      std::unordered_map<std::string, std::uint32_t> events;
+      for (auto const &c : p._pending)
+        for (auto const &e : c.alphabet)
+          if (events.emplace(e, std::uint32_t(_event_names.size())).second)
+            _event_names.push_back(e);
+      auto ne = _event_names.size();
+      _participants.resize(ne);
+
+      std::uint32_t bits = 0;
+      for (std::size_t ci = 0; ci < p._pending.size(); ci++) {
+        auto const &pc = p._pending[ci];
+        product::component c = pc;
+        auto ns = c.states.size();
+        std::vector<std::vector<std::uint32_t>> to(ns * ne);
+        std::vector<bool> known(ne, false), leaves(ns, false);
+        for (auto const &name : pc.alphabet) known[events[name]] = true;
+        for (auto const &[f, name, t] : pc.edges) {
+          to[f * ne + events[name]].push_back(t);
+          leaves[f] = true;
+        }
+        for (std::size_t i = 0; i < ns; i++) c.rest[i] = c.rest[i] || !leaves[i];
+        c.first.assign(ns * ne + 1, 0);
+        for (std::size_t i = 0; i < ns * ne; i++) {
+          c.first[i] = static_cast<std::uint32_t>(c.targets.size());
+          c.targets.insert(c.targets.end(), to[i].begin(), to[i].end());
+        }
+        c.first[ns * ne] = static_cast<std::uint32_t>(c.targets.size());
+        for (std::size_t e = 0; e < ne; e++)
+          if (known[e]) _participants[e].push_back(static_cast<std::uint32_t>(ci));
+        _shift.push_back(bits);
+        bits += c.bits;
+        _components.push_back(std::move(c));
+      }
+      _packed = bits <= 64;
+    }
+
+    std::size_t components() const { return _components.size(); }
+    std::vector<std::string> const &events() const { return _event_names; }
+
+    report run(options const &opt = options{}) const {
+      report rep;
+      auto n = _components.size();
+      if (!n) return rep;
+      auto threads = opt.threads ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+      rep.exact = _packed && !opt.compact;
+      detail::visited_set seen{opt.capacity};
+
+      std::vector<std::uint32_t> level(n), next;
+      std::vector<std::uint32_t> level_slots(1), next_slots;
+      for (std::size_t i = 0; i < n; i++) level[i] = _components[i].initial;
+      seen.insert(_key(level.data(), rep.exact), level_slots[0]);
+
+      struct local {
+        std::vector<std::uint32_t> configs{}, slots{}, dead{}, bad{};
+        std::vector<std::vector<bool>> reached{};
+        std::uint64_t transitions{};
+        bool full{false};
+      };
+      std::vector<local> locals(threads);
+      for (auto &l : locals) {
+        l.reached.resize(n);
+        for (std::size_t i = 0; i < n; i++) l.reached[i].assign(_components[i].states.size(), false);
+      }
+      std::vector<std::uint32_t> dead_slots, bad_slots;
+
+      for (std::uint32_t depth = 0; !level_slots.empty(); depth++) {
+        rep.depth = depth;
+        if (opt.max_depth && depth == opt.max_depth) {
+          rep.complete = false;
+          break;
+        }
+        std::atomic<std::size_t> cursor{0};
+        auto count = level_slots.size();
+        auto work = [&](std::size_t t) {
+          auto &l = locals[t];
+          std::vector<std::uint32_t> succ(n);
+          for (;;) {
+            auto begin = cursor.fetch_add(256);
+            if (begin >= count) break;
+            auto end = std::min(count, begin + 256);
+            for (auto k = begin; k < end; k++) {
+              auto const *cfg = &level[k * n];
+              auto slot = level_slots[k];
+              bool any = false, live = false, is_bad = false;
+              for (std::size_t i = 0; i < n; i++) {
+                l.reached[i][cfg[i]] = true;
+                live |= !_components[i].rest[cfg[i]];
+                is_bad |= _components[i].bad[cfg[i]];
+              }
+              if (is_bad) l.bad.push_back(slot);
+              _successors(cfg, succ, [&](std::uint32_t e, std::uint32_t const *to) {
+                any = true;
+                l.transitions++;
+                std::uint32_t s;
+                auto r = seen.insert(_key(to, rep.exact), s);
+                if (r == detail::visited_set::outcome::full) l.full = true;
+                if (r != detail::visited_set::outcome::inserted) return;
+                seen.parent(s) = slot;
+                seen.event(s) = e;
+                l.configs.insert(l.configs.end(), to, to + n);
+                l.slots.push_back(s);
+              });
+              if (!any && live) l.dead.push_back(slot);
+            }
+          }
+        };
+        auto used = std::min<std::size_t>(threads, (count + 255) / 256);
+        if (used <= 1) work(0);
+        else {
+          std::vector<std::thread> ts;
+          for (std::size_t t = 0; t < used; t++) ts.emplace_back(work, t);
+          for (auto &t : ts) t.join();
+        }
+
+        next.clear(), next_slots.clear();
+        std::uint32_t first_dead = detail::visited_set::none, first_bad = detail::visited_set::none;
+        for (auto &l : locals) {
+          next.insert(next.end(), l.configs.begin(), l.configs.end());
+          next_slots.insert(next_slots.end(), l.slots.begin(), l.slots.end());
+          rep.deadlocks += l.dead.size();
+          rep.bad += l.bad.size();
+          if (!l.dead.empty()) first_dead = std::min(first_dead, l.dead.front());
+          if (!l.bad.empty()) first_bad = std::min(first_bad, l.bad.front());
+          rep.complete &= !l.full;
+          l.configs.clear(), l.slots.clear(), l.dead.clear(), l.bad.clear();
+        }
+        if (!rep.first_deadlock && first_dead != detail::visited_set::none) rep.first_deadlock = _trace(seen, first_dead, rep.exact);
+        if (!rep.first_bad && first_bad != detail::visited_set::none) rep.first_bad = _trace(seen, first_bad, rep.exact);
+        level.swap(next);
+        level_slots.swap(next_slots);
+      }
+
+      rep.configurations = seen.count();
+      rep.reachable.resize(n);
+      rep.unreachable.resize(n);
+      for (std::size_t i = 0; i < n; i++) {
+        auto const &c = _components[i];
+        for (std::size_t s = 0; s < c.states.size(); s++) {
+          bool r = false;
+          for (auto const &l : locals) r |= bool(l.reached[i][s]);
+          (r ? rep.reachable : rep.unreachable)[i].push_back(c.states[s]);
+        }
+      }
+      for (auto const &l : locals) rep.transitions += l.transitions;
+      return rep;
+    }
+
+  private:
+    // call fn(event, successor) for each successor of cfg
+    template<typename Fn>
+    void _successors(std::uint32_t const *cfg, std::vector<std::uint32_t> &succ, Fn &&fn) const {
+      auto n = _components.size(), ne = _event_names.size();
+      for (std::uint32_t e = 0; e < ne; e++) {
+        auto const &ps = _participants[e];
+        bool enabled = !ps.empty();
+        for (auto ci : ps) {
+          auto const &c = _components[ci];
+          auto i = cfg[ci] * ne + e;
+          if (c.first[i] == c.first[i + 1]) {
+            enabled = false;
+            break;
+          }
+        }
+        if (!enabled) continue;
+        std::copy(cfg, cfg + n, succ.begin());
+        _choose(ps, 0, e, cfg, succ, fn);
+      }
+    }
+    // every combination of the participants' targets
+    template<typename Fn>
+    void _choose(std::vector<std::uint32_t> const &ps, std::size_t k, std::uint32_t e, std::uint32_t const *cfg,
+                 std::vector<std::uint32_t> &succ, Fn &fn) const {
+      if (k == ps.size()) {
+        fn(e, succ.data());
+        return;
+      }
+      auto const &c = _components[ps[k]];
+      auto i = cfg[ps[k]] * _event_names.size() + e;
+      for (auto j = c.first[i]; j < c.first[i + 1]; j++) {
+        succ[ps[k]] = c.targets[j];
+        _choose(ps, k + 1, e, cfg, succ, fn);
+      }
+    }
+
+    std::uint64_t _key(std::uint32_t const *cfg, bool exact) const {
+      if (exact) {
+        std::uint64_t k = 0;
+        for (std::size_t i = 0; i < _components.size(); i++) k |= std::uint64_t(cfg[i]) << _shift[i];
+        return detail::fmix64(k); // a bijection: still exact
+      }
+      std::uint64_t h = 0x9e3779b97f4a7c15ULL;
+      for (std::size_t i = 0; i < _components.size(); i++) h = detail::fmix64(h ^ (cfg[i] + 0x100000001b3ULL * (i + 1)));
+      return h;
+    }
+
+    // back to the root through the parents, then forward again from the
+    // initial configuration choosing the successors by their keys
+    trace _trace(detail::visited_set &seen, std::uint32_t slot, bool exact) const {
+      std::vector<std::uint32_t> chain;
+      for (auto s = slot; s != detail::visited_set::none; s = seen.parent(s)) chain.push_back(s);
+      std::reverse(chain.begin(), chain.end());
+
+      auto n = _components.size();
+      std::vector<std::uint32_t> cfg(n), succ(n), found(n);
+      for (std::size_t i = 0; i < n; i++) cfg[i] = _components[i].initial;
+      trace t;
+      auto add = [&](std::string ev) {
+        step st{std::move(ev), {}};
+        for (std::size_t i = 0; i < n; i++) st.states.push_back(_components[i].states[cfg[i]]);
+        t.push_back(std::move(st));
+      };
+      add({});
+      for (std::size_t k = 1; k < chain.size(); k++) {
+        auto want = seen.key(chain[k]);
+        auto ev = seen.event(chain[k]);
+        bool hit = false;
+        _successors(cfg.data(), succ, [&](std::uint32_t e, std::uint32_t const *to) {
+          if (!hit && e == ev && _key(to, exact) == want) {
+            std::copy(to, to + n, found.begin());
+            hit = true;
+          }
+        });
+        if (!hit) break;
+        cfg.swap(found);
+        add(fsm_cxx::detail::shorten(_event_names[ev]));
+      }
+      return t;
+    }
+
+    std::vector<product::component> _components{};
+    std::vector<std::uint32_t> _shift{};
+    std::vector<std::string> _event_names{};
+    std::vector<std::vector<std::uint32_t>> _participants{}; // per event
+    bool _packed{true};
+  };
+
+}} // namespace fsm_cxx::explore
+
+#endif // __FSM_CXX_FSM_EXPLORE_HH
@@ -0,0 +1,987 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/13.
+//
+
+#ifndef __FSM_CXX_FSM_FROZEN_HH
+#define __FSM_CXX_FSM_FROZEN_HH
+
+#include "fsm-mmap.hh"
+#include "fsm-sm.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ----------------------------- frozen image layout
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief layout of a frozen machine definition.
+   * @details A frozen definition is one contiguous, position-independent
+   * block: a header followed by arrays of 32 bits words, every reference
+   * being an index or an offset from the beginning of the block. It can
+   * be written to a file once and mapped read-only by any number of
+   * processes, which then dispatch directly from the mapped pages.
+   *
+   * States and events are renumbered to dense indices. Guards and
+   * actions are stored as indices into the name table and bound to real
+   * callables by a registry at load time.
+   *
+   * Event names map to their dense indices through a minimal perfect
+   * hash stored in the block (off_event_hash, 0 when absent): one
+   * displacement word per bucket, then the event index of each slot.
+   */
+  constexpr std::uint32_t npos = 0xffffffffu;
+  constexpr std::uint32_t magic = 0x444d5346; // "FSMD"
+  constexpr std::uint16_t version = 1;
+  constexpr std::uint16_t byte_order_mark = 0x0102;
+
+  // edge_rec::flags: every slot of the edge was declared exclusive, so
+  // they may be tried in any order (see transition_builder::exclusive())
+  constexpr std::uint32_t edge_exclusive = 1u << 0;
+
+  struct header {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t byte_order;
+    std::uint32_t total_size;
+    std::uint32_t state_count;
+    std::uint32_t edge_count;
+    std::uint32_t slot_count;
+    std::uint32_t guard_count; // entries of the state guards list
+    std::uint32_t event_count;
+    std::uint32_t name_count;
+    std::uint32_t initial, terminated, error;
+    std::uint32_t off_states;
+    std::uint32_t off_state_by_id;
+    std::uint32_t off_edges;
+    std::uint32_t off_slots;
+    std::uint32_t off_guards;
+    std::uint32_t off_events;
+    std::uint32_t off_event_by_name;
+    std::uint32_t off_names;
+    std::uint32_t off_strings;
+    std::uint32_t strings_size;
+    std::uint32_t off_event_hash;
+    std::uint32_t event_hash_seed;
+    std::uint32_t reserved[4];
+  };
+  static_assert(sizeof(header) == 112, "frozen::header must be 112 bytes");
+
+  struct state_rec {
+    std::uint32_t id; // the raw state value
+    std::uint32_t entry, exit;
+    std::uint32_t guard_first, guard_count;
+    std::uint32_t edge_first, edge_count;
+    std::uint32_t flags;
+  };
+  struct edge_rec {
+    std::uint32_t event;
+    std::uint32_t slot_first, slot_count;
+    std::uint32_t flags;
+  };
+  struct slot_rec {
+    std::uint32_t to; // dense state index
+    std::uint32_t guard, entry, exit;
+  };
+  struct name_rec {
+    std::uint32_t off, len;
+  };
+
+  namespace detail {
+    inline std::uint64_t fmix64(std::uint64_t h) {
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+    // the first level hash of an event name, 8 bytes at a time
+    inline std::uint64_t name_hash(std::string_view s, std::uint32_t seed) {
+      std::uint64_t h = (std::uint64_t{seed} << 32 | seed) ^ (s.size() * 0x9e3779b97f4a7c15ULL);
+      auto p = s.data();
+      auto n = s.size();
+      for (; n >= 8; p += 8, n -= 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+      }
+      if (n) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+      }
+      return fmix64(h);
+    }
+    // the slot of a name hashed to h, in a bucket displaced by d
+    inline std::uint32_t hash_slot(std::uint64_t h, std::uint32_t d, std::uint32_t n) {
+      return static_cast<std::uint32_t>(fmix64(h + d * 0x9e3779b97f4a7c15ULL) % n);
+    }
+
+    /**
+     * @brief build a minimal perfect hash of keys, by hash and displace:
+     * the keys are spread over keys.size() buckets, then the buckets,
+     * largest first, each search for a displacement sending all their
+     * keys to free slots.
+     * @param disp the displacement of each bucket
+     * @param slots the key index in each slot
+     * @return false if the keys are not distinct
+     */
+    inline bool build_name_hash(std::vector<std::string_view> const &keys, std::uint32_t &seed,
+                                std::vector<std::uint32_t> &disp, std::vector<std::uint32_t> &slots) {
+      auto const n = static_cast<std::uint32_t>(keys.size());
+      if (n == 0) return true;
+      std::vector<std::uint64_t> hashes(n);
+      std::vector<std::vector<std::uint32_t>> buckets;
+      std::vector<std::uint32_t> order(n), taken;
+      for (seed = 0; seed < 64; seed++) {
+        buckets.assign(n, {});
+        for (std::uint32_t i = 0; i < n; i++) {
+          hashes[i] = name_hash(keys[i], seed);
+          buckets[hashes[i] % n].push_back(i);
+        }
+        for (std::uint32_t b = 0; b < n; b++) order[b] = b;
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::uint32_t a, std::uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+        disp.assign(n, 0);
+        slots.assign(n, npos);
+        bool placed_all = true;
+        for (auto b : order) {
+          auto const &keys_of = buckets[b];
+          if (keys_of.empty()) break;
+          bool placed = false;
+          for (std::uint32_t d = 0; d < (1u << 20) && !placed; d++) {
+            taken.clear();
+            for (auto k : keys_of) {
+              auto sl = hash_slot(hashes[k], d, n);
+              if (slots[sl] != npos || std::find(taken.begin(), taken.end(), sl) != taken.end()) break;
+              taken.push_back(sl);
+            }
+            if (taken.size() != keys_of.size()) continue;
+            for (std::size_t j = 0; j < taken.size(); j++) slots[taken[j]] = keys_of[j];
+            disp[b] = d;
+            placed = true;
+          }
+          if (!placed) {
+            placed_all = false;
+            break;
+          }
+        }
+        if (placed_all) return true;
+        // identical keys collide under every seed
+        std::vector<std::string_view> sorted(keys);
+        std::sort(sorted.begin(), sorted.end());
+        if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) return false;
+      }
+      return false;
+    }
+
+    // the key index for name, or npos if it can only be another key
+    inline std::uint32_t lookup_name_hash(std::string_view name, std::uint32_t seed, std::uint32_t const *disp,
+                                          std::uint32_t const *slots, std::uint32_t n) {
+      if (n == 0) return npos;
+      auto h = name_hash(name, seed);
+      return slots[hash_slot(h, disp[h % n], n)];
+    }
+  } // namespace detail
+
+  /**
+   * @brief an owned, 4-bytes aligned frozen definition block.
+   */
+  class image {
+  public:
+    image() = default;
+    explicit image(std::size_t bytes) : _words((bytes + 3) / 4), _size(bytes) {}
+
+    char const *data() const { return reinterpret_cast<char const *>(_words.data()); }
+    char *data() { return reinterpret_cast<char *>(_words.data()); }
+    std::size_t size() const { return _size; }
+
+  private:
+    std::vector<std::uint32_t> _words{};
+    std::size_t _size{0};
+  };
+
+  inline bool write_file(image const &img, std::string const &path) {
+    std::FILE *fp = std::fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = std::fwrite(img.data(), 1, img.size(), fp) == img.size();
+    return std::fclose(fp) == 0 && ok;
+  }
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- model
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief the editable form of a frozen definition.
+   * @details freeze() fills it from a machine_t, optimization passes
+   * rewrite it, serialize() turns it into an image. Indices are dense:
+   * slot::to indexes states, edge::event indexes events, and guards and
+   * actions index names (npos for none).
+   */
+  struct model {
+    struct slot {
+      std::uint32_t to{npos};
+      std::uint32_t guard{npos}, entry{npos}, exit{npos};
+      std::uint64_t hits{}; // profile recorded by the adaptive mode, not serialized
+    };
+    struct edge {
+      std::uint32_t event{};
+      std::uint32_t flags{};
+      std::vector<slot> slots{};
+    };
+    struct state {
+      std::uint32_t id{};
+      std::uint32_t entry{npos}, exit{npos};
+      std::uint32_t flags{};
+      std::vector<std::uint32_t> guards{};
+      std::vector<edge> edges{};
+    };
+
+    std::vector<state> states{};
+    std::vector<std::uint32_t> events{}; // name index of each event
+    std::vector<std::string> names{};
+    std::uint32_t initial{npos}, terminated{npos}, error{npos};
+
+    std::uint32_t intern(std::string const &s) {
+      if (_name_index.size() != names.size()) {
+        _name_index.clear();
+        for (std::uint32_t i = 0; i < names.size(); i++)
+          _name_index.emplace(names[i], i);
+      }
+      auto it = _name_index.find(s);
+      if (it != _name_index.end()) return it->second;
+      auto ix = static_cast<std::uint32_t>(names.size());
+      names.push_back(s);
+      _name_index.emplace(s, ix);
+      return ix;
+    }
+    std::uint32_t event_of(std::string const &event_name) {
+      auto n = intern(event_name);
+      for (std::uint32_t i = 0; i < events.size(); i++)
+        if (events[i] == n) return i;
+      events.push_back(n);
+      return static_cast<std::uint32_t>(events.size() - 1);
+    }
+    std::uint32_t state_of(std::uint32_t id) const {
+      for (std::uint32_t i = 0; i < states.size(); i++)
+        if (states[i].id == id) return i;
+      return npos;
+    }
+
+    std::size_t slot_count() const {
+      std::size_t n = 0;
+      for (auto const &st : states)
+        for (auto const &e : st.edges) n += e.slots.size();
+      return n;
+    }
+
+    image serialize() const;
+
+  private:
+    std::unordered_map<std::string, std::uint32_t> _name_index{};
+  };
+
+  inline image model::serialize() const {
+    std::size_t edge_count = 0, slot_count = 0, guard_count = 0, strings_size = 0;
+    for (auto const &st : states) {
+      edge_count += st.edges.size();
+      guard_count += st.guards.size();
+      for (auto const &e : st.edges) slot_count += e.slots.size();
+    }
+    for (auto const &n : names) strings_size += n.size();
+
+    std::vector<std::string_view> event_names;
+    for (auto e : events) event_names.push_back(names[e]);
+    std::uint32_t hash_seed = 0;
+    std::vector<std::uint32_t> hash_disp, hash_slots;
+    bool hashed = !events.empty() && detail::build_name_hash(event_names, hash_seed, hash_disp, hash_slots);
+
+    auto const state_count = states.size(), event_count = events.size(), name_count = names.size();
+    std::size_t off = sizeof(header);
+    auto place = [&off](std::size_t bytes) {
+      auto at = off;
+      off += (bytes + 3) & ~std::size_t(3);
+      return static_cast<std::uint32_t>(at);
+    };
+    header h{};
+    h.magic = magic;
+    h.version = version;
+    h.byte_order = byte_order_mark;
+    h.state_count = static_cast<std::uint32_t>(state_count);
+    h.edge_count = static_cast<std::uint32_t>(edge_count);
+    h.slot_count = static_cast<std::uint32_t>(slot_count);
+    h.guard_count = static_cast<std::uint32_t>(guard_count);
+    h.event_count = static_cast<std::uint32_t>(event_count);
+    h.name_count = static_cast<std::uint32_t>(name_count);
+    h.initial = initial;
+    h.terminated = terminated;
+    h.error = error;
+    h.off_states = place(state_count * sizeof(state_rec));
+    h.off_state_by_id = place(state_count * 4);
+    h.off_edges = place(edge_count * sizeof(edge_rec));
+    h.off_slots = place(slot_count * sizeof(slot_rec));
+    h.off_guards = place(guard_count * 4);
+    h.off_events = place(event_count * 4);
+    h.off_event_by_name = place(event_count * 4);
+    h.off_names = place(name_count * sizeof(name_rec));
+    h.off_strings = place(strings_size);
+    h.strings_size = static_cast<std::uint32_t>(strings_size);
+    if (hashed) {
+      h.off_event_hash = place(event_count * 8);
+      h.event_hash_seed = hash_seed;
+    }
+    h.total_size = static_cast<std::uint32_t>(off);
+
+    image img{off};
+    char *base = img.data();
+    auto sr = reinterpret_cast<state_rec *>(base + h.off_states);
+    auto er = reinterpret_cast<edge_rec *>(base + h.off_edges);
+    auto lr = reinterpret_cast<slot_rec *>(base + h.off_slots);
+    auto gr = reinterpret_cast<std::uint32_t *>(base + h.off_guards);
+
+    std::uint32_t ei = 0, li = 0, gi = 0;
+    for (std::size_t i = 0; i < state_count; i++) {
+      auto const &st = states[i];
+      // edges are kept sorted by event so that lookups can bisect
+      std::vector<edge const *> sorted;
+      for (auto const &e : st.edges) sorted.push_back(&e);
+      std::sort(sorted.begin(), sorted.end(), [](edge const *a, edge const *b) { return a->event < b->event; });
+
+      sr[i] = state_rec{st.id, st.entry, st.exit, gi, static_cast<std::uint32_t>(st.guards.size()),
+                        ei, static_cast<std::uint32_t>(sorted.size()), st.flags};
+      for (auto g : st.guards) gr[gi++] = g;
+      for (auto e : sorted) {
+        er[ei++] = edge_rec{e->event, li, static_cast<std::uint32_t>(e->slots.size()), e->flags};
+        for (auto const &s : e->slots)
+          lr[li++] = slot_rec{s.to, s.guard, s.entry, s.exit};
+      }
+    }
+
+    auto by_id = reinterpret_cast<std::uint32_t *>(base + h.off_state_by_id);
+    for (std::uint32_t i = 0; i < state_count; i++) by_id[i] = i;
+    std::sort(by_id, by_id + state_count, [this](std::uint32_t a, std::uint32_t b) { return states[a].id < states[b].id; });
+
+    auto ev = reinterpret_cast<std::uint32_t *>(base + h.off_events);
+    auto by_name = reinterpret_cast<std::uint32_t *>(base + h.off_event_by_name);
+    for (std::uint32_t i = 0; i < event_count; i++) ev[i] = events[i], by_name[i] = i;
+    std::sort(by_name, by_name + event_count, [this](std::uint32_t a, std::uint32_t b) { return names[events[a]] < names[events[b]]; });
+    if (hashed) {
+      auto eh = reinterpret_cast<std::uint32_t *>(base + h.off_event_hash);
+      std::copy(hash_disp.begin(), hash_disp.end(), eh);
+      std::copy(hash_slots.begin(), hash_slots.end(), eh + event_count);
+    }
+
+    auto nr = reinterpret_cast<name_rec *>(base + h.off_names);
+    std::uint32_t so = 0;
+    for (std::size_t i = 0; i < name_count; i++) {
+      nr[i] = name_rec{so, static_cast<std::uint32_t>(names[i].size())};
+      std::memcpy(base + h.off_strings + so, names[i].data(), names[i].size());
+      so += static_cast<std::uint32_t>(names[i].size());
+    }
+
+    std::memcpy(base, &h, sizeof(h));
+    return img;
+  }
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- freeze
+namespace fsm_cxx { namespace frozen {
+
+  namespace detail {
+    template<typename ActionT>
+    inline bool name_of(ActionT const &a, model &m, std::uint32_t &out, std::string *err, char const *what) {
+      out = npos;
+      if (!a) return true;
+      if (a.name().empty()) {
+        if (err) *err = std::string("an anonymous ") + what + " cannot be frozen, give it a name";
+        return false;
+      }
+      out = m.intern(a.name());
+      return true;
+    }
+    template<typename FN>
+    inline bool guard_of(FN const &fn, std::string const &name, model &m, std::uint32_t &out, std::string *err) {
+      out = npos;
+      if (!fn) return true;
+      if (name.empty()) {
+        if (err) *err = "an anonymous guard cannot be frozen, give it a name";
+        return false;
+      }
+      out = m.intern(name);
+      return true;
+    }
+  } // namespace detail
+
+  /**
+   * @brief export the definition of a built machine into a model.
+   * @details Every guard and action must carry a name (see the *_named()
+   * and guard(name, fn) builder methods), since only the names survive.
+   * A frozen definition is flat: composite states, transitions into a
+   * history, internal and completion transitions cannot be frozen.
+   * @return false with a message in err if something cannot be frozen
+   */
+  template<typename M>
+  inline bool freeze(M const &m, model &out, std::string *err = nullptr) {
+    out = model{};
+    if (m.has_composites()) {
+      if (err) *err = "composite states cannot be frozen, declare the transitions on the sub-states";
+      return false;
+    }
+    std::vector<std::uint32_t> ids;
+    auto add_id = [&ids](typename M::State const &s) { ids.push_back(state_id(s)); };
+    add_id(m.initial_state());
+    add_id(m.terminated_state());
+    add_id(m.error_state());
+    for (auto const &[from, tr] : m.transitions()) {
+      add_id(from);
+      for (auto const &[ev, items] : tr.m_)
+        for (auto const &it : items) add_id(it.to);
+    }
+    for (auto const &[st, a] : m.state_actions()) add_id(st);
+    for (auto const &[st, g] : m.context().guards()) add_id(st);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    std::unordered_map<std::uint32_t, std::uint32_t> index;
+    for (auto id : ids) {
+      index.emplace(id, static_cast<std::uint32_t>(out.states.size()));
+      out.states.emplace_back().id = id;
+    }
+    out.initial = index[state_id(m.initial_state())];
+    out.terminated = index[state_id(m.terminated_state())];
+    out.error = index[state_id(m.error_state())];
+
+    // events: sorted by name so that two processes freezing the same
+    // machine produce identical images
+    std::vector<std::string> event_names;
+    for (auto const &[from, tr] : m.transitions())
+      for (auto const &[ev, items] : tr.m_) event_names.push_back(ev);
+    std::sort(event_names.begin(), event_names.end());
+    event_names.erase(std::unique(event_names.begin(), event_names.end()), event_names.end());
+    for (auto const &n : event_names) out.event_of(n);
+
+    for (auto const &[st, a] : m.state_actions()) {
+      auto &s = out.states[index[state_id(st)]];
+      if (!detail::name_of(a.entry_action, out, s.entry, err, "entry action") ||
+          !detail::name_of(a.exit_action, out, s.exit, err, "exit action"))
+        return false;
+    }
+    auto const &names = m.context().guard_names();
+    for (auto const &[st, preds] : m.context().guards()) {
+      auto &s = out.states[index[state_id(st)]];
+      auto nit = names.find(st);
+      for (std::size_t i = 0; i < preds.size(); i++) {
+        std::uint32_t g;
+        std::string const nm = nit != names.end() && i < nit->second.size() ? nit->second[i] : std::string{};
+        if (!detail::guard_of(preds[i], nm, out, g, err)) return false;
+        s.guards.push_back(g);
+      }
+    }
+
+    for (auto const &[from, tr] : m.transitions()) {
+      auto &s = out.states[index[state_id(from)]];
+      for (auto const &[ev, items] : tr.m_) {
+        if (ev == M::completion_name()) {
+          if (err) *err = "a completion transition cannot be frozen, a frozen step does not take them";
+          return false;
+        }
+        model::edge e;
+        e.event = out.event_of(ev);
+        e.flags = items.empty() ? 0 : edge_exclusive;
+        for (auto const &it : items) {
+          if (it.internal) {
+            if (err) *err = "an internal transition cannot be frozen, make it a self-transition";
+            return false;
+          }
+          if (it.history != history_kind::none) {
+            if (err) *err = "a transition into a history cannot be frozen";
+            return false;
+          }
+          model::slot sl;
+          sl.to = index[state_id(it.to)];
+          sl.hits = it.hits.load(std::memory_order_relaxed);
+          if (!it.exclusive) e.flags &= ~edge_exclusive;
+          if (!detail::guard_of(it.pred, it.guard_name, out, sl.guard, err) ||
+              !detail::name_of(it.entry_action, out, sl.entry, err, "entry action") ||
+              !detail::name_of(it.exit_action, out, sl.exit, err, "exit action"))
+            return false;
+          e.slots.push_back(sl);
+        }
+        s.edges.push_back(std::move(e));
+      }
+    }
+    return true;
+  }
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- view
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief a validated, read-only view over a frozen definition block.
+   * @details The block is not copied; all accessors read it in place.
+   */
+  class view {
+  public:
+    view() = default;
+    view(char const *data, std::size_t size) { _valid = _validate(data, size); }
+
+    bool valid() const { return _valid; }
+    header const &head() const { return *_h; }
+    char const *data() const { return _base; }
+    std::size_t size() const { return _h ? _h->total_size : 0; }
+
+    std::uint32_t state_count() const { return _h->state_count; }
+    std::uint32_t event_count() const { return _h->event_count; }
+    std::uint32_t slot_count() const { return _h->slot_count; }
+    std::uint32_t name_count() const { return _h->name_count; }
+
+    state_rec const &state(std::uint32_t i) const { return _states[i]; }
+    edge_rec const &edge(std::uint32_t i) const { return _edges[i]; }
+    slot_rec const &slot(std::uint32_t i) const { return _slots[i]; }
+    std::uint32_t state_guard(std::uint32_t i) const { return _guards[i]; }
+    std::uint32_t event_name_index(std::uint32_t ev) const { return _events[ev]; }
+    std::string_view name(std::uint32_t i) const { return std::string_view{_strings + _names[i].off, _names[i].len}; }
+    std::string_view event_name(std::uint32_t ev) const { return name(_events[ev]); }
+
+    /**
+     * @brief the edge of state for event, or nullptr.
+     */
+    edge_rec const *find_edge(std::uint32_t state, std::uint32_t event) const {
+      auto const &s = _states[state];
+      auto first = _edges + s.edge_first, last = first + s.edge_count;
+      if (s.edge_count <= 8) {
+        for (; first != last; ++first)
+          if (first->event == event) return first;
+        return nullptr;
+      }
+      auto it = std::lower_bound(first, last, event, [](edge_rec const &e, std::uint32_t v) { return e.event < v; });
+      return it != last && it->event == event ? it : nullptr;
+    }
+    /**
+     * @brief dense index of the state with the raw value id, or npos.
+     */
+    std::uint32_t state_index(std::uint32_t id) const {
+      auto first = _state_by_id, last = first + _h->state_count;
+      auto it = std::lower_bound(first, last, id, [this](std::uint32_t i, std::uint32_t v) { return _states[i].id < v; });
+      return it != last && _states[*it].id == id ? *it : npos;
+    }
+    /**
+     * @brief dense index of the event named name, or npos.
+     * @details Through the perfect hash: one hash of n, two loads, and a
+     * single comparison with the only name n can be. Nothing is
+     * allocated.
+     */
+    std::uint32_t event_index(std::string_view n) const {
+      if (_event_hash) {
+        auto ev = detail::lookup_name_hash(n, _h->event_hash_seed, _event_hash, _event_hash + _h->event_count, _h->event_count);
+        return ev != npos && event_name(ev) == n ? ev : npos;
+      }
+      auto first = _event_by_name, last = first + _h->event_count;
+      auto it = std::lower_bound(first, last, n, [this](std::uint32_t i, std::string_view v) { return event_name(i) < v; });
+      return it != last && event_name(*it) == n ? *it : npos;
+    }
+    template<typename Evt>
+    std::uint32_t event_index() const { return event_index(fsm_cxx::debug::type_name<Evt>()); }
+
+  private:
+    template<typename T>
+    bool _section(T const *&p, std::uint32_t off, std::size_t count) {
+      if (off % 4 || off > _h->total_size || count * sizeof(T) > _h->total_size - off) return false;
+      p = reinterpret_cast<T const *>(_base + off);
+      return true;
+    }
+    bool _validate(char const *data, std::size_t size) {
+      if (!data || size < sizeof(header) || reinterpret_cast<std::uintptr_t>(data) % 4) return false;
+      _base = data;
+      _h = reinterpret_cast<header const *>(data);
+      auto const &h = *_h;
+      if (h.magic != magic || h.version != version || h.byte_order != byte_order_mark || h.total_size > size)
+        return false;
+      char const *strings{};
+      if (!_section(_states, h.off_states, h.state_count) ||
+          !_section(_state_by_id, h.off_state_by_id, h.state_count) ||
+          !_section(_edges, h.off_edges, h.edge_count) ||
+          !_section(_slots, h.off_slots, h.slot_count) ||
+          !_section(_guards, h.off_guards, h.guard_count) ||
+          !_section(_events, h.off_events, h.event_count) ||
+          !_section(_event_by_name, h.off_event_by_name, h.event_count) ||
+          !_section(_names, h.off_names, h.name_count) ||
+          h.off_strings > h.total_size || h.strings_size > h.total_size - h.off_strings)
+        return false;
+      strings = data + h.off_strings;
+      _strings = strings;
+
+      auto name_ok = [&h](std::uint32_t n) { return n == npos || n < h.name_count; };
+      auto state_ok = [&h](std::uint32_t s) { return s == npos || s < h.state_count; };
+      // instances start in initial, so it must be a real state
+      if (h.initial >= h.state_count || !state_ok(h.terminated) || !state_ok(h.error)) return false;
+      for (std::uint32_t i = 0; i < h.name_count; i++)
+        if (_names[i].off > h.strings_size || _names[i].len > h.strings_size - _names[i].off) return false;
+      for (std::uint32_t i = 0; i < h.state_count; i++) {
+        auto const &s = _states[i];
+        if (_state_by_id[i] >= h.state_count || !name_ok(s.entry) || !name_ok(s.exit) ||
+            s.guard_first > h.guard_count || s.guard_count > h.guard_count - s.guard_first ||
+            s.edge_first > h.edge_count || s.edge_count > h.edge_count - s.edge_first)
+          return false;
+      }
+      for (std::uint32_t i = 0; i < h.guard_count; i++)
+        if (_guards[i] >= h.name_count) return false;
+      for (std::uint32_t i = 0; i < h.edge_count; i++) {
+        auto const &e = _edges[i];
+        if (e.event >= h.event_count || e.slot_first > h.slot_count || e.slot_count > h.slot_count - e.slot_first)
+          return false;
+      }
+      for (std::uint32_t i = 0; i < h.slot_count; i++) {
+        auto const &s = _slots[i];
+        if (s.to >= h.state_count || !name_ok(s.guard) || !name_ok(s.entry) || !name_ok(s.exit)) return false;
+      }
+      for (std::uint32_t i = 0; i < h.event_count; i++)
+        if (_events[i] >= h.name_count || _event_by_name[i] >= h.event_count) return false;
+      if (h.off_event_hash) {
+        if (!_section(_event_hash, h.off_event_hash, std::size_t(h.event_count) * 2)) return false;
+        for (std::uint32_t i = 0; i < h.event_count; i++)
+          if (_event_hash[h.event_count + i] >= h.event_count) return false;
+      }
+      return true;
+    }
+
+  private:
+    bool _valid{false};
+    char const *_base{nullptr};
+    header const *_h{nullptr};
+    state_rec const *_states{nullptr};
+    std::uint32_t const *_state_by_id{nullptr};
+    edge_rec const *_edges{nullptr};
+    slot_rec const *_slots{nullptr};
+    std::uint32_t const *_guards{nullptr};
+    std::uint32_t const *_events{nullptr};
+    std::uint32_t const *_event_by_name{nullptr};
+    std::uint32_t const *_event_hash{nullptr};
+    name_rec const *_names{nullptr};
+    char const *_strings{nullptr};
+  };
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- registry, definition
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief named guards and actions to rebind a frozen definition with.
+   */
+  template<typename M>
+  class registry {
+  public:
+    using Guard = typename M::Guard;
+    using FN = typename M::Action::FN;
+
+    registry &guard(std::string const &name, Guard &&fn) {
+      _guards[name] = std::move(fn);
+      return (*this);
+    }
+    registry &action(std::string const &name, FN &&fn) {
+      _actions[name] = std::move(fn);
+      return (*this);
+    }
+
+    /**
+     * @brief harvest every named guard and action of a built machine.
+     */
+    registry &collect(M const &m) {
+      for (auto const &[from, tr] : m.transitions()) {
+        for (auto const &[ev, items] : tr.m_) {
+          for (auto const &it : items) {
+            if (it.pred && !it.guard_name.empty()) _guards[it.guard_name] = it.pred;
+            _collect(it.entry_action);
+            _collect(it.exit_action);
+          }
+        }
+      }
+      for (auto const &[st, a] : m.state_actions()) {
+        _collect(a.entry_action);
+        _collect(a.exit_action);
+      }
+      auto const &names = m.context().guard_names();
+      for (auto const &[st, preds] : m.context().guards()) {
+        auto nit = names.find(st);
+        for (std::size_t i = 0; nit != names.end() && i < preds.size() && i < nit->second.size(); i++) {
+          if (nit->second[i].empty()) continue;
+          auto p = preds[i];
+          _guards[nit->second[i]] = [p](typename M::Event const &ev, typename M::Context &c, typename M::State const &s, typename M::Payload const &pl) { return p(ev, c, s, pl); };
+        }
+      }
+      return (*this);
+    }
+
+    Guard const *find_guard(std::string_view name) const {
+      auto it = _guards.find(std::string{name});
+      return it == _guards.end() ? nullptr : &it->second;
+    }
+    FN const *find_action(std::string_view name) const {
+      auto it = _actions.find(std::string{name});
+      return it == _actions.end() ? nullptr : &it->second;
+    }
+
+  private:
+    void _collect(typename M::Action const &a) {
+      if (a && !a.name().empty()) {
+        _actions[a.name()] = [a](typename M::Event const &ev, typename M::Context &c, typename M::State const &s, typename M::Payload const &p) { a(ev, c, s, p); };
+      }
+    }
+
+  private:
+    std::unordered_map<std::string, Guard> _guards{};
+    std::unordered_map<std::string, FN> _actions{};
+  };
+
+  /**
+   * @brief a frozen definition bound to callables, ready to dispatch.
+   * @details It owns (or shares) the memory of its block, e.g. a mapped
+   * file, and is immutable after bind(): any number of threads may call
+   * step() concurrently on their own contexts.
+   */
+  template<typename M>
+  class definition {
+  public:
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+    using Guard = typename M::Guard;
+    using FN = typename M::Action::FN;
+
+    definition(std::shared_ptr<void const> storage, char const *data, std::size_t size)
+        : _storage(std::move(storage)), _v(data, size) {}
+
+    bool valid() const { return _v.valid(); }
+    view const &table() const { return _v; }
+
+    /**
+     * @brief resolve every guard and action name against reg.
+     * @return false if the block is invalid or a name is missing
+     */
+    bool bind(registry<M> const &reg, std::string *err = nullptr) {
+      if (!_v.valid()) {
+        if (err) *err = "invalid frozen definition";
+        return false;
+      }
+      std::vector<char> used(_v.name_count(), 0);
+      std::vector<char> used_as_guard(_v.name_count(), 0);
+      auto mark = [&used](std::uint32_t n) { if (n != npos) used[n] = 1; };
+      for (std::uint32_t i = 0; i < _v.slot_count(); i++) {
+        auto const &s = _v.slot(i);
+        if (s.guard != npos) used_as_guard[s.guard] = 1;
+        mark(s.entry), mark(s.exit);
+      }
+      for (std::uint32_t i = 0; i < _v.state_count(); i++) {
+        auto const &s = _v.state(i);
+        mark(s.entry), mark(s.exit);
+        for (std::uint32_t g = 0; g < s.guard_count; g++) used_as_guard[_v.state_guard(s.guard_first + g)] = 1;
+      }
+
+      _guards.assign(_v.name_count(), Guard{});
+      _actions.assign(_v.name_count(), FN{});
+      for (std::uint32_t i = 0; i < _v.name_count(); i++) {
+        if (used_as_guard[i]) {
+          auto g = reg.find_guard(_v.name(i));
+          if (!g) return _missing(err, "guard", i);
+          _guards[i] = *g;
+        }
+        if (used[i]) {
+          auto a = reg.find_action(_v.name(i));
+          if (!a) return _missing(err, "action", i);
+          _actions[i] = *a;
+        }
+      }
+      _states.clear();
+      _states.reserve(_v.state_count());
+      for (std::uint32_t i = 0; i < _v.state_count(); i++)
+        _states.push_back(state_from_id<State>(_v.state(i).id));
+      _bound = true;
+      return true;
+    }
+    bool bound() const { return _bound; }
+
+    State const &state(std::uint32_t i) const { return _states[i]; }
+    std::uint32_t initial() const { return _v.head().initial; }
+
+    /**
+     * @brief dispatch one event on the instance whose dense state index
+     * is cur, with the same semantics as machine_t::step_by().
+     * @param cur the current dense state index, updated on success
+     * @param event the dense event index, see view::event_index()
+     * @param reason the failure reason if it returns false
+     */
+    bool step(std::uint32_t &cur, std::uint32_t event, Event const &ev, Context &ctx, Payload const &payload, Reason *reason = nullptr) const {
+      auto e = cur < _v.state_count() && event < _v.event_count() ? _v.find_edge(cur, event) : nullptr;
+      if (!e) return _fail(reason, Reason::StateNotFound);
+
+      slot_rec const *chosen = nullptr;
+      for (std::uint32_t i = 0; i < e->slot_count; i++) {
+        auto const &s = _v.slot(e->slot_first + i);
+        if (s.guard == npos || _guards[s.guard](ev, ctx, _states[s.to], payload)) {
+          chosen = &s;
+          break;
+        }
+      }
+      if (!chosen) return _fail(reason, Reason::StateNotFound);
+
+      auto const &to = _v.state(chosen->to);
+      for (std::uint32_t g = 0; g < to.guard_count; g++)
+        if (!_guards[_v.state_guard(to.guard_first + g)](ev, ctx, _states[chosen->to], payload))
+          return _fail(reason, Reason::FailureGuard);
+
+      auto const &from = _v.state(cur);
+      auto const &from_state = _states[cur];
+      _call(chosen->exit, ev, ctx, from_state, payload);
+      _call(from.exit, ev, ctx, _states[chosen->to], payload);
+      cur = chosen->to;
+      ctx.current(_states[cur]);
+      _call(chosen->entry, ev, ctx, _states[cur], payload);
+      _call(to.entry, ev, ctx, from_state, payload);
+      return true;
+    }
+
+    /**
+     * @brief as step(), for an event arriving by name; an unknown name
+     * fails with Reason::StateNotFound.
+     */
+    bool step(std::uint32_t &cur, std::string_view event_name, Event const &ev, Context &ctx, Payload const &payload, Reason *reason = nullptr) const {
+      return step(cur, _v.event_index(event_name), ev, ctx, payload, reason);
+    }
+
+  private:
+    void _call(std::uint32_t a, Event const &ev, Context &ctx, State const &s, Payload const &p) const {
+      if (a != npos && _actions[a]) _actions[a](ev, ctx, s, p);
+    }
+    static bool _fail(Reason *reason, Reason r) {
+      if (reason) *reason = r;
+      return false;
+    }
+    bool _missing(std::string *err, char const *what, std::uint32_t i) const {
+      if (err) *err = std::string("no ") + what + " registered as '" + std::string(_v.name(i)) + "'";
+      return false;
+    }
+
+  private:
+    std::shared_ptr<void const> _storage;
+    view _v;
+    std::vector<Guard> _guards{};
+    std::vector<FN> _actions{};
+    std::vector<State> _states{};
+    bool _bound{false};
+  };
+
+  /**
+   * @brief bind an in-memory image.
+   * @return nullptr with a message in err on failure
+   */
+  template<typename M>
+  inline std::shared_ptr<definition<M> const> make(image img, registry<M> const &reg, std::string *err = nullptr) {
+    auto storage = std::make_shared<image>(std::move(img));
+    auto def = std::make_shared<definition<M>>(storage, storage->data(), storage->size());
+    if (!def->bind(reg, err)) return nullptr;
+    return def;
+  }
+
+  /**
+   * @brief map a frozen definition file read-only and bind it in place.
+   * @return nullptr with a message in err on failure
+   */
+  template<typename M>
+  inline std::shared_ptr<definition<M> const> load(std::string const &path, registry<M> const &reg, std::string *err = nullptr) {
+    auto f = std::make_shared<util::mapped_file>(path);
+    if (!*f) {
+      if (err) *err = "cannot map " + path;
+      return nullptr;
+    }
+    auto def = std::make_shared<definition<M>>(f, f->data(), f->size());
+    if (!def->bind(reg, err)) return nullptr;
+    return def;
+  }
+
+}} // namespace fsm_cxx::frozen
+
+// ----------------------------- instance
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief a lightweight machine instance running on a shared definition.
+   */
+  template<typename M>
+  class instance {
+  public:
+    using Definition = definition<M>;
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+
+    explicit instance(std::shared_ptr<Definition const> def)
+        : _def(std::move(def)) { reset(); }
+
+    instance &reset() {
+      _cur = _def->initial();
+      _ctx.reset(_def->state(_cur));
+      return (*this);
+    }
+
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value, bool> = true>
+    bool step_by(Evt const &ev, Payload const &payload = Payload{}) {
+      return step_by(_def->table().template event_index<Evt>(), ev, payload);
+    }
+    bool step_by(std::uint32_t event, Event const &ev, Payload const &payload, Reason *reason = nullptr) {
+      return _def->step(_cur, event, ev, _ctx, payload, reason);
+    }
+    bool step_by(std::string_view event_name, Event const &ev, Payload const &payload, Reason *reason = nullptr) {
+      return _def->step(_cur, _def->table().event_index(event_name), ev, _ctx, payload, reason);
+    }
+
+    State const &current() const { return _def->state(_cur); }
+    std::uint32_t current_index() const { return _cur; }
+    /**
+     * @brief move the instance to the dense state index i, e.g. restored
+     * from a snapshot.
+     * @return false, leaving the instance as it was, if i is no state
+     */
+    bool current_index(std::uint32_t i) {
+      if (i >= _def->table().state_count()) return false;
+      _cur = i;
+      _ctx.current(_def->state(i));
+      return true;
+    }
+    Context &context() { return _ctx; }
+    Context const &context() const { return _ctx; }
+    Definition const &def() const { return *_def; }
+
+  private:
+    std::shared_ptr<Definition const> _def;
+    std::uint32_t _cur{npos};
+    Context _ctx{};
+  };
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_FROZEN_HH
@@ -0,0 +1,765 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_JOURNAL_HH
+#define __FSM_CXX_FSM_JOURNAL_HH
+
+#include "fsm-mmap.hh"
+#include "fsm-sm.hh"
+#include "fsm-snapshot.hh"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !OS_WIN
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#endif
+
+// ----------------------------- format
+namespace fsm_cxx { namespace journal {
+
+  /**
+   * @brief the on-disk layout of a journal.
+   * @details A journal is a directory of segments named by a sequence
+   * number, 00000001.journal and up. A segment is a segment_header
+   * followed by records; a record is a record_header followed by its
+   * body, the payload bytes then the event bytes, as written by their
+   * journal_save() hooks. The crc covers the header (crc zeroed) and
+   * the body, so that a record torn by a crash is detected and ends the
+   * journal. Fields are in host byte order.
+   */
+  constexpr std::uint32_t magic = 0x4a4d5346; // "FSMJ"
+  constexpr std::uint16_t version = 1;
+  constexpr std::uint16_t no_event = 0xffff;
+
+  struct segment_header {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t byte_order;
+    std::uint64_t first_lsn;
+  };
+  static_assert(sizeof(segment_header) == 16, "segment_header must be 16 bytes");
+
+  struct record_header {
+    std::uint32_t size; // of the body
+    std::uint32_t crc;
+    std::uint64_t lsn;      // log sequence number, from 1, dense
+    std::uint64_t instance; // the key given to sink::attach()
+    std::uint32_t to;       // state_id() of the state entered
+    std::uint16_t event;    // the codec id, or no_event
+    std::uint16_t flags;
+    std::uint32_t payload_size; // the leading part of the body
+    std::uint32_t reserved;
+  };
+  static_assert(sizeof(record_header) == 40, "record_header must be 40 bytes");
+
+  namespace detail {
+    inline std::uint32_t crc32(void const *p, std::size_t n, std::uint32_t crc = 0) {
+      static auto const table = []() {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; i++) {
+          auto c = i;
+          for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+          t[i] = c;
+        }
+        return t;
+      }();
+      auto const *b = static_cast<unsigned char const *>(p);
+      crc = ~crc;
+      for (std::size_t i = 0; i < n; i++) crc = table[(crc ^ b[i]) & 0xff] ^ (crc >> 8);
+      return ~crc;
+    }
+    inline std::uint32_t record_crc(record_header h, char const *body) {
+      h.crc = 0;
+      return crc32(body, h.size, crc32(&h, sizeof(h)));
+    }
+
+    inline std::string segment_path(std::string const &dir, std::uint64_t seq) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "%08llu.journal", static_cast<unsigned long long>(seq));
+      return (std::filesystem::path(dir) / name).string();
+    }
+    // the segments of dir, by sequence number
+    inline std::vector<std::pair<std::uint64_t, std::string>> list_segments(std::string const &dir) {
+      std::vector<std::pair<std::uint64_t, std::string>> v;
+      std::error_code ec;
+      for (auto const &e : std::filesystem::directory_iterator(dir, ec)) {
+        if (e.path().extension() != ".journal") continue;
+        auto stem = e.path().stem().string();
+        char *end = nullptr;
+        auto seq = std::strtoull(stem.c_str(), &end, 10);
+        if (end && *end == '\0' && seq) v.emplace_back(seq, e.path().string());
+      }
+      std::sort(v.begin(), v.end());
+      return v;
+    }
+
+    // the length of the valid prefix of a segment, and its last lsn
+    inline std::size_t valid_prefix(char const *p, std::size_t n, std::uint64_t &last_lsn, bool &torn) {
+      torn = false;
+      segment_header sh{};
+      if (n < sizeof(sh)) return torn = n != 0, 0;
+      std::memcpy(&sh, p, sizeof(sh));
+      if (sh.magic != magic || sh.version != version || sh.byte_order != snapshot::byte_order_mark) return torn = true, 0;
+      std::size_t off = sizeof(sh);
+      while (off < n) {
+        record_header h{};
+        if (n - off < sizeof(h)) return torn = true, off;
+        std::memcpy(&h, p + off, sizeof(h));
+        if (n - off - sizeof(h) < h.size || h.payload_size > h.size || record_crc(h, p + off + sizeof(h)) != h.crc)
+          return torn = true, off;
+        last_lsn = h.lsn;
+        off += sizeof(h) + h.size;
+      }
+      return off;
+    }
+
+#if !OS_WIN
+    inline int file_create(std::string const &path) { return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644); }
+    inline bool file_write(int fd, char const *p, std::size_t n) {
+      while (n) {
+        auto w = ::write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<std::size_t>(w);
+      }
+      return true;
+    }
+    inline bool file_sync(int fd) {
+#if defined(__APPLE__)
+      return ::fsync(fd) == 0;
+#else
+      return ::fdatasync(fd) == 0;
+#endif
+    }
+    inline void file_close(int fd) { ::close(fd); }
+#else
+    inline int file_create(std::string const &path) { return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE); }
+    inline bool file_write(int fd, char const *p, std::size_t n) {
+      while (n) {
+        auto w = ::_write(fd, p, static_cast<unsigned>(std::min<std::size_t>(n, 1u << 30)));
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<std::size_t>(w);
+      }
+      return true;
+    }
+    inline bool file_sync(int fd) { return ::_commit(fd) == 0; }
+    inline void file_close(int fd) { ::_close(fd); }
+#endif
+
+    // the journal_save()/journal_load() hooks of events and payloads
+    template<typename T, typename = void>
+    struct field_codec {
+      static void save(T const &, snapshot::writer &) {}
+      static bool load(T &, snapshot::reader &) { return true; }
+    };
+    template<typename T>
+    struct field_codec<T, std::void_t<decltype(std::declval<T const &>().journal_save(std::declval<snapshot::writer &>()))>> {
+      static void save(T const &o, snapshot::writer &w) { o.journal_save(w); }
+      static bool load(T &o, snapshot::reader &r) { return o.journal_load(r); }
+    };
+  } // namespace detail
+
+}} // namespace fsm_cxx::journal
+
+// ----------------------------- codec
+namespace fsm_cxx { namespace journal {
+
+  /**
+   * @brief the events a journal can record and replay.
+   * @details Each registered event type gets a dense id, in the order
+   * of registration, so the writer and the replayer must register the
+   * same types in the same order. An event or payload type carrying
+   * data provides
+   * @code{c++}
+   *   void journal_save(fsm_cxx::snapshot::writer &w) const;
+   *   bool journal_load(fsm_cxx::snapshot::reader &r);
+   * @endcode
+   * and must be default constructible; without them only its type is
+   * recorded.
+   */
+  template<typename M>
+  class codec {
+  public:
+    using Event = typename M::Event;
+    using Payload = typename M::Payload;
+    // prepares a new instance for replay, as it was before its first step
+    using Init = std::function<void(std::uint64_t, M &)>;
+
+    struct entry {
+      std::string name;
+      void (*save)(Event const &, snapshot::writer &);
+      bool (*step)(M &, snapshot::reader &, Payload const &);
+    };
+
+    template<typename Evt>
+    codec &event() {
+      auto name = std::string{debug::type_name<Evt>()};
+      if (_ids.count(name)) return (*this);
+      entry e{
+              name,
+              [](Event const &ev, snapshot::writer &w) { detail::field_codec<Evt>::save(static_cast<Evt const &>(ev), w); },
+              [](M &m, snapshot::reader &r, Payload const &p) -> bool {
+                Evt ev{};
+                return detail::field_codec<Evt>::load(ev, r) && r.ok() && m.step_by(ev, p);
+              }};
+      _ids.emplace(name, static_cast<std::uint16_t>(_entries.size()));
+      _entries.push_back(std::move(e));
+      return (*this);
+    }
+
+    // the id of an event name, or no_event
+    std::uint16_t id_of(std::string const &name) const {
+      auto it = _ids.find(name);
+      return it == _ids.end() ? no_event : it->second;
+    }
+    entry const *at(std::uint16_t id) const { return id < _entries.size() ? &_entries[id] : nullptr; }
+    std::size_t size() const { return _entries.size(); }
+
+  private:
+    std::vector<entry> _entries{};
+    std::unordered_map<std::string, std::uint16_t> _ids{};
+  };
+
+}} // namespace fsm_cxx::journal
+
+// ----------------------------- log
+namespace fsm_cxx { namespace journal {
+
+  struct log_options {
+    std::size_t segment_bytes{64u << 20};
+    std::size_t buffer_bytes{1u << 20}; // append() commits when so much is queued
+    bool sync{true};                    // false: commit() writes without fdatasync
+  };
+
+  /**
+   * @brief an append-only segmented log with group commit.
+   * @details append() assigns the next lsn and queues the record in
+   * memory, under a short lock. commit(lsn) returns once the record is
+   * on disk: the first caller to arrive becomes the leader, writes all
+   * that is queued and calls fdatasync once, while the others wait for
+   * it; the callers arriving meanwhile are served by the next leader,
+   * so that N concurrent commits cost about two syncs. A segment is
+   * closed when it reaches segment_bytes, the next one starts with the
+   * next record.
+   *
+   * open() continues an existing journal: the torn tail a crash may
+   * leave in the last segment is cut, and appending goes on in a new
+   * segment.
+   */
+  class log {
+  public:
+    using options = log_options;
+
+    log() = default;
+    explicit log(std::string const &dir, options const &opt = options{}) { open(dir, opt); }
+    ~log() { close(); }
+    log(log const &) = delete;
+    log &operator=(log const &) = delete;
+
+    bool open(std::string const &dir, options const &opt = options{}) {
+      close();
+      std::error_code ec;
+      std::filesystem::create_directories(dir, ec);
+      if (!std::filesystem::is_directory(dir, ec)) return false;
+      _dir = dir;
+      _opt = opt;
+      _segments.clear();
+      _lsn = _durable = 0;
+      _next_seq = 1;
+      for (auto const &[seq, path] : detail::list_segments(dir)) {
+        util::mapped_file f{path};
+        if (!f) return false;
+        std::uint64_t last = _lsn;
+        bool torn;
+        auto keep = detail::valid_prefix(f.data(), f.size(), last, torn);
+        segment_header sh{};
+        if (keep >= sizeof(sh)) std::memcpy(&sh, f.data(), sizeof(sh));
+        f.close();
+        if (torn) std::filesystem::resize_file(path, keep, ec);
+        if (keep >= sizeof(sh)) _segments.emplace_back(seq, sh.first_lsn);
+        _lsn = last;
+        _next_seq = seq + 1;
+      }
+      _durable = _lsn;
+      _ok = true;
+      return true;
+    }
+
+    // commit what is queued and close the current segment
+    void close() {
+      if (!_ok) return;
+      commit(last_lsn());
+      if (_fd >= 0) detail::file_close(_fd);
+      _fd = -1;
+      _ok = false;
+    }
+    explicit operator bool() const { return _ok; }
+
+    /**
+     * @brief queue a record; h.size is set from body, h.lsn and h.crc
+     * are filled in.
+     * @return the lsn of the record
+     */
+    std::uint64_t append(record_header h, std::string_view body) {
+      std::uint64_t lsn;
+      bool full;
+      {
+        std::lock_guard<std::mutex> lk(_lock);
+        lsn = h.lsn = ++_lsn;
+        h.size = static_cast<std::uint32_t>(body.size());
+        h.crc = detail::record_crc(h, body.data());
+        auto n = sizeof(h) + body.size();
+        if (_fill_seq == 0 || (_seg_used + n > _opt.segment_bytes && _seg_used > sizeof(segment_header))) {
+          _fill_seq = _next_seq++;
+          _seg_used = sizeof(segment_header);
+          _pending.push_back(chunk{_fill_seq, lsn, true, {}});
+          _segments.emplace_back(_fill_seq, lsn);
+        } else if (_pending.empty())
+          _pending.push_back(chunk{_fill_seq, 0, false, {}});
+        auto &out = _pending.back().bytes;
+        out.append(reinterpret_cast<char const *>(&h), sizeof(h));
+        out.append(body.data(), body.size());
+        _seg_used += n;
+        _queued += n;
+        full = _queued >= _opt.buffer_bytes;
+      }
+      if (full) commit(lsn);
+      return lsn;
+    }
+
+    /**
+     * @brief wait until the records up to lsn are on disk.
+     * @return false if a write or a sync failed; the log is unusable then
+     */
+    bool commit(std::uint64_t lsn) {
+      std::unique_lock<std::mutex> lk(_lock);
+      while (_durable < lsn && !_failed) {
+        if (_flushing) {
+          _flushed.wait(lk);
+          continue;
+        }
+        _flushing = true;
+        std::vector<chunk> batch;
+        batch.swap(_pending);
+        auto upto = _lsn;
+        _queued = 0;
+        lk.unlock();
+        bool ok = _write(batch);
+        lk.lock();
+        _flushing = false;
+        if (ok) _durable = upto;
+        else _failed = true;
+        _syncs++;
+        _flushed.notify_all();
+      }
+      return !_failed;
+    }
+    bool commit() { return commit(last_lsn()); }
+
+    std::uint64_t last_lsn() const {
+      std::lock_guard<std::mutex> lk(_lock);
+      return _lsn;
+    }
+    std::uint64_t durable_lsn() const {
+      std::lock_guard<std::mutex> lk(_lock);
+      return _durable;
+    }
+    // the number of group commits, each one write and one sync
+    std::uint64_t syncs() const {
+      std::lock_guard<std::mutex> lk(_lock);
+      return _syncs;
+    }
+    std::string const &dir() const { return _dir; }
+
+    /**
+     * @brief delete the segments holding only records before lsn, those
+     * a checkpoint taken at lsn - 1 has made useless.
+     * @return the number of segments deleted
+     */
+    std::size_t truncate_before(std::uint64_t lsn) {
+      std::lock_guard<std::mutex> lk(_lock);
+      std::size_t n = 0;
+      // a segment ends where the next one begins; the last one is kept
+      while (_segments.size() > 1 && _segments[1].second <= lsn && _segments[1].second <= _durable + 1) {
+        std::error_code ec;
+        std::filesystem::remove(detail::segment_path(_dir, _segments.front().first), ec);
+        _segments.erase(_segments.begin());
+        n++;
+      }
+      return n;
+    }
+
+  private:
+    struct chunk {
+      std::uint64_t seq;
+      std::uint64_t first_lsn;
+      bool fresh; // starts the segment seq
+      std::string bytes;
+    };
+
+    // the leader only
+    bool _write(std::vector<chunk> const &batch) {
+      for (auto const &c : batch) {
+        if (c.fresh) {
+          if (_fd >= 0) {
+            if (_opt.sync && !detail::file_sync(_fd)) return false;
+            detail::file_close(_fd);
+          }
+          _fd = detail::file_create(detail::segment_path(_dir, c.seq));
+          if (_fd < 0) return false;
+          segment_header sh{magic, version, snapshot::byte_order_mark, c.first_lsn};
+          if (!detail::file_write(_fd, reinterpret_cast<char const *>(&sh), sizeof(sh))) return false;
+        }
+        if (_fd < 0 || !detail::file_write(_fd, c.bytes.data(), c.bytes.size())) return false;
+      }
+      return !_opt.sync || _fd < 0 || detail::file_sync(_fd);
+    }
+
+  private:
+    std::string _dir{};
+    options _opt{};
+    mutable std::mutex _lock{};
+    std::condition_variable _flushed{};
+    std::vector<chunk> _pending{};
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> _segments{}; // seq, first lsn
+    std::uint64_t _lsn{0}, _durable{0}, _syncs{0};
+    std::uint64_t _next_seq{1}, _fill_seq{0};
+    std::size_t _seg_used{0}, _queued{0};
+    bool _flushing{false}, _failed{false}, _ok{false};
+    int _fd{-1};
+  };
+
+}} // namespace fsm_cxx::journal
+
+// ----------------------------- reader
+namespace fsm_cxx { namespace journal {
+
+  struct entry {
+    record_header h;
+    std::string_view payload;
+    std::string_view event;
+  };
+
+  /**
+   * @brief the records of a journal directory, in lsn order.
+   * @details The segments are mapped and the records decoded in place;
+   * the views of an entry stay valid while the reader lives. Reading
+   * stops at the first record failing its checks, and torn() tells.
+   */
+  class reader {
+  public:
+    explicit reader(std::string const &dir) {
+      for (auto const &[seq, path] : detail::list_segments(dir)) {
+        (void) seq;
+        _files.emplace_back(path);
+      }
+    }
+
+    /**
+     * @brief call fn(entry const &) for the records with an lsn >= from.
+     * @return the number of records visited
+     */
+    template<typename F>
+    std::size_t for_each(F &&fn, std::uint64_t from = 0) {
+      std::size_t count = 0;
+      _torn = false;
+      for (auto const &f : _files) {
+        if (!f) continue;
+        bool torn;
+        auto end = detail::valid_prefix(f.data(), f.size(), _last, torn);
+        for (std::size_t off = sizeof(segment_header); off < end;) {
+          entry e{};
+          std::memcpy(&e.h, f.data() + off, sizeof(e.h));
+          auto const *body = f.data() + off + sizeof(e.h);
+          e.payload = std::string_view{body, e.h.payload_size};
+          e.event = std::string_view{body + e.h.payload_size, e.h.size - e.h.payload_size};
+          off += sizeof(e.h) + e.h.size;
+          if (e.h.lsn < from) continue;
+          fn(static_cast<entry const &>(e));
+          count++;
+        }
+        if (torn) {
+          _torn = true;
+          break;
+        }
+      }
+      return count;
+    }
+
+    bool torn() const { return _torn; }
+    // the lsn of the last valid record seen by for_each()
+    std::uint64_t last_lsn() const { return _last; }
+
+  private:
+    std::vector<util::mapped_file> _files{};
+    std::uint64_t _last{0};
+    bool _torn{false};
+  };
+
+}} // namespace fsm_cxx::journal
+
+// ----------------------------- sink
+namespace fsm_cxx { namespace journal {
+
+  /**
+   * @brief records the transitions of machines into a log.
+   * @details attach() installs the machine's on_commit hook: each
+   * transition appends (instance, event id, state entered, payload and
+   * event bytes). With wait set, step_by() returns only once the record
+   * is durable, before the entry actions run, so that no effect is seen
+   * for a transition the journal could lose; concurrent steps share the
+   * syncs through group commit. Without it the caller commits when it
+   * sees fit, and the log commits on its own when its buffer fills.
+   *
+   * @code{c++}
+   *   journal::codec<M> c;
+   *   c.event<open>().event<close>();
+   *   journal::log lg{"var/journal"};
+   *   journal::sink<M> s{lg, c};
+   *   s.attach(machine, 42);
+   * @endcode
+   */
+  template<typename M>
+  class sink {
+  public:
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Payload = typename M::Payload;
+
+    struct options {
+      bool wait{true};
+    };
+
+    sink(log &l, codec<M> const &c, options const &opt = options{})
+        : _log(l), _codec(c), _opt(opt) {}
+
+    void attach(M &m, std::uint64_t instance) {
+      m.on_commit([this, instance](std::string const &name, Event const &ev, Payload const &payload, State const &, State const &to) {
+        record(instance, name, ev, payload, to);
+      });
+    }
+
+    /**
+     * @brief append one transition. An event the codec does not know is
+     * recorded without its bytes; replay() sets the state it entered.
+     * @return its lsn
+     */
+    std::uint64_t record(std::uint64_t instance, std::string const &event_name, Event const &ev, Payload const &payload, State const &to) {
+      thread_local std::string body;
+      body.clear();
+      record_header h{};
+      h.instance = instance;
+      h.to = state_id(to);
+      h.event = _codec.id_of(event_name);
+      {
+        snapshot::writer w{body, false};
+        detail::field_codec<Payload>::save(payload, w);
+        h.payload_size = static_cast<std::uint32_t>(body.size());
+        if (auto const *e = _codec.at(h.event)) e->save(ev, w);
+      }
+      auto lsn = _log.append(h, body);
+      if (_opt.wait) _log.commit(lsn);
+      return lsn;
+    }
+
+  private:
+    log &_log;
+    codec<M> const &_codec;
+    options _opt;
+  };
+
+}} // namespace fsm_cxx::journal
+
+// ----------------------------- replay, checkpoint, recover
+namespace fsm_cxx { namespace journal {
+
+  struct replay_options {
+    std::size_t threads{0};  // 0 for one per hardware thread
+    std::uint64_t from{0};   // the first lsn to apply
+  };
+
+  struct replay_result {
+    std::uint64_t records{}; // applied, at or after replay_options::from
+    std::uint64_t stepped{}; // re-stepped into the recorded state
+    std::uint64_t forced{};  // set to the recorded state: unknown event, or guards deciding otherwise
+    std::uint64_t last_lsn{};
+    bool torn{};
+  };
+
+  /**
+   * @brief rebuild a pool from a journal.
+   * @details The records are partitioned by instance over the threads,
+   * each thread applying its instances' records in lsn order with the
+   * machines in replaying() mode: guards run, actions do not. A record
+   * whose re-step fails or lands elsewhere, as when a guard reads
+   * context data that only actions maintain, sets the recorded state.
+   * Instances missing from pool are created and passed to init first.
+   */
+  template<typename M>
+  inline replay_result replay(std::string const &dir, codec<M> const &c, std::unordered_map<std::uint64_t, M> &pool,
+                              typename codec<M>::Init const &init, replay_options const &opt = replay_options{}) {
+    using State = typename M::State;
+    using Payload = typename M::Payload;
+    replay_result res;
+    reader rd{dir};
+
+    auto threads = opt.threads ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+    struct job {
+      M *m;
+      entry e;
+    };
+    std::vector<std::vector<job>> parts(threads);
+    rd.for_each([&](entry const &e) {
+      auto [it, fresh] = pool.try_emplace(e.h.instance);
+      if (fresh && init) init(e.h.instance, it->second);
+      auto id = e.h.instance;
+      id ^= id >> 33;
+      id *= 0xff51afd7ed558ccdULL;
+      id ^= id >> 33;
+      parts[id % threads].push_back(job{&it->second, e});
+    },
+                opt.from);
+    res.last_lsn = rd.last_lsn();
+    res.torn = rd.torn();
+
+    std::vector<replay_result> part_res(threads);
+    auto run = [&](std::size_t t) {
+      auto &r = part_res[t];
+      for (auto &j : parts[t]) {
+        auto &m = *j.m;
+        auto was = m.replaying();
+        m.replaying(true);
+        bool ok = false;
+        if (auto const *ev = c.at(j.e.h.event)) {
+          Payload p{};
+          snapshot::reader pr{j.e.payload.data(), j.e.payload.size()};
+          snapshot::reader er{j.e.event.data(), j.e.event.size()};
+          ok = detail::field_codec<Payload>::load(p, pr) && ev->step(m, er, p) && state_id(m.context().current()) == j.e.h.to;
+        }
+        m.replaying(was);
+        if (ok) r.stepped++;
+        else {
+          m.set_current(state_from_id<State>(j.e.h.to));
+          r.forced++;
+        }
+        r.records++;
+      }
+    };
+    if (threads == 1) run(0);
+    else {
+      std::vector<std::thread> ts;
+      for (std::size_t t = 0; t < threads; t++) ts.emplace_back(run, t);
+      for (auto &t : ts) t.join();
+    }
+    for (auto const &r : part_res) {
+      res.records += r.records;
+      res.stepped += r.stepped;
+      res.forced += r.forced;
+    }
+    return res;
+  }
+
+  namespace detail {
+    constexpr std::uint32_t checkpoint_magic = 0x4b4d5346; // "FSMK"
+    struct checkpoint_header {
+      std::uint32_t magic;
+      std::uint32_t reserved;
+      std::uint64_t lsn;
+      std::uint64_t count;
+    };
+  } // namespace detail
+
+  /**
+   * @brief write a pool with the lsn it reflects: the ids of the
+   * instances, then a snapshot of them (see fsm-snapshot.hh). The file
+   * is written aside and renamed into place. Take lsn from
+   * log::last_lsn() while no instance steps.
+   */
+  template<typename M>
+  inline bool checkpoint(std::string const &path, std::unordered_map<std::uint64_t, M> const &pool, std::uint64_t lsn) {
+    std::string out;
+    detail::checkpoint_header ch{detail::checkpoint_magic, 0, lsn, pool.size()};
+    out.append(reinterpret_cast<char const *>(&ch), sizeof(ch));
+    for (auto const &[id, m] : pool) out.append(reinterpret_cast<char const *>(&id), sizeof(id));
+    {
+      snapshot::writer w{out};
+      for (auto const &[id, m] : pool) w.write(m);
+    }
+    auto tmp = path + ".tmp";
+    auto fd = detail::file_create(tmp);
+    if (fd < 0) return false;
+    bool ok = detail::file_write(fd, out.data(), out.size()) && detail::file_sync(fd);
+    detail::file_close(fd);
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    return ok && !ec;
+  }
+
+  /**
+   * @brief rebuild a pool from a checkpoint, if path names one, and the
+   * journal records after it.
+   * @return false if the checkpoint is unreadable
+   */
+  template<typename M>
+  inline bool recover(std::string const &path, std::string const &dir, codec<M> const &c, std::unordered_map<std::uint64_t, M> &pool,
+                      typename codec<M>::Init const &init, replay_result *result = nullptr, replay_options opt = replay_options{}) {
+    std::error_code ec;
+    if (!path.empty() && std::filesystem::exists(path, ec)) {
+      util::mapped_file f{path};
+      detail::checkpoint_header ch{};
+      if (!f || f.size() < sizeof(ch)) return false;
+      std::memcpy(&ch, f.data(), sizeof(ch));
+      auto ids_end = sizeof(ch) + ch.count * sizeof(std::uint64_t);
+      if (ch.magic != detail::checkpoint_magic || f.size() < ids_end) return false;
+      snapshot::view v{f.data() + ids_end, f.size() - ids_end};
+      if (!v.valid()) return false;
+      std::size_t i = 0;
+      for (auto const &rec : v) {
+        if (i == ch.count) break;
+        std::uint64_t id;
+        std::memcpy(&id, f.data() + sizeof(ch) + i++ * sizeof(id), sizeof(id));
+        auto [it, fresh] = pool.try_emplace(id);
+        if (fresh && init) init(id, it->second);
+        if (!snapshot::restore(it->second, rec)) return false;
+      }
+      if (i != ch.count) return false;
+      opt.from = std::max(opt.from, ch.lsn + 1);
+    }
+    auto r = replay(dir, c, pool, init, opt);
+    if (result) *result = r;
+    return true;
+  }
+
+}} // namespace fsm_cxx::journal
+
+#endif // __FSM_CXX_FSM_JOURNAL_HH
@@ -0,0 +1,137 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/12.
+//
+
+#ifndef __FSM_CXX_FSM_MMAP_HH
+#define __FSM_CXX_FSM_MMAP_HH
+
+#include "fsm-assert.hh"
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !OS_WIN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------- mapped_file
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a read-only view of a whole file.
+   * @details On POSIX systems the file is mapped with mmap(2) so that
+   * many processes share the same page-cached copy; elsewhere it falls
+   * back to reading the file into a private buffer.
+   * @code{c++}
+   *   fsm_cxx::util::mapped_file f("states.bin");
+   *   if (f) consume(f.data(), f.size());
+   * @endcode
+   */
+  class mapped_file {
+  public:
+    mapped_file() = default;
+    explicit mapped_file(std::string const &path) { open(path); }
+    ~mapped_file() { close(); }
+    mapped_file(mapped_file const &) = delete;
+    mapped_file &operator=(mapped_file const &) = delete;
+    mapped_file(mapped_file &&o) noexcept { swap(o); }
+    mapped_file &operator=(mapped_file &&o) noexcept {
+      if (this != &o) {
+        close();
+        swap(o);
+      }
+      return (*this);
+    }
+
+    /**
+     * @brief map the file at path, closing any previously opened one.
+     * @return false if the file cannot be opened or mapped
+     */
+    bool open(std::string const &path) {
+      close();
+#if !OS_WIN
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st {};
+      if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+      }
+      _size = static_cast<std::size_t>(st.st_size);
+      if (_size > 0) {
+        void *p = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+          ::close(fd);
+          _size = 0;
+          return false;
+        }
+        _data = static_cast<char const *>(p);
+      }
+      ::close(fd);
+      _ok = true;
+      return true;
+#else
+      std::FILE *fp = std::fopen(path.c_str(), "rb");
+      if (!fp) return false;
+      char chunk[65536];
+      std::size_t n;
+      while ((n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        _buf.insert(_buf.end(), chunk, chunk + n);
+      std::fclose(fp);
+      _data = _buf.data();
+      _size = _buf.size();
+      _ok = true;
+      return true;
+#endif
+    }
+
+    void close() {
+#if !OS_WIN
+      if (_data && _size > 0)
+        ::munmap(const_cast<char *>(_data), _size);
+#else
+      _buf.clear();
+#endif
+      _data = nullptr;
+      _size = 0;
+      _ok = false;
+    }
+
+    char const *data() const { return _data; }
+    std::size_t size() const { return _size; }
+    explicit operator bool() const { return _ok; }
+
+  private:
+    void swap(mapped_file &o) noexcept {
+      std::swap(_data, o._data);
+      std::swap(_size, o._size);
+      std::swap(_ok, o._ok);
+#if OS_WIN
+      std::swap(_buf, o._buf);
+#endif
+    }
+
+  private:
+    char const *_data{nullptr};
+    std::size_t _size{0};
+    bool _ok{false};
+#if OS_WIN
+    std::vector<char> _buf{};
+#endif
+  }; // class mapped_file
+
+} // namespace fsm_cxx::util
+
+#endif // __FSM_CXX_FSM_MMAP_HH
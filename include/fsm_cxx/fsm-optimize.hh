@@ -0,0 +1,309 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/15.
+//
+
+#ifndef __FSM_CXX_FSM_OPTIMIZE_HH
+#define __FSM_CXX_FSM_OPTIMIZE_HH
+
+#include "fsm-frozen.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <vector>
+
+// ----------------------------- optimize
+namespace fsm_cxx { namespace frozen {
+
+  struct optimize_options {
+    enum order_e {
+      Keep,    // keep the freeze() order (by state id)
+      Bfs,     // breadth-first from the initial state
+      Hotness, // most visited first, see hotness
+    };
+    // reorder the slots of exclusive edges by the recorded hits
+    bool apply_profile{true};
+    bool prune_unreachable{true};
+    // opt-in: a merged state is reported as its representative, so
+    // current() and the State passed to guards and actions may differ
+    // from the unoptimized definition
+    bool merge_equivalent{false};
+    order_e order{Bfs};
+    // visit counts per dense state index of the input model, for Hotness
+    std::vector<std::uint64_t> hotness{};
+  };
+
+  struct optimize_report {
+    std::size_t states_before{}, states_after{};
+    std::size_t edges_before{}, edges_after{};
+    std::size_t slots_before{}, slots_after{};
+    std::size_t bytes_before{}, bytes_after{};
+    std::size_t unreachable_states{}; // removed
+    std::size_t dead_slots{};         // shadowed by an unguarded slot, removed
+    std::size_t merged_states{};      // folded into an equivalent state, see merge_equivalent
+    std::size_t reordered_edges{};    // exclusive edges reordered by profile
+
+    friend std::ostream &operator<<(std::ostream &os, optimize_report const &r) {
+      return os << "states " << r.states_before << " -> " << r.states_after
+                << ", edges " << r.edges_before << " -> " << r.edges_after
+                << ", slots " << r.slots_before << " -> " << r.slots_after
+                << ", bytes " << r.bytes_before << " -> " << r.bytes_after
+                << " (unreachable " << r.unreachable_states << ", merged " << r.merged_states
+                << ", dead slots " << r.dead_slots << ", reordered " << r.reordered_edges << ")"
+                << (r.merged_states ? ", merged states report their representative" : "");
+    }
+  };
+
+  namespace detail {
+    inline std::size_t edge_count(model const &m) {
+      std::size_t n = 0;
+      for (auto const &s : m.states) n += s.edges.size();
+      return n;
+    }
+
+    inline std::vector<std::uint32_t> roots_of(model const &m) {
+      std::vector<std::uint32_t> roots;
+      for (auto r : {m.initial, m.terminated, m.error})
+        if (r != npos) roots.push_back(r);
+      return roots;
+    }
+
+    // breadth-first order from the roots; unreachable states are left out
+    inline std::vector<std::uint32_t> bfs_order(model const &m) {
+      std::vector<std::uint32_t> order;
+      std::vector<char> seen(m.states.size(), 0);
+      std::deque<std::uint32_t> q;
+      for (auto r : roots_of(m))
+        if (!seen[r]) seen[r] = 1, q.push_back(r);
+      while (!q.empty()) {
+        auto s = q.front();
+        q.pop_front();
+        order.push_back(s);
+        for (auto const &e : m.states[s].edges)
+          for (auto const &sl : e.slots)
+            if (!seen[sl.to]) seen[sl.to] = 1, q.push_back(sl.to);
+      }
+      return order;
+    }
+
+    // keep the states listed in order, renumbered as listed; old indices
+    // missing from map (npos) must not be referenced any more
+    inline void renumber(model &m, std::vector<std::uint32_t> const &order, std::vector<std::uint32_t> const &map) {
+      std::vector<model::state> states;
+      states.reserve(order.size());
+      for (auto s : order) {
+        states.push_back(std::move(m.states[s]));
+        for (auto &e : states.back().edges)
+          for (auto &sl : e.slots) sl.to = map[sl.to];
+      }
+      m.states = std::move(states);
+      for (auto *r : {&m.initial, &m.terminated, &m.error})
+        if (*r != npos) *r = map[*r];
+    }
+
+    // drop the events and names nothing refers to any more
+    inline void compact_names(model &m) {
+      std::vector<std::uint32_t> used_events(m.events.size(), 0);
+      for (auto const &s : m.states)
+        for (auto const &e : s.edges) used_events[e.event] = 1;
+      std::vector<std::uint32_t> used_names(m.names.size(), 0);
+      auto use = [&used_names](std::uint32_t n) { if (n != npos) used_names[n] = 1; };
+      for (std::size_t i = 0; i < m.events.size(); i++)
+        if (used_events[i]) use(m.events[i]);
+      for (auto const &s : m.states) {
+        use(s.entry), use(s.exit);
+        for (auto g : s.guards) use(g);
+        for (auto const &e : s.edges)
+          for (auto const &sl : e.slots) use(sl.guard), use(sl.entry), use(sl.exit);
+      }
+
+      std::vector<std::uint32_t> name_map(m.names.size(), npos);
+      std::vector<std::string> names;
+      for (std::size_t i = 0; i < m.names.size(); i++)
+        if (used_names[i]) name_map[i] = static_cast<std::uint32_t>(names.size()), names.push_back(std::move(m.names[i]));
+      std::vector<std::uint32_t> event_map(m.events.size(), npos);
+      std::vector<std::uint32_t> events;
+      for (std::size_t i = 0; i < m.events.size(); i++)
+        if (used_events[i]) event_map[i] = static_cast<std::uint32_t>(events.size()), events.push_back(name_map[m.events[i]]);
+
+      auto remap = [&name_map](std::uint32_t &n) { if (n != npos) n = name_map[n]; };
+      for (auto &s : m.states) {
+        remap(s.entry), remap(s.exit);
+        for (auto &g : s.guards) remap(g);
+        for (auto &e : s.edges) {
+          e.event = event_map[e.event];
+          for (auto &sl : e.slots) remap(sl.guard), remap(sl.entry), remap(sl.exit);
+        }
+      }
+      m.names = std::move(names);
+      m.events = std::move(events);
+    }
+  } // namespace detail
+
+  /**
+   * @brief move the most matched slots to the front of each exclusive edge.
+   * @details Only edges whose slots were all declared exclusive are
+   * touched, since for those at most one guard can pass and the order of
+   * evaluation cannot change the outcome. The hits come from the
+   * adaptive mode of machine_t (see machine_t::adaptive()) and are
+   * captured by freeze(). The sort is stable, so an edge without a
+   * profile keeps its order.
+   * @return the number of edges whose order changed
+   */
+  inline std::size_t order_by_profile(model &m) {
+    std::size_t n = 0;
+    for (auto &s : m.states) {
+      for (auto &e : s.edges) {
+        if (!(e.flags & edge_exclusive) || e.slots.size() < 2) continue;
+        auto hotter = [](model::slot const &a, model::slot const &b) { return a.hits > b.hits; };
+        if (std::is_sorted(e.slots.begin(), e.slots.end(), hotter)) continue;
+        std::stable_sort(e.slots.begin(), e.slots.end(), hotter);
+        n++;
+      }
+    }
+    return n;
+  }
+
+  /**
+   * @brief shrink a frozen model without changing what it dispatches.
+   * @details The passes are, in order:
+   *   - exclusive edges are reordered by the recorded profile, see
+   *     order_by_profile();
+   *   - slots that follow an unguarded slot of the same edge can never
+   *     be chosen and are removed;
+   *   - states unreachable from the initial, terminated and error states
+   *     are removed;
+   *   - if merge_equivalent is set, states with the same actions, guards
+   *     and equivalent transitions (the coarsest such partition, computed
+   *     by refinement) are merged into one; the special states are never
+   *     merged;
+   *   - states are renumbered breadth-first or by hotness, so that the
+   *     states visited together sit together in the table.
+   *
+   * Every event sequence accepted by the input is accepted by the output
+   * with the same guards and actions invoked in the same order and, by
+   * default, the same states. Only merging changes the states: a merged
+   * state is reported as its representative, i.e. the one with the
+   * smallest index among its class.
+   */
+  inline optimize_report optimize(model &m, optimize_options const &opt = {}) {
+    optimize_report r;
+    r.states_before = m.states.size();
+    r.edges_before = detail::edge_count(m);
+    r.slots_before = m.slot_count();
+    r.bytes_before = m.serialize().size();
+
+    if (opt.apply_profile)
+      r.reordered_edges = order_by_profile(m);
+
+    for (auto &s : m.states) {
+      for (auto &e : s.edges) {
+        auto it = std::find_if(e.slots.begin(), e.slots.end(), [](model::slot const &sl) { return sl.guard == npos; });
+        if (it != e.slots.end() && it + 1 != e.slots.end()) {
+          r.dead_slots += static_cast<std::size_t>(e.slots.end() - (it + 1));
+          e.slots.erase(it + 1, e.slots.end());
+        }
+      }
+    }
+
+    auto const n = static_cast<std::uint32_t>(m.states.size());
+    std::vector<std::uint64_t> hot = opt.hotness;
+    hot.resize(n, 0);
+
+    if (opt.prune_unreachable) {
+      auto order = detail::bfs_order(m);
+      std::sort(order.begin(), order.end());
+      std::vector<std::uint32_t> map(n, npos);
+      std::vector<std::uint64_t> h;
+      for (std::uint32_t i = 0; i < order.size(); i++) map[order[i]] = i, h.push_back(hot[order[i]]);
+      r.unreachable_states = n - order.size();
+      detail::renumber(m, order, map);
+      hot = std::move(h);
+    }
+
+    if (opt.merge_equivalent && !m.states.empty()) {
+      auto const k = static_cast<std::uint32_t>(m.states.size());
+      std::vector<std::uint32_t> cls(k, 0);
+      // initial partition: what a state does by itself
+      {
+        std::map<std::vector<std::uint32_t>, std::uint32_t> keys;
+        for (std::uint32_t i = 0; i < k; i++) {
+          auto const &s = m.states[i];
+          std::vector<std::uint32_t> key{s.entry, s.exit, s.flags};
+          key.insert(key.end(), s.guards.begin(), s.guards.end());
+          if (i == m.initial || i == m.terminated || i == m.error) key.push_back(npos - 1), key.push_back(i);
+          cls[i] = keys.emplace(key, static_cast<std::uint32_t>(keys.size())).first->second;
+        }
+      }
+      // refine by where the transitions lead, until stable
+      for (std::size_t classes = 0;;) {
+        std::map<std::vector<std::uint32_t>, std::uint32_t> keys;
+        std::vector<std::uint32_t> next(k);
+        for (std::uint32_t i = 0; i < k; i++) {
+          auto const &s = m.states[i];
+          std::vector<model::edge const *> edges;
+          for (auto const &e : s.edges) edges.push_back(&e);
+          std::sort(edges.begin(), edges.end(), [](model::edge const *a, model::edge const *b) { return a->event < b->event; });
+          std::vector<std::uint32_t> key{cls[i]};
+          for (auto e : edges) {
+            key.insert(key.end(), {e->event, e->flags, static_cast<std::uint32_t>(e->slots.size())});
+            for (auto const &sl : e->slots) key.insert(key.end(), {cls[sl.to], sl.guard, sl.entry, sl.exit});
+          }
+          next[i] = keys.emplace(key, static_cast<std::uint32_t>(keys.size())).first->second;
+        }
+        cls = std::move(next);
+        if (keys.size() == classes) break;
+        classes = keys.size();
+      }
+
+      std::vector<std::uint32_t> rep(k, npos), order, map(k);
+      for (std::uint32_t i = 0; i < k; i++)
+        if (rep[cls[i]] == npos) rep[cls[i]] = i, order.push_back(i);
+      std::vector<std::uint32_t> slot_of(k);
+      for (std::uint32_t i = 0; i < order.size(); i++) slot_of[order[i]] = i;
+      std::vector<std::uint64_t> h(order.size(), 0);
+      for (std::uint32_t i = 0; i < k; i++) {
+        map[i] = slot_of[rep[cls[i]]];
+        h[map[i]] += hot[i];
+      }
+      r.merged_states = k - order.size();
+      detail::renumber(m, order, map);
+      hot = std::move(h);
+    }
+
+    if (opt.order != optimize_options::Keep) {
+      auto order = detail::bfs_order(m);
+      if (order.size() != m.states.size()) { // pruning disabled: keep the rest at the end
+        std::vector<char> seen(m.states.size(), 0);
+        for (auto s : order) seen[s] = 1;
+        for (std::uint32_t i = 0; i < m.states.size(); i++)
+          if (!seen[i]) order.push_back(i);
+      }
+      if (opt.order == optimize_options::Hotness)
+        std::stable_sort(order.begin(), order.end(), [&hot](std::uint32_t a, std::uint32_t b) { return hot[a] > hot[b]; });
+      std::vector<std::uint32_t> map(m.states.size());
+      for (std::uint32_t i = 0; i < order.size(); i++) map[order[i]] = i;
+      detail::renumber(m, order, map);
+    }
+
+    detail::compact_names(m);
+
+    r.states_after = m.states.size();
+    r.edges_after = detail::edge_count(m);
+    r.slots_after = m.slot_count();
+    r.bytes_after = m.serialize().size();
+    return r;
+  }
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_OPTIMIZE_HH
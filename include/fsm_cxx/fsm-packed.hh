@@ -0,0 +1,167 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#ifndef __FSM_CXX_FSM_PACKED_HH
+#define __FSM_CXX_FSM_PACKED_HH
+
+#include "fsm-frozen.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// ----------------------------- packed_pool
+namespace fsm_cxx { namespace frozen {
+
+  namespace detail {
+    // the bits per packed state for an enum with count values
+    constexpr unsigned packed_bits(std::size_t count) {
+      return count <= 16 ? 4 : count <= 256 ? 8 : 16;
+    }
+
+    template<typename Context, typename Slot, typename = void>
+    struct slot_binder {
+      static void bind(Context &, Slot &) {}
+    };
+    template<typename Context, typename Slot>
+    struct slot_binder<Context, Slot, std::void_t<decltype(std::declval<Context &>().bind_slot(std::declval<Slot &>()))>> {
+      static void bind(Context &c, Slot &s) { c.bind_slot(s); }
+    };
+
+    struct no_slot {};
+  } // namespace detail
+
+  /**
+   * @brief a pool of instances kept as packed state indices.
+   * @details An instance is its dense state index in the definition,
+   * packed in 4, 8 or 16 bits according to the __COUNT of the state
+   * enum, so that 100M instances of a machine with up to 16 states take
+   * 50MB. An optional Slot, a trivially copyable struct, gives each
+   * instance a fixed-size user context kept in a parallel slab.
+   *
+   * Steps run through definition::step() on a scratch Context shared by
+   * the pool, set to the instance's state first. Guards and actions that
+   * need the per-instance data reach it through the context: when
+   * Context has a member bind_slot(Slot &), it is called before each
+   * step with the slot of the instance being stepped.
+   *
+   * A pool is not thread-safe: its instances share words and the
+   * scratch context.
+   *
+   * @tparam M the machine_t the definition was frozen from
+   * @tparam Slot void, or the per-instance fixed-size data
+   */
+  template<typename M, typename Slot = void>
+  class packed_pool {
+  public:
+    using Definition = definition<M>;
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+    using Enum = std::decay_t<decltype(std::declval<State>().t)>;
+    using SlotT = std::conditional_t<std::is_void<Slot>::value, detail::no_slot, Slot>;
+
+    static constexpr unsigned bits = detail::packed_bits(static_cast<std::size_t>(Enum::__COUNT));
+    static constexpr unsigned per_word = 64 / bits;
+    static constexpr std::uint64_t field = (std::uint64_t{1} << bits) - 1;
+    static_assert(std::is_void<Slot>::value || std::is_trivially_copyable<Slot>::value, "Slot must be trivially copyable");
+
+    explicit packed_pool(std::shared_ptr<Definition const> def, std::size_t n = 0)
+        : _def(std::move(def)) {
+      resize(n);
+    }
+
+    /**
+     * @brief grow or shrink to n instances; new ones are at the initial
+     * state with a value-initialized slot.
+     */
+    void resize(std::size_t n) {
+      // a shrink clears the tail of its last word, for a later growth
+      for (auto i = n; i < std::min(_n, (n + per_word - 1) / per_word * per_word); i++) state_index(i, 0);
+      auto old = _n;
+      _words.resize((n + per_word - 1) / per_word, 0);
+      if constexpr (!std::is_void<Slot>::value) _slab.resize(n);
+      _n = n;
+      auto init = _def->initial();
+      if (init == 0 || n <= old) return;
+      std::uint64_t pattern = 0;
+      for (unsigned k = 0; k < per_word; k++) pattern |= std::uint64_t{init} << (k * bits);
+      auto i = old;
+      for (; i < n && i % per_word; i++) state_index(i, init);
+      for (; i + per_word <= n; i += per_word) _words[i / per_word] = pattern;
+      for (; i < n; i++) state_index(i, init);
+    }
+    std::size_t size() const { return _n; }
+    // the memory held by the states and slots
+    std::size_t bytes() const {
+      if constexpr (std::is_void<Slot>::value) return _words.capacity() * sizeof(std::uint64_t);
+      else return _words.capacity() * sizeof(std::uint64_t) + _slab.capacity() * sizeof(Slot);
+    }
+    Definition const &def() const { return *_def; }
+
+    std::uint32_t state_index(std::size_t i) const {
+      return static_cast<std::uint32_t>(_words[i / per_word] >> (i % per_word * bits) & field);
+    }
+    void state_index(std::size_t i, std::uint32_t s) {
+      auto &w = _words[i / per_word];
+      auto sh = i % per_word * bits;
+      w = (w & ~(field << sh)) | (std::uint64_t{s} & field) << sh;
+    }
+    State const &current(std::size_t i) const { return _def->state(state_index(i)); }
+
+    template<typename T = Slot, std::enable_if_t<!std::is_void<T>::value, bool> = true>
+    T &slot(std::size_t i) { return _slab[i]; }
+    template<typename T = Slot, std::enable_if_t<!std::is_void<T>::value, bool> = true>
+    T const &slot(std::size_t i) const { return _slab[i]; }
+
+    /**
+     * @brief dispatch one event on instance i.
+     * @param event the dense event index, see view::event_index()
+     */
+    bool step_by(std::size_t i, std::uint32_t event, Event const &ev, Payload const &payload = Payload{}, Reason *reason = nullptr) {
+      auto cur = state_index(i);
+      _ctx.current(_def->state(cur));
+      if constexpr (!std::is_void<Slot>::value) detail::slot_binder<Context, Slot>::bind(_ctx, _slab[i]);
+      if (!_def->step(cur, event, ev, _ctx, payload, reason)) return false;
+      state_index(i, cur);
+      return true;
+    }
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value, bool> = true>
+    bool step_by(std::size_t i, Evt const &ev, Payload const &payload = Payload{}) {
+      return step_by(i, _def->table().template event_index<Evt>(), ev, payload);
+    }
+
+    /**
+     * @brief dispatch one event on every instance.
+     * @return the number of instances that moved
+     */
+    std::size_t step_all(std::uint32_t event, Event const &ev, Payload const &payload = Payload{}) {
+      std::size_t moved = 0;
+      for (std::size_t i = 0; i < _n; i++) moved += step_by(i, event, ev, payload);
+      return moved;
+    }
+
+  private:
+    std::shared_ptr<Definition const> _def;
+    std::vector<std::uint64_t> _words{};
+    std::vector<SlotT> _slab{};
+    std::size_t _n{0};
+    Context _ctx{};
+  };
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_PACKED_HH
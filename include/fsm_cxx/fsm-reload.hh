@@ -0,0 +1,346 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/16.
+//
+
+#ifndef __FSM_CXX_FSM_RELOAD_HH
+#define __FSM_CXX_FSM_RELOAD_HH
+
+#include "fsm-frozen.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// ----------------------------- epoch_domain
+namespace fsm_cxx::util {
+
+  /**
+   * @brief epoch-based reclamation for read-mostly shared objects.
+   * @details Readers pin the domain around each access to a shared
+   * pointer; a writer unlinks an object, then retires it with a deleter.
+   * A retired object is deleted once every reader pinned at the time of
+   * its retirement has unpinned. Pinning is wait-free: two atomic stores
+   * on a per-thread record plus a load of the global epoch. Retiring
+   * and collecting take a mutex, they are for the rare writers.
+   *
+   * Each thread gets a record on its first pin() in a domain; records
+   * are reused after their thread exits and are never freed before the
+   * domain is.
+   */
+  class epoch_domain {
+    struct alignas(64) record {
+      std::atomic<std::uint64_t> epoch{0}; // 0 when not pinned
+      std::atomic<bool> taken{true};
+      unsigned depth{0}; // nested pins, owner thread only
+      record *next{nullptr};
+    };
+    struct retired {
+      std::uint64_t epoch;
+      std::function<void()> deleter;
+    };
+    struct shared {
+      std::atomic<std::uint64_t> global{1};
+      std::atomic<record *> head{nullptr};
+      std::mutex lock{};
+      std::vector<retired> garbage{};
+
+      ~shared() {
+        for (auto &g : garbage) g.deleter();
+        for (auto *r = head.load(); r;) {
+          auto *n = r->next;
+          delete r;
+          r = n;
+        }
+      }
+      record *acquire() {
+        for (auto *r = head.load(std::memory_order_acquire); r; r = r->next) {
+          bool expected = false;
+          if (!r->taken.load(std::memory_order_relaxed) && r->taken.compare_exchange_strong(expected, true))
+            return r;
+        }
+        auto *r = new record;
+        r->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+        return r;
+      }
+    };
+
+  public:
+    epoch_domain()
+        : _s(std::make_shared<shared>()) {}
+    ~epoch_domain() = default;
+    epoch_domain(epoch_domain const &) = delete;
+    epoch_domain &operator=(epoch_domain const &) = delete;
+
+    class guard {
+    public:
+      guard(guard const &) = delete;
+      guard &operator=(guard const &) = delete;
+      ~guard() {
+        if (--_r->depth == 0) _r->epoch.store(0, std::memory_order_release);
+      }
+
+    private:
+      friend class epoch_domain;
+      explicit guard(record *r)
+          : _r(r) {}
+      record *_r;
+    };
+
+    /**
+     * @brief protect the shared pointers loaded until the guard dies.
+     */
+    guard pin() {
+      auto *r = _record();
+      if (r->depth++ == 0)
+        r->epoch.store(_s->global.load(std::memory_order_acquire), std::memory_order_seq_cst);
+      return guard{r};
+    }
+
+    /**
+     * @brief delete p once no reader can see it any more. The caller must
+     * have unlinked p before retiring it.
+     */
+    template<typename T>
+    void retire(T const *p) {
+      retire([p]() { delete p; });
+    }
+    void retire(std::function<void()> deleter) {
+      auto e = _s->global.fetch_add(1, std::memory_order_seq_cst);
+      {
+        std::lock_guard<std::mutex> lk(_s->lock);
+        _s->garbage.push_back(retired{e, std::move(deleter)});
+      }
+      collect();
+    }
+
+    /**
+     * @brief delete what no pinned reader can see.
+     * @return the number of objects still waiting
+     */
+    std::size_t collect() {
+      auto oldest = _s->global.load(std::memory_order_seq_cst);
+      for (auto *r = _s->head.load(std::memory_order_acquire); r; r = r->next) {
+        auto e = r->epoch.load(std::memory_order_seq_cst);
+        if (e && e < oldest) oldest = e;
+      }
+      std::vector<retired> ready;
+      std::size_t left;
+      {
+        std::lock_guard<std::mutex> lk(_s->lock);
+        auto &g = _s->garbage;
+        auto it = std::stable_partition(g.begin(), g.end(), [oldest](retired const &x) { return x.epoch >= oldest; });
+        std::move(it, g.end(), std::back_inserter(ready));
+        g.erase(it, g.end());
+        left = g.size();
+      }
+      for (auto &x : ready) x.deleter();
+      return left;
+    }
+
+  private:
+    record *_record() {
+      // the records of this thread, released when the thread exits
+      struct owned {
+        std::vector<std::pair<std::weak_ptr<shared>, record *>> v;
+        ~owned() {
+          for (auto &[s, r] : v)
+            if (auto alive = s.lock()) r->taken.store(false, std::memory_order_release);
+        }
+      };
+      thread_local owned mine;
+      for (auto &[s, r] : mine.v)
+        if (!s.owner_before(_s) && !_s.owner_before(s)) return r;
+      // forget the records of dead domains before growing
+      mine.v.erase(std::remove_if(mine.v.begin(), mine.v.end(), [](auto const &x) { return x.first.expired(); }), mine.v.end());
+      auto *r = _s->acquire();
+      mine.v.emplace_back(_s, r);
+      return r;
+    }
+
+  private:
+    std::shared_ptr<shared> _s;
+  };
+
+} // namespace fsm_cxx::util
+
+// ----------------------------- live definitions
+namespace fsm_cxx { namespace frozen {
+
+  /**
+   * @brief the published version of a definition, swapped under load.
+   * @details Readers dispatch on whatever version is current when their
+   * step begins and finish the step on it, without locking; publish()
+   * swaps in a new version atomically and hands the old one to the
+   * epoch domain, which releases it once the steps in flight are done.
+   * Definitions are immutable, so a version never changes under a
+   * reader. See live_instance for the instances that follow it.
+   */
+  template<typename M>
+  class live {
+  public:
+    using Definition = definition<M>;
+
+    struct version {
+      std::shared_ptr<Definition const> def;
+      std::uint64_t number;
+    };
+
+    live() = default;
+    explicit live(std::shared_ptr<Definition const> def) { publish(std::move(def)); }
+    ~live() {
+      delete _cur.load(std::memory_order_acquire);
+    }
+    live(live const &) = delete;
+    live &operator=(live const &) = delete;
+
+    /**
+     * @brief make def the current version.
+     * @return its version number, starting from 1
+     */
+    std::uint64_t publish(std::shared_ptr<Definition const> def) {
+      std::lock_guard<std::mutex> lk(_publishing);
+      auto *v = new version{std::move(def), ++_published};
+      auto *old = _cur.exchange(v, std::memory_order_seq_cst);
+      if (old) _domain.retire(old);
+      return v->number;
+    }
+
+    /**
+     * @brief the current version; valid while the guard g is alive.
+     */
+    version const *acquire(util::epoch_domain::guard const &g) const {
+      (void) g;
+      return _cur.load(std::memory_order_seq_cst);
+    }
+    util::epoch_domain::guard pin() const { return _domain.pin(); }
+
+    /**
+     * @brief a counted reference to the current definition, for the
+     * callers that keep it beyond one step.
+     */
+    std::shared_ptr<Definition const> current() const {
+      auto g = pin();
+      auto *v = acquire(g);
+      return v ? v->def : nullptr;
+    }
+    std::uint64_t number() const {
+      auto g = pin();
+      auto *v = acquire(g);
+      return v ? v->number : 0;
+    }
+
+    /**
+     * @brief release the retired versions no step uses any more.
+     * @return the number of versions still retained
+     */
+    std::size_t collect() { return _domain.collect(); }
+
+  private:
+    mutable util::epoch_domain _domain{};
+    std::atomic<version *> _cur{nullptr};
+    std::mutex _publishing{};
+    std::uint64_t _published{0};
+  };
+
+  /**
+   * @brief an instance following the current version of a live
+   * definition.
+   * @details The instance remembers its state by id, which is stable
+   * across versions, and caches the dense index of the version it last
+   * ran on. The first step after a publish rebases it on the new
+   * version; if the new version has no such state, the step fails with
+   * Reason::StateNotFound until the instance is reset() or moved with
+   * current_id().
+   *
+   * An instance is not itself thread-safe: like machine_t, one thread
+   * steps it at a time. Many instances on many threads share a live<>.
+   */
+  template<typename M>
+  class live_instance {
+  public:
+    using Live = live<M>;
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+
+    // l must have a published version
+    explicit live_instance(Live &l)
+        : _live(l) { reset(); }
+
+    live_instance &reset() {
+      auto g = _live.pin();
+      auto *v = _live.acquire(g);
+      auto const &d = *v->def;
+      _version = v->number;
+      _cur = d.initial();
+      _id = d.table().state(_cur).id;
+      _ctx.reset(d.state(_cur));
+      return (*this);
+    }
+
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value, bool> = true>
+    bool step_by(Evt const &ev, Payload const &payload = Payload{}, Reason *reason = nullptr) {
+      auto g = _live.pin();
+      auto *v = _live.acquire(g);
+      if (!_rebase(*v)) {
+        if (reason) *reason = Reason::StateNotFound;
+        return false;
+      }
+      auto const &d = *v->def;
+      if (!d.step(_cur, d.table().template event_index<Evt>(), ev, _ctx, payload, reason))
+        return false;
+      _id = d.table().state(_cur).id;
+      return true;
+    }
+
+    /**
+     * @brief the raw value of the current state, see state_id().
+     */
+    std::uint32_t current_id() const { return _id; }
+    void current_id(std::uint32_t id) {
+      _id = id;
+      _version = 0; // rebase on the next step
+      _ctx.current(state_from_id<State>(id));
+    }
+    State current() const { return state_from_id<State>(_id); }
+    std::uint64_t version() const { return _version; }
+    Context &context() { return _ctx; }
+    Context const &context() const { return _ctx; }
+
+  private:
+    bool _rebase(typename Live::version const &v) {
+      if (v.number == _version) return true;
+      auto i = v.def->table().state_index(_id);
+      if (i == npos) return false;
+      _cur = i;
+      _version = v.number;
+      return true;
+    }
+
+  private:
+    Live &_live;
+    std::uint64_t _version{0};
+    std::uint32_t _cur{npos};
+    std::uint32_t _id{0};
+    Context _ctx{};
+  };
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_RELOAD_HH
@@ -0,0 +1,115 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_SEQLOCK_HH
+#define __FSM_CXX_FSM_SEQLOCK_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// ----------------------------- seqlock
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a value of any trivially copyable type, written rarely and
+   * read often, without the readers ever blocking the writers.
+   * @details A write makes the sequence odd, stores the value, then makes
+   * the sequence even again; writers are serialized by taking the
+   * sequence from even to odd with a compare-and-swap. A read loads the
+   * sequence, copies the value, and retries if the sequence was odd or
+   * has changed in the meantime. The value lives in relaxed atomic words,
+   * so that a read racing with a write is torn, then discarded, rather
+   * than undefined.
+   */
+  template<typename T>
+  class seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "a seqlock holds a trivially copyable type");
+    static constexpr std::size_t words = (sizeof(T) + 7) / 8;
+
+  public:
+    seqlock() { store(T{}); }
+    explicit seqlock(T const &v) { store(v); }
+    seqlock(seqlock const &o) { store(o.read()); }
+    seqlock &operator=(seqlock const &o) {
+      if (this != &o) write(o.read());
+      return (*this);
+    }
+
+    void write(T const &v) {
+      update([&v](T &o) { o = v; });
+    }
+    // a write of f applied to the value, as one
+    template<typename F>
+    void update(F &&f) {
+      auto s = _seq.load(std::memory_order_relaxed);
+      for (;;) {
+        if (s & 1) {
+          std::this_thread::yield();
+          s = _seq.load(std::memory_order_relaxed);
+        } else if (_seq.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed))
+          break;
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      T v = load();
+      f(v);
+      store(v);
+      _seq.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief one attempt at a consistent read.
+     * @return false if a write was in progress
+     */
+    bool try_read(T &out, std::uint64_t *seq = nullptr) const {
+      auto s1 = _seq.load(std::memory_order_acquire);
+      if (s1 & 1) return false;
+      auto v = load();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) != s1) return false;
+      out = v;
+      if (seq) *seq = s1 / 2;
+      return true;
+    }
+    // retry until consistent
+    T read(std::uint64_t *seq = nullptr) const {
+      T v;
+      for (unsigned spins = 0; !try_read(v, seq); spins++)
+        if (spins >= 64) std::this_thread::yield();
+      return v;
+    }
+
+    // the number of writes so far
+    std::uint64_t sequence() const { return _seq.load(std::memory_order_acquire) / 2; }
+
+  private:
+    void store(T const &v) {
+      std::uint64_t buf[words]{};
+      std::memcpy(buf, &v, sizeof(T));
+      for (std::size_t i = 0; i < words; i++) _w[i].store(buf[i], std::memory_order_relaxed);
+    }
+    T load() const {
+      std::uint64_t buf[words];
+      for (std::size_t i = 0; i < words; i++) buf[i] = _w[i].load(std::memory_order_relaxed);
+      T v;
+      std::memcpy(&v, buf, sizeof(T));
+      return v;
+    }
+
+    std::atomic<std::uint64_t> _seq{0};
+    std::atomic<std::uint64_t> _w[words];
+  };
+
+} // namespace fsm_cxx::util
+
+#endif // __FSM_CXX_FSM_SEQLOCK_HH
@@ -0,0 +1,288 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#ifndef __FSM_CXX_FSM_SHARD_HH
+#define __FSM_CXX_FSM_SHARD_HH
+
+#include "fsm-assert.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// ----------------------------- mpsc_ring
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a bounded lock-free queue for many producers and one consumer.
+   * @details Each cell carries a sequence number telling whether it is
+   * free for the producer of a given position or full for the consumer
+   * (D. Vyukov's bounded queue). Producers claim a position with one CAS;
+   * the consumer never writes shared counters except its own head.
+   * @tparam T a movable type
+   */
+  template<typename T>
+  class mpsc_ring {
+    struct cell {
+      std::atomic<std::size_t> seq;
+      T value;
+    };
+
+  public:
+    // capacity is rounded up to a power of two
+    explicit mpsc_ring(std::size_t capacity = 4096) {
+      std::size_t n = 2;
+      while (n < capacity) n <<= 1;
+      _mask = n - 1;
+      _cells.reset(new cell[n]);
+      for (std::size_t i = 0; i < n; i++) _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mpsc_ring(mpsc_ring const &) = delete;
+    mpsc_ring &operator=(mpsc_ring const &) = delete;
+
+    std::size_t capacity() const { return _mask + 1; }
+
+    // false when full
+    bool try_push(T &&v) {
+      auto pos = _tail.load(std::memory_order_relaxed);
+      for (;;) {
+        auto &c = _cells[pos & _mask];
+        auto seq = c.seq.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+          if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            c.value = std::move(v);
+            c.seq.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0)
+          return false;
+        else
+          pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+
+    // the single consumer only; false when empty
+    bool try_pop(T &out) {
+      auto &c = _cells[_head & _mask];
+      if (c.seq.load(std::memory_order_acquire) != _head + 1) return false;
+      out = std::move(c.value);
+      c.seq.store(_head + _mask + 1, std::memory_order_release);
+      _head++;
+      return true;
+    }
+
+  private:
+    std::unique_ptr<cell[]> _cells;
+    std::size_t _mask{};
+    alignas(64) std::atomic<std::size_t> _tail{0};
+    alignas(64) std::size_t _head{0};
+  };
+
+  // pin the calling thread to one cpu; false where unsupported
+  inline bool pin_to_cpu(unsigned cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+  }
+
+} // namespace fsm_cxx::util
+
+// ----------------------------- sharded_executor
+namespace fsm_cxx {
+
+  /**
+   * @brief runs machine instances on a fixed set of shard threads.
+   * @details Instance ids are hashed to a shard; the shard thread owns
+   * its instances (created on the first message by the factory) and is
+   * the only one to touch them, so they need no MutexT. Any thread may
+   * post(); a message travels through the lock-free inbox of the owning
+   * shard, and the messages for one instance are handled in the order a
+   * single producer posted them.
+   *
+   * @code{c++}
+   *   using M = fsm_cxx::machine_t<my_state>;   // MutexT = void
+   *   struct msg { int kind; };
+   *   fsm_cxx::sharded_executor<M, msg> ex{
+   *       [](std::uint64_t id, M &m) { define(m); },
+   *       [](std::uint64_t id, M &m, msg &e) { e.kind ? m.step_by(open{}) : m.step_by(close{}); }};
+   *   ex.post(42, msg{1});
+   *   ex.drain();
+   * @endcode
+   *
+   * @tparam Instance default constructible, e.g. a machine_t
+   * @tparam Msg what is posted, moved through the inbox
+   */
+  template<typename Instance, typename Msg>
+  class sharded_executor {
+  public:
+    using Init = std::function<void(std::uint64_t id, Instance &)>;
+    using Handler = std::function<void(std::uint64_t id, Instance &, Msg &)>;
+
+    struct options {
+      std::size_t shards{0};           // 0 for one per hardware thread
+      std::size_t inbox_capacity{4096}; // per shard
+      bool pin{true};                   // pin shard i to cpu i
+      std::size_t batch{256};           // messages handled between polls of stop
+    };
+
+    sharded_executor(Init init, Handler handler, options const &opt = options{})
+        : _init(std::move(init)), _handler(std::move(handler)), _opt(opt) {
+      auto n = opt.shards ? opt.shards : std::max(1u, std::thread::hardware_concurrency());
+      _shards.reserve(n);
+      for (std::size_t i = 0; i < n; i++) _shards.emplace_back(std::make_unique<shard>(opt.inbox_capacity));
+      for (std::size_t i = 0; i < n; i++) _shards[i]->thread = std::thread([this, i]() { _run(i); });
+    }
+    ~sharded_executor() { stop(); }
+    sharded_executor(sharded_executor const &) = delete;
+    sharded_executor &operator=(sharded_executor const &) = delete;
+
+    std::size_t shard_count() const { return _shards.size(); }
+    std::size_t shard_of(std::uint64_t id) const {
+      // a 64-bit mix, so that sequential ids spread evenly
+      id ^= id >> 33;
+      id *= 0xff51afd7ed558ccdULL;
+      id ^= id >> 33;
+      return static_cast<std::size_t>(id % _shards.size());
+    }
+
+    /**
+     * @brief queue msg for the instance id.
+     * @return false if the inbox of its shard is full
+     */
+    bool try_post(std::uint64_t id, Msg msg) {
+      auto &s = *_shards[shard_of(id)];
+      if (!s.inbox.try_push(envelope{id, std::move(msg)})) return false;
+      s.posted.fetch_add(1, std::memory_order_release);
+      return true;
+    }
+    // as try_post(), waiting while the inbox is full
+    void post(std::uint64_t id, Msg msg) {
+      auto &s = *_shards[shard_of(id)];
+      envelope e{id, std::move(msg)};
+      for (unsigned spins = 0; !s.inbox.try_push(std::move(e)); spins++)
+        if (spins > 64) std::this_thread::yield();
+      s.posted.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief wait until every message posted before the call is handled.
+     */
+    void drain() {
+      for (auto &s : _shards) {
+        auto target = s->posted.load(std::memory_order_acquire);
+        while (s->handled.load(std::memory_order_acquire) < target) std::this_thread::yield();
+      }
+    }
+
+    /**
+     * @brief handle what is queued, then join the shard threads. No
+     * post() may run concurrently with it.
+     */
+    void stop() {
+      if (_stopping.exchange(true)) return;
+      for (auto &s : _shards)
+        if (s->thread.joinable()) s->thread.join();
+    }
+
+    std::uint64_t handled() const {
+      std::uint64_t n = 0;
+      for (auto const &s : _shards) n += s->handled.load(std::memory_order_relaxed);
+      return n;
+    }
+    // call fn(id, instance) for every instance; only after stop()
+    template<typename F>
+    void for_each(F &&fn) {
+      for (auto &s : _shards)
+        for (auto &[id, inst] : s->instances) fn(id, inst);
+    }
+    // the number of instances owned by each shard; call after drain()
+    std::vector<std::size_t> occupancy() const {
+      std::vector<std::size_t> v;
+      for (auto const &s : _shards) v.push_back(s->instances.size());
+      return v;
+    }
+
+  private:
+    struct envelope {
+      std::uint64_t id{};
+      Msg msg{};
+    };
+    struct shard {
+      explicit shard(std::size_t capacity)
+          : inbox(capacity) {}
+      util::mpsc_ring<envelope> inbox;
+      alignas(64) std::atomic<std::uint64_t> posted{0};
+      alignas(64) std::atomic<std::uint64_t> handled{0};
+      std::unordered_map<std::uint64_t, Instance> instances{}; // shard thread only
+      std::thread thread{};
+    };
+
+    void _run(std::size_t i) {
+      auto &s = *_shards[i];
+      if (_opt.pin) util::pin_to_cpu(static_cast<unsigned>(i));
+      envelope e;
+      unsigned idle = 0;
+      for (;;) {
+        std::size_t n = 0;
+        while (n < _opt.batch && s.inbox.try_pop(e)) {
+          auto it = s.instances.find(e.id);
+          if (it == s.instances.end()) {
+            it = s.instances.try_emplace(e.id).first;
+            if (_init) _init(e.id, it->second);
+          }
+          _handler(e.id, it->second, e.msg);
+          n++;
+        }
+        if (n) {
+          s.handled.fetch_add(n, std::memory_order_release);
+          idle = 0;
+          continue;
+        }
+        if (_stopping.load(std::memory_order_acquire) && s.handled.load(std::memory_order_relaxed) == s.posted.load(std::memory_order_acquire))
+          break;
+        // back off: spin, then yield, then nap
+        if (++idle < 64) continue;
+        if (idle < 1024) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+
+  private:
+    Init _init;
+    Handler _handler;
+    options _opt;
+    std::vector<std::unique_ptr<shard>> _shards{};
+    std::atomic<bool> _stopping{false};
+  };
+
+} // namespace fsm_cxx
+
+#endif // __FSM_CXX_FSM_SHARD_HH
@@ -0,0 +1,459 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+#ifndef __FSM_CXX_FSM_SHM_HH
+#define __FSM_CXX_FSM_SHM_HH
+
+#include "fsm-frozen.hh"
+#include "fsm-packed.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if !OS_WIN
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------- shared_region
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a read-write mapping shared between processes.
+   * @details A name of the form "/name" is a POSIX shared memory object
+   * (shm_open(3)), anything else the path of a file. The region outlives
+   * the processes mapping it until unlink(). Unsupported where mmap is
+   * not available: create() and attach() fail.
+   */
+  class shared_region {
+  public:
+    shared_region() = default;
+    ~shared_region() { close(); }
+    shared_region(shared_region const &) = delete;
+    shared_region &operator=(shared_region const &) = delete;
+
+    // a new zero-filled region of size bytes; fails if name exists
+    bool create(std::string const &name, std::size_t size) { return _open(name, size, true); }
+    // the whole of an existing region
+    bool attach(std::string const &name) { return _open(name, 0, false); }
+
+    void close() {
+#if !OS_WIN
+      if (_data) ::munmap(_data, _size);
+#endif
+      _data = nullptr;
+      _size = 0;
+    }
+    static bool unlink(std::string const &name) {
+#if !OS_WIN
+      return (is_shm(name) ? ::shm_unlink(name.c_str()) : ::unlink(name.c_str())) == 0;
+#else
+      (void) name;
+      return false;
+#endif
+    }
+    static bool is_shm(std::string const &name) {
+      return name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos;
+    }
+
+    char *data() const { return _data; }
+    std::size_t size() const { return _size; }
+    explicit operator bool() const { return _data != nullptr; }
+
+  private:
+    bool _open(std::string const &name, std::size_t size, bool create) {
+      close();
+#if !OS_WIN
+      int flags = O_RDWR | (create ? O_CREAT | O_EXCL : 0);
+      int fd = is_shm(name) ? ::shm_open(name.c_str(), flags, 0600) : ::open(name.c_str(), flags, 0600);
+      if (fd < 0) return false;
+      struct stat st {};
+      bool ok = create ? ::ftruncate(fd, static_cast<off_t>(size)) == 0 : ::fstat(fd, &st) == 0 && st.st_size > 0;
+      if (!create) size = static_cast<std::size_t>(st.st_size);
+      void *p = ok ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      if (p == MAP_FAILED) {
+        if (create) unlink(name);
+        return false;
+      }
+      _data = static_cast<char *>(p);
+      _size = size;
+      return true;
+#else
+      (void) name, (void) size, (void) create;
+      return false;
+#endif
+    }
+
+  private:
+    char *_data{nullptr};
+    std::size_t _size{0};
+  }; // class shared_region
+
+} // namespace fsm_cxx::util
+
+// ----------------------------- shared_pool
+namespace fsm_cxx { namespace frozen {
+
+  namespace detail {
+    constexpr std::uint64_t shared_magic = 0x314c5048534d5346; // "FSMSHPL1"
+    constexpr std::uint32_t shared_version = 2;
+
+    struct shared_header {
+      std::atomic<std::uint64_t> magic; // stored last by the creator
+      std::uint32_t version;
+      std::uint32_t record_size; // tells a pool of another Slot
+      std::uint64_t capacity;
+      std::uint64_t off_definition, definition_size;
+      std::uint64_t off_records;
+      alignas(64) std::atomic<std::uint64_t> next; // where allocate() looks first
+    };
+
+    // one instance, a cache line of its own
+    template<typename SlotT>
+    struct alignas(64) shared_record {
+      // seq << 32, plus the pid of the process holding the claim while
+      // seq is odd
+      std::atomic<std::uint64_t> word;
+      std::atomic<std::uint32_t> state; // the dense state index
+      std::atomic<std::uint32_t> owner; // the pid that allocated it, 0 while free
+      // the slot, in relaxed atomic words as util::seqlock keeps its
+      // value, so that a read racing with a step is torn, not undefined
+      static constexpr std::size_t words = (sizeof(SlotT) + 7) / 8;
+      std::atomic<std::uint64_t> slot[words];
+
+      void load(SlotT &out) const {
+        std::uint64_t buf[words];
+        for (std::size_t i = 0; i < words; i++) buf[i] = slot[i].load(std::memory_order_relaxed);
+        std::memcpy(&out, buf, sizeof(SlotT));
+      }
+      void store(SlotT const &v) {
+        std::uint64_t buf[words]{};
+        std::memcpy(buf, &v, sizeof(SlotT));
+        for (std::size_t i = 0; i < words; i++) slot[i].store(buf[i], std::memory_order_relaxed);
+      }
+    };
+
+    constexpr std::uint64_t round64(std::uint64_t n) { return (n + 63) & ~std::uint64_t{63}; }
+  } // namespace detail
+
+  /**
+   * @brief instances of a frozen definition in memory shared by the
+   * processes of one host.
+   * @details The region holds the frozen table, copied in once by
+   * create() and bound in place by every attach(), and one record per
+   * instance: its dense state index, a sequence number and an optional
+   * Slot, the fixed-size context of packed_pool. Nothing is serialized
+   * and no process talks to another: any of them steps any instance.
+   *
+   * A step claims the record with one CAS, turning its sequence odd and
+   * leaving the pid of the process in it; runs definition::step() on a
+   * scratch Context of the thread, bound through Context::bind_slot(Slot &)
+   * to a copy of the slot, stored back when the step ends; then publishes
+   * the state with the next even sequence. Steps of one instance are
+   * serialized, those of different instances never wait on each other.
+   * read() copies the slot without claiming, as a seqlock reader would.
+   * Guards and actions must not step the pool themselves.
+   *
+   * A process dying in a step leaves the instance claimed, with the state
+   * and the slot from before the step. A step, reset() or read() which
+   * has waited a while on a claim checks whether its process is still
+   * alive, and gives the claim back if not; recover() gives back all of
+   * them at once. Each
+   * process attaches on its own: a pool object is not to be used across
+   * fork().
+   *
+   * @code{c++}
+   *   auto pool = frozen::shared_pool<M, session>::create("/sessions", md.serialize(), 4096, reg, &err);
+   *   // in the other processes
+   *   auto pool = frozen::shared_pool<M, session>::attach("/sessions", reg, &err);
+   *   auto i = pool->allocate();
+   *   pool->step_by(i, login{});
+   * @endcode
+   *
+   * @tparam M the machine_t the definition was frozen from
+   * @tparam Slot void, or the per-instance fixed-size data, trivially
+   * copyable and the same in every process
+   */
+  template<typename M, typename Slot = void>
+  class shared_pool {
+  public:
+    using Definition = definition<M>;
+    using Event = typename M::Event;
+    using State = typename M::State;
+    using Context = typename M::Context;
+    using Payload = typename M::Payload;
+    using SlotT = std::conditional_t<std::is_void<Slot>::value, detail::no_slot, Slot>;
+    using Record = detail::shared_record<SlotT>;
+
+    static constexpr std::size_t none = ~std::size_t(0);
+    static_assert(std::is_void<Slot>::value || std::is_trivially_copyable<Slot>::value, "Slot must be trivially copyable");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "a shared pool needs lock-free 64-bit atomics");
+
+    /**
+     * @brief create the region name with capacity instances of the
+     * frozen definition img, all free and at the initial state, and bind
+     * it with reg.
+     * @return nullptr with a message in err on failure, e.g. if the
+     * region exists already
+     */
+    static std::shared_ptr<shared_pool> create(std::string const &name, image const &img, std::size_t capacity, registry<M> const &reg, std::string *err = nullptr) {
+      auto off_def = detail::round64(sizeof(detail::shared_header));
+      auto off_records = detail::round64(off_def + img.size());
+      auto region = std::make_shared<util::shared_region>();
+      if (!capacity || !region->create(name, off_records + capacity * sizeof(Record))) return _error(err, "cannot create " + name);
+      auto *h = reinterpret_cast<detail::shared_header *>(region->data());
+      h->version = detail::shared_version;
+      h->record_size = static_cast<std::uint32_t>(sizeof(Record));
+      h->capacity = capacity;
+      h->off_definition = off_def;
+      h->definition_size = img.size();
+      h->off_records = off_records;
+      std::memcpy(region->data() + off_def, img.data(), img.size());
+
+      std::shared_ptr<shared_pool> pool{new shared_pool(region)};
+      if (!pool->_bind(reg, err)) {
+        util::shared_region::unlink(name);
+        return nullptr;
+      }
+      for (std::size_t i = 0; i < capacity; i++) pool->_rec(i).state.store(pool->_def->initial(), std::memory_order_relaxed);
+      h->magic.store(detail::shared_magic, std::memory_order_release);
+      return pool;
+    }
+
+    /**
+     * @brief map the region name, created by another process, and bind
+     * its definition with reg.
+     * @return nullptr with a message in err on failure
+     */
+    static std::shared_ptr<shared_pool> attach(std::string const &name, registry<M> const &reg, std::string *err = nullptr) {
+      auto region = std::make_shared<util::shared_region>();
+      if (!region->attach(name)) return _error(err, "cannot map " + name);
+      auto const *h = reinterpret_cast<detail::shared_header const *>(region->data());
+      if (region->size() < sizeof(detail::shared_header) || h->magic.load(std::memory_order_acquire) != detail::shared_magic)
+        return _error(err, name + " is not a shared pool, or not ready yet");
+      if (h->version != detail::shared_version || h->record_size != sizeof(Record))
+        return _error(err, name + " holds records of another version or Slot");
+      if (h->off_definition + h->definition_size > h->off_records || h->off_records % 64 ||
+          h->capacity > (region->size() - h->off_records) / sizeof(Record))
+        return _error(err, name + " is truncated");
+      std::shared_ptr<shared_pool> pool{new shared_pool(region)};
+      if (!pool->_bind(reg, err)) return nullptr;
+      return pool;
+    }
+
+    // remove the region name; the processes mapping it keep it
+    static bool unlink(std::string const &name) { return util::shared_region::unlink(name); }
+
+    std::size_t size() const { return _capacity; }
+    Definition const &def() const { return *_def; }
+
+    /**
+     * @brief take a free instance for this process and reset it.
+     * @return none once every instance is taken
+     */
+    std::size_t allocate() {
+      auto start = _head->next.load(std::memory_order_relaxed);
+      for (std::size_t k = 0; k < _capacity; k++) {
+        auto i = (start + k) % _capacity;
+        auto &r = _rec(i);
+        std::uint32_t free = 0;
+        if (r.owner.load(std::memory_order_relaxed) == 0 && r.owner.compare_exchange_strong(free, _pid, std::memory_order_acq_rel)) {
+          _head->next.store(i + 1, std::memory_order_relaxed);
+          reset(i);
+          return i;
+        }
+      }
+      return none;
+    }
+    // give back instance i; false if it was free
+    bool release(std::size_t i) { return _rec(i).owner.exchange(0, std::memory_order_acq_rel) != 0; }
+    // the pid of the process that allocated instance i, 0 if it is free
+    std::uint32_t owner(std::size_t i) const { return _rec(i).owner.load(std::memory_order_acquire); }
+
+    // back to the initial state, with a value-initialized slot
+    void reset(std::size_t i) {
+      auto &r = _rec(i);
+      auto w = _claim(r);
+      r.store(SlotT{});
+      _publish(r, w, _def->initial());
+    }
+
+    std::uint32_t state_index(std::size_t i) const { return _rec(i).state.load(std::memory_order_acquire); }
+    State const &current(std::size_t i) const { return _def->state(state_index(i)); }
+    // the number of steps and resets of instance i so far
+    std::uint64_t sequence(std::size_t i) const { return (_rec(i).word.load(std::memory_order_acquire) >> 32) / 2; }
+    // whether a step of instance i is under way, or was cut short
+    bool claimed(std::size_t i) const { return _rec(i).word.load(std::memory_order_acquire) >> 32 & 1; }
+
+    /**
+     * @brief a consistent copy of the slot of instance i, and the state
+     * it goes with; waits while a step holds the instance.
+     */
+    template<typename T = Slot, std::enable_if_t<!std::is_void<T>::value, bool> = true>
+    State const &read(std::size_t i, T &out) const {
+      auto &r = _records[i];
+      for (unsigned spins = 0;; spins++) {
+        auto w = r.word.load(std::memory_order_acquire);
+        if (!(w >> 32 & 1)) {
+          r.load(out);
+          auto s = r.state.load(std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (r.word.load(std::memory_order_relaxed) == w) return _def->state(s);
+        } else if (_stale(spins))
+          _give_back(r, w);
+        if (spins >= 64) std::this_thread::yield();
+      }
+    }
+
+    /**
+     * @brief dispatch one event on instance i, waiting while another
+     * step holds it.
+     * @details A guard or an action that throws leaves the instance as
+     * it was before the step, in its state and with its slot, and free
+     * for the next step.
+     * @param event the dense event index, see view::event_index()
+     */
+    bool step_by(std::size_t i, std::uint32_t event, Event const &ev, Payload const &payload = Payload{}, Reason *reason = nullptr) {
+      auto &r = _rec(i);
+      // ends the claim with the state from before the step, unless the
+      // step got as far as publishing
+      struct unwind {
+        shared_pool &p;
+        Record &r;
+        std::uint64_t w;
+        std::uint32_t before;
+        bool done{false};
+        ~unwind() {
+          if (!done) p._publish(r, w, before);
+        }
+      } g{*this, r, _claim(r), r.state.load(std::memory_order_relaxed)};
+      auto cur = g.before;
+      auto &ctx = _scratch();
+      ctx.current(_def->state(cur));
+      [[maybe_unused]] SlotT slot{};
+      if constexpr (!std::is_void<Slot>::value) {
+        r.load(slot);
+        detail::slot_binder<Context, Slot>::bind(ctx, slot);
+      }
+      bool ok = _def->step(cur, event, ev, ctx, payload, reason);
+      if constexpr (!std::is_void<Slot>::value) r.store(slot);
+      _publish(r, g.w, cur);
+      g.done = true;
+      return ok;
+    }
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value, bool> = true>
+    bool step_by(std::size_t i, Evt const &ev, Payload const &payload = Payload{}) {
+      return step_by(i, _def->table().template event_index<Evt>(), ev, payload);
+    }
+
+    /**
+     * @brief give back the claims of the processes that died in a step.
+     * @details Those instances keep the state and the slot from before
+     * the step, unless the process died while storing the slot back.
+     * @return the number of claims given back
+     */
+    std::size_t recover() {
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < _capacity; i++) {
+        auto &r = _rec(i);
+        n += _give_back(r, r.word.load(std::memory_order_acquire));
+      }
+      return n;
+    }
+
+  private:
+    explicit shared_pool(std::shared_ptr<util::shared_region> region)
+        : _region(std::move(region)),
+          _head(reinterpret_cast<detail::shared_header *>(_region->data())),
+          _records(reinterpret_cast<Record *>(_region->data() + _head->off_records)),
+          _capacity(static_cast<std::size_t>(_head->capacity)) {
+#if !OS_WIN
+      _pid = static_cast<std::uint32_t>(::getpid());
+#endif
+    }
+
+    bool _bind(registry<M> const &reg, std::string *err) {
+      auto def = std::make_shared<Definition>(_region, _region->data() + _head->off_definition, static_cast<std::size_t>(_head->definition_size));
+      if (!def->bind(reg, err)) return false;
+      _def = std::move(def);
+      return true;
+    }
+
+    Record &_rec(std::size_t i) { return _records[i]; }
+    Record const &_rec(std::size_t i) const { return _records[i]; }
+
+    // seq from even to odd, with our pid in the low half
+    std::uint64_t _claim(Record &r) {
+      auto w = r.word.load(std::memory_order_relaxed);
+      for (unsigned spins = 0;; spins++) {
+        if (w >> 32 & 1) {
+          if (_stale(spins)) _give_back(r, w);
+          if (spins >= 64) std::this_thread::yield();
+          w = r.word.load(std::memory_order_relaxed);
+        } else if (r.word.compare_exchange_weak(w, ((w >> 32) + 1) << 32 | _pid, std::memory_order_acquire, std::memory_order_relaxed)) {
+          std::atomic_thread_fence(std::memory_order_release); // the slot is stored after the claim
+          return w;
+        }
+      }
+    }
+    // long enough on a claim to ask whether its process is still alive
+    static bool _stale(unsigned spins) { return spins >= 64 && spins % 1024 == 0; }
+    // end the claim in w if its process died, with the next even sequence
+    static bool _give_back(Record &r, std::uint64_t w) {
+      if (!(w >> 32 & 1) || _alive(static_cast<std::uint32_t>(w))) return false;
+      return r.word.compare_exchange_strong(w, ((w >> 32) + 1) << 32, std::memory_order_acq_rel);
+    }
+    void _publish(Record &r, std::uint64_t w, std::uint32_t state) {
+      r.state.store(state, std::memory_order_relaxed);
+      r.word.store(((w >> 32) + 2) << 32, std::memory_order_release);
+    }
+
+    static Context &_scratch() {
+      thread_local Context ctx{};
+      return ctx;
+    }
+    static bool _alive(std::uint32_t pid) {
+#if !OS_WIN
+      return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#else
+      (void) pid;
+      return true;
+#endif
+    }
+    static std::shared_ptr<shared_pool> _error(std::string *err, std::string msg) {
+      if (err) *err = std::move(msg);
+      return nullptr;
+    }
+
+  private:
+    std::shared_ptr<util::shared_region> _region;
+    detail::shared_header *_head;
+    Record *_records;
+    std::size_t _capacity;
+    std::shared_ptr<Definition const> _def{};
+    std::uint32_t _pid{1};
+  };
+
+}} // namespace fsm_cxx::frozen
+
+#endif // __FSM_CXX_FSM_SHM_HH
@@ -0,0 +1,323 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_SIMULATE_HH
+#define __FSM_CXX_FSM_SIMULATE_HH
+
+#include "fsm-sm.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ----------------------------- histogram
+namespace fsm_cxx { namespace sim {
+
+  /**
+   * @brief a histogram of equal width buckets from 0, with an overflow
+   * bucket, keeping the exact count, sum and maximum.
+   */
+  class histogram {
+  public:
+    explicit histogram(double width = 1.0, std::size_t buckets = 64)
+        : _width(width > 0 ? width : 1.0), _buckets(buckets ? buckets : 1) {}
+
+    void add(double v) {
+      auto i = v <= 0 ? 0 : static_cast<std::size_t>(v / _width);
+      if (i < _buckets.size()) _buckets[i]++;
+      else _overflow++;
+      _count++;
+      _sum += v;
+      _max = std::max(_max, v);
+    }
+    // h must have the same shape
+    void merge(histogram const &h) {
+      for (std::size_t i = 0; i < _buckets.size() && i < h._buckets.size(); i++) _buckets[i] += h._buckets[i];
+      _overflow += h._overflow;
+      _count += h._count;
+      _sum += h._sum;
+      _max = std::max(_max, h._max);
+    }
+
+    std::uint64_t count() const { return _count; }
+    double sum() const { return _sum; }
+    double mean() const { return _count ? _sum / double(_count) : 0.0; }
+    double max() const { return _max; }
+    double width() const { return _width; }
+    std::vector<std::uint64_t> const &buckets() const { return _buckets; }
+    std::uint64_t overflow() const { return _overflow; }
+
+    /**
+     * @brief the value below which a fraction q of the samples fall,
+     * interpolated inside its bucket; max() if it is in the overflow.
+     */
+    double quantile(double q) const {
+      if (!_count) return 0.0;
+      auto rank = q * double(_count);
+      double seen = 0;
+      for (std::size_t i = 0; i < _buckets.size(); i++) {
+        if (_buckets[i] && seen + double(_buckets[i]) >= rank)
+          return std::min(_max, _width * (double(i) + (rank - seen) / double(_buckets[i])));
+        seen += double(_buckets[i]);
+      }
+      return _max;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, histogram const &h) {
+      return os << "n " << h.count() << ", mean " << h.mean() << ", p50 " << h.quantile(0.5)
+                << ", p99 " << h.quantile(0.99) << ", max " << h.max();
+    }
+
+  private:
+    double _width;
+    std::vector<std::uint64_t> _buckets;
+    std::uint64_t _overflow{0}, _count{0};
+    double _sum{0}, _max{0};
+  };
+
+}} // namespace fsm_cxx::sim
+
+// ----------------------------- model, run
+namespace fsm_cxx { namespace sim {
+
+  /**
+   * @brief the event distributions of a simulation: for each state, the
+   * events which may occur in it with their rates.
+   * @details A walk spends an exponentially distributed time of mean
+   * 1/(sum of the rates) in a state, then picks one of its events with
+   * probability rate/(sum of the rates), a continuous-time Markov chain.
+   * With unit rates and no interest in time, the rates are plain
+   * weights. A state without events ends the walk.
+   *
+   * @code{c++}
+   *   fsm_cxx::sim::model<M> md;
+   *   md.on(my_state::Sending, 3.0, ack{}).on(my_state::Sending, 1.0, timeout{});
+   *   md.on(my_state::Retrying, 2.0, retry{}).on(my_state::Retrying, 0.5, give_up{});
+   *   auto r = fsm_cxx::sim::run(m, md);
+   *   std::cout << r.states[my_state::Retrying].dwell << '\n';
+   * @endcode
+   */
+  template<typename M>
+  class model {
+  public:
+    using State = typename M::State;
+    using Event = typename M::Event;
+    using Payload = typename M::Payload;
+
+    struct choice {
+      double rate;
+      std::string name;
+      std::shared_ptr<Event const> event;
+      std::shared_ptr<Payload const> payload;
+    };
+    struct distribution {
+      std::vector<choice> choices{};
+      std::vector<double> cumulative{};
+      double total{0};
+    };
+
+    // ev may occur in s at the given rate, with payload
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value, bool> = true>
+    model &on(State const &s, double rate, Evt ev = Evt{}, Payload payload = Payload{}) {
+      if (!(rate > 0)) return (*this);
+      auto &d = _dists[s];
+      d.choices.push_back(choice{rate, std::string{debug::type_name<Evt>()},
+                                 std::make_shared<Evt const>(std::move(ev)), std::make_shared<Payload const>(std::move(payload))});
+      d.total += rate;
+      d.cumulative.push_back(d.total);
+      return (*this);
+    }
+
+    // nullptr for a state which ends the walks
+    distribution const *at(State const &s) const {
+      auto it = _dists.find(s);
+      return it == _dists.end() ? nullptr : &it->second;
+    }
+    std::unordered_map<State, distribution> const &distributions() const { return _dists; }
+
+  private:
+    std::unordered_map<State, distribution> _dists{};
+  };
+
+  struct options {
+    std::uint64_t walks{1000000};
+    std::size_t threads{0};         // 0 for one per hardware thread
+    std::uint64_t max_steps{10000}; // a longer walk is cut
+    std::uint64_t seed{0x9e3779b97f4a7c15ULL};
+    bool skip_actions{true};        // step in skip_actions() mode: guards and completions run, actions and observers do not
+    double dwell_width{0.1};        // the histogram buckets
+    std::size_t dwell_buckets{256};
+    double length_width{1.0};
+    std::size_t length_buckets{256};
+  };
+
+  template<typename M>
+  struct result {
+    using State = typename M::State;
+
+    struct state_stats {
+      std::uint64_t visits{};  // entries into the state, self-transitions excluded
+      std::uint64_t ends{};    // walks ending there
+      double time{};           // the time spent in the state over all walks
+      histogram dwell;         // the time of each visit, for the states the walks leave
+
+      double occupancy(double total) const { return total > 0 ? time / total : 0.0; }
+    };
+
+    std::uint64_t walks{};
+    std::uint64_t steps{};     // the events drawn
+    std::uint64_t refused{};   // the events the machine did not move by
+    std::uint64_t truncated{}; // the walks cut at options::max_steps
+    double time{};             // the simulated time of all walks
+    histogram length;          // the events per walk
+    histogram duration;        // the simulated time per walk
+    std::unordered_map<State, state_stats> states{};
+  };
+
+  namespace detail {
+    inline std::uint64_t splitmix64(std::uint64_t &x) {
+      auto z = (x += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+  } // namespace detail
+
+  /**
+   * @brief run opt.walks independent random walks of m from its initial
+   * state, drawing the events from md.
+   * @details The walks are split evenly over the threads; each thread
+   * steps its own copy of m, reset() before each walk, with its own
+   * generator seeded from opt.seed and the thread index, so that a run
+   * is reproducible for a given seed and thread count. An event which
+   * does not move the machine leaves the walk in its state, in the same
+   * visit. The per-thread results are merged at the end.
+   *
+   * With opt.skip_actions the copies step in skip_actions() mode; otherwise
+   * the actions and observers of m run, concurrently, on the copies.
+   */
+  template<typename M>
+  inline result<M> run(M const &m, model<M> const &md, options const &opt = options{}) {
+    using State = typename M::State;
+    using Result = result<M>;
+    using Stats = typename Result::state_stats;
+
+    auto threads = opt.threads ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<std::size_t>(1, std::min<std::size_t>(threads, opt.walks ? opt.walks : 1));
+    auto fresh = [&opt]() {
+      Result r;
+      r.length = histogram{opt.length_width, opt.length_buckets};
+      r.duration = histogram{opt.dwell_width, opt.dwell_buckets};
+      return r;
+    };
+    std::vector<Result> parts(threads, fresh());
+
+    auto walk_all = [&](std::size_t t) {
+      auto &r = parts[t];
+      auto stats = [&r, &opt](State const &s) -> Stats & {
+        auto it = r.states.find(s);
+        if (it == r.states.end())
+          it = r.states.emplace(s, Stats{0, 0, 0.0, histogram{opt.dwell_width, opt.dwell_buckets}}).first;
+        return it->second;
+      };
+      std::uint64_t sm = opt.seed ^ (0xd1b54a32d192ed03ULL * (t + 1));
+      std::mt19937_64 rng{detail::splitmix64(sm)};
+      std::uniform_real_distribution<double> uni{0.0, 1.0};
+
+      M local{m};
+      local.skip_actions(opt.skip_actions);
+      auto walks = opt.walks / threads + (t < opt.walks % threads);
+      for (std::uint64_t w = 0; w < walks; w++) {
+        local.reset();
+        State cur = local.context().current();
+        double now = 0, entered = 0;
+        std::uint64_t n = 0;
+        auto *st = &stats(cur);
+        st->visits++;
+        for (;;) {
+          auto const *d = md.at(cur);
+          if (!d || d->total <= 0) {
+            st->ends++;
+            break;
+          }
+          if (n == opt.max_steps) {
+            r.truncated++;
+            break;
+          }
+          now += -std::log1p(-uni(rng)) / d->total;
+          auto x = uni(rng) * d->total;
+          auto i = std::size_t(std::upper_bound(d->cumulative.begin(), d->cumulative.end(), x) - d->cumulative.begin());
+          auto const &c = d->choices[std::min(i, d->choices.size() - 1)];
+          n++;
+          if (!local.step_by(c.name, *c.event, *c.payload)) {
+            r.refused++;
+            continue;
+          }
+          auto const &to = local.context().current();
+          if (to == cur) continue;
+          st->time += now - entered;
+          st->dwell.add(now - entered);
+          cur = to, entered = now;
+          st = &stats(cur);
+          st->visits++;
+        }
+        st->time += now - entered; // the time up to a cut, none in an end state
+        r.walks++;
+        r.steps += n;
+        r.time += now;
+        r.length.add(double(n));
+        r.duration.add(now);
+      }
+    };
+    if (threads == 1) walk_all(0);
+    else {
+      std::vector<std::thread> ts;
+      for (std::size_t t = 0; t < threads; t++) ts.emplace_back(walk_all, t);
+      for (auto &t : ts) t.join();
+    }
+
+    auto res = fresh();
+    for (auto const &r : parts) {
+      res.walks += r.walks;
+      res.steps += r.steps;
+      res.refused += r.refused;
+      res.truncated += r.truncated;
+      res.time += r.time;
+      res.length.merge(r.length);
+      res.duration.merge(r.duration);
+      for (auto const &[s, x] : r.states) {
+        auto it = res.states.find(s);
+        if (it == res.states.end()) {
+          res.states.emplace(s, x);
+          continue;
+        }
+        it->second.visits += x.visits;
+        it->second.ends += x.ends;
+        it->second.time += x.time;
+        it->second.dwell.merge(x.dwell);
+      }
+    }
+    return res;
+  }
+
+}} // namespace fsm_cxx::sim
+
+#endif // __FSM_CXX_FSM_SIMULATE_HH
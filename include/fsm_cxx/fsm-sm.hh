@@ -11,13 +11,18 @@
 #ifndef __FSM_CXX_FSM_SM_HH
 #define __FSM_CXX_FSM_SM_HH
 
+#include "fsm-common.hh"
 #include "fsm-def.hh"
 
 #include "fsm-assert.hh"
 #include "fsm-debug.hh"
+#include "fsm-seqlock.hh"
+#include "fsm-subscribers.hh"
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <new>
 #include <random>
@@ -29,12 +34,13 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <future>
 #include <mutex>
 
 // #include <any>
 // #include <array>
 #include <chrono>
-// #include <deque>
+#include <deque>
 // #include <initializer_list>
 // #include <list>
 // #include <map>
@@ -87,6 +93,25 @@ namespace fsm_cxx {
     std::string to_string() const { return detail::shorten(std::string(debug::type_name<T>())); }
   };
 
+  /**
+   * @brief the event of the completion transitions, taken with no event
+   * as soon as their source state is entered and their guard holds.
+   * @see machine_t::transition_builder::completion()
+   */
+  struct completion_event : public event_type<completion_event> {};
+
+  /**
+   * @brief the event machine_t::operator>> steps by, one per character
+   * read from the input stream. Guards may inspect the character.
+   * @see byte_dfa_t for high throughput byte-stream processing
+   */
+  template<typename CharT = char>
+  struct char_event : public event_type<char_event<CharT>> {
+    char_event(CharT c_ = CharT{}) : c(c_) {}
+    ~char_event() override = default;
+    CharT c;
+  };
+
   // template<typename EventT>
   // struct event_t {
   //     EventT eo{};
@@ -151,6 +176,7 @@ namespace fsm_cxx {
     using First = State;
     using Second = Preds;
     using Guards = std::unordered_map<First, Second>;
+    using GuardNames = std::unordered_map<First, std::vector<std::string>>;
 
     /**
          * @brief reset the context to initial state
@@ -158,8 +184,10 @@ namespace fsm_cxx {
          */
     void reset(State const &t, bool clear_guards = false) {
       _current = t;
-      if (clear_guards)
+      if (clear_guards) {
         _guards.clear();
+        _guard_names.clear();
+      }
     }
 
     /**
@@ -207,9 +235,18 @@ namespace fsm_cxx {
          */
     template<typename _Callable, typename... _Args>
     void add_guard(State const &st, _Callable &&f, _Args &&...args) {
+      add_named_guard(std::string{}, st, std::forward<_Callable>(f), std::forward<_Args>(args)...);
+    }
+    /**
+         * @brief add a transition guard with a name, so that it can be
+         * exported into a frozen definition and rebound later.
+         */
+    template<typename _Callable, typename... _Args>
+    void add_named_guard(std::string const &name, State const &st, _Callable &&f, _Args &&...args) {
       using namespace std::placeholders;
       auto fn = fsm_cxx::util::cool::bind_tie<4>(std::forward<_Callable>(f), std::forward<_Args>(args)..., _1, _2, _3, _4, _5);
 
+      _guard_names[st].push_back(name);
       auto it = _guards.find(st);
       if (it == _guards.end()) {
         Second second;
@@ -220,9 +257,13 @@ namespace fsm_cxx {
       it->second.push_back(fn);
     }
 
+    Guards const &guards() const { return _guards; }
+    GuardNames const &guard_names() const { return _guard_names; }
+
   private:
     State _current{};
     Guards _guards{};
+    GuardNames _guard_names{};
   };
 } // namespace fsm_cxx
 
@@ -258,6 +299,135 @@ namespace fsm_cxx {
     friend std::ostream &operator<<(std::ostream &os, state_t const &o) { return os << o.t; }
   };
 
+  namespace detail {
+    template<typename StateT, typename = void>
+    struct state_raw {
+      using type = StateT;
+      static type const &get(StateT const &s) { return s; }
+    };
+    template<typename StateT>
+    struct state_raw<StateT, std::void_t<decltype(std::declval<StateT const &>().t)>> {
+      using type = std::decay_t<decltype(std::declval<StateT const &>().t)>;
+      static type const &get(StateT const &s) { return s.t; }
+    };
+
+    // whether std::size() tells the length of a range, see machine_t::load()
+    template<typename R, typename = void>
+    struct is_sized_range : std::false_type {};
+    template<typename R>
+    struct is_sized_range<R, std::void_t<decltype(std::size(std::declval<R &>()))>> : std::true_type {};
+  } // namespace detail
+
+  namespace detail {
+    struct no_fields {};
+
+    // the context fields published with the current state, see
+    // machine_t::observe()
+    template<typename ContextT, typename = void>
+    struct published_fields {
+      using type = no_fields;
+      static void get(ContextT const &, type &) {}
+    };
+    template<typename ContextT>
+    struct published_fields<ContextT, std::void_t<decltype(std::declval<ContextT const &>().publish(std::declval<typename ContextT::published &>()))>> {
+      using type = typename ContextT::published;
+      static void get(ContextT const &c, type &f) { c.publish(f); }
+    };
+
+    template<typename Raw, typename Fields>
+    struct published_value {
+      Raw state;
+      Fields fields;
+    };
+    struct no_seqlock {};
+
+    /**
+     * @brief runs the jobs posted to it one at a time and in order, on
+     * the threads of an executor: the first post of a burst hands a
+     * drain of the queue to the executor, the later ones only queue.
+     */
+    class serial_queue : public std::enable_shared_from_this<serial_queue> {
+    public:
+      using Job = std::function<void()>;
+      using Executor = std::function<void(Job)>;
+
+      // block until the jobs posted so far have run; not from one of them
+      void wait() {
+        std::unique_lock<std::mutex> lk(_lock);
+        _idle.wait(lk, [this]() { return !_running; });
+      }
+
+      void post(Executor const &ex, Job job) {
+        {
+          std::lock_guard<std::mutex> lk(_lock);
+          _jobs.push_back(std::move(job));
+          if (_running) return;
+          _running = true;
+        }
+        ex([self = shared_from_this()]() { self->_drain(); });
+      }
+      std::size_t pending() const {
+        std::lock_guard<std::mutex> lk(_lock);
+        return _jobs.size();
+      }
+
+    private:
+      void _drain() {
+        for (;;) {
+          Job job;
+          {
+            std::lock_guard<std::mutex> lk(_lock);
+            if (_jobs.empty()) {
+              _running = false;
+              _idle.notify_all();
+              return;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+          }
+          try {
+            job();
+          } catch (...) {
+            // a job reports its own failures; the next ones still run
+          }
+        }
+      }
+
+      mutable std::mutex _lock{};
+      std::condition_variable _idle{};
+      std::deque<Job> _jobs{};
+      bool _running{false};
+    };
+
+    // a copy of a machine gets a queue of its own
+    struct deferred_actions {
+      serial_queue::Executor executor{};
+      std::shared_ptr<serial_queue> queue{std::make_shared<serial_queue>()};
+
+      deferred_actions() = default;
+      deferred_actions(deferred_actions const &o)
+          : executor(o.executor) {}
+      deferred_actions &operator=(deferred_actions const &) = delete;
+    };
+  } // namespace detail
+
+  /**
+   * @brief the numeric id of a state, i.e. the value of its enum.
+   * @details state ids are what binary formats (snapshots, frozen
+   * tables, ...) store in place of the state object itself.
+   */
+  template<typename StateT>
+  inline std::uint32_t state_id(StateT const &s) {
+    return static_cast<std::uint32_t>(detail::state_raw<StateT>::get(s));
+  }
+  /**
+   * @brief rebuild a state object from its numeric id.
+   */
+  template<typename StateT>
+  inline StateT state_from_id(std::uint32_t id) {
+    return StateT{static_cast<typename detail::state_raw<StateT>::type>(id)};
+  }
+
 } // namespace fsm_cxx
 
 // ----------------------------- action_t
@@ -280,8 +450,18 @@ namespace fsm_cxx {
     action_t() = default;
     ~action_t() = default;
     action_t(std::nullptr_t) {}
-    // explicit action_t(action_t &&f) : _f(std::move(f._f)) {}
-    explicit action_t(action_t const &f) : _f(f._f) {}
+    action_t(action_t &&f) noexcept : _f(std::move(f._f)), _name(std::move(f._name)) {}
+    explicit action_t(action_t const &f) : _f(f._f), _name(f._name) {}
+    action_t &operator=(action_t const &f) {
+      _f = f._f;
+      _name = f._name;
+      return (*this);
+    }
+    action_t &operator=(action_t &&f) noexcept {
+      _f = std::move(f._f);
+      _name = std::move(f._name);
+      return (*this);
+    }
     explicit action_t(FN &&f) : _f(std::move(f)) {}
     template<typename _Callable, typename... _Args,
              std::enable_if_t<!std::is_same<std::decay_t<_Callable>, FN>::value && !std::is_same<std::decay_t<_Callable>, action_t>::value && !std::is_same<std::decay_t<_Callable>, std::nullopt_t>::value && !std::is_same<std::decay_t<_Callable>, std::nullptr_t>::value,
@@ -296,7 +476,10 @@ namespace fsm_cxx {
     void update(_Callable &&f, _Args &&...args) {
       using namespace std::placeholders;
       constexpr auto count = 4;
-      _f = fsm_cxx::util::cool::bind_tie<count>(std::forward<_Callable>(f), std::forward<_Args>(args)..., _1, _2, _3, _4);
+      if constexpr (sizeof...(_Args) == 0 && std::is_constructible<FN, _Callable &&>::value)
+        _f = std::forward<_Callable>(f); // no arguments to bind: store it as is
+      else
+        _f = fsm_cxx::util::cool::bind_tie<count>(std::forward<_Callable>(f), std::forward<_Args>(args)..., _1, _2, _3, _4);
     }
 
     /**
@@ -312,8 +495,19 @@ namespace fsm_cxx {
 
     operator bool() const { return bool(_f); }
 
+    /**
+         * @brief the name an action is registered with, used by frozen
+         * definitions to rebind it; empty for anonymous actions.
+         */
+    std::string const &name() const { return _name; }
+    action_t &name(std::string const &n) {
+      _name = n;
+      return (*this);
+    }
+
   private:
     FN _f;
+    std::string _name{};
   }; // class action_t
 
 } // namespace fsm_cxx
@@ -371,10 +565,28 @@ namespace fsm_cxx { namespace detail {
           : entry_action(std::move(entry)), exit_action(std::move(exit)) {}
       actions_t(actions_t const &o)
           : entry_action(o.entry_action), exit_action(o.exit_action) {}
+      actions_t(actions_t &&o) noexcept
+          : entry_action(std::move(o.entry_action)), exit_action(std::move(o.exit_action)) {}
       bool valid() const { return entry_action || exit_action; }
     };
 }} // namespace fsm_cxx::detail
 
+// ----------------------------- history_kind
+namespace fsm_cxx {
+  /**
+   * @brief how a transition into a composite state resumes it, see
+   * machine_t::transition_builder::to_history().
+   * @details none enters the default sub-states; shallow resumes the
+   * sub-state last active directly under the composite, then enters its
+   * default sub-states; deep resumes the innermost state last active.
+   */
+  enum class history_kind : std::uint8_t {
+    none,
+    shallow,
+    deep,
+  };
+} // namespace fsm_cxx
+
 // ----------------------------- trans_item_t
 namespace fsm_cxx { namespace detail {
     template<typename S,
@@ -395,16 +607,47 @@ namespace fsm_cxx { namespace detail {
       State to{};
       Action entry_action{nullptr};
       Action exit_action{nullptr};
+      std::string guard_name{};
+      bool exclusive{false};  // the guard never passes together with the other exclusive candidates'
+      history_kind history{history_kind::none}; // resume the composite state to is, see machine_t
+      bool internal{false};   // runs its actions only: no exit, no entry, no state change
+      std::atomic<std::uint64_t> hits{0}; // how many times it was chosen, counted (relaxed) in adaptive mode
 
       bool verify(EventT const &ev, Context &c, Payload const &p) const {
         if (pred) return pred(ev, c, to, p);
         return true;
       }
 
-      trans_item_t(State const &st = State{}, Guard &&p = nullptr, Action &&entry = nullptr, Action &&exit = nullptr)
-          : pred(p), to(st), entry_action(std::move(entry)), exit_action(std::move(exit)) {}
+      trans_item_t(State const &st = State{}, Guard &&p = nullptr, Action &&entry = nullptr, Action &&exit = nullptr, std::string gn = {})
+          : pred(std::move(p)), to(st), entry_action(std::move(entry)), exit_action(std::move(exit)), guard_name(std::move(gn)) {}
       trans_item_t(trans_item_t const &o)
-          : pred(o.pred), to(o.to), entry_action(o.entry_action), exit_action(o.exit_action) {}
+          : pred(o.pred), to(o.to), entry_action(o.entry_action), exit_action(o.exit_action), guard_name(o.guard_name), exclusive(o.exclusive), history(o.history), internal(o.internal), hits(o.hits.load(std::memory_order_relaxed)) {}
+      trans_item_t(trans_item_t &&o) noexcept
+          : pred(std::move(o.pred)), to(o.to), entry_action(std::move(o.entry_action)), exit_action(std::move(o.exit_action)), guard_name(std::move(o.guard_name)), exclusive(o.exclusive), history(o.history), internal(o.internal), hits(o.hits.load(std::memory_order_relaxed)) {}
+      trans_item_t &operator=(trans_item_t const &o) {
+        pred = o.pred;
+        to = o.to;
+        entry_action = o.entry_action;
+        exit_action = o.exit_action;
+        guard_name = o.guard_name;
+        exclusive = o.exclusive;
+        history = o.history;
+        internal = o.internal;
+        hits.store(o.hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return (*this);
+      }
+      trans_item_t &operator=(trans_item_t &&o) noexcept {
+        pred = std::move(o.pred);
+        to = o.to;
+        entry_action = std::move(o.entry_action);
+        exit_action = std::move(o.exit_action);
+        guard_name = std::move(o.guard_name);
+        exclusive = o.exclusive;
+        history = o.history;
+        internal = o.internal;
+        hits.store(o.hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return (*this);
+      }
     };
 }} // namespace fsm_cxx::detail
 
@@ -431,6 +674,7 @@ namespace fsm_cxx {
     using Guard = typename Item::Guard;
 
     Maps m_;
+    std::uint32_t adaptive_period{0}; // see machine_t::adaptive()
 
     transition_t() = default;
     ~transition_t() = default;
@@ -451,19 +695,22 @@ namespace fsm_cxx {
       s.emplace_back(to, std::move(p), std::move(entry), std::move(exit));
       m_.emplace(std::move(First{event_name}), std::move(s));
     }
-    transition_t(std::string const &event_name, StateT const &to, Guard &&p = nullptr, ActionT &&entry = nullptr, ActionT &&exit = nullptr) {
+    transition_t(std::string const &event_name, StateT const &to, Guard &&p = nullptr, ActionT &&entry = nullptr, ActionT &&exit = nullptr, std::string const &guard_name = {}) {
       Second s;
-      s.emplace_back(to, std::move(p), std::move(entry), std::move(exit));
+      s.emplace_back(to, std::move(p), std::move(entry), std::move(exit), guard_name);
       m_.emplace(std::move(First{event_name}), std::move(s));
     }
 
     void add(transition_t &&t) {
-      for (auto &[k, v] : t.m_) {
-        if (auto it = m_.find(k); it == m_.end())
-          m_.emplace(k, v);
-        else
-          for (auto &z : v)
+      for (auto src = t.m_.begin(); src != t.m_.end();) {
+        if (auto it = m_.find(src->first); it == m_.end())
+          m_.insert(t.m_.extract(src++)); // relink the node, key and vector and all
+        else {
+          it->second.reserve(it->second.size() + src->second.size());
+          for (auto &z : src->second)
             it->second.emplace_back(std::move(z));
+          ++src;
+        }
       }
     }
 
@@ -473,14 +720,42 @@ namespace fsm_cxx {
     auto _get(std::string const &event_name, EventT const &ev, Context &ctx, Payload const &payload) -> std::tuple<bool, Item &> {
       auto it = m_.find(event_name);
       if (it != m_.end()) {
-        for (auto &v : it->second) {
-          if (v.verify(ev, ctx, payload))
-            return std::tuple<bool, Item &>{true, v};
+        auto &v = it->second;
+        for (std::size_t i = 0; i < v.size(); i++) {
+          if (v[i].verify(ev, ctx, payload)) {
+            if (adaptive_period && v[i].exclusive) v[i].hits.fetch_add(1, std::memory_order_relaxed);
+            return std::tuple<bool, Item &>{true, v[i]};
+          }
         }
       }
       static Item s2{};
       return std::tuple<bool, Item &>{false, s2};
     }
+
+    /**
+     * @brief reorder each run of exclusive candidates of event_name by
+     * hits, most chosen first, and halve their counts so that the order
+     * follows the traffic.
+     * @details It moves the candidates: no reference to one may be held,
+     * i.e. it must not run during a step, see machine_t::adaptive().
+     */
+    void reorder(std::string const &event_name) {
+      auto it = m_.find(event_name);
+      if (it == m_.end()) return;
+      auto &v = it->second;
+      auto hits = [](Item const &x) { return x.hits.load(std::memory_order_relaxed); };
+      for (std::size_t a = 0; a < v.size();) {
+        if (!v[a].exclusive) {
+          a++;
+          continue;
+        }
+        auto b = a + 1;
+        while (b < v.size() && v[b].exclusive) ++b;
+        std::stable_sort(v.begin() + std::ptrdiff_t(a), v.begin() + std::ptrdiff_t(b), [&hits](Item const &x, Item const &y) { return hits(x) > hits(y); });
+        for (auto k = a; k < b; k++) v[k].hits.store(hits(v[k]) / 2, std::memory_order_relaxed);
+        a = b;
+      }
+    }
   };
 
 } // namespace fsm_cxx
@@ -491,7 +766,8 @@ namespace fsm_cxx {
   AWESOME_MAKE_ENUM(Reason,
                     Unknown,
                     FailureGuard,
-                    StateNotFound)
+                    StateNotFound,
+                    CompletionLimit)
 
   template<typename S,
            typename EventT = event_t,
@@ -505,7 +781,8 @@ namespace fsm_cxx {
   class machine_t final {
   public:
     machine_t() = default;
-    ~machine_t() = default;
+    // waits for the actions step_async() handed to the executor
+    ~machine_t() { _deferred.queue->wait(); }
     machine_t(machine_t const &) = default;
     machine_t &operator=(machine_t &) = delete;
 
@@ -519,13 +796,135 @@ namespace fsm_cxx {
     using TransitionTable = std::unordered_map<State, Transition>;
     using OnAction = std::function<void(State const &, Event const &, State const &, typename Transition::Item const &, Payload const &)>;
     using OnErrorAction = std::function<void(Reason reason, State const &, Context &, Event const &, Payload const &)>;
+    using OnCommit = std::function<void(std::string const &event_name, Event const &, Payload const &, State const &from, State const &to)>;
     using StateActions = std::unordered_map<State, Actions>;
+
+    // a transition as kept for the batched subscribers
+    struct TransitionRecord {
+      State from{}, to{};
+      std::string event{};
+      Payload payload{};
+
+      void assign(std::string const &event_name, Event const &, Payload const &p, State const &f, State const &t) {
+        from = f, to = t;
+        event.assign(event_name);
+        payload = p;
+      }
+    };
+    using Subscribers = util::subscriber_list<TransitionRecord, std::string const &, Event const &, Payload const &, State const &, State const &>;
+    using Subscription = typename Subscribers::handle;
+    using OnBatch = typename Subscribers::Batch;
+
+    using Executor = detail::serial_queue::Executor;
+    // the result of step_async(): whether the state changed, and when
+    // its actions have run
+    struct Completion {
+      bool committed{false};
+      std::shared_future<void> done{};
+
+      bool ready() const { return !done.valid() || done.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+      void wait() const {
+        if (done.valid()) done.wait();
+      }
+    };
+
+    using Fields = typename detail::published_fields<Context>::type;
+    // the current state and the published context fields, as of version
+    struct Observed {
+      State state{};
+      Fields fields{};
+      std::uint64_t version{};
+    };
     using lock_guard_t = util::cool::lock_guard<MutexT>;
     using Guard = typename Transition::Guard;
 
   public:
     machine_t &reset() {
       _ctx.reset(_initial);
+      _history.clear();
+      _remember(_initial);
+      return publish();
+    }
+
+    // the composite state s is a sub-state of
+    std::optional<State> parent_of(State const &s) const {
+      if (auto it = _parents.find(s); it != _parents.end()) return it->second;
+      return std::nullopt;
+    }
+    // the sub-state a transition into composite enters
+    std::optional<State> default_of(State const &composite) const {
+      if (auto it = _defaults.find(composite); it != _defaults.end()) return it->second;
+      return std::nullopt;
+    }
+    // whether some state is a sub-state of another
+    bool has_composites() const { return !_parents.empty(); }
+    /**
+     * @brief the state a transition into the history of composite
+     * would resume, if one of its sub-states has been active since the
+     * last reset().
+     * @details The history of each composite state is recorded as its
+     * sub-states are entered: the sub-state directly under it (shallow)
+     * and the innermost state (deep).
+     */
+    std::optional<State> history_of(State const &composite, history_kind k = history_kind::deep) const {
+      auto it = _history.find(composite);
+      if (it == _history.end() || k == history_kind::none) return std::nullopt;
+      return k == history_kind::deep ? it->second.deep : it->second.shallow;
+    }
+
+    /**
+     * @brief read the current state, and the context fields its context
+     * publishes, without blocking the stepping thread.
+     * @details The current state is published under a seqlock each time
+     * it changes, then once more when the entry actions have run. A
+     * context publishes fields along with it by declaring them:
+     * @code{c++}
+     *   struct my_context : fsm_cxx::context_t<my_state_t> {
+     *     int retries{};
+     *     struct published { int retries; };
+     *     void publish(published &p) const { p.retries = retries; }
+     *   };
+     * @endcode
+     * Readers retry while a write is in progress, so that the state and
+     * the fields of an Observed were current together. The raw state
+     * (see state_id()) and the fields must be trivially copyable.
+     */
+    Observed observe() const {
+      static_assert(observable, "observe() needs a trivially copyable raw state and published fields");
+      std::uint64_t seq;
+      auto v = _published.read(&seq);
+      return Observed{State{v.state}, v.fields, seq};
+    }
+    // one attempt, false if a write was in progress
+    bool try_observe(Observed &o) const {
+      static_assert(observable, "try_observe() needs a trivially copyable raw state and published fields");
+      Value v;
+      if (!_published.try_read(v, &o.version)) return false;
+      o.state = State{v.state};
+      o.fields = v.fields;
+      return true;
+    }
+    /**
+     * @brief set the current state outside of step_by(), as a restore
+     * does: no action runs, the state is remembered in the history of
+     * the composite states around it and published with the fields.
+     */
+    machine_t &set_current(State const &s) {
+      _ctx.current(s);
+      _remember(s);
+      return publish();
+    }
+    /**
+     * @brief publish the current state and fields again, after they were
+     * changed outside of step_by().
+     */
+    machine_t &publish() {
+      if constexpr (observable) {
+        Value v;
+        v.state = detail::state_raw<State>::get(_ctx.current());
+        detail::published_fields<Context>::get(_ctx, v.fields);
+        _published.write(v);
+      }
       return (*this);
     }
 
@@ -537,11 +936,222 @@ namespace fsm_cxx {
       _on_error = fn;
       return (*this);
     }
+    /**
+     * @brief observe each transition at its commit point, right after
+     * the current state changes and before the entry actions run, with
+     * the name of the event. A journal attaches here.
+     * @see journal::sink
+     */
+    machine_t &on_commit(OnCommit &&fn) {
+      _on_commit = fn;
+      return (*this);
+    }
+
+    /**
+     * @brief add a transition subscriber, called like on_commit() but
+     * alongside any number of others. Subscribers can be added and
+     * removed from any thread while the machine steps; publishing to
+     * them takes no lock.
+     * @see util::subscriber_list
+     */
+    Subscription subscribe(OnCommit fn) { return _subscribers.add(std::move(fn)); }
+    /**
+     * @brief add a batched transition subscriber, called with the
+     * transitions by chunks of n from a delivery thread, with a ring of
+     * `chunks` chunks between the steps and the sink. A step never waits
+     * for the sink: when the ring is full the transition is dropped and
+     * counted by subscribers_dropped(). flush_subscribers() delivers the
+     * full and the partial chunks from the calling thread.
+     */
+    Subscription subscribe(std::size_t n, OnBatch fn, std::size_t chunks = 4) { return _subscribers.add(n, std::move(fn), chunks); }
+    // deliver its partial chunk and remove it; not from within a subscriber
+    bool unsubscribe(Subscription h) { return _subscribers.remove(h); }
+    void flush_subscribers() { _subscribers.flush(); }
+    std::size_t subscribers() const { return _subscribers.size(); }
+    std::uint64_t subscribers_dropped() const { return _subscribers.dropped(); }
+
+    /**
+     * @brief the executor step_async() hands the actions to, such as
+     * [&pool](std::function<void()> job) { pool.submit(std::move(job)); }.
+     * Without one, step_async() runs the actions inline.
+     */
+    machine_t &executor(Executor ex) {
+      _deferred.executor = std::move(ex);
+      return (*this);
+    }
+    // the step_async() whose actions have not started yet
+    std::size_t pending_actions() const { return _deferred.queue->pending(); }
+
+    /**
+     * @brief in replay mode step_by() evaluates the guards and moves the
+     * current state, but runs no actions, calls neither on_transition
+     * nor on_commit, and takes no completion transition: the effects of
+     * the events replayed already happened.
+     */
+    machine_t &replaying(bool b) {
+      _replaying = b;
+      return (*this);
+    }
+    bool replaying() const { return _replaying; }
+    /**
+     * @brief with skip_actions step_by() runs the guards and moves the
+     * current state as in replay mode, but takes the completion
+     * transitions as well: what a simulation or a model checker steps.
+     * A journal replay does not, as it recorded them one by one.
+     */
+    machine_t &skip_actions(bool b) {
+      _skip_actions = b;
+      return (*this);
+    }
+    bool skip_actions() const { return _skip_actions; }
+
+    Context &context() { return _ctx; }
+    Context const &context() const { return _ctx; }
+
+    TransitionTable const &transitions() const { return _trans_tbl; }
+    StateActions const &state_actions() const { return _state_actions; }
+    State const &initial_state() const { return _initial; }
+    State const &terminated_state() const { return _terminated; }
+    State const &error_state() const { return _error; }
+
+    /**
+     * @brief drop the transitions and state actions of the states that
+     * cannot be reached from the initial, terminated or error states.
+     * @details A state reached is in its composite states too, whose
+     * transitions it takes; a transition into a history reaches the
+     * sub-states recorded there as well as the default ones.
+     * @return the count of states removed
+     * @see frozen::optimize() for merging equivalent states as well
+     */
+    std::size_t prune_unreachable() {
+      std::unordered_map<State, bool> seen;
+      std::vector<State> q;
+      auto reach = [&seen, &q](State const &s) {
+        if (seen.emplace(s, true).second) q.push_back(s);
+      };
+      for (auto const *s : {&_initial, &_terminated, &_error}) reach(*s);
+      for (std::size_t i = 0; i < q.size(); i++) {
+        State const s{q[i]}; // q grows below
+        if (auto d = _defaults.find(s); d != _defaults.end()) reach(d->second);
+        if (auto p = _parents.find(s); p != _parents.end()) reach(p->second);
+        auto it = _trans_tbl.find(s);
+        if (it == _trans_tbl.end()) continue;
+        for (auto const &[ev, items] : it->second.m_)
+          for (auto const &item : items) {
+            reach(item.to);
+            if (item.history == history_kind::none) continue;
+            if (auto h = _history.find(item.to); h != _history.end()) reach(h->second.shallow), reach(h->second.deep);
+          }
+      }
+      std::unordered_map<State, bool> removed;
+      for (auto it = _trans_tbl.begin(); it != _trans_tbl.end();) {
+        if (seen.count(it->first)) {
+          ++it;
+          continue;
+        }
+        removed[it->first] = true;
+        it = _trans_tbl.erase(it);
+      }
+      for (auto it = _state_actions.begin(); it != _state_actions.end();) {
+        if (seen.count(it->first)) {
+          ++it;
+          continue;
+        }
+        removed[it->first] = true;
+        it = _state_actions.erase(it);
+      }
+      return removed.size();
+    }
+
+  public:
+    /**
+     * @brief one transition for load(): the fields transition() collects,
+     * with the event given by its name.
+     */
+    struct Descriptor {
+      S from{};
+      std::string event_name{};
+      S to{};
+      Guard guard{nullptr};
+      Action entry{nullptr};
+      Action exit{nullptr};
+      std::string guard_name{};
+      bool exclusive{false};
+      history_kind history{history_kind::none};
+      bool internal{false};
+    };
+    /**
+     * @brief the expected sizes of a definition, zero where unknown.
+     * @details states counts the source states of the transitions, and
+     * events_per_state the distinct events leaving one of them.
+     */
+    struct SizingHints {
+      std::size_t states{0};
+      std::size_t transitions{0};
+      std::size_t events_per_state{0};
+    };
+
+    // allocate the tables for the sizes hinted, ahead of the definition
+    machine_t &reserve(SizingHints const &hints) {
+      auto states = hints.states ? hints.states : hints.transitions;
+      _trans_tbl.reserve(_trans_tbl.size() + states);
+      _state_actions.reserve(_state_actions.size() + states);
+      return (*this);
+    }
+
+    /**
+     * @brief add many transitions at once.
+     * @details The tables are reserved once for the hints, the states
+     * and the events are each looked up once, and the descriptors are
+     * moved into the table when the range is an rvalue (copied
+     * otherwise). Without hints a sized range reserves for as many
+     * states as descriptors. Candidates keep the order of the range,
+     * after those already defined for the same state and event.
+     *
+     *     std::vector<M::Descriptor> v;
+     *     v.push_back({st::Idle, "app::start", st::Running});
+     *     m.load(std::move(v), {states, transitions, events_per_state});
+     */
+    template<typename Range>
+    machine_t &load(Range &&descriptors, SizingHints hints = {}) {
+      if (!hints.states && !hints.transitions) {
+        if constexpr (detail::is_sized_range<Range>::value) hints.transitions = std::size(descriptors);
+      }
+      reserve(hints);
+      auto per_state = hints.events_per_state;
+      if (!per_state && hints.states && hints.transitions) per_state = (hints.transitions + hints.states - 1) / hints.states;
+
+      constexpr bool movable = !std::is_lvalue_reference<Range>::value;
+      for (auto &d : descriptors) {
+        _has_completions = _has_completions || d.event_name == completion_name();
+        auto [st, created] = _trans_tbl.try_emplace(State{d.from});
+        auto &trans = st->second;
+        if (created) {
+          trans.adaptive_period = _adaptive_period;
+          if (per_state) trans.m_.reserve(per_state);
+        }
+        if constexpr (movable) {
+          auto &items = trans.m_.try_emplace(std::move(d.event_name)).first->second;
+          items.emplace_back(State{d.to}, std::move(d.guard), std::move(d.entry), std::move(d.exit), std::move(d.guard_name));
+          items.back().exclusive = d.exclusive;
+          items.back().history = d.history;
+          items.back().internal = d.internal;
+        } else {
+          auto &items = trans.m_[d.event_name];
+          items.emplace_back(State{d.to}, Guard{d.guard}, Action{d.entry}, Action{d.exit}, d.guard_name);
+          items.back().exclusive = d.exclusive;
+          items.back().history = d.history;
+          items.back().internal = d.internal;
+        }
+      }
+      return (*this);
+    }
 
   protected:
     machine_t &initial_set(S st, ActionT &&entry_action = nullptr, ActionT &&exit_action = nullptr) {
       _initial = st;
       _ctx.current(st);
+      publish();
       return state_set(st, std::move(entry_action), std::move(exit_action));
     }
     machine_t &terminated_set(S st, ActionT &&entry_action = nullptr, ActionT &&exit_action = nullptr) {
@@ -553,6 +1163,28 @@ namespace fsm_cxx {
       return state_set(st, std::move(entry_action), std::move(exit_action));
     }
 
+    /**
+     * @brief make child a sub-state of the composite state parent.
+     * @details A transition declared on a composite state is taken from
+     * any of its sub-states that has none for the event. A transition
+     * leaving a sub-state runs the exit actions of the composite states
+     * it leaves, innermost first, and then the entry actions of those it
+     * enters, outermost first. A transition into a composite state
+     * enters its default sub-state, if it has one, and so on down.
+     * A parent that would make a cycle is ignored.
+     */
+    machine_t &parent_set(State const &child, State const &parent, bool as_default = false) {
+      for (auto const *p = &parent;;) {
+        if (*p == child) return (*this);
+        auto it = _parents.find(*p);
+        if (it == _parents.end()) break;
+        p = &it->second;
+      }
+      _parents.insert_or_assign(child, parent);
+      if (as_default) _defaults.insert_or_assign(parent, child);
+      return (*this);
+    }
+
     machine_t &state_set(S st, ActionT &&entry_action = nullptr, ActionT &&exit_action = nullptr) {
       Actions actions{std::move(entry_action), std::move(exit_action)};
       if (actions.valid())
@@ -562,7 +1194,19 @@ namespace fsm_cxx {
 
     template<typename _Callable, typename... _Args>
     machine_t &guard_add(State const &st, _Callable &&f, _Args &&...args) {
-      _ctx.add_guard(st, std::forward<_Callable>(f), std::forward<_Args>(args)...);
+      return named_guard_add(std::string{}, st, std::forward<_Callable>(f), std::forward<_Args>(args)...);
+    }
+    template<typename _Callable, typename... _Args>
+    machine_t &named_guard_add(std::string const &name, State const &st, _Callable &&f, _Args &&...args) {
+      using Base = typename Context::Context;
+      if constexpr (std::is_same<Context, Base>::value) {
+        _ctx.add_named_guard(name, st, std::forward<_Callable>(f), std::forward<_Args>(args)...);
+      } else {
+        // ContextT derives from context_t: the guards want to see the derived type
+        using namespace std::placeholders;
+        Guard fn = fsm_cxx::util::cool::bind_tie<4>(std::forward<_Callable>(f), std::forward<_Args>(args)..., _1, _2, _3, _4, _5);
+        _ctx.add_named_guard(name, st, [fn](Event const &ev, Base &c, State const &s, Payload const &p) -> bool { return fn(ev, static_cast<Context &>(c), s, p); });
+      }
       return (*this);
     }
 
@@ -577,6 +1221,8 @@ namespace fsm_cxx {
       return transition_set(f, std::forward<Transition>(trans));
     }
     machine_t &transition_set(State const &from, Transition &&trans) {
+      trans.adaptive_period = _adaptive_period;
+      _has_completions = _has_completions || trans.m_.count(completion_name());
       if (auto it = _trans_tbl.find(from); it == _trans_tbl.end())
         _trans_tbl.emplace(from, std::move(trans));
       else
@@ -584,19 +1230,49 @@ namespace fsm_cxx {
       return (*this);
     }
 
+  public:
+    /**
+     * @brief enable the adaptive candidate ordering.
+     * @details When an event has several candidate transitions, step_by()
+     * evaluates their guards in order. In adaptive mode each candidate
+     * counts how often it is chosen, and every period choices of a
+     * candidate the runs of candidates declared exclusive() of its event
+     * are reordered, most chosen first, so that the common case
+     * evaluates a single guard. Candidates not declared exclusive never
+     * move. The reordering waits for the outermost step to return, so
+     * that no step, even one an action nests in another, sees its
+     * candidate move.
+     *
+     * Only a machine without a mutex (MutexT = void) can be adaptive:
+     * the steps running and the candidates due are counted without
+     * synchronization, and a step on another thread could be walking
+     * the candidates being reordered.
+     * @param period 0 to disable (the default)
+     */
+    machine_t &adaptive(std::uint32_t period = 64) {
+      static_assert(std::is_void<MutexT>::value, "adaptive() reorders the candidates without synchronization, use a machine_t without a mutex");
+      _adaptive_period = period;
+      for (auto &[from, tr] : _trans_tbl) tr.adaptive_period = period;
+      return (*this);
+    }
+
   public:
     class state_builder {
       machine_t &owner;
       S st{};
       std::vector<Guard> guard_fn{};
+      std::vector<std::string> guard_names{};
       Action entry_fn{nullptr};
       Action exit_fn{nullptr};
-      bool initial_, terminated_, error_;
+      std::optional<S> parent_{};
+      bool initial_{}, terminated_{}, error_{}, default_{};
 
     public:
       state_builder(machine_t &tt)
           : owner(tt) {}
       machine_t &build() {
+        if (parent_)
+          owner.parent_set(st, *parent_, default_);
         if (initial_) {
           return owner.initial_set(st, std::move(entry_fn), std::move(exit_fn));
         } else if (terminated_) {
@@ -604,8 +1280,8 @@ namespace fsm_cxx {
         } else if (error_) {
           return owner.error_set(st, std::move(entry_fn), std::move(exit_fn));
         }
-        for (auto &fn : guard_fn)
-          owner.guard_add(st, fn);
+        for (std::size_t i = 0; i < guard_fn.size(); i++)
+          owner.named_guard_add(guard_names[i], st, guard_fn[i]);
         return owner.state_set(st, std::move(entry_fn), std::move(exit_fn));
       }
       state_builder &set(S s) {
@@ -627,18 +1303,49 @@ namespace fsm_cxx {
         initial_ = terminated_ = false;
         return (*this);
       }
+      /**
+       * @brief make this state a sub-state of the composite state p.
+       * @see machine_t::parent_set()
+       */
+      state_builder &parent(S p) {
+        parent_ = p;
+        return (*this);
+      }
+      // the sub-state entered when a transition targets the parent
+      state_builder &as_default() {
+        default_ = true;
+        return (*this);
+      }
       state_builder &guard(Guard &&fn) {
         guard_fn.emplace_back(fn);
+        guard_names.emplace_back();
+        return (*this);
+      }
+      state_builder &guard(std::string const &name, Guard &&fn) {
+        guard_fn.emplace_back(fn);
+        guard_names.emplace_back(name);
         return (*this);
       }
       template<typename _Callable, typename... _Args>
       state_builder &entry_action(_Callable &&f, _Args &&...args) {
-        entry_fn.update(f, args...);
+        entry_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
         return (*this);
       }
       template<typename _Callable, typename... _Args>
       state_builder &exit_action(_Callable &&f, _Args &&...args) {
-        exit_fn.update(f, args...);
+        exit_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        return (*this);
+      }
+      template<typename _Callable, typename... _Args>
+      state_builder &entry_action_named(std::string const &name, _Callable &&f, _Args &&...args) {
+        entry_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        entry_fn.name(name);
+        return (*this);
+      }
+      template<typename _Callable, typename... _Args>
+      state_builder &exit_action_named(std::string const &name, _Callable &&f, _Args &&...args) {
+        exit_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        exit_fn.name(name);
         return (*this);
       }
     };
@@ -651,13 +1358,23 @@ namespace fsm_cxx {
       std::string event_name{};
       S to{};
       Guard guard_fn{nullptr};
+      std::string guard_name{};
       Action entry_fn{nullptr};
       Action exit_fn{nullptr};
+      bool exclusive_{false};
+      history_kind history_{history_kind::none};
+      bool internal_{false};
 
     public:
       transition_builder(machine_t &tt)
           : owner(tt) {}
-      machine_t &build() { return owner.transition_set(from, Transition{event_name, to, std::move(guard_fn), std::move(entry_fn), std::move(exit_fn)}); }
+      machine_t &build() {
+        Transition t{event_name, internal_ ? from : to, std::move(guard_fn), std::move(entry_fn), std::move(exit_fn), guard_name};
+        t.m_.begin()->second.back().exclusive = exclusive_;
+        t.m_.begin()->second.back().history = history_;
+        t.m_.begin()->second.back().internal = internal_;
+        return owner.transition_set(from, std::move(t));
+      }
       template<typename Evt,
                std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value && !std::is_same<Evt, std::string>::value, bool> = true>
       transition_builder &set(S from_, Evt const &, S to_) {
@@ -670,14 +1387,74 @@ namespace fsm_cxx {
         guard_fn = std::move(fn);
         return (*this);
       }
+      transition_builder &guard(std::string const &name, Guard &&fn) {
+        guard_fn = std::move(fn);
+        guard_name = name;
+        return (*this);
+      }
+      /**
+       * @brief declare that the guard of this transition never passes
+       * together with the guards of the other exclusive transitions of
+       * the same state and event, which allows reordering them.
+       * @see machine_t::adaptive()
+       */
+      transition_builder &exclusive() {
+        exclusive_ = true;
+        return (*this);
+      }
+      /**
+       * @brief target the history of the composite state to rather than
+       * its default sub-states: the transition resumes the sub-state
+       * that was active when the composite was last left, whatever the
+       * path that led there.
+       */
+      transition_builder &to_history(history_kind k = history_kind::deep) {
+        history_ = k;
+        return (*this);
+      }
+      /**
+       * @brief an internal transition runs its actions, and nothing else:
+       * the state does not change, no state action runs, on_commit() and
+       * the subscribers are not called. The target is ignored.
+       */
+      transition_builder &internal() {
+        internal_ = true;
+        return (*this);
+      }
+      /**
+       * @brief a completion transition from from_ to to_: step_by() takes
+       * it right after entering from_, if its guard holds, and then the
+       * completion transitions of to_, in a loop. Guards and actions see
+       * the event of the step; on_commit() and the subscribers see
+       * completion_name(). In replaying mode they are not taken: their
+       * commits were recorded on their own.
+       */
+      transition_builder &completion(S from_, S to_) {
+        from = from_;
+        event_name = completion_name();
+        to = to_;
+        return (*this);
+      }
       template<typename _Callable, typename... _Args>
       transition_builder &entry_action(_Callable &&f, _Args &&...args) {
-        entry_fn.update(f, args...);
+        entry_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
         return (*this);
       }
       template<typename _Callable, typename... _Args>
       transition_builder &exit_action(_Callable &&f, _Args &&...args) {
-        exit_fn.update(f, args...);
+        exit_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        return (*this);
+      }
+      template<typename _Callable, typename... _Args>
+      transition_builder &entry_action_named(std::string const &name, _Callable &&f, _Args &&...args) {
+        entry_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        entry_fn.name(name);
+        return (*this);
+      }
+      template<typename _Callable, typename... _Args>
+      transition_builder &exit_action_named(std::string const &name, _Callable &&f, _Args &&...args) {
+        exit_fn.update(std::forward<_Callable>(f), std::forward<_Args>(args)...);
+        exit_fn.name(name);
         return (*this);
       }
     };
@@ -697,60 +1474,319 @@ namespace fsm_cxx {
       return step_by(event_name, ev, payload);
     }
     bool step_by(std::string const &event_name, Event const &ev, Payload const &payload) {
-      auto reason = Reason::StateNotFound;
+      stepping_guard g{*this};
+      return _step(event_name, ev, payload);
+    }
 
-      typename TransitionTable::iterator it;
-      lock_guard_t locker;
-      auto &from = _ctx.current(); // reentrant is ok on the same lock/mutex.
-      while ((it = _trans_tbl.find(from)) != _trans_tbl.end()) {
-        auto &tr = it->second;
-        auto [ok, item] = tr.get(event_name, ev, _ctx, payload);
-        if (ok) {
-          auto &trans = item;
-
-          // verify state guards
-          if (!_ctx.verify(trans.to, ev, payload)) {
-            reason = Reason::FailureGuard;
+  private:
+    // counts the steps running, nested ones included; the outermost
+    // reorders the candidates adaptive() found due
+    struct stepping_guard {
+      machine_t &m;
+      explicit stepping_guard(machine_t &o)
+          : m(o) { m._stepping++; }
+      ~stepping_guard() {
+        if (--m._stepping == 0 && !m._due.empty()) m._reorder_due();
+      }
+    };
+    void _reorder_due() {
+      auto due = std::move(_due);
+      _due.clear();
+      for (auto &[tr, event_name] : due) tr->reorder(event_name);
+    }
+
+    bool _step(std::string const &event_name, Event const &ev, Payload const &payload) {
+      Reason reason;
+      State const *to{};
+      auto *item = _select(event_name, ev, payload, reason, to);
+      if (!item) {
+        if (_on_error)
+          _on_error(reason, _ctx.current(), _ctx, ev, payload);
+        return false;
+      }
+      _fire(event_name, *item, *to, ev, payload);
+      if (_has_completions && !_replaying)
+        for (unsigned n = 0; (item = _select(completion_name(), ev, payload, reason, to)) != nullptr; n++) {
+          if (n == _completion_limit) {
+            if (_on_error)
+              _on_error(Reason::CompletionLimit, _ctx.current(), _ctx, ev, payload);
             break;
           }
+          _fire(completion_name(), *item, *to, ev, payload);
+        }
 
-          locker.unlock();
+      // UNUSED(actions);
+      // fsm_debug("        [%s] -- %s --> [%s]", state_to_sting(_ctx.current).c_str(), event_name.c_str(), state_to_sting(to).c_str());
+      return true;
+    }
 
-          reason = Reason::Unknown;
-          auto leave = _state_actions.find(from);
-          trans.exit_action(ev, _ctx, from, payload);
-          if (leave != _state_actions.end())
-            leave->second.exit_action(ev, _ctx, trans.to, payload);
+  public:
+    /**
+     * @brief a two-phase step: commit the state change now, run the
+     * actions later on the executor.
+     * @details The transition is chosen and the current state changes
+     * synchronously, and on_commit() and the subscribers see it at once,
+     * in commit order. The exit actions, on_transition() and the entry
+     * actions then run on the executor with copies of the event and the
+     * payload, in the order the steps were committed and one step at a
+     * time per machine; Completion::done is ready once they have run,
+     * and holds the exception if one of them threw, the actions of the
+     * later steps running still. The entry actions publish the fields of
+     * observe() along with the state last committed. The machine must not
+     * be destroyed by one of its actions: its destructor waits for the
+     * actions pending.
+     * The completion transitions that follow are committed at once too,
+     * their guards evaluated before the entry actions have run.
+     *
+     * The guards of the next steps may run while earlier actions are
+     * still pending: what they share through the context must be made
+     * safe for it. The definition must not change while actions are
+     * pending.
+     */
+    template<typename Evt,
+             std::enable_if_t<std::is_base_of<Event, std::decay_t<Evt>>::value && !std::is_same<std::decay_t<Evt>, std::string>::value, bool> = true>
+    Completion step_async(Evt &&ev, Payload const &payload = Payload{}) {
+      std::string event_name{fsm_cxx::debug::type_name<std::decay_t<Evt>>()};
+      return step_async(event_name, std::make_shared<std::decay_t<Evt> const>(std::forward<Evt>(ev)), payload);
+    }
+    Completion step_async(std::string const &event_name, std::shared_ptr<Event const> ev, Payload const &payload) {
+      stepping_guard g{*this};
+      Reason reason;
+      State const *target{};
+      auto *item = _select(event_name, *ev, payload, reason, target);
+      Completion c;
+      if (!item) {
+        if (_on_error)
+          _on_error(reason, _ctx.current(), _ctx, *ev, payload);
+        return c;
+      }
+      c.committed = true;
+      auto p = std::make_shared<Payload const>(payload);
+      c.done = _fire_async(event_name, *item, *target, ev, p);
+      if (_has_completions && !_replaying)
+        for (unsigned n = 0; (item = _select(completion_name(), *ev, payload, reason, target)) != nullptr; n++) {
+          if (n == _completion_limit) {
+            if (_on_error)
+              _on_error(Reason::CompletionLimit, _ctx.current(), _ctx, *ev, payload);
+            break;
+          }
+          c.done = _fire_async(completion_name(), *item, *target, ev, p); // done after the earlier ones
+        }
+      return c;
+    }
 
-          _ctx.current(trans.to);
-          if (_on_action)
-            _on_action(from, ev, trans.to, trans, payload);
+    /**
+     * @brief the event name completion transitions are declared with.
+     * @see transition_builder::completion()
+     */
+    static std::string const &completion_name() {
+      static std::string const name{fsm_cxx::debug::type_name<completion_event>()};
+      return name;
+    }
+    /**
+     * @brief how many completion transitions one step may chain, so that
+     * a cycle of them whose guards keep passing ends; reaching it calls
+     * on_error() with Reason::CompletionLimit.
+     */
+    machine_t &completion_limit(unsigned n) {
+      _completion_limit = n;
+      return (*this);
+    }
 
-          auto enter = _state_actions.find(trans.to);
-          trans.entry_action(ev, _ctx, trans.to, payload);
-          if (enter != _state_actions.end())
+  private:
+    // take trans from the current state to to
+    void _fire(std::string const &event_name, typename Transition::Item &trans, State const &to, Event const &ev, Payload const &payload) {
+      if (_replaying || _skip_actions) {
+        if (!trans.internal) {
+          _ctx.current(to);
+          _remember(to);
+          publish();
+        }
+        return;
+      }
+      // a copy: the current state changes at the commit, and the actions
+      // after it still see where the transition came from
+      State const from{_ctx.current()};
+      auto const *lca = trans.internal ? nullptr : _common(from, to);
+      trans.exit_action(ev, _ctx, from, payload);
+      if (!trans.internal) {
+        _leave(from, lca, [&](State const &s) {
+          if (auto leave = _state_actions.find(s); leave != _state_actions.end())
+            leave->second.exit_action(ev, _ctx, to, payload);
+        });
+        if (_on_commit || !_subscribers.empty()) {
+          _commit(event_name, ev, payload, from, to);
+        } else {
+          _ctx.current(to);
+          _remember(to);
+          publish();
+        }
+      }
+      if (_on_action)
+        _on_action(from, ev, to, trans, payload);
+
+      trans.entry_action(ev, _ctx, to, payload);
+      if (!trans.internal)
+        _enter(to, lca, [&](State const &s) {
+          if (auto enter = _state_actions.find(s); enter != _state_actions.end())
             enter->second.entry_action(ev, _ctx, from, payload);
+        });
+      if constexpr (!std::is_same<Fields, detail::no_fields>::value)
+        publish(); // the fields the entry actions changed
+    }
+    // commit trans now, run its actions on the executor; the future of
+    // their completion
+    std::shared_future<void> _fire_async(std::string const &event_name, typename Transition::Item &trans, State const &target, std::shared_ptr<Event const> const &ev, std::shared_ptr<Payload const> const &p) {
+      State const prev{_ctx.current()};
+      auto const *lca = trans.internal ? nullptr : _common(prev, target);
+      if (!trans.internal)
+        _commit(event_name, *ev, *p, prev, target);
+      if (_replaying || _skip_actions) return {};
+
+      auto done = std::make_shared<std::promise<void>>();
+      auto job = [this, ev, p, prev, to = State{target}, lca, trans = trans, done]() {
+        try {
+          _run_actions(trans, prev, to, lca, *ev, *p);
+          done->set_value();
+        } catch (...) {
+          done->set_exception(std::current_exception());
+        }
+      };
+      auto f = done->get_future().share();
+      if (_deferred.executor)
+        _deferred.queue->post(_deferred.executor, std::move(job));
+      else
+        job();
+      return f;
+    }
+    // the actions of a transition committed by step_async(), on the
+    // executor: the current state may have moved on since, so only the
+    // fields are published, along with the state last committed
+    void _run_actions(typename Transition::Item const &trans, State const &prev, State const &to, State const *lca, Event const &ev, Payload const &payload) {
+      trans.exit_action(ev, _ctx, prev, payload);
+      if (!trans.internal)
+        _leave(prev, lca, [&](State const &s) {
+          if (auto leave = _state_actions.find(s); leave != _state_actions.end())
+            leave->second.exit_action(ev, _ctx, to, payload);
+        });
+      if (_on_action)
+        _on_action(prev, ev, to, trans, payload);
+      trans.entry_action(ev, _ctx, to, payload);
+      if (!trans.internal)
+        _enter(to, lca, [&](State const &s) {
+          if (auto enter = _state_actions.find(s); enter != _state_actions.end())
+            enter->second.entry_action(ev, _ctx, prev, payload);
+        });
+      if constexpr (observable && !std::is_same<Fields, detail::no_fields>::value)
+        _published.update([this](Value &v) { detail::published_fields<Context>::get(_ctx, v.fields); });
+    }
 
-          // UNUSED(actions);
-          // fsm_debug("        [%s] -- %s --> [%s]", state_to_sting(_ctx.current).c_str(), event_name.c_str(), state_to_sting(to).c_str());
-          return true;
+    // the transition event_name takes from the current state, or from
+    // the innermost composite state around it that has one, or nullptr
+    // with the reason; to is the state it leads to
+    typename Transition::Item *_select(std::string const &event_name, Event const &ev, Payload const &payload, Reason &reason, State const *&to) {
+      reason = Reason::StateNotFound;
+      lock_guard_t locker;
+      for (auto const *from = &_ctx.current();;) {
+        if (auto it = _trans_tbl.find(*from); it != _trans_tbl.end()) {
+          auto [ok, item] = it->second.get(event_name, ev, _ctx, payload);
+          if (ok) {
+            if (_adaptive_period && item.exclusive && item.hits.load(std::memory_order_relaxed) % _adaptive_period == 0)
+              _due.emplace_back(&it->second, event_name);
+            if (item.internal) {
+              to = &_ctx.current(); // enters nothing: no state guards either
+              reason = Reason::Unknown;
+              return &item;
+            }
+            to = &_target(item);
+            // verify state guards
+            if (!_ctx.verify(*to, ev, payload)) {
+              reason = Reason::FailureGuard;
+              return nullptr;
+            }
+            reason = Reason::Unknown;
+            return &item;
+          }
         }
-        break;
+        if (_parents.empty()) return nullptr;
+        auto up = _parents.find(*from);
+        if (up == _parents.end()) return nullptr;
+        from = &up->second;
+      }
+    }
+    // where item leads: its history, or its default sub-states
+    State const &_target(typename Transition::Item const &item) const {
+      if (item.history != history_kind::none) {
+        if (auto h = _history.find(item.to); h != _history.end())
+          return item.history == history_kind::deep ? h->second.deep : _descend(h->second.shallow);
+      }
+      return _descend(item.to);
+    }
+    State const &_descend(State const &s) const {
+      auto const *p = &s;
+      if (!_defaults.empty())
+        for (auto it = _defaults.find(*p); it != _defaults.end(); it = _defaults.find(*p)) p = &it->second;
+      return *p;
+    }
+    // the innermost composite state around both from and to, which a
+    // transition between them neither leaves nor enters
+    State const *_common(State const &from, State const &to) const {
+      if (_parents.empty()) return nullptr;
+      for (auto a = _parents.find(from); a != _parents.end(); a = _parents.find(a->second))
+        for (auto b = _parents.find(to); b != _parents.end(); b = _parents.find(b->second))
+          if (a->second == b->second) return &a->second;
+      return nullptr;
+    }
+    // s and the composite states around it up to lca, innermost first
+    template<typename F>
+    void _leave(State const &s, State const *lca, F &&f) const {
+      f(s);
+      if (_parents.empty()) return;
+      for (auto p = _parents.find(s); p != _parents.end() && !(lca && p->second == *lca); p = _parents.find(p->second))
+        f(p->second);
+    }
+    // the same, outermost first
+    template<typename F>
+    void _enter(State const &s, State const *lca, F &&f) const {
+      if (!_parents.empty())
+        if (auto p = _parents.find(s); p != _parents.end() && !(lca && p->second == *lca))
+          _enter(p->second, lca, f);
+      f(s);
+    }
+    // record s as the history of the composite states around it
+    void _remember(State const &s) {
+      if (_parents.empty()) return;
+      auto const *child = &s;
+      for (auto p = _parents.find(s); p != _parents.end(); p = _parents.find(p->second)) {
+        auto &h = _history[p->second];
+        h.shallow = *child;
+        h.deep = s;
+        child = &p->second;
       }
-      if (_on_error)
-        _on_error(reason, from, _ctx, ev, payload);
-      return false;
+    }
+    void _commit(std::string const &event_name, Event const &ev, Payload const &payload, State const &prev, State const &to) {
+      _ctx.current(to);
+      _remember(to);
+      publish();
+      if (_replaying || _skip_actions) return;
+      if (_on_commit)
+        _on_commit(event_name, ev, payload, prev, to);
+      _subscribers.publish(event_name, ev, payload, prev, to);
     }
 
   public:
     static std::string state_to_sting(StateT const &state) { return detail::shorten(to_string(state)); }
     static std::string state_to_sting(S const &state) { return detail::shorten(to_string(state)); }
 
-  protected:
+  public:
+    /**
+     * @brief read one character and step by it as a char_event<CharT>.
+     */
     friend std::basic_istream<CharT> &operator>>(std::basic_istream<CharT> &is, machine_t &o) {
+      static_assert(std::is_base_of<Event, char_event<CharT>>::value, "operator>> steps by char_event<CharT>, which must derive from EventT");
       CharT c;
-      is >> c; // TODO process the input stream (is >> c) and convert it to event and trigger
-      o.step_by(c);
+      if (is.get(c))
+        o.step_by(char_event<CharT>{c});
       return is;
     }
 
@@ -769,7 +1805,28 @@ namespace fsm_cxx {
     TransitionTable _trans_tbl{};
     OnAction _on_action{}; // for debugging
     OnErrorAction _on_error{};
+    OnCommit _on_commit{};
+    Subscribers _subscribers{};
     StateActions _state_actions{}; // entry/exit actions for states
+    struct History {
+      State shallow{}, deep{};
+    };
+    std::unordered_map<State, State> _parents{};  // sub-state -> composite state
+    std::unordered_map<State, State> _defaults{}; // composite state -> default sub-state
+    std::unordered_map<State, History> _history{};
+    std::uint32_t _adaptive_period{0};
+    unsigned _stepping{0};                                          // steps running, see stepping_guard
+    std::vector<std::pair<Transition *, std::string>> _due{};     // candidates to reorder after them
+    unsigned _completion_limit{64};
+    bool _has_completions{false};
+    bool _replaying{false};
+    bool _skip_actions{false};
+
+    using Raw = typename detail::state_raw<State>::type;
+    using Value = detail::published_value<Raw, Fields>;
+    static constexpr bool observable = std::is_trivially_copyable<Raw>::value && std::is_trivially_copyable<Fields>::value;
+    std::conditional_t<observable, util::seqlock<Value>, detail::no_seqlock> _published{};
+    detail::deferred_actions _deferred{};
   };                               // class machine_t
 
   template<typename S,
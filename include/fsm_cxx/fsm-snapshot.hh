@@ -0,0 +1,385 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/12.
+//
+
+#ifndef __FSM_CXX_FSM_SNAPSHOT_HH
+#define __FSM_CXX_FSM_SNAPSHOT_HH
+
+#include "fsm-sm.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// ----------------------------- snapshot format
+namespace fsm_cxx { namespace snapshot {
+
+  /**
+   * @brief layout of a snapshot stream.
+   * @details A snapshot is a 16 bytes file_header followed by records.
+   * Each record is a record_header (state id and the size of the user
+   * context bytes), the context bytes themselves, and zero padding up to
+   * a 4 bytes boundary. All integers are in host byte order; a stream
+   * produced on a host with a different byte order is rejected by view.
+   */
+  constexpr std::uint32_t magic = 0x534d5346; // "FSMS"
+  constexpr std::uint16_t version = 1;
+  constexpr std::uint16_t byte_order_mark = 0x0102;
+
+  struct file_header {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t byte_order;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+  };
+  static_assert(sizeof(file_header) == 16, "file_header must be 16 bytes");
+
+  struct record_header {
+    std::uint32_t state;
+    std::uint32_t context_size;
+  };
+  static_assert(sizeof(record_header) == 8, "record_header must be 8 bytes");
+
+  namespace detail {
+    constexpr std::size_t align4(std::size_t n) { return (n + 3) & ~std::size_t(3); }
+  } // namespace detail
+
+}} // namespace fsm_cxx::snapshot
+
+// ----------------------------- writer, reader
+namespace fsm_cxx { namespace snapshot {
+
+  /**
+   * @brief a cursor over the context bytes of one record.
+   * @details Handed to the user's snapshot_load() hook. get_bytes() and
+   * get_string() return views into the underlying buffer, no copy is made.
+   */
+  class reader {
+  public:
+    reader(char const *data, std::size_t size) : _p(data), _end(data + size) {}
+
+    template<typename T>
+    bool get(T &v) {
+      static_assert(std::is_trivially_copyable<T>::value, "reader::get() needs a trivially copyable type");
+      if (remaining() < sizeof(T)) return _fail();
+      std::memcpy(&v, _p, sizeof(T));
+      _p += sizeof(T);
+      return true;
+    }
+    bool get_bytes(std::size_t n, std::string_view &out) {
+      if (remaining() < n) return _fail();
+      out = std::string_view{_p, n};
+      _p += n;
+      return true;
+    }
+    bool get_string(std::string_view &out) {
+      std::uint32_t n{};
+      return get(n) && get_bytes(n, out);
+    }
+
+    std::size_t remaining() const { return static_cast<std::size_t>(_end - _p); }
+    bool ok() const { return _ok; }
+
+  private:
+    bool _fail() {
+      _ok = false;
+      return false;
+    }
+
+  private:
+    char const *_p;
+    char const *_end;
+    bool _ok{true};
+  };
+
+  /**
+   * @brief streaming snapshot writer.
+   * @details Records are accumulated in a buffer and handed to the
+   * std::ostream in large chunks, so the per-instance cost is a few
+   * memcpy's. When constructed on a std::string the records are appended
+   * to it directly.
+   * @code{c++}
+   *   std::ofstream ofs("pool.snap", std::ios::binary);
+   *   fsm_cxx::snapshot::writer w(ofs);
+   *   w.write_pool(machines.begin(), machines.end());
+   *   w.flush();
+   * @endcode
+   */
+  class writer {
+  public:
+    explicit writer(std::ostream &os, std::size_t buffer_size = 64 * 1024)
+        : _os(&os), _threshold(buffer_size) {
+      _buf.reserve(buffer_size + 256);
+      _put_header();
+    }
+    // with_header false appends bare bytes, for the formats embedding records
+    explicit writer(std::string &out, bool with_header = true)
+        : _out(&out) {
+      if (with_header) _put_header();
+    }
+    ~writer() { flush(); }
+    writer(writer const &) = delete;
+    writer &operator=(writer const &) = delete;
+
+    template<typename T>
+    void put(T const &v) {
+      static_assert(std::is_trivially_copyable<T>::value, "writer::put() needs a trivially copyable type");
+      put_bytes(&v, sizeof(T));
+    }
+    void put_bytes(void const *p, std::size_t n) { _target().append(static_cast<char const *>(p), n); }
+    void put_string(std::string_view s) {
+      put(static_cast<std::uint32_t>(s.size()));
+      put_bytes(s.data(), s.size());
+    }
+
+    /**
+     * @brief append one record: the current state of ctx and the bytes
+     * produced by its snapshot_save() hook, if any.
+     */
+    template<typename ContextT>
+    void write(ContextT const &ctx);
+
+    /**
+     * @brief append one record for every element of [first, last).
+     * @details elements may be machine_t's or contexts.
+     */
+    template<typename It>
+    void write_pool(It first, It last) {
+      for (; first != last; ++first)
+        write(*first);
+    }
+
+    /**
+     * @brief hand the buffered records to the output stream.
+     */
+    void flush() {
+      if (_os && !_buf.empty()) {
+        _os->write(_buf.data(), static_cast<std::streamsize>(_buf.size()));
+        _buf.clear();
+      }
+    }
+
+    std::size_t count() const { return _count; }
+
+  private:
+    std::string &_target() { return _out ? *_out : _buf; }
+    void _put_header() {
+      file_header h{magic, version, byte_order_mark, 0, 0};
+      put(h);
+    }
+    void _end_record() {
+      ++_count;
+      if (_os && _buf.size() >= _threshold)
+        flush();
+    }
+
+  private:
+    std::ostream *_os{nullptr};
+    std::string *_out{nullptr};
+    std::string _buf{};
+    std::size_t _threshold{0};
+    std::size_t _count{0};
+  };
+
+}} // namespace fsm_cxx::snapshot
+
+// ----------------------------- context_codec
+namespace fsm_cxx { namespace snapshot {
+
+  /**
+   * @brief serialization hook for the user part of a context.
+   * @details By default only the current state is persisted. A context
+   * type (usually derived from context_t) that provides
+   * @code{c++}
+   *   void snapshot_save(fsm_cxx::snapshot::writer &w) const;
+   *   bool snapshot_load(fsm_cxx::snapshot::reader &r);
+   * @endcode
+   * gets those called; alternatively specialize context_codec for it.
+   */
+  template<typename ContextT, typename = void>
+  struct context_codec {
+    static void save(ContextT const &, writer &) {}
+    static bool load(ContextT &, reader &) { return true; }
+  };
+
+  template<typename ContextT>
+  struct context_codec<ContextT, std::void_t<decltype(std::declval<ContextT const &>().snapshot_save(std::declval<writer &>()))>> {
+    static void save(ContextT const &c, writer &w) { c.snapshot_save(w); }
+    static bool load(ContextT &c, reader &r) { return c.snapshot_load(r); }
+  };
+
+  namespace detail {
+    template<typename T, typename = void>
+    struct context_of {
+      using type = T;
+      static T &get(T &o) { return o; }
+      static T const &get(T const &o) { return o; }
+    };
+    template<typename T>
+    struct context_of<T, std::void_t<decltype(std::declval<T &>().context())>> {
+      using type = std::decay_t<decltype(std::declval<T &>().context())>;
+      static type &get(T &o) { return o.context(); }
+      static type const &get(T const &o) { return o.context(); }
+    };
+    // a machine sets its current state with set_current(), see restore()
+    template<typename T, typename = void>
+    struct is_machine : std::false_type {};
+    template<typename T>
+    struct is_machine<T, std::void_t<decltype(std::declval<T &>().set_current(std::declval<typename T::State const &>()))>> : std::true_type {};
+  } // namespace detail
+
+  template<typename ContextT>
+  inline void writer::write(ContextT const &o) {
+    using CO = detail::context_of<ContextT>;
+    using Ctx = typename CO::type;
+    auto const &ctx = CO::get(o);
+
+    auto &t = _target();
+    auto start = t.size();
+    record_header rh{state_id(ctx.current()), 0};
+    put(rh);
+    context_codec<Ctx>::save(ctx, *this);
+    auto n = t.size() - start - sizeof(record_header);
+    rh.context_size = static_cast<std::uint32_t>(n);
+    std::memcpy(&t[start], &rh, sizeof(rh));
+    t.append(detail::align4(n) - n, '\0');
+    _end_record();
+  }
+
+}} // namespace fsm_cxx::snapshot
+
+// ----------------------------- view
+namespace fsm_cxx { namespace snapshot {
+
+  struct record {
+    std::uint32_t state{};
+    std::string_view context{};
+  };
+
+  /**
+   * @brief a zero-copy view over a snapshot held in memory.
+   * @details Works on any buffer, typically a std::string filled by a
+   * writer or a util::mapped_file. Iterating the view decodes records in
+   * place; nothing is copied until restore() assigns the state.
+   */
+  class view {
+  public:
+    class iterator {
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = record;
+      using difference_type = std::ptrdiff_t;
+      using pointer = record const *;
+      using reference = record const &;
+
+      iterator() = default;
+      iterator(char const *p, char const *end) : _p(p), _end(end) { _decode(); }
+
+      reference operator*() const { return _rec; }
+      pointer operator->() const { return &_rec; }
+      iterator &operator++() {
+        _p = _next;
+        _decode();
+        return (*this);
+      }
+      bool operator==(iterator const &o) const { return _p == o._p; }
+      bool operator!=(iterator const &o) const { return _p != o._p; }
+
+    private:
+      void _decode() {
+        if (_p == _end) return;
+        record_header rh{};
+        if (static_cast<std::size_t>(_end - _p) < sizeof(rh)) {
+          _p = _end; // truncated
+          return;
+        }
+        std::memcpy(&rh, _p, sizeof(rh));
+        auto body = _p + sizeof(rh);
+        if (static_cast<std::size_t>(_end - body) < rh.context_size) {
+          _p = _end;
+          return;
+        }
+        _rec.state = rh.state;
+        _rec.context = std::string_view{body, rh.context_size};
+        auto padded = detail::align4(rh.context_size);
+        _next = static_cast<std::size_t>(_end - body) < padded ? _end : body + padded;
+      }
+
+    private:
+      char const *_p{nullptr};
+      char const *_end{nullptr};
+      char const *_next{nullptr};
+      record _rec{};
+    };
+
+    view() = default;
+    view(char const *data, std::size_t size) : _data(data), _size(size) {
+      file_header h{};
+      if (size >= sizeof(h)) {
+        std::memcpy(&h, data, sizeof(h));
+        _valid = h.magic == magic && h.version == version && h.byte_order == byte_order_mark;
+      }
+    }
+    explicit view(std::string_view s) : view(s.data(), s.size()) {}
+
+    bool valid() const { return _valid; }
+    iterator begin() const { return _valid ? iterator{_data + sizeof(file_header), _data + _size} : end(); }
+    iterator end() const { return iterator{_data + _size, _data + _size}; }
+
+  private:
+    char const *_data{nullptr};
+    std::size_t _size{0};
+    bool _valid{false};
+  };
+
+  /**
+   * @brief restore a machine or a context from one record.
+   * @details A machine then publishes the state and the fields restored,
+   * and remembers the state in its history, through set_current().
+   * @return false if the user context hook rejected the bytes
+   */
+  template<typename T>
+  inline bool restore(T &o, record const &rec) {
+    using CO = detail::context_of<T>;
+    using Ctx = typename CO::type;
+    auto &ctx = CO::get(o);
+    using State = std::decay_t<decltype(ctx.current())>;
+    auto const st = state_from_id<State>(rec.state);
+    ctx.current(st);
+    reader r{rec.context.data(), rec.context.size()};
+    bool ok = context_codec<Ctx>::load(ctx, r) && r.ok();
+    if constexpr (detail::is_machine<T>::value) o.set_current(st);
+    return ok;
+  }
+
+  /**
+   * @brief restore [first, last) from the records of v, in order.
+   * @return the count of instances restored; it stops at the first
+   * record that fails to load, or when either side runs out.
+   */
+  template<typename It>
+  inline std::size_t restore_pool(view const &v, It first, It last) {
+    std::size_t n = 0;
+    for (auto it = v.begin(); it != v.end() && first != last; ++it, ++first, ++n) {
+      if (!restore(*first, *it))
+        break;
+    }
+    return n;
+  }
+
+}} // namespace fsm_cxx::snapshot
+
+#endif // __FSM_CXX_FSM_SNAPSHOT_HH
@@ -0,0 +1,149 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/16.
+//
+
+#ifndef __FSM_CXX_FSM_SPEC_HH
+#define __FSM_CXX_FSM_SPEC_HH
+
+#include "fsm-sm.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// ----------------------------- spec
+namespace fsm_cxx { namespace spec {
+
+  /**
+   * @brief the runtime side of the tables emitted by fsm-gen.
+   * @details fsm-gen (see tools/fsm-gen.cc and fsm_cxx_generate() in
+   * tools/fsm_cxx-generate.cmake) compiles a declarative spec into a header
+   * holding a Spec struct:
+   *
+   *     struct spec {
+   *       using state_type = ...;                  // enum class with __COUNT
+   *       static constexpr std::uint16_t state_count, event_count, initial, final_state;
+   *       static constexpr char const *state_names[], *event_names[];
+   *       static constexpr row rows[];             // sorted by (from, event)
+   *       static constexpr span index[];           // rows of [from * event_count + event]
+   *       static constexpr span entry[], exit[];   // per state, into actions[]
+   *       static constexpr std::uint16_t actions[];
+   *       template<class Impl, class Evt> static bool guard(std::uint16_t, Impl &, Evt const &);
+   *       template<class Impl, class Evt> static void action(std::uint16_t, Impl &, Evt const &);
+   *     };
+   *
+   * and one event type per event, deriving from event_type<> and
+   * carrying its dense id. Guards and actions are bound by name: the
+   * generated guard() and action() call the member functions of Impl
+   * with the spec names, so a missing one is a compile error.
+   */
+  constexpr std::uint16_t none = 0xffff;
+
+  struct span {
+    std::uint16_t first, count;
+  };
+
+  struct row {
+    std::uint16_t from, event, to;
+    std::uint16_t guard; // none for an unguarded row
+    span actions;        // the executable content of the transition
+    bool internal;       // a targetless transition, no exit nor entry
+  };
+
+  /**
+   * @brief checks a generated table, for static_assert.
+   */
+  template<typename Spec>
+  constexpr bool valid() {
+    constexpr auto rows = sizeof(Spec::rows) / sizeof(row);
+    constexpr auto actions = sizeof(Spec::actions) / sizeof(std::uint16_t);
+    if (Spec::state_count == 0 || Spec::initial >= Spec::state_count) return false;
+    if (Spec::final_state != none && Spec::final_state >= Spec::state_count) return false;
+    if (static_cast<std::size_t>(Spec::state_type::__COUNT) != Spec::state_count) return false;
+    for (std::size_t i = 0; i < rows; i++) {
+      auto const &r = Spec::rows[i];
+      if (r.from >= Spec::state_count || r.to >= Spec::state_count || r.event >= Spec::event_count) return false;
+      if (r.actions.first + r.actions.count > actions) return false;
+      if (i > 0 && (Spec::rows[i - 1].from > r.from || (Spec::rows[i - 1].from == r.from && Spec::rows[i - 1].event > r.event))) return false;
+    }
+    for (std::size_t s = 0; s < Spec::state_count; s++) {
+      if (Spec::entry[s].first + Spec::entry[s].count > actions) return false;
+      if (Spec::exit[s].first + Spec::exit[s].count > actions) return false;
+      for (std::size_t e = 0; e < Spec::event_count; e++) {
+        auto const &x = Spec::index[s * Spec::event_count + e];
+        if (x.first + x.count > rows) return false;
+        for (std::size_t k = x.first; k < x.first + x.count; k++)
+          if (Spec::rows[k].from != s || Spec::rows[k].event != e) return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief an instance of a generated machine.
+   * @details Nothing is built at runtime: step_by() indexes the constant
+   * table with the current state and the event id, then evaluates the
+   * guards of the candidate rows in document order. The first one
+   * passing is taken and the executable content runs as in SCXML: the
+   * exit actions of the source, the actions of the transition, the
+   * entry actions of the target. A targetless transition runs only its
+   * own actions.
+   *
+   * @tparam Spec the struct generated by fsm-gen
+   * @tparam Impl provides the guards and actions named by the spec
+   */
+  template<typename Spec, typename Impl>
+  class machine {
+  public:
+    using state_type = typename Spec::state_type;
+
+    explicit machine(Impl &impl)
+        : _impl(impl) {}
+
+    void reset() { _current = Spec::initial; }
+    state_type current() const { return static_cast<state_type>(_current); }
+    std::uint16_t current_index() const { return _current; }
+    char const *current_name() const { return Spec::state_names[_current]; }
+    bool terminated() const { return _current == Spec::final_state; }
+    Impl &impl() { return _impl; }
+
+    template<typename Evt>
+    bool step_by(Evt const &ev, Reason *reason = nullptr) {
+      static_assert(std::is_same<typename Evt::spec_type, Spec>::value, "the event is not from this spec");
+      auto const &x = Spec::index[_current * Spec::event_count + Evt::id];
+      for (std::uint16_t k = x.first; k < x.first + x.count; k++) {
+        auto const &r = Spec::rows[k];
+        if (r.guard != none && !Spec::guard(r.guard, _impl, ev)) continue;
+        if (!r.internal) _run(Spec::exit[_current], ev);
+        _run(r.actions, ev);
+        if (!r.internal) {
+          _current = r.to;
+          _run(Spec::entry[_current], ev);
+        }
+        return true;
+      }
+      if (reason) *reason = x.count ? Reason::FailureGuard : Reason::StateNotFound;
+      return false;
+    }
+
+  private:
+    template<typename Evt>
+    void _run(span s, Evt const &ev) {
+      for (std::uint16_t i = s.first; i < s.first + s.count; i++)
+        Spec::action(Spec::actions[i], _impl, ev);
+    }
+
+  private:
+    Impl &_impl;
+    std::uint16_t _current{Spec::initial};
+  };
+
+}} // namespace fsm_cxx::spec
+
+#endif // __FSM_CXX_FSM_SPEC_HH
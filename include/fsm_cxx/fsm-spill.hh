@@ -0,0 +1,341 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_SPILL_HH
+#define __FSM_CXX_FSM_SPILL_HH
+
+#include "fsm-mmap.hh"
+#include "fsm-snapshot.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !OS_WIN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------- spill_arena
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a scratch file, mapped read-write, carved into blocks.
+   * @details Blocks come in power-of-two size classes from 32 bytes and
+   * are recycled through per-class free lists; the file doubles when
+   * full. The content does not outlive the arena: the file is truncated
+   * when opened and removed when closed. Where mmap is not available
+   * the arena lives in memory.
+   */
+  class spill_arena {
+  public:
+    spill_arena() = default;
+    explicit spill_arena(std::string const &path, std::size_t initial = 1 << 20) { open(path, initial); }
+    ~spill_arena() { close(); }
+    spill_arena(spill_arena const &) = delete;
+    spill_arena &operator=(spill_arena const &) = delete;
+
+    bool open(std::string const &path, std::size_t initial = 1 << 20) {
+      close();
+      _path = path;
+#if !OS_WIN
+      _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if (_fd < 0) return false;
+#endif
+      return _grow(initial);
+    }
+    void close() {
+#if !OS_WIN
+      if (_base) ::munmap(_base, _cap);
+      if (_fd >= 0) {
+        ::close(_fd);
+        std::remove(_path.c_str());
+      }
+      _fd = -1;
+#else
+      _mem.clear();
+#endif
+      _base = nullptr;
+      _cap = _top = 0;
+      for (auto &f : _free) f.clear();
+    }
+    explicit operator bool() const { return _base != nullptr; }
+
+    struct block {
+      std::uint64_t offset;
+      std::uint32_t size; // what was stored, the class is derived from it
+    };
+
+    /**
+     * @brief copy n bytes into a free block.
+     * @return false if the file cannot grow
+     */
+    bool store(void const *p, std::uint32_t n, block &out) {
+      auto c = _class_of(n);
+      std::uint64_t off;
+      if (!_free[c].empty()) {
+        off = _free[c].back();
+        _free[c].pop_back();
+      } else {
+        auto sz = std::size_t{32} << c;
+        if (_top + sz > _cap && !_grow(std::max(_cap * 2, _top + sz))) return false;
+        off = _top;
+        _top += sz;
+      }
+      std::memcpy(_base + off, p, n);
+      out = block{off, n};
+      return true;
+    }
+    char const *data(block const &b) const { return _base + b.offset; }
+    void release(block const &b) { _free[_class_of(b.size)].push_back(b.offset); }
+
+    // the bytes the file takes
+    std::size_t capacity() const { return _cap; }
+
+  private:
+    static unsigned _class_of(std::uint32_t n) {
+      unsigned c = 0;
+      while ((std::size_t{32} << c) < n) c++;
+      return c;
+    }
+    bool _grow(std::size_t cap) {
+      cap = (cap + 4095) & ~std::size_t{4095};
+#if !OS_WIN
+      if (::ftruncate(_fd, static_cast<off_t>(cap)) != 0) return false;
+      // the old mapping goes only once the new one is there: the blocks
+      // spilled so far stay readable when mmap() fails
+      void *p = ::mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+      if (p == MAP_FAILED) return false;
+      if (_base) ::munmap(_base, _cap);
+      _base = static_cast<char *>(p);
+#else
+      _mem.resize(cap);
+      _base = _mem.data();
+#endif
+      _cap = cap;
+      return true;
+    }
+
+  private:
+    std::string _path{};
+    char *_base{nullptr};
+    std::size_t _cap{0}, _top{0};
+    std::vector<std::uint64_t> _free[32]{};
+#if !OS_WIN
+    int _fd{-1};
+#else
+    std::vector<char> _mem{};
+#endif
+  };
+
+} // namespace fsm_cxx::util
+
+// ----------------------------- instance_store
+namespace fsm_cxx {
+
+  /**
+   * @brief a keyed set of machines that keeps only the warm ones in
+   * memory.
+   * @details At most resident_limit machines are held; when another one
+   * is needed, the CLOCK hand sweeps the resident ones, sparing those
+   * used since its last pass, and spills the first cold one: its state
+   * and context, serialized as a snapshot record (see
+   * snapshot::context_codec for the context part), go to a mapped
+   * scratch file and the machine is destroyed. The next step_by() on
+   * its key builds a fresh machine with the init callback and restores
+   * the record, transparently.
+   *
+   * @code{c++}
+   *   fsm_cxx::instance_store<M> sessions{"sessions.spill", 10000, [](std::uint64_t, M &m) { define(m); }};
+   *   sessions.step_by(session_id, ev, payload);
+   *   std::cout << sessions.stats() << '\n';
+   * @endcode
+   *
+   * @tparam Machine a default constructible machine_t
+   */
+  template<typename Machine, typename Key = std::uint64_t>
+  class instance_store {
+  public:
+    using Init = std::function<void(Key const &, Machine &)>;
+    using Payload = typename Machine::Payload;
+
+    struct statistics {
+      std::uint64_t hits{};      // found resident
+      std::uint64_t misses{};    // faulted in from the spill file
+      std::uint64_t created{};   // first use of a key
+      std::uint64_t evictions{}; // spilled out
+      std::size_t resident{};
+      std::size_t spilled{};
+      std::size_t file_bytes{};
+
+      friend std::ostream &operator<<(std::ostream &os, statistics const &s) {
+        return os << "hits " << s.hits << ", misses " << s.misses << ", created " << s.created
+                  << ", evictions " << s.evictions << ", resident " << s.resident
+                  << ", spilled " << s.spilled << " (" << s.file_bytes << " bytes on file)";
+      }
+    };
+
+    instance_store(std::string const &spill_path, std::size_t resident_limit, Init init)
+        : _arena(spill_path), _limit(resident_limit ? resident_limit : 1), _init(std::move(init)) {}
+
+    explicit operator bool() const { return bool(_arena); }
+
+    /**
+     * @brief the memory budget, in resident machines. Lowering it spills
+     * the excess at once, as far as the spill file can take it.
+     */
+    void resident_limit(std::size_t n) {
+      _limit = n ? n : 1;
+      while (_index.size() > _limit && _evict_one()) {}
+    }
+    std::size_t resident_limit() const { return _limit; }
+
+    /**
+     * @brief the machine for key, faulted in or created as needed. The
+     * reference is valid until the next call on the store.
+     * @return nullptr if a spilled record cannot be restored
+     */
+    Machine *get(Key const &key) {
+      if (auto it = _index.find(key); it != _index.end()) {
+        _stats.hits++;
+        auto &e = _ring[it->second];
+        e.referenced = true;
+        return e.m.get();
+      }
+      auto m = std::make_unique<Machine>();
+      if (_init) _init(key, *m);
+      if (auto sp = _spilled.find(key); sp != _spilled.end()) {
+        if (!_load(*m, sp->second)) return nullptr;
+        _arena.release(sp->second);
+        _spilled.erase(sp);
+        _stats.misses++;
+      } else
+        _stats.created++;
+      return _admit(key, std::move(m));
+    }
+
+    template<typename Evt>
+    bool step_by(Key const &key, Evt const &ev, Payload const &payload = Payload{}) {
+      auto *m = get(key);
+      return m && m->step_by(ev, payload);
+    }
+
+    bool contains(Key const &key) const { return _index.count(key) || _spilled.count(key); }
+    bool resident(Key const &key) const { return _index.count(key) != 0; }
+
+    // forget key, wherever it is
+    void erase(Key const &key) {
+      if (auto it = _index.find(key); it != _index.end()) {
+        _ring[it->second].m.reset();
+        _ring[it->second].referenced = false;
+        _holes.push_back(it->second);
+        _index.erase(it);
+      } else if (auto sp = _spilled.find(key); sp != _spilled.end()) {
+        _arena.release(sp->second);
+        _spilled.erase(sp);
+      }
+    }
+
+    statistics stats() const {
+      auto s = _stats;
+      s.resident = _index.size();
+      s.spilled = _spilled.size();
+      s.file_bytes = _arena.capacity();
+      return s;
+    }
+
+  private:
+    struct entry {
+      Key key{};
+      std::unique_ptr<Machine> m{};
+      bool referenced{false};
+    };
+
+    // when nothing can be spilled the machine is admitted over the budget
+    Machine *_admit(Key const &key, std::unique_ptr<Machine> m) {
+      while (_index.size() >= _limit && _evict_one()) {}
+      std::size_t at;
+      if (!_holes.empty()) {
+        at = _holes.back();
+        _holes.pop_back();
+      } else {
+        at = _ring.size();
+        _ring.emplace_back();
+      }
+      _ring[at] = entry{key, std::move(m), true};
+      _index[key] = at;
+      return _ring[at].m.get();
+    }
+
+    // false if a whole sweep, the referenced machines given their second
+    // chance, spilled nothing: the spill file cannot take more
+    bool _evict_one() {
+      for (std::size_t n = 0; n < 2 * _ring.size(); n++, _hand++) {
+        if (_hand >= _ring.size()) _hand = 0;
+        auto &e = _ring[_hand];
+        if (e.m && e.referenced)
+          e.referenced = false;
+        else if (e.m && _spill(e)) {
+          _holes.push_back(_hand++);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // false, the machine left resident, if the file cannot grow
+    bool _spill(entry &e) {
+      _buf.clear();
+      {
+        snapshot::writer w{_buf};
+        w.write(*e.m);
+      }
+      auto rec = std::string_view{_buf}.substr(sizeof(snapshot::file_header));
+      util::spill_arena::block b{};
+      if (!_arena.store(rec.data(), static_cast<std::uint32_t>(rec.size()), b)) return false;
+      _spilled[e.key] = b;
+      _stats.evictions++;
+      _index.erase(e.key);
+      e.m.reset();
+      return true;
+    }
+
+    bool _load(Machine &m, util::spill_arena::block const &b) {
+      snapshot::record_header rh{};
+      std::memcpy(&rh, _arena.data(b), sizeof(rh));
+      snapshot::record r{rh.state, std::string_view{_arena.data(b) + sizeof(rh), rh.context_size}};
+      return snapshot::restore(m, r);
+    }
+
+  private:
+    util::spill_arena _arena;
+    std::size_t _limit;
+    Init _init;
+    std::vector<entry> _ring{};
+    std::vector<std::size_t> _holes{};
+    std::unordered_map<Key, std::size_t> _index{};
+    std::unordered_map<Key, util::spill_arena::block> _spilled{};
+    std::size_t _hand{0};
+    std::string _buf{};
+    statistics _stats{};
+  };
+
+} // namespace fsm_cxx
+
+#endif // __FSM_CXX_FSM_SPILL_HH
@@ -0,0 +1,306 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_SUBSCRIBERS_HH
+#define __FSM_CXX_FSM_SUBSCRIBERS_HH
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ----------------------------- subscriber_list
+namespace fsm_cxx::util {
+
+  /**
+   * @brief a copy-on-write array of subscribers, added and removed at
+   * runtime while other threads publish to it.
+   * @details A subscriber is either synchronous, called with the
+   * publisher's arguments on each publish(), or batched: the arguments
+   * are kept in a Record (through Record::assign(Args...), which should
+   * reuse its storage) and handed over in chunks of n records, so that
+   * an expensive sink is not called per event.
+   *
+   * publish() is wait-free: it counts itself in one of two reader
+   * counters, loads the current array and walks it. add() and remove()
+   * copy the array, swap it in, and wait for the readers which may still
+   * hold the old one before freeing it; they are serialized by a mutex.
+   * Once remove() returns, the subscriber is not running and will not be
+   * called again; for the same reason a subscriber must not add or
+   * remove subscribers.
+   *
+   * A batched subscriber has a ring of chunks, four by default.
+   * publish() appends to the chunk being filled and, when it is
+   * full, moves on to the next one and wakes a delivery thread, which the
+   * list starts with its first batched subscriber and which calls the
+   * sink; the publisher never waits for it. If the sink falls behind and
+   * no chunk is free, the record is dropped and counted by dropped().
+   * flush() delivers the full chunks and the partial one from the calling
+   * thread, and so does remove(); the rest is dropped with the list.
+   * Chunks come in publish order, which needs the publish() calls to a
+   * list with batched subscribers not to overlap, as the steps of a
+   * machine do not.
+   */
+  template<typename Record, typename... Args>
+  class subscriber_list {
+  public:
+    using Sync = std::function<void(Args...)>;
+    using Batch = std::function<void(Record const *, std::size_t)>;
+    using handle = std::uint64_t;
+
+    subscriber_list() = default;
+    ~subscriber_list() {
+      {
+        std::lock_guard<std::mutex> lk(_wake_lock);
+        _stop = true;
+      }
+      _wake.notify_one();
+      if (_courier.joinable()) _courier.join();
+      delete _head.load();
+    }
+    // a copy has the same subscribers with empty buffers
+    subscriber_list(subscriber_list const &o) {
+      std::lock_guard<std::mutex> lk(o._writer);
+      if (auto const *l = o._head.load()) {
+        auto *c = new list;
+        for (auto const &s : l->subs) c->subs.push_back(s.fresh());
+        _head.store(c);
+        for (auto const &s : c->subs)
+          if (s.buf) _start();
+      }
+      _next = o._next;
+    }
+    subscriber_list &operator=(subscriber_list const &) = delete;
+
+    handle add(Sync fn) { return _add(entry{0, std::move(fn), nullptr}); }
+    // a batched subscriber with a ring of `chunks` chunks of n records
+    handle add(std::size_t n, Batch fn, std::size_t chunks = 4) {
+      return _add(entry{0, Sync{}, std::make_shared<buffer>(n, chunks, std::move(fn))});
+    }
+
+    // false if h is not subscribed
+    bool remove(handle h) {
+      std::shared_ptr<buffer> b;
+      {
+        std::lock_guard<std::mutex> lk(_writer);
+        auto const *old = _head.load();
+        if (!old) return false;
+        auto it = std::find_if(old->subs.begin(), old->subs.end(), [h](entry const &e) { return e.id == h; });
+        if (it == old->subs.end()) return false;
+        b = it->buf;
+        list *l = nullptr;
+        if (old->subs.size() > 1) {
+          l = new list{*old};
+          l->subs.erase(l->subs.begin() + (it - old->subs.begin()));
+        }
+        _head.store(l);
+        _synchronize();
+        delete old;
+      }
+      if (b) _drain(*b, true, true);
+      return true;
+    }
+
+    bool empty() const { return _head.load(std::memory_order_relaxed) == nullptr; }
+    std::size_t size() const {
+      std::lock_guard<std::mutex> lk(_writer);
+      auto const *l = _head.load();
+      return l ? l->subs.size() : 0;
+    }
+    // the records the batched subscribers had no room for
+    std::uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    void publish(Args... args) {
+      if (empty()) return;
+      auto &readers = _readers[_epoch.load() & 1];
+      readers.fetch_add(1);
+      bool handed = false;
+      if (auto const *l = _head.load()) {
+        for (auto const &s : l->subs) {
+          if (s.buf) handed |= _append(*s.buf, args...);
+          else s.sync(args...);
+        }
+      }
+      readers.fetch_sub(1);
+      if (handed) {
+        _handoffs.fetch_add(1);
+        _wake.notify_one();
+      }
+    }
+
+    // hand all the chunks over to the batched subscribers, the partial
+    // ones included
+    void flush() {
+      for (auto const &b : _buffers()) _drain(*b, true, false);
+    }
+
+  private:
+    static constexpr std::uint64_t closed = std::uint64_t(1) << 63;
+
+    struct chunk {
+      std::vector<Record> records{};
+      // the records published in it; flush() sets the closed bit to take
+      // a partial chunk, and the publisher moves on to the next one
+      std::atomic<std::uint64_t> count{0};
+      std::size_t done{0}; // delivered already, by the consumers
+    };
+    struct buffer {
+      buffer(std::size_t n_, std::size_t k, Batch fn_)
+          : n(n_ ? n_ : 1)
+          , chunks(k > 1 ? k : 2)
+          , fn(std::move(fn_)) {
+        for (auto &c : chunks) c.records.resize(n);
+      }
+      chunk &at(std::uint64_t seq) { return chunks[seq % chunks.size()]; }
+
+      std::size_t const n;
+      std::vector<chunk> chunks;
+      Batch const fn;
+      std::atomic<std::uint64_t> fill{0};    // the chunk being filled, by the publisher
+      std::atomic<std::uint64_t> drained{0}; // the next chunk to deliver, by the consumers
+      std::mutex lock{};                     // serializes the consumers
+      bool retired{false};                   // by remove()
+    };
+    struct entry {
+      handle id;
+      Sync sync;
+      std::shared_ptr<buffer> buf;
+
+      entry fresh() const {
+        entry e{id, sync, nullptr};
+        if (buf) e.buf = std::make_shared<buffer>(buf->n, buf->chunks.size(), buf->fn);
+        return e;
+      }
+    };
+    struct list {
+      std::vector<entry> subs{};
+    };
+
+    handle _add(entry e) {
+      std::lock_guard<std::mutex> lk(_writer);
+      e.id = ++_next;
+      if (e.buf) _start();
+      auto const *old = _head.load();
+      auto *l = old ? new list{*old} : new list;
+      l->subs.push_back(std::move(e));
+      _head.store(l);
+      if (old) {
+        _synchronize();
+        delete old;
+      }
+      return _next;
+    }
+
+    // wait until no publisher can hold an array unlinked before the call:
+    // flip the epoch and drain the counter it left, twice, since a reader
+    // of either counter may have loaded the old array
+    void _synchronize() {
+      for (int i = 0; i < 2; i++) {
+        auto &readers = _readers[_epoch.fetch_add(1) & 1];
+        while (readers.load() != 0) std::this_thread::yield();
+      }
+    }
+
+    // the publisher's side: store the record in the chunk being filled,
+    // true if that filled it up. A chunk taken by flush() is skipped.
+    bool _append(buffer &b, Args const &...args) {
+      for (int attempt = 0; attempt < 2; attempt++) {
+        auto const seq = b.fill.load(std::memory_order_relaxed);
+        if (seq - b.drained.load(std::memory_order_acquire) >= b.chunks.size()) break;
+        auto &c = b.at(seq);
+        auto i = c.count.load(std::memory_order_acquire);
+        if (!(i & closed)) {
+          c.records[i].assign(args...);
+          if (c.count.compare_exchange_strong(i, i + 1, std::memory_order_acq_rel)) {
+            if (i + 1 < b.n) return false;
+            b.fill.store(seq + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        b.fill.store(seq + 1, std::memory_order_release);
+      }
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    // the consumers' side: deliver the full chunks in order, and with
+    // partial the records of the one being filled too
+    static void _drain(buffer &b, bool partial, bool retire) {
+      std::lock_guard<std::mutex> lk(b.lock);
+      if (b.retired) return;
+      b.retired = retire;
+      auto const seq = b.fill.load(std::memory_order_acquire);
+      auto d = b.drained.load(std::memory_order_relaxed);
+      for (; d != seq; d++) {
+        auto &c = b.at(d);
+        auto m = c.count.load(std::memory_order_acquire) & ~closed;
+        if (m > c.done) b.fn(c.records.data() + c.done, m - c.done);
+        c.done = 0;
+        c.count.store(0, std::memory_order_relaxed);
+        b.drained.store(d + 1, std::memory_order_release);
+      }
+      if (!partial) return;
+      auto &c = b.at(seq);
+      if ((c.count.load(std::memory_order_acquire) & ~closed) == c.done) return;
+      auto m = c.count.fetch_or(closed, std::memory_order_acq_rel) & ~closed;
+      if (m > c.done) b.fn(c.records.data() + c.done, m - c.done);
+      c.done = m;
+    }
+
+    std::vector<std::shared_ptr<buffer>> _buffers() const {
+      std::vector<std::shared_ptr<buffer>> v;
+      std::lock_guard<std::mutex> lk(_writer);
+      if (auto const *l = _head.load())
+        for (auto const &s : l->subs)
+          if (s.buf) v.push_back(s.buf);
+      return v;
+    }
+
+    // the delivery thread, woken by the publishers as they fill chunks up;
+    // the timeout covers a wakeup sent while it was delivering
+    void _start() {
+      if (_courier.joinable()) return;
+      _courier = std::thread([this]() {
+        std::unique_lock<std::mutex> lk(_wake_lock);
+        std::uint64_t seen = 0;
+        while (!_stop) {
+          _wake.wait_for(lk, std::chrono::milliseconds(10), [this, &seen]() { return _stop || _handoffs.load() != seen; });
+          seen = _handoffs.load();
+          lk.unlock();
+          for (auto const &b : _buffers()) _drain(*b, false, false);
+          lk.lock();
+        }
+      });
+    }
+
+    std::atomic<list *> _head{nullptr};
+    std::atomic<std::uint32_t> _epoch{0};
+    std::atomic<std::uint32_t> _readers[2]{};
+    mutable std::mutex _writer{};
+    handle _next{0};
+
+    std::atomic<std::uint64_t> _dropped{0}, _handoffs{0};
+    std::thread _courier{};
+    std::mutex _wake_lock{};
+    std::condition_variable _wake{};
+    bool _stop{false};
+  };
+
+} // namespace fsm_cxx::util
+
+#endif // __FSM_CXX_FSM_SUBSCRIBERS_HH
@@ -0,0 +1,218 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#ifndef __FSM_CXX_FSM_WIRE_HH
+#define __FSM_CXX_FSM_WIRE_HH
+
+#include "fsm-frozen.hh"
+#include "fsm-sm.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+// ----------------------------- bytes, event_view
+namespace fsm_cxx { namespace wire {
+
+  /**
+   * @brief a borrowed range of bytes, std::span<std::byte const> before
+   * C++20.
+   */
+  struct bytes {
+    std::byte const *data{nullptr};
+    std::size_t size{0};
+
+    bytes() = default;
+    bytes(void const *p, std::size_t n)
+        : data(static_cast<std::byte const *>(p)), size(n) {}
+    bytes(std::string_view s)
+        : bytes(s.data(), s.size()) {}
+#if __cplusplus >= 202002L && __has_include(<span>)
+    bytes(std::span<std::byte const> s)
+        : bytes(s.data(), s.size()) {}
+#endif
+  };
+
+  /**
+   * @brief an event read in place from a caller-owned buffer.
+   * @details Derive the events of a wire protocol from it and give them
+   * accessors decoding their fields on demand:
+   * @code{c++}
+   *   struct order : fsm_cxx::wire::event_view<order> {
+   *     using event_view::event_view;
+   *     std::uint64_t id() const { return get<std::uint64_t>(0); }
+   *     std::string_view symbol() const { return str(8, 8); }
+   *   };
+   * @endcode
+   * Nothing is copied: a view is a pointer, a size and the frame's type
+   * id, and it must not outlive the step it is passed to (it cannot be
+   * copied). Out of range reads yield zero values rather than reading
+   * past the buffer. Fields are read with memcpy in host byte order.
+   */
+  template<typename T>
+  struct event_view : public event_type<T> {
+    event_view() = default;
+    explicit event_view(bytes b, std::uint16_t type = 0)
+        : _b(b), _type(type) {}
+    event_view(event_view const &) = delete;
+    event_view &operator=(event_view const &) = delete;
+    ~event_view() override = default;
+
+    std::uint16_t type() const { return _type; }
+    bytes raw() const { return _b; }
+    std::size_t size() const { return _b.size; }
+    bool has(std::size_t off, std::size_t n) const { return off <= _b.size && n <= _b.size - off; }
+
+    template<typename F>
+    F get(std::size_t off) const {
+      static_assert(std::is_trivially_copyable<F>::value, "event_view::get() needs a trivially copyable type");
+      F v{};
+      if (has(off, sizeof(F))) std::memcpy(&v, _b.data + off, sizeof(F));
+      return v;
+    }
+    // n bytes at off, or an empty view if out of range
+    std::string_view str(std::size_t off, std::size_t n) const {
+      return has(off, n) ? std::string_view{reinterpret_cast<char const *>(_b.data) + off, n} : std::string_view{};
+    }
+    // a string prefixed by its 16 bits length at off
+    std::string_view lstr(std::size_t off) const { return str(off + 2, get<std::uint16_t>(off)); }
+
+  private:
+    bytes _b{};
+    std::uint16_t _type{0};
+  };
+
+  /**
+   * @brief an owned copy of a frame, for the queues.
+   * @details The bytes are held inline, so that a frame is trivially
+   * copyable and travels through a ring or a mailbox without touching
+   * the heap; views built on it live as long as the queue entry.
+   */
+  template<std::size_t Capacity = 240>
+  struct frame {
+    std::uint16_t type{0};
+    std::uint16_t size{0};
+    std::byte data[Capacity]{};
+
+    static_assert(Capacity <= 0xffff, "a frame holds at most 64KB");
+
+    // false if b does not fit
+    bool assign(std::uint16_t t, bytes b) {
+      if (b.size > Capacity) return false;
+      type = t;
+      size = static_cast<std::uint16_t>(b.size);
+      if (b.size) std::memcpy(data, b.data, b.size);
+      return true;
+    }
+    wire::bytes view() const { return wire::bytes{data, size}; }
+  };
+
+}} // namespace fsm_cxx::wire
+
+// ----------------------------- router
+namespace fsm_cxx { namespace wire {
+
+  /**
+   * @brief steps machines by wire frames, selecting the view type from
+   * the frame's type id.
+   * @details on<V>(id) registers the view type V for frames of type id.
+   * A step builds the V on the stack over the frame bytes and steps by
+   * it: on a machine_t through the event name cached at registration,
+   * and on a frozen instance through the dense event index resolved by
+   * bind(), so that neither path allocates.
+   *
+   * @code{c++}
+   *   fsm_cxx::wire::router<M> r;
+   *   r.on<login>(1).on<order>(2);
+   *   r.step(m, hdr.type, fsm_cxx::wire::bytes{buf + sizeof(hdr), hdr.len});
+   * @endcode
+   */
+  template<typename M>
+  class router {
+  public:
+    using Event = typename M::Event;
+    using Payload = typename M::Payload;
+    using Instance = frozen::instance<M>;
+
+    template<typename V>
+    router &on(std::uint16_t type_id) {
+      static_assert(std::is_base_of<Event, V>::value, "a view type must derive from the event type of the machine");
+      if (_routes.size() <= type_id) _routes.resize(std::size_t(type_id) + 1);
+      auto &r = _routes[type_id];
+      r.name = std::string{debug::type_name<V>()};
+      r.index = frozen::npos;
+      r.machine_step = [](M &m, std::string const &name, bytes b, std::uint16_t t, Payload const &p) -> bool {
+        V v{b, t};
+        return m.step_by(name, v, p);
+      };
+      r.frozen_step = [](Instance &in, std::uint32_t index, bytes b, std::uint16_t t, Payload const &p, Reason *reason) -> bool {
+        V v{b, t};
+        return in.step_by(index, v, p, reason);
+      };
+      return (*this);
+    }
+
+    /**
+     * @brief resolve the dense event indices of def, for the steps of
+     * frozen instances.
+     * @return the number of registered types def has no event for
+     */
+    std::size_t bind(frozen::definition<M> const &def) {
+      std::size_t missing = 0;
+      for (auto &r : _routes) {
+        if (!r.machine_step) continue;
+        r.index = def.table().event_index(r.name);
+        missing += r.index == frozen::npos;
+      }
+      return missing;
+    }
+
+    bool known(std::uint16_t type_id) const { return type_id < _routes.size() && _routes[type_id].machine_step; }
+
+    // false for an unknown type id, or when the machine does not move
+    bool step(M &m, std::uint16_t type_id, bytes b, Payload const &payload = Payload{}) const {
+      if (!known(type_id)) return false;
+      auto const &r = _routes[type_id];
+      return r.machine_step(m, r.name, b, type_id, payload);
+    }
+    bool step(Instance &in, std::uint16_t type_id, bytes b, Payload const &payload = Payload{}, Reason *reason = nullptr) const {
+      if (!known(type_id)) {
+        if (reason) *reason = Reason::StateNotFound;
+        return false;
+      }
+      auto const &r = _routes[type_id];
+      return r.frozen_step(in, r.index, b, type_id, payload, reason);
+    }
+    template<typename Target, std::size_t Capacity>
+    bool step(Target &t, frame<Capacity> const &f, Payload const &payload = Payload{}) const {
+      return step(t, f.type, f.view(), payload);
+    }
+
+  private:
+    struct route {
+      std::string name{};
+      std::uint32_t index{frozen::npos};
+      bool (*machine_step)(M &, std::string const &, bytes, std::uint16_t, Payload const &){nullptr};
+      bool (*frozen_step)(Instance &, std::uint32_t, bytes, std::uint16_t, Payload const &, Reason *){nullptr};
+    };
+    std::vector<route> _routes{};
+  };
+
+}} // namespace fsm_cxx::wire
+
+#endif // __FSM_CXX_FSM_WIRE_HH
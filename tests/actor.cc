@@ -0,0 +1,178 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-actor.hh"
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(relay_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Holding)
+
+  FSM_DEFINE_EVENT(token);
+
+  // a letter: who sent it, its sequence number from that sender, and the
+  // hops it still has to travel
+  struct letter {
+    std::uint32_t from{};
+    std::uint32_t seq{};
+    std::uint32_t hops{};
+  };
+
+  struct relay_context : public context_t<state_t<relay_state>> {
+    letter in{};                     // the letter being handled
+    std::uint64_t passed{};          // tokens passed on
+    std::vector<std::uint32_t> last{}; // the last seq seen from each sender
+    bool in_order{true};
+  };
+
+  using M = machine_t<relay_state, event_t, void, payload_t, state_t<relay_state>, relay_context>;
+  using System = actor::system<M, letter>;
+
+  void handle(actor::address, M &m, letter &l) {
+    m.context().in = l;
+    m.step_by(token{});
+  }
+
+  int test_ring() {
+    constexpr std::uint32_t actors = 64, tokens = 16, hops = 2000;
+    actor::options opt;
+    opt.workers = 3;
+    opt.mailbox = 64;
+    System sys{handle, opt};
+    // each relay passes a token on to the next, until its hops are spent
+    std::vector<actor::address> ring;
+    for (std::uint32_t i = 0; i < actors; i++)
+      ring.push_back(sys.spawn([&sys, i](actor::address self, M &m) {
+        m.context().last.assign(actors, 0);
+        m.state().set(relay_state::Initial).as_initial().build();
+        auto pass = [&sys, self, next = actor::address{(i + 1) % actors}](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+          auto const &l = c.in;
+          if (l.from < c.last.size()) {
+            if (l.seq <= c.last[l.from]) c.in_order = false;
+            c.last[l.from] = l.seq;
+          }
+          if (l.hops == 0) return;
+          c.passed++;
+          sys.send(next, letter{self.id, static_cast<std::uint32_t>(c.passed), l.hops - 1});
+        };
+        m.transition().set(relay_state::Initial, token{}, relay_state::Holding).entry_action(pass).build();
+        m.transition().set(relay_state::Holding, token{}, relay_state::Holding).internal().entry_action(pass).build();
+      }));
+    if (sys.size() != actors || ring.back().id != actors - 1) return 1;
+
+    for (std::uint32_t t = 0; t < tokens; t++) sys.send(ring[t * (actors / tokens)], letter{actors, t + 1, hops});
+    sys.wait_idle();
+    std::printf("  %llu letters, %llu stolen, %llu blocked\n", (unsigned long long) sys.handled(),
+                (unsigned long long) sys.stolen(), (unsigned long long) sys.blocked());
+    if (sys.handled() != tokens * (hops + 1)) return 1;
+    std::uint64_t passed = 0;
+    for (auto a : ring) {
+      auto const &c = sys.instance(a).context();
+      if (!c.in_order) return 1;
+      passed += c.passed;
+    }
+    if (passed != std::uint64_t(tokens) * hops) return 1;
+    if (sys.send(actor::address{actors}, letter{}) || sys.spawn().id != actors) return 1;
+
+    std::printf("---- END OF test_ring()\n\n\n");
+    return 0;
+  }
+
+  // many senders into one small mailbox: the senders are held back,
+  // nothing is lost or reordered
+  int test_backpressure() {
+    constexpr std::uint32_t senders = 8, burst = 500;
+    actor::options opt;
+    opt.workers = 2;
+    opt.mailbox = 4;
+    opt.batch = 2;
+    System sys{[](actor::address, M &m, letter &l) { m.context().in = l, m.step_by(token{}); }, opt};
+    auto sink = sys.spawn([](actor::address, M &m) {
+      m.context().last.assign(senders, 0);
+      m.state().set(relay_state::Initial).as_initial().build();
+      auto count = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+        auto const &l = c.in;
+        if (l.seq != c.last[l.from] + 1) c.in_order = false;
+        c.last[l.from] = l.seq;
+        c.passed++;
+      };
+      m.transition().set(relay_state::Initial, token{}, relay_state::Holding).entry_action(count).build();
+      m.transition().set(relay_state::Holding, token{}, relay_state::Holding).internal().entry_action(count).build();
+    });
+    std::vector<actor::address> from;
+    for (std::uint32_t i = 0; i < senders; i++)
+      from.push_back(sys.spawn([&sys, sink](actor::address self, M &m) {
+        m.state().set(relay_state::Initial).as_initial().build();
+        // one letter in, a burst out
+        auto burst_out = [&sys, sink, self](M::Event const &, M::Context &, M::State const &, M::Payload const &) {
+          for (std::uint32_t k = 1; k <= burst; k++) sys.send(sink, letter{self.id - 1, k, 0});
+        };
+        m.transition().set(relay_state::Initial, token{}, relay_state::Holding).entry_action(burst_out).build();
+      }));
+    for (auto a : from) sys.send(a, letter{});
+    sys.wait_idle();
+    auto const &c = sys.instance(sink).context();
+    std::printf("  %llu letters, %llu blocked\n", (unsigned long long) sys.handled(), (unsigned long long) sys.blocked());
+    if (c.passed != senders * burst || !c.in_order || sys.blocked() == 0) return 1;
+    for (auto l : c.last)
+      if (l != burst) return 1;
+
+    std::printf("---- END OF test_backpressure()\n\n\n");
+    return 0;
+  }
+
+  int test_try_send() {
+    std::atomic<bool> release{false};
+    actor::options opt;
+    opt.workers = 1;
+    opt.mailbox = 4;
+    System sys{[&release](actor::address, M &, letter &) {
+                 while (!release.load()) std::this_thread::yield();
+               },
+               opt};
+    auto a = sys.spawn();
+    int accepted = 0;
+    for (int i = 0; i < 16; i++) accepted += sys.try_send(a, letter{});
+    // the first one may be taken by the worker, the rest fill the mailbox
+    if (accepted < 4 || accepted > 5) return 1;
+    release = true;
+    sys.wait_idle();
+    if (sys.handled() != std::uint64_t(accepted)) return 1;
+    sys.stop();
+
+    std::printf("---- END OF test_try_send()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_ring();
+  rc |= fsm_cxx::test::test_backpressure();
+  rc |= fsm_cxx::test::test_try_send();
+  return rc;
+}
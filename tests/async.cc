@@ -0,0 +1,272 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(door_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  // the events carry a sequence number and some data moved into the step
+  struct open : public event_type<open> {
+    int seq{};
+    std::string who{};
+  };
+  struct close : public event_type<close> {
+    int seq{};
+  };
+
+  struct door_context : public context_t<state_t<door_state>> {
+    std::vector<int> log{}; // the sequence numbers, in the order the actions ran
+    std::string last{};
+  };
+
+  using M = machine_t<door_state, event_t, void, payload_t, state_t<door_state>, door_context>;
+
+  void define(M &m) {
+    m.state().set(door_state::Initial).as_initial().build();
+    m.state().set(door_state::Opened).entry_action([](M::Event const &ev, M::Context &c, M::State const &, M::Payload const &) {
+      auto const &o = static_cast<open const &>(ev);
+      std::this_thread::yield(); // slow I/O, as far as the caller knows
+      c.log.push_back(o.seq);
+      c.last = o.who;
+    }).build();
+    m.state().set(door_state::Closed).entry_action([](M::Event const &ev, M::Context &c, M::State const &, M::Payload const &) {
+      c.log.push_back(static_cast<close const &>(ev).seq);
+    }).build();
+    m.transition().set(door_state::Initial, open{}, door_state::Opened).build();
+    m.transition().set(door_state::Opened, close{}, door_state::Closed).build();
+    m.transition().set(door_state::Closed, open{}, door_state::Opened).build();
+  }
+
+  // a plain pool of worker threads
+  class pool {
+  public:
+    explicit pool(int n) {
+      for (int i = 0; i < n; i++)
+        _ts.emplace_back([this]() {
+          for (;;) {
+            std::function<void()> job;
+            {
+              std::unique_lock<std::mutex> lk(_lock);
+              _cv.wait(lk, [this]() { return _stop || !_jobs.empty(); });
+              if (_jobs.empty()) return;
+              job = std::move(_jobs.front());
+              _jobs.pop_front();
+            }
+            job();
+          }
+        });
+    }
+    ~pool() {
+      {
+        std::lock_guard<std::mutex> lk(_lock);
+        _stop = true;
+      }
+      _cv.notify_all();
+      for (auto &t : _ts) t.join();
+    }
+    void submit(std::function<void()> job) {
+      {
+        std::lock_guard<std::mutex> lk(_lock);
+        _jobs.push_back(std::move(job));
+      }
+      _cv.notify_one();
+    }
+
+  private:
+    std::mutex _lock{};
+    std::condition_variable _cv{};
+    std::deque<std::function<void()>> _jobs{};
+    std::vector<std::thread> _ts{};
+    bool _stop{false};
+  };
+
+  int test_async_actions() {
+    pool workers{4};
+    std::vector<M> doors(4);
+    std::vector<std::vector<int>> committed(doors.size());
+    for (std::size_t i = 0; i < doors.size(); i++) {
+      define(doors[i]);
+      doors[i].executor([&workers](std::function<void()> job) { workers.submit(std::move(job)); });
+      doors[i].subscribe([&committed, i](std::string const &, M::Event const &ev, M::Payload const &, M::State const &, M::State const &) {
+        auto const *o = dynamic_cast<open const *>(&ev);
+        committed[i].push_back(o ? o->seq : static_cast<close const &>(ev).seq);
+      });
+    }
+
+    constexpr int steps = 2000;
+    std::vector<M::Completion> last(doors.size());
+    for (int k = 0; k < steps; k++) {
+      for (std::size_t i = 0; i < doors.size(); i++) {
+        M::Completion c;
+        if (k % 2 == 0) {
+          open o;
+          o.seq = k;
+          o.who = "visitor #" + std::to_string(k);
+          c = doors[i].step_async(std::move(o));
+        } else {
+          close e;
+          e.seq = k;
+          c = doors[i].step_async(e);
+        }
+        // the state is committed before step_async() returns
+        auto expect = k % 2 == 0 ? door_state::Opened : door_state::Closed;
+        if (!c.committed || !(doors[i].context().current() == M::State{expect})) return 1;
+        last[i] = c;
+      }
+    }
+    for (auto &c : last) c.wait();
+
+    for (std::size_t i = 0; i < doors.size(); i++) {
+      auto const &log = doors[i].context().log;
+      if (log.size() != steps || committed[i].size() != steps || doors[i].pending_actions() != 0) return 1;
+      // actions ran in commit order, and so did the subscribers
+      for (int k = 0; k < steps; k++)
+        if (log[k] != k || committed[i][k] != k) return 1;
+      if (doors[i].context().last != "visitor #" + std::to_string(steps - 2)) return 1;
+    }
+
+    // a refused step commits nothing and is complete at once
+    auto r = doors[0].step_async(close{});
+    if (r.committed || !r.ready()) return 1;
+
+    std::printf("---- END OF test_async_actions()\n\n\n");
+    return 0;
+  }
+
+  int test_async_inline() {
+    M m;
+    define(m);
+    open o;
+    o.seq = 7;
+    auto c = m.step_async(o);
+    // no executor: the actions ran before step_async() returned
+    if (!c.committed || !c.ready() || m.context().log != std::vector<int>{7}) return 1;
+
+    std::printf("---- END OF test_async_inline()\n\n\n");
+    return 0;
+  }
+
+  // an action that throws fails its own step only, and the machine waits
+  // for the actions pending before it goes
+  int test_async_failures() {
+    pool workers{2};
+    std::atomic<int> ran{0};
+    std::vector<M::Completion> cs;
+    {
+      M m;
+      define(m);
+      m.executor([&workers](std::function<void()> job) { workers.submit(std::move(job)); });
+      m.transition().set(door_state::Opened, open{}, door_state::Opened).internal().entry_action([](M::Event const &, M::Context &, M::State const &, M::Payload const &) {
+        throw std::runtime_error("jammed");
+      }).build();
+      m.on_transition([&ran](M::State const &, M::Event const &, M::State const &, M::Transition::Item const &, M::Payload const &) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ran++;
+      });
+      for (int k = 0; k < 10; k++) {
+        open o;
+        o.seq = k;
+        cs.push_back(m.step_async(o)); // all but the first are the internal one
+        if (k == 5) cs.push_back(m.step_async(close{}));
+      }
+    }
+    if (ran != 11) return 1;
+    int failed = 0;
+    for (auto &c : cs) {
+      try {
+        c.done.get();
+      } catch (std::runtime_error const &) {
+        failed++;
+      }
+    }
+    if (failed != 8) return 1;
+
+    std::printf("---- END OF test_async_failures()\n\n\n");
+    return 0;
+  }
+
+  // on_transition() and the entry actions see the same states whichever
+  // way the step is taken, with or without a subscriber
+  int test_async_same_arguments() {
+    using seen_t = std::vector<std::pair<std::string, std::string>>;
+    auto run = [](bool async, bool subscribed) {
+      seen_t seen;
+      M m;
+      m.state().set(door_state::Initial).as_initial().build();
+      m.state().set(door_state::Opened).build();
+      m.state().set(door_state::Closed).entry_action([&seen](M::Event const &, M::Context &, M::State const &from, M::Payload const &) {
+        seen.emplace_back("entered from", to_string(from));
+      }).build();
+      m.transition().set(door_state::Initial, open{}, door_state::Opened).build();
+      m.transition().set(door_state::Opened, close{}, door_state::Closed).build();
+      m.on_transition([&seen](M::State const &from, M::Event const &, M::State const &to, M::Transition::Item const &, M::Payload const &) {
+        seen.emplace_back(to_string(from), to_string(to));
+      });
+      if (subscribed)
+        m.subscribe([](std::string const &, M::Event const &, M::Payload const &, M::State const &, M::State const &) {});
+      if (async) {
+        m.step_async(open{});
+        m.step_async(close{});
+      } else {
+        m.step_by(open{});
+        m.step_by(close{});
+      }
+      return seen;
+    };
+    auto const opened = to_string(M::State{door_state::Opened});
+    for (bool subscribed : {false, true}) {
+      auto sync = run(false, subscribed);
+      if (sync != run(true, subscribed) || sync.size() != 3 || sync[0].first != to_string(M::State{door_state::Initial}) || sync[1].first != opened || sync[2].second != opened) {
+        std::printf("  E. step_by() and step_async() disagree (subscribed: %d)\n", subscribed);
+        return 1;
+      }
+    }
+
+    std::printf("---- END OF test_async_same_arguments()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_async_actions();
+  rc |= fsm_cxx::test::test_async_inline();
+  rc |= fsm_cxx::test::test_async_failures();
+  rc |= fsm_cxx::test::test_async_same_arguments();
+  return rc;
+}
@@ -0,0 +1,117 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#include "fsm_cxx/fsm-batch.hh"
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(cell_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Seed,
+                    Sprout,
+                    Tree,
+                    Fire,
+                    Ash)
+
+  FSM_DEFINE_EVENT(tick);
+  FSM_DEFINE_EVENT(spark);
+
+  using M = machine_t<cell_state>;
+
+  int burnt = 0;
+
+  // tick grows Seed -> Sprout -> Tree without actions (the fast path);
+  // Tree -> Fire needs a dry payload (guarded) and Fire -> Ash counts
+  // the burnt cells (an action): both take the slow path
+  std::shared_ptr<frozen::definition<M> const> make_def() {
+    M m;
+    auto dry = [](M::Event const &, M::Context &, M::State const &, M::Payload const &p) -> bool { return p._ok; };
+    m.state().set(cell_state::Initial).as_initial().build();
+    m.state().set(cell_state::Terminated).as_terminated().build();
+    m.state().set(cell_state::Error).as_error().build();
+    m.state().set(cell_state::Ash).entry_action_named("burnt", [](M::Event const &, M::Context &, M::State const &, M::Payload const &) { burnt++; }).build();
+    m.transition().set(cell_state::Initial, tick{}, cell_state::Seed).build();
+    m.transition().set(cell_state::Seed, tick{}, cell_state::Sprout).build();
+    m.transition().set(cell_state::Sprout, tick{}, cell_state::Tree).build();
+    m.transition().set(cell_state::Tree, tick{}, cell_state::Fire).guard("dry", dry).build();
+    m.transition().set(cell_state::Fire, tick{}, cell_state::Ash).build();
+    m.transition().set(cell_state::Ash, tick{}, cell_state::Seed).build();
+    m.transition().set(cell_state::Tree, spark{}, cell_state::Fire).build();
+    std::string err;
+    frozen::model md;
+    frozen::registry<M> reg;
+    reg.collect(m);
+    if (!frozen::freeze(m, md, &err)) return nullptr;
+    return frozen::make(md.serialize(), reg, &err);
+  }
+
+  int test_batch_matches_scalar() {
+    auto def = make_def();
+    if (!def) return 1;
+    auto tick_id = def->table().event_index<tick>();
+    auto spark_id = def->table().event_index<spark>();
+
+    std::mt19937 rng{34};
+    std::vector<std::uint32_t> init(100003); // not a multiple of the lane count
+    for (auto &s : init) s = rng() % def->table().state_count();
+
+    // the reference: definition::step() one instance at a time
+    auto want = init;
+    M::Context ctx;
+    burnt = 0;
+    for (int round = 0; round < 6; round++)
+      for (auto &s : want) def->step(s, round == 3 ? spark_id : tick_id, tick{}, ctx, payload_t{});
+    auto want_burnt = burnt;
+
+    for (auto isa : {frozen::simd::Scalar, frozen::simd::Avx2, frozen::simd::Avx512}) {
+      frozen::batch<M> b{def, isa};
+      auto got = init;
+      std::vector<std::uint64_t> mask(b.mask_words(got.size()));
+      frozen::batch_result total;
+      burnt = 0;
+      for (int round = 0; round < 6; round++) {
+        auto ev = round == 3 ? spark_id : tick_id;
+        auto r = b.step(got.data(), got.size(), ev, mask.data());
+        b.run_slow(got.data(), got.size(), mask.data(), ev, tick{}, [&ctx](std::size_t) -> M::Context & { return ctx; });
+        total.stepped += r.stepped, total.slow += r.slow, total.rejected += r.rejected;
+        if (r.stepped + r.slow + r.rejected != got.size()) return 1;
+      }
+      std::printf("  isa %d: %zu fast, %zu slow, %zu rejected\n", static_cast<int>(b.isa()), total.stepped, total.slow, total.rejected);
+      if (got != want || burnt != want_burnt || total.slow == 0) return 1;
+    }
+
+    std::printf("---- END OF test_batch_matches_scalar()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_batch_matches_scalar();
+  return rc;
+}
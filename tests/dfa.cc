@@ -0,0 +1,155 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/14.
+//
+
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-dfa.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(tok,
+                    Space,
+                    Word,
+                    Number,
+                    Quoted)
+
+  byte_dfa_t<tok> make_tokenizer() {
+    auto space = byte_class::of(" \t\r\n");
+    auto digit = byte_class::range('0', '9');
+    auto quote = byte_class::of('"');
+    byte_dfa_t<tok> d;
+    d.initial(tok::Space)
+        .on(tok::Space, ~quote, tok::Word)
+        .on(tok::Space, space, tok::Space)
+        .on(tok::Space, digit, tok::Number)
+        .on(tok::Space, quote, tok::Quoted)
+        .on(tok::Word, ~quote, tok::Word)
+        .on(tok::Word, space, tok::Space)
+        .on(tok::Number, digit, tok::Number)
+        .on(tok::Number, space, tok::Space)
+        .on(tok::Quoted, ~quote, tok::Quoted)
+        .on(tok::Quoted, quote, tok::Space);
+    d.compile();
+    return d;
+  }
+
+  std::string make_input(std::size_t size) {
+    std::mt19937 rng{20211014};
+    std::string s;
+    s.reserve(size + 64);
+    while (s.size() < size) {
+      switch (rng() % 4) {
+      case 0: s.append(std::to_string(rng() % 100000)); break;
+      case 1: s.append(1 + rng() % 12, static_cast<char>('a' + rng() % 26)); break;
+      case 2: s.append("\"").append(20 + rng() % 200, 'q').append("\""); break;
+      default: s.append(1 + rng() % 3, ' '); continue;
+      }
+      s.push_back(' ');
+    }
+    return s;
+  }
+
+  // the reference: a plain per-byte scan, no table
+  std::size_t count_tokens(std::string const &s) {
+    std::size_t n = 0;
+    bool in = false, quoted = false;
+    for (auto c : s) {
+      if (quoted) {
+        if (c == '"') quoted = in = false;
+        continue;
+      }
+      bool sp = c == ' ' || c == '\t' || c == '\r' || c == '\n';
+      if (!in && !sp) {
+        n++;
+        in = true;
+        quoted = c == '"';
+      } else if (in && sp)
+        in = false;
+    }
+    return n;
+  }
+
+  int test_dfa_tokens() {
+    auto d = make_tokenizer();
+    auto input = make_input(8 << 20);
+
+    std::size_t tokens = 0;
+    auto on_change = [&tokens](tok from, tok, std::size_t) { tokens += from == tok::Space; };
+    auto t0 = std::chrono::steady_clock::now();
+    auto n = d.feed(input, on_change);
+    auto t1 = std::chrono::steady_clock::now();
+    auto secs = std::chrono::duration<double>(t1 - t0).count();
+    std::printf("  %zu tokens in %zu bytes, %.1f MB/s, table %zu bytes\n", tokens, n, double(n) / secs / 1e6, d.table_bytes());
+    if (n != input.size() || tokens != count_tokens(input)) return 1;
+
+    // chunked feeding gives the same result
+    d.reset();
+    std::size_t chunked = 0;
+    for (std::size_t i = 0; i < input.size(); i += 1000)
+      d.feed(std::string_view{input}.substr(i, 1000), [&chunked](tok from, tok, std::size_t) { chunked += from == tok::Space; });
+    if (chunked != tokens) return 1;
+
+    // a digit run broken by a letter is rejected
+    d.reset();
+    if (d.feed("12 345x") != 6 || !d.failed() || d.current() != tok::Number) return 1;
+
+    std::istringstream is{"one 22 \"three\" four"};
+    d.reset();
+    is >> d;
+    if (d.failed() || d.offset() != 19) return 1;
+
+    std::printf("---- END OF test_dfa_tokens()\n\n\n");
+    return 0;
+  }
+
+  AWESOME_MAKE_ENUM(num_state,
+                    Empty,
+                    Initial,
+                    Digits)
+
+  int test_machine_char_input() {
+    using M = machine_t<num_state>;
+    M m;
+    int digits = 0;
+    m.state().set(num_state::Initial).as_initial().build();
+    auto is_digit = [](M::Event const &ev, M::Context &, M::State const &, M::Payload const &) -> bool {
+      auto c = static_cast<char_event<char> const &>(ev).c;
+      return c >= '0' && c <= '9';
+    };
+    m.transition().set(num_state::Initial, char_event<char>{}, num_state::Digits).guard(is_digit).build();
+    m.transition().set(num_state::Digits, char_event<char>{}, num_state::Digits).guard(is_digit).entry_action([&digits](M::Event const &, M::Context &, M::State const &, M::Payload const &) { digits++; }).build();
+
+    std::istringstream is{"2021x"};
+    for (int i = 0; i < 5; i++) is >> m;
+    if (digits != 3 || !(m.context().current() == M::State{num_state::Digits})) return 1;
+
+    std::printf("---- END OF test_machine_char_input()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_dfa_tokens();
+  rc |= fsm_cxx::test::test_machine_char_input();
+  return rc;
+}
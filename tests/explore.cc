@@ -0,0 +1,168 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-explore.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(client_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Idle,
+                    Waiting,
+                    Closed)
+
+  AWESOME_MAKE_ENUM(server_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Ready,
+                    Busy,
+                    Stalled)
+
+  FSM_DEFINE_EVENT(connect);
+  FSM_DEFINE_EVENT(request);
+  FSM_DEFINE_EVENT(response);
+  FSM_DEFINE_EVENT(quit);
+  FSM_DEFINE_EVENT(reset);
+  FSM_DEFINE_EVENT(overload);
+  FSM_DEFINE_EVENT(crash);
+
+  using Client = machine_t<client_state>;
+  using Server = machine_t<server_state>;
+
+  void define(Client &m) {
+    m.state().set(client_state::Initial).as_initial().build();
+    m.state().set(client_state::Error).as_error().build();
+    m.transition().set(client_state::Initial, connect{}, client_state::Idle).build();
+    m.transition().set(client_state::Idle, request{}, client_state::Waiting).build();
+    m.transition().set(client_state::Waiting, response{}, client_state::Idle).build();
+    m.transition().set(client_state::Idle, quit{}, client_state::Closed).build();
+    m.transition().set(client_state::Idle, reset{}, client_state::Idle).build();
+  }
+
+  void define(Server &m) {
+    m.state().set(server_state::Initial).as_initial().build();
+    m.state().set(server_state::Error).as_error().build();
+    m.transition().set(server_state::Initial, connect{}, server_state::Ready).build();
+    m.transition().set(server_state::Ready, request{}, server_state::Busy).build();
+    m.transition().set(server_state::Busy, response{}, server_state::Ready).build();
+    m.transition().set(server_state::Busy, overload{}, server_state::Stalled).build();
+    m.transition().set(server_state::Stalled, reset{}, server_state::Ready).build();
+    // never taken with the default payload
+    m.transition().set(server_state::Busy, crash{}, server_state::Error).guard([](Server::Event const &, Server::Context &, Server::State const &, Server::Payload const &p) -> bool {
+      return !p._ok;
+    }).build();
+  }
+
+  int test_explore_product() {
+    Client c;
+    Server s;
+    define(c);
+    define(s);
+
+    explore::product p;
+    p.add(c, "client");
+    p.accepting(p.add(s, "server"), server_state::Ready);
+    auto r = explore::explorer{p}.run();
+    std::printf("  %llu configurations, %llu transitions, depth %u, %llu deadlocks, %llu bad\n",
+                (unsigned long long) r.configurations, (unsigned long long) r.transitions, r.depth,
+                (unsigned long long) r.deadlocks, (unsigned long long) r.bad);
+    // a stalled or failed server leaves the client waiting
+    if (!r.exact || !r.complete || r.deadlocks != 2 || !r.first_deadlock || r.ok()) return 1;
+    auto const &t = *r.first_deadlock;
+    for (auto const &st : t) std::cout << "    " << st << '\n';
+    if (t.size() != 4 || t[2].event != "request" || t[3].states[0] != "Waiting" || t[3].states[1] == "Busy") return 1;
+    // the guard of crash is abstracted: Error is reachable
+    if (r.bad == 0 || !r.first_bad || r.first_bad->back().states[1] != "Error") return 1;
+    // the client never fails
+    if (r.unreachable[0] != std::vector<std::string>{"Empty", "Error"}) return 1;
+
+    // sampled: crash is refused by its guard, reset and overload have no
+    // prototype, so the server can neither stall nor fail
+    explore::prototypes<Server> ps;
+    ps.event<connect>().event<request>().event<response>().event<crash>();
+    explore::product q;
+    q.add(c, "client");
+    q.accepting(q.add(s, "server", explore::guards::sample, &ps), server_state::Ready);
+    auto r2 = explore::explorer{q}.run();
+    if (!r2.ok() || r2.configurations != 4 || r2.unreachable[1].back() != "Stalled") return 1;
+
+    std::printf("---- END OF test_explore_product()\n\n\n");
+    return 0;
+  }
+
+  AWESOME_MAKE_ENUM(dial,
+                    Empty,
+                    S0, S1, S2, S3, S4, S5, S6, S7)
+
+  template<int I>
+  struct tick : public event_type<tick<I>> {};
+
+  using Dial = machine_t<dial>;
+
+  template<int I>
+  void define_dial(Dial &m) {
+    m.state().set(dial::S0).as_initial().build();
+    dial const ring[] = {dial::S0, dial::S1, dial::S2, dial::S3, dial::S4, dial::S5, dial::S6, dial::S7};
+    for (int k = 0; k < 8; k++) m.transition().set(ring[k], tick<I>{}, ring[(k + 1) % 8]).build();
+  }
+
+  // independent dials interleave: 8^6 configurations
+  int test_explore_interleaving() {
+    Dial d[6];
+    define_dial<0>(d[0]), define_dial<1>(d[1]), define_dial<2>(d[2]);
+    define_dial<3>(d[3]), define_dial<4>(d[4]), define_dial<5>(d[5]);
+    explore::product p;
+    for (auto &m : d) p.add(m);
+    explore::explorer x{p};
+
+    explore::options opt;
+    opt.threads = 4;
+    auto r = x.run(opt);
+    std::printf("  %llu configurations, %llu transitions, depth %u\n", (unsigned long long) r.configurations,
+                (unsigned long long) r.transitions, r.depth);
+    if (!r.ok() || !r.exact || r.configurations != 262144 || r.transitions != 262144 * 6 || r.depth != 6 * 7) return 1;
+
+    // fingerprints instead of the packed configurations
+    opt.compact = true;
+    auto rc = x.run(opt);
+    if (rc.exact || rc.configurations != 262144) return 1;
+
+    // a visited set too small ends the search incomplete
+    opt.capacity = 4096;
+    if (x.run(opt).complete) return 1;
+
+    std::printf("---- END OF test_explore_interleaving()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_explore_product();
+  rc |= fsm_cxx::test::test_explore_interleaving();
+  return rc;
+}
@@ -0,0 +1,407 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/13.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-optimize.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(my_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  FSM_DEFINE_EVENT(begin);
+  FSM_DEFINE_EVENT(end);
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  using M = machine_t<my_state>;
+
+  std::string trace;
+
+  void define(M &m) {
+    auto log = [](char const *s) {
+      return [s](M::Event const &, M::Context &, M::State const &, M::Payload const &) { trace += s; };
+    };
+    m.state().set(my_state::Initial).as_initial().build();
+    m.state().set(my_state::Terminated).as_terminated().build();
+    m.state().set(my_state::Error).as_error().build();
+    m.state().set(my_state::Opened).guard("payload_ok", [](M::Event const &, M::Context &, M::State const &, M::Payload const &p) -> bool { return p._ok; }).entry_action_named("opened_in", log("O+")).exit_action_named("opened_out", log("O-")).build();
+    m.state().set(my_state::Closed).entry_action_named("closed_in", log("C+")).exit_action_named("closed_out", log("C-")).build();
+
+    m.transition().set(my_state::Initial, begin{}, my_state::Closed).build();
+    m.transition().set(my_state::Closed, open{}, my_state::Opened).entry_action_named("t_open_in", log("t+")).exit_action_named("t_open_out", log("t-")).build();
+    m.transition().set(my_state::Opened, close{}, my_state::Closed).build();
+    m.transition().set(my_state::Closed, end{}, my_state::Terminated).build();
+    m.transition().set(my_state::Opened, end{}, my_state::Terminated).build();
+  }
+
+  template<typename T>
+  std::string drive(T &m) {
+    trace.clear();
+    m.step_by(begin{});
+    m.step_by(open{}, payload_t{false});
+    m.step_by(open{});
+    m.step_by(close{});
+    m.step_by(close{});
+    m.step_by(open{});
+    m.step_by(end{});
+    return trace;
+  }
+
+  int test_frozen_roundtrip() {
+    M m;
+    define(m);
+
+    frozen::model md;
+    std::string err;
+    if (!frozen::freeze(m, md, &err)) {
+      std::printf("  E. freeze: %s\n", err.c_str());
+      return 1;
+    }
+    auto img = md.serialize();
+    std::string const path = "frozen-test.fsmd";
+    if (!frozen::write_file(img, path)) return 1;
+
+    frozen::registry<M> reg;
+    reg.collect(m);
+    auto def = frozen::load(path, reg, &err);
+    std::remove(path.c_str());
+    if (!def) {
+      std::printf("  E. load: %s\n", err.c_str());
+      return 1;
+    }
+    std::printf("  %u states, %u events, %u slots, %zu bytes\n", def->table().state_count(), def->table().event_count(), def->table().slot_count(), img.size());
+
+    M m2;
+    define(m2);
+    auto want = drive(m2);
+    frozen::instance<M> inst{def};
+    auto got = drive(inst);
+    std::printf("  machine_t: %s\n  frozen:    %s\n", want.c_str(), got.c_str());
+    if (want != got || !(inst.current() == m2.context().current()))
+      return 1;
+
+    std::printf("---- END OF test_frozen_roundtrip()\n\n\n");
+    return 0;
+  }
+
+  int test_frozen_errors() {
+    M m;
+    m.state().set(my_state::Initial).as_initial().build();
+    m.transition().set(my_state::Initial, begin{}, my_state::Closed).entry_action([](M::Event const &, M::Context &, M::State const &, M::Payload const &) {}).build();
+    frozen::model md;
+    std::string err;
+    if (frozen::freeze(m, md, &err)) return 1;
+    std::printf("  expected: %s\n", err.c_str());
+
+    M m2;
+    define(m2);
+    if (!frozen::freeze(m2, md, &err)) return 1;
+    frozen::registry<M> empty;
+    if (frozen::make(md.serialize(), empty, &err)) return 1;
+    std::printf("  expected: %s\n", err.c_str());
+
+    auto img = md.serialize();
+    img.data()[sizeof(frozen::header) - 4] = 0x7f; // corrupt the reserved words only
+    if (!frozen::view(img.data(), img.size()).valid()) return 1;
+    reinterpret_cast<frozen::header *>(img.data())->off_slots = 0xfffffff0u;
+    if (frozen::view(img.data(), img.size()).valid()) return 1;
+
+    // a definition without an initial state, and out of range indices
+    auto no_initial = md;
+    no_initial.initial = frozen::npos;
+    auto img2 = no_initial.serialize();
+    if (frozen::view(img2.data(), img2.size()).valid()) return 1;
+    frozen::registry<M> reg;
+    reg.collect(m2);
+    auto def = frozen::make(md.serialize(), reg, &err);
+    if (!def) return 1;
+    frozen::instance<M> inst{def};
+    auto at = inst.current_index();
+    if (inst.current_index(frozen::npos) || inst.current_index() != at) return 1;
+    std::uint32_t cur = frozen::npos;
+    Reason reason{};
+    if (def->step(cur, def->table().event_index<begin>(), begin{}, inst.context(), payload_t{}, &reason) || reason != Reason::StateNotFound) return 1;
+
+    std::printf("---- END OF test_frozen_errors()\n\n\n");
+    return 0;
+  }
+
+  AWESOME_MAKE_ENUM(gen_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    A1,
+                    A2,
+                    B1,
+                    B2,
+                    Orphan)
+
+  using G = machine_t<gen_state>;
+
+  void define_generated(G &m) {
+    auto log = [](char const *s) {
+      return [s](G::Event const &, G::Context &, G::State const &, G::Payload const &) { trace += s; };
+    };
+    auto ok = [](G::Event const &, G::Context &, G::State const &, G::Payload const &p) -> bool { return p._ok; };
+    m.state().set(gen_state::Initial).as_initial().build();
+    m.state().set(gen_state::Terminated).as_terminated().build();
+    m.state().set(gen_state::Error).as_error().build();
+    for (auto s : {gen_state::A1, gen_state::A2})
+      m.state().set(s).entry_action_named("a_in", log("a")).build();
+    for (auto s : {gen_state::B1, gen_state::B2})
+      m.state().set(s).entry_action_named("b_in", log("b")).exit_action_named("b_out", log("~b")).build();
+    m.state().set(gen_state::Orphan).entry_action_named("orphan_in", log("!")).build();
+
+    m.transition().set(gen_state::Initial, begin{}, gen_state::A1).build();
+    m.transition().set(gen_state::A1, open{}, gen_state::B1).guard("ok", ok).build();
+    m.transition().set(gen_state::A2, open{}, gen_state::B2).guard("ok", ok).build();
+    m.transition().set(gen_state::B1, close{}, gen_state::A2).entry_action_named("t_close", log("t")).build();
+    m.transition().set(gen_state::B2, close{}, gen_state::A1).entry_action_named("t_close", log("t")).build();
+    m.transition().set(gen_state::A1, close{}, gen_state::A1).build();
+    m.transition().set(gen_state::A1, close{}, gen_state::B1).guard("ok", ok).build(); // shadowed
+    m.transition().set(gen_state::A2, close{}, gen_state::A2).build();
+    for (auto s : {gen_state::A1, gen_state::A2, gen_state::B1, gen_state::B2})
+      m.transition().set(s, end{}, gen_state::Terminated).build();
+    m.transition().set(gen_state::Orphan, begin{}, gen_state::A1).build();
+  }
+
+  // random walks on the machine and on def must invoke the same actions
+  // and, unless states were merged, end each step in the same state
+  int compare_generated(std::shared_ptr<frozen::definition<G> const> const &def, bool same_states) {
+    std::mt19937 rng{29};
+    for (int round = 0; round < 200; round++) {
+      G ref;
+      define_generated(ref);
+      frozen::instance<G> inst{def};
+      std::string want, got;
+      for (int i = 0; i < 20; i++) {
+        auto pick = rng() % 4;
+        payload_t p{rng() % 3 != 0};
+        auto step = [&](auto const &ev) {
+          trace.clear();
+          bool a = ref.step_by(ev, p);
+          want += trace + (a ? "+" : "-");
+          trace.clear();
+          bool b = inst.step_by(ev, p);
+          got += trace + (b ? "+" : "-");
+          if (same_states && !(inst.current() == ref.context().current())) got += "?";
+        };
+        if (pick == 0) step(begin{});
+        else if (pick == 1) step(open{});
+        else if (pick == 2) step(close{});
+        else step(end{});
+      }
+      if (want != got) {
+        std::printf("  E. round %d:\n  %s\n  %s\n", round, want.c_str(), got.c_str());
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  int test_frozen_optimize() {
+    G m;
+    define_generated(m);
+    frozen::model md;
+    std::string err;
+    if (!frozen::freeze(m, md, &err)) return 1;
+    auto merged = md;
+    auto r = frozen::optimize(md);
+    std::cout << "  " << r << '\n';
+    if (r.unreachable_states != 1 || r.merged_states != 0 || r.dead_slots != 1 || r.bytes_after >= r.bytes_before)
+      return 1; // Orphan is unreachable
+
+    frozen::registry<G> reg;
+    reg.collect(m);
+    auto def = frozen::make(md.serialize(), reg, &err);
+    if (!def) return 1;
+    if (def->table().state(def->initial()).id != static_cast<std::uint32_t>(gen_state::Initial)) return 1;
+    if (compare_generated(def, true)) return 1;
+
+    // merging is opt-in: A1 ~ A2 and B1 ~ B2 fold, the actions stay the same
+    frozen::optimize_options opt;
+    opt.merge_equivalent = true;
+    r = frozen::optimize(merged, opt);
+    std::cout << "  " << r << '\n';
+    if (r.merged_states != 2) return 1;
+    def = frozen::make(merged.serialize(), reg, &err);
+    if (!def || compare_generated(def, false)) return 1;
+
+    G pruned;
+    define_generated(pruned);
+    if (pruned.prune_unreachable() != 1) return 1; // Orphan
+    std::printf("---- END OF test_frozen_optimize()\n\n\n");
+    return 0;
+  }
+
+  int test_adaptive_profile() {
+    // three mutually exclusive candidates on one event; the last one
+    // declared is the one that matches most of the time
+    int evaluated = 0;
+    auto band = [&evaluated](int lo, int hi) {
+      return [&evaluated, lo, hi](G::Event const &, G::Context &, G::State const &, G::Payload const &p) -> bool {
+        evaluated++;
+        auto v = static_cast<int>(p._ok ? 1 : 0) + (trace.empty() ? 0 : trace[0] - '0');
+        return v >= lo && v < hi;
+      };
+    };
+    auto build = [&band](G &m) {
+      m.state().set(gen_state::Initial).as_initial().build();
+      m.state().set(gen_state::Terminated).as_terminated().build();
+      m.state().set(gen_state::Error).as_error().build();
+      m.transition().set(gen_state::Initial, open{}, gen_state::A1).guard("low", band(0, 1)).exclusive().build();
+      m.transition().set(gen_state::Initial, open{}, gen_state::A2).guard("mid", band(1, 2)).exclusive().build();
+      m.transition().set(gen_state::Initial, open{}, gen_state::B1).guard("high", band(2, 10)).exclusive().build();
+      for (auto s : {gen_state::A1, gen_state::A2, gen_state::B1})
+        m.transition().set(s, close{}, gen_state::Initial).build();
+    };
+    auto run = [&evaluated](G &m, std::string &path) {
+      std::mt19937 rng{30};
+      evaluated = 0;
+      for (int i = 0; i < 3000; i++) {
+        trace = rng() % 10 == 0 ? "0" : "5"; // 90% take the last candidate
+        m.step_by(open{}, payload_t{false});
+        path += static_cast<char>('0' + state_id(m.context().current()));
+        m.step_by(close{});
+      }
+      return evaluated;
+    };
+
+    G plain, adaptive;
+    build(plain);
+    build(adaptive);
+    adaptive.adaptive(16);
+    std::string p1, p2;
+    auto e1 = run(plain, p1), e2 = run(adaptive, p2);
+    std::printf("  guards evaluated: %d in order, %d adaptive\n", e1, e2);
+    if (p1 != p2 || e2 * 2 > e1) return 1;
+
+    // the recorded profile survives freeze() ...
+    auto const b1 = static_cast<std::uint32_t>(gen_state::B1);
+    frozen::model md;
+    std::string err;
+    if (!frozen::freeze(adaptive, md, &err)) return 1;
+    auto const &hot = md.states[md.initial].edges[0].slots.front();
+    if (md.states[hot.to].id != b1 || hot.hits == 0) return 1; // already promoted at runtime
+
+    // ... and optimize() applies it to a definition frozen in declared order
+    if (!frozen::freeze(plain, md, &err)) return 1;
+    auto &open_edge = md.states[md.initial].edges[0];
+    if (!(open_edge.flags & frozen::edge_exclusive) || md.states[open_edge.slots.back().to].id != b1) return 1;
+    open_edge.slots.back().hits = 100;
+    frozen::optimize_options opt;
+    auto r = frozen::optimize(md, opt);
+    std::cout << "  " << r << '\n';
+    auto const &first = md.states[md.initial].edges[0].slots.front();
+    if (r.reordered_edges != 1 || md.states[first.to].id != b1) return 1;
+
+    // a step nested in an action of another on the same state and event
+    // must not move the candidate the outer step is running
+    G nested;
+    bool inner = false;
+    nested.adaptive(1);
+    nested.state().set(gen_state::Initial).as_initial().build();
+    nested.transition().set(gen_state::Initial, open{}, gen_state::A1).guard([&inner](G::Event const &, G::Context &, G::State const &, G::Payload const &) -> bool { return !inner; }).exclusive().exit_action([&inner, &nested](G::Event const &, G::Context &, G::State const &, G::Payload const &) {
+      inner = true;
+      nested.step_by(open{});
+      inner = false;
+    }).entry_action([](G::Event const &, G::Context &, G::State const &, G::Payload const &) { trace += '1'; }).build();
+    nested.transition().set(gen_state::Initial, open{}, gen_state::A2).guard([&inner](G::Event const &, G::Context &, G::State const &, G::Payload const &) -> bool { return inner; }).exclusive().entry_action([](G::Event const &, G::Context &, G::State const &, G::Payload const &) { trace += '2'; }).build();
+    trace.clear();
+    nested.step_by(open{});
+    std::printf("  nested: %s\n", trace.c_str());
+    if (trace != "21") return 1;
+
+    std::printf("---- END OF test_adaptive_profile()\n\n\n");
+    return 0;
+  }
+
+  int test_event_hash() {
+    M m;
+    define(m);
+    frozen::model md;
+    frozen::registry<M> reg;
+    reg.collect(m);
+    std::string err;
+    if (!frozen::freeze(m, md, &err)) return 1;
+    auto def = frozen::make(md.serialize(), reg, &err);
+    if (!def || !def->table().head().off_event_hash) return 1;
+
+    // every name finds its index; anything else is rejected
+    auto const &v = def->table();
+    for (std::uint32_t i = 0; i < v.event_count(); i++) {
+      std::string name{v.event_name(i)};
+      if (v.event_index(name) != i) return 1;
+      name.back() ^= 1;
+      if (v.event_index(name) != frozen::npos) return 1;
+    }
+    if (v.event_index("") != frozen::npos || v.event_index("open") != frozen::npos) return 1;
+
+    // events arriving by name step an instance without allocating
+    frozen::instance<M> in{def};
+    Reason reason{};
+    if (!in.step_by(debug::type_name<begin>(), begin{}, payload_t{}, &reason) ||
+        !(in.current() == M::State{my_state::Closed}) ||
+        in.step_by("no such event", open{}, payload_t{}, &reason) || reason != Reason::StateNotFound)
+      return 1;
+
+    // the hash is minimal and perfect over many keys
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20000; i++) keys.push_back("fsm_cxx::event::" + std::to_string(i * 7919));
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::uint32_t seed;
+    std::vector<std::uint32_t> disp, slots;
+    if (!frozen::detail::build_name_hash(views, seed, disp, slots)) return 1;
+    std::vector<char> seen(keys.size(), 0);
+    for (auto k : slots)
+      if (k >= keys.size() || seen[k]++) return 1;
+    auto n = static_cast<std::uint32_t>(keys.size());
+    for (std::uint32_t i = 0; i < n; i++)
+      if (frozen::detail::lookup_name_hash(views[i], seed, disp.data(), slots.data(), n) != i) return 1;
+    std::printf("  seed %u for %u keys\n", seed, n);
+    views.push_back(views.front());
+    if (frozen::detail::build_name_hash(views, seed, disp, slots)) return 1; // duplicates
+
+    std::printf("---- END OF test_event_hash()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_frozen_roundtrip();
+  rc |= fsm_cxx::test::test_frozen_errors();
+  rc |= fsm_cxx::test::test_frozen_optimize();
+  rc |= fsm_cxx::test::test_adaptive_profile();
+  rc |= fsm_cxx::test::test_event_hash();
+  return rc;
+}
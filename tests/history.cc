@@ -0,0 +1,194 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-explore.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  // Connected { Handshake*, Authenticated { Idle*, Busy } }, * the defaults
+  AWESOME_MAKE_ENUM(session_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Disconnected,
+                    Connected,
+                    Handshake,
+                    Authenticated,
+                    Idle,
+                    Busy)
+
+  FSM_DEFINE_EVENT(connect);
+  FSM_DEFINE_EVENT(login);
+  FSM_DEFINE_EVENT(work);
+  FSM_DEFINE_EVENT(done);
+  FSM_DEFINE_EVENT(drop);
+  FSM_DEFINE_EVENT(resume);
+  FSM_DEFINE_EVENT(resume_shallow);
+
+  struct session_context : public context_t<state_t<session_state>> {
+    std::vector<std::string> trail{};
+  };
+
+  using M = machine_t<session_state, event_t, void, payload_t, state_t<session_state>, session_context>;
+
+  void define(M &m) {
+    auto entry = [](std::string tag) {
+      return [tag](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.trail.push_back("+" + tag); };
+    };
+    auto exit = [](std::string tag) {
+      return [tag](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.trail.push_back("-" + tag); };
+    };
+    m.state().set(session_state::Disconnected).as_initial().build();
+    m.state().set(session_state::Connected).entry_action(entry("Connected")).exit_action(exit("Connected")).build();
+    m.state().set(session_state::Handshake).parent(session_state::Connected).as_default().entry_action(entry("Handshake")).build();
+    m.state().set(session_state::Authenticated).parent(session_state::Connected).entry_action(entry("Authenticated")).exit_action(exit("Authenticated")).build();
+    m.state().set(session_state::Idle).parent(session_state::Authenticated).as_default().entry_action(entry("Idle")).build();
+    m.state().set(session_state::Busy).parent(session_state::Authenticated).entry_action(entry("Busy")).exit_action(exit("Busy")).build();
+
+    m.transition().set(session_state::Disconnected, connect{}, session_state::Connected).build();
+    m.transition().set(session_state::Handshake, login{}, session_state::Authenticated).build();
+    m.transition().set(session_state::Idle, work{}, session_state::Busy).build();
+    m.transition().set(session_state::Busy, done{}, session_state::Idle).build();
+    // declared once on the composite, taken from every sub-state
+    m.transition().set(session_state::Connected, drop{}, session_state::Disconnected).build();
+    m.transition().set(session_state::Disconnected, resume{}, session_state::Connected).to_history().build();
+    m.transition().set(session_state::Disconnected, resume_shallow{}, session_state::Connected).to_history(history_kind::shallow).build();
+  }
+
+  bool at(M const &m, session_state s) { return m.context().current() == M::State{s}; }
+
+  int test_composite() {
+    M m;
+    define(m);
+    if (!m.step_by(connect{}) || !at(m, session_state::Handshake)) return 1;
+    if (!m.step_by(login{}) || !at(m, session_state::Idle)) return 1;
+    m.context().trail.clear();
+    if (!m.step_by(work{}) || !m.step_by(done{})) return 1;
+    // between siblings the composite states are neither left nor entered
+    if (m.context().trail != std::vector<std::string>{"+Busy", "-Busy", "+Idle"}) return 1;
+
+    m.step_by(work{});
+    m.context().trail.clear();
+    if (!m.step_by(drop{}) || !at(m, session_state::Disconnected)) return 1;
+    if (m.context().trail != std::vector<std::string>{"-Busy", "-Authenticated", "-Connected"}) return 1;
+    if (m.step_by(login{})) return 1;
+
+    std::printf("---- END OF test_composite()\n\n\n");
+    return 0;
+  }
+
+  int test_history() {
+    M m;
+    define(m);
+    // no history yet: the defaults are entered
+    if (m.history_of(M::State{session_state::Connected}) || !m.step_by(resume{}) || !at(m, session_state::Handshake)) return 1;
+    m.step_by(login{});
+    m.step_by(work{});
+    m.step_by(drop{});
+    auto deep = m.history_of(M::State{session_state::Connected});
+    auto shallow = m.history_of(M::State{session_state::Connected}, history_kind::shallow);
+    if (!deep || !(*deep == M::State{session_state::Busy}) || !shallow || !(*shallow == M::State{session_state::Authenticated})) return 1;
+
+    // one transition back into Busy, without Handshake nor Idle
+    m.context().trail.clear();
+    if (!m.step_by(resume{}) || !at(m, session_state::Busy)) return 1;
+    if (m.context().trail != std::vector<std::string>{"+Connected", "+Authenticated", "+Busy"}) return 1;
+
+    // shallow: back into Authenticated, then its default
+    m.step_by(drop{});
+    if (!m.step_by(resume_shallow{}) || !at(m, session_state::Idle)) return 1;
+
+    // replaying records the history too
+    M r;
+    define(r);
+    r.replaying(true);
+    r.step_by(connect{});
+    r.step_by(login{});
+    r.step_by(work{});
+    r.step_by(drop{});
+    r.replaying(false);
+    if (!r.step_by(resume{}) || !at(r, session_state::Busy)) return 1;
+
+    r.reset();
+    if (r.history_of(M::State{session_state::Connected})) return 1;
+
+    std::printf("---- END OF test_history()\n\n\n");
+    return 0;
+  }
+
+  // the transitions of a composite state are kept as long as one of its
+  // sub-states is reachable, even if it is never a target itself
+  int test_prune() {
+    M m;
+    m.state().set(session_state::Idle).parent(session_state::Authenticated).as_initial().build();
+    m.state().set(session_state::Busy).parent(session_state::Authenticated).build();
+    m.transition().set(session_state::Authenticated, drop{}, session_state::Disconnected).build();
+    m.transition().set(session_state::Busy, done{}, session_state::Idle).build(); // nothing leads to Busy
+    if (m.prune_unreachable() != 1) return 1;
+    if (!m.step_by(drop{}) || !at(m, session_state::Disconnected)) return 1;
+
+    M full;
+    define(full);
+    if (full.prune_unreachable() != 0) return 1;
+
+    std::printf("---- END OF test_prune()\n\n\n");
+    return 0;
+  }
+
+  // a frozen definition is flat and refuses the composites; the explorer
+  // flattens them as step_by() walks them
+  int test_composite_flattened() {
+    M m;
+    define(m);
+    frozen::model md;
+    std::string err;
+    if (frozen::freeze(m, md, &err) || err.find("composite") == std::string::npos) return 1;
+
+    explore::product p;
+    p.add(m, "session");
+    auto r = explore::explorer{p}.run();
+    if (r.reachable[0] != std::vector<std::string>{"Disconnected", "Handshake", "Idle", "Busy"}) return 1;
+
+    // the transitions of a composite state are taken from its sub-states
+    M n;
+    n.state().set(session_state::Idle).parent(session_state::Authenticated).as_initial().build();
+    n.transition().set(session_state::Authenticated, drop{}, session_state::Disconnected).build();
+    explore::product q;
+    q.add(n, "session");
+    auto r2 = explore::explorer{q}.run();
+    if (r2.reachable[0] != std::vector<std::string>{"Disconnected", "Idle"}) return 1;
+
+    std::printf("---- END OF test_composite_flattened()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_composite();
+  rc |= fsm_cxx::test::test_history();
+  rc |= fsm_cxx::test::test_prune();
+  rc |= fsm_cxx::test::test_composite_flattened();
+  return rc;
+}
@@ -0,0 +1,251 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-journal.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(account_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Open,
+                    Frozen,
+                    Closed)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(freeze);
+  FSM_DEFINE_EVENT(thaw);
+  FSM_DEFINE_EVENT(close);
+
+  // an event with data, recorded through its hooks
+  struct deposit : public event_type<deposit> {
+    std::int32_t cents{};
+    void journal_save(snapshot::writer &w) const { w.put(cents); }
+    bool journal_load(snapshot::reader &r) { return r.get(cents); }
+  };
+
+  struct amount : public payload_t {
+    std::int32_t limit{1000};
+    void journal_save(snapshot::writer &w) const { w.put(limit); }
+    bool journal_load(snapshot::reader &r) { return r.get(limit); }
+  };
+
+  struct account_context : public context_t<state_t<account_state>, event_t, void, amount> {
+    std::int64_t balance{};
+    std::uint32_t actions{};
+
+    void snapshot_save(snapshot::writer &w) const {
+      w.put(balance);
+      w.put(actions);
+    }
+    bool snapshot_load(snapshot::reader &r) { return r.get(balance) && r.get(actions); }
+  };
+
+  using M = machine_t<account_state, event_t, void, amount, state_t<account_state>, account_context>;
+
+  void define(std::uint64_t, M &m) {
+    m.state().set(account_state::Initial).as_initial().build();
+    m.state().set(account_state::Open).entry_action([](M::Event const &ev, M::Context &c, M::State const &, M::Payload const &) {
+      if (auto const *d = dynamic_cast<deposit const *>(&ev)) c.balance += d->cents;
+      c.actions++;
+    }).build();
+    m.transition().set(account_state::Initial, open{}, account_state::Open).build();
+    // deposits above the payload limit freeze the account: the guard
+    // reads the recorded event and payload, so replay decides the same
+    m.transition().set(account_state::Open, deposit{}, account_state::Frozen).guard([](M::Event const &ev, M::Context &, M::State const &, M::Payload const &p) -> bool {
+      return static_cast<deposit const &>(ev).cents > p.limit;
+    }).build();
+    m.transition().set(account_state::Open, deposit{}, account_state::Open).build();
+    m.transition().set(account_state::Frozen, thaw{}, account_state::Open).build();
+    m.transition().set(account_state::Open, freeze{}, account_state::Frozen).build();
+    m.transition().set(account_state::Open, close{}, account_state::Closed).build();
+  }
+
+  journal::codec<M> make_codec() {
+    journal::codec<M> c;
+    c.event<open>().event<deposit>().event<freeze>().event<thaw>();
+    // close is left out: replay forces the recorded state
+    return c;
+  }
+
+  using Pool = std::unordered_map<std::uint64_t, M>;
+
+  // one pseudo-random step on instance id
+  void drive(M &m, std::uint64_t &x) {
+    x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+    amount p;
+    p.limit = 500 + static_cast<std::int32_t>(x % 1000);
+    switch ((x >> 20) % 8) {
+      case 0: m.step_by(open{}, p); break;
+      case 1: m.step_by(freeze{}, p); break;
+      case 2: m.step_by(thaw{}, p); break;
+      case 3:
+        if ((x >> 30) % 16 == 0) m.step_by(close{}, p);
+        break;
+      default: {
+        deposit d;
+        d.cents = static_cast<std::int32_t>((x >> 32) % 1200);
+        m.step_by(d, p);
+      }
+    }
+  }
+
+  // b was rebuilt from a journal of a: an instance that never moved is
+  // not in it
+  bool same_states(Pool const &a, Pool const &b) {
+    for (auto const &[id, m] : a) {
+      auto it = b.find(id);
+      auto const &s = it == b.end() ? M::State{account_state::Initial} : it->second.context().current();
+      if (!(s == m.context().current())) {
+        std::printf("  E. instance %llu differs\n", static_cast<unsigned long long>(id));
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int test_journal_replay() {
+    std::string const dir = "journal-test.d";
+    std::filesystem::remove_all(dir);
+    auto c = make_codec();
+    Pool live;
+    std::uint64_t lsn_at_checkpoint = 0, steps = 0;
+    {
+      journal::log::options lo;
+      lo.segment_bytes = 16 * 1024; // many segments
+      lo.sync = false;
+      journal::log lg{dir, lo};
+      journal::sink<M> sk{lg, c, journal::sink<M>::options{false}};
+      for (std::uint64_t id = 0; id < 64; id++) {
+        define(id, live[id]);
+        sk.attach(live[id], id);
+      }
+
+      std::uint64_t x = 0x9e3779b97f4a7c15ULL;
+      for (int k = 0; k < 20000; k++, steps++) drive(live[x % 64], x);
+      lg.commit();
+      lsn_at_checkpoint = lg.last_lsn();
+      if (!journal::checkpoint(dir + "/pool.ckpt", live, lsn_at_checkpoint)) return 1;
+      for (int k = 0; k < 20000; k++, steps++) drive(live[x % 64], x);
+      lg.commit();
+      std::printf("  %llu steps, %llu records\n", static_cast<unsigned long long>(steps), static_cast<unsigned long long>(lg.last_lsn()));
+    }
+
+    // the whole journal, replayed in parallel with actions suppressed
+    Pool full;
+    journal::replay_options ro;
+    ro.threads = 4;
+    auto r = journal::replay(dir, c, full, define, ro);
+    std::printf("  replay: %llu records, %llu stepped, %llu forced\n", static_cast<unsigned long long>(r.records),
+                static_cast<unsigned long long>(r.stepped), static_cast<unsigned long long>(r.forced));
+    if (r.torn || r.records != r.last_lsn || r.forced == 0 || !same_states(live, full)) return 1;
+    for (auto const &[id, m] : full)
+      if (m.context().actions != 0 || m.replaying()) return 1;
+
+    // checkpoint plus log tail, after dropping the segments it covers
+    {
+      journal::log lg{dir};
+      if (lg.last_lsn() != r.last_lsn) return 1;
+      if (lg.truncate_before(lsn_at_checkpoint + 1) == 0) return 1;
+    }
+    Pool rec;
+    journal::replay_result tail;
+    if (!journal::recover(dir + "/pool.ckpt", dir, c, rec, define, &tail, ro)) return 1;
+    if (tail.records != r.last_lsn - lsn_at_checkpoint || !same_states(live, rec)) return 1;
+
+    // a torn tail ends the journal; reopening cuts it and appends after
+    auto segs = journal::detail::list_segments(dir);
+    {
+      std::FILE *fp = std::fopen(segs.back().second.c_str(), "ab");
+      std::fputs("garbage, as left by a crash in the middle of a write", fp);
+      std::fclose(fp);
+    }
+    journal::reader rd{dir};
+    rd.for_each([](journal::entry const &) {});
+    if (rd.last_lsn() != r.last_lsn || !rd.torn()) return 1;
+    {
+      journal::log lg{dir};
+      journal::sink<M> sk{lg, c};
+      M m;
+      define(64, m);
+      sk.attach(m, 64);
+      m.step_by(open{}, amount{});
+      m.step_by(freeze{}, amount{});
+      if (lg.durable_lsn() != r.last_lsn + 2) return 1;
+    }
+    journal::reader rd2{dir};
+    rd2.for_each([](journal::entry const &) {});
+    if (rd2.last_lsn() != r.last_lsn + 2 || rd2.torn()) return 1;
+
+    std::filesystem::remove_all(dir);
+    std::printf("---- END OF test_journal_replay()\n\n\n");
+    return 0;
+  }
+
+  int test_journal_group_commit() {
+    std::string const dir = "journal-group.d";
+    std::filesystem::remove_all(dir);
+    auto c = make_codec();
+    constexpr std::size_t threads = 4, per = 8, rounds = 200;
+    Pool live;
+    for (std::uint64_t id = 0; id < threads * per; id++) define(id, live[id]);
+
+    std::uint64_t syncs;
+    {
+      journal::log lg{dir};
+      journal::sink<M> sk{lg, c}; // every step waits for its record to be durable
+      for (auto &[id, m] : live) sk.attach(m, id);
+      std::vector<std::thread> ts;
+      for (std::size_t t = 0; t < threads; t++)
+        ts.emplace_back([&live, t]() {
+          std::uint64_t x = 0x2545f4914f6cdd1dULL * (t + 1);
+          for (std::size_t k = 0; k < rounds; k++) drive(live[t * per + (x % per)], x);
+        });
+      for (auto &t : ts) t.join();
+      syncs = lg.syncs();
+      if (lg.durable_lsn() != lg.last_lsn()) return 1;
+      std::printf("  %llu records, %llu syncs\n", static_cast<unsigned long long>(lg.last_lsn()), static_cast<unsigned long long>(syncs));
+      if (syncs > lg.last_lsn()) return 1;
+    }
+
+    Pool back;
+    auto r = journal::replay(dir, c, back, define);
+    if (r.torn || !same_states(live, back)) return 1;
+
+    std::filesystem::remove_all(dir);
+    std::printf("---- END OF test_journal_group_commit()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_journal_replay();
+  rc |= fsm_cxx::test::test_journal_group_commit();
+  return rc;
+}
@@ -0,0 +1,106 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(valve_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Open,
+                    Closed,
+                    Stuck)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+  FSM_DEFINE_EVENT(jam);
+
+  struct valve_context : public context_t<state_t<valve_state>> {
+    int opened{}, closed{};
+  };
+
+  using M = machine_t<valve_state, event_t, void, payload_t, state_t<valve_state>, valve_context>;
+
+  template<typename Evt>
+  std::string name_of() { return std::string{fsm_cxx::debug::type_name<Evt>()}; }
+
+  std::vector<M::Descriptor> descriptors() {
+    std::vector<M::Descriptor> v;
+    v.push_back({valve_state::Initial, name_of<open>(), valve_state::Open});
+    M::Descriptor d{valve_state::Open, name_of<close>(), valve_state::Closed};
+    d.entry = M::Action{[](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.closed++; }};
+    v.push_back(std::move(d));
+    v.push_back({valve_state::Closed, name_of<open>(), valve_state::Open});
+    // two candidates for jam: the first refuses a payload that is not ok
+    M::Descriptor g{valve_state::Open, name_of<jam>(), valve_state::Stuck};
+    g.guard = [](M::Event const &, M::Context &, M::State const &, M::Payload const &p) -> bool { return !p._ok; };
+    g.guard_name = "failing";
+    v.push_back(std::move(g));
+    v.push_back({valve_state::Open, name_of<jam>(), valve_state::Closed});
+    return v;
+  }
+
+  int test_load() {
+    M m;
+    m.state().set(valve_state::Initial).as_initial().build();
+    m.state().set(valve_state::Open).entry_action([](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.opened++; }).build();
+    m.load(descriptors(), {4, 5, 2});
+    if (m.transitions().size() != 3 || m.transitions().at(M::State{valve_state::Open}).m_.size() != 2) return 1;
+
+    auto const &jams = m.transitions().at(M::State{valve_state::Open}).m_.at(name_of<jam>());
+    if (jams.size() != 2 || jams[0].guard_name != "failing" || !(jams[1].to == M::State{valve_state::Closed})) return 1;
+
+    if (!m.step_by(open{}) || !m.step_by(close{}) || !m.step_by(open{})) return 1;
+    if (m.context().opened != 2 || m.context().closed != 1) return 1;
+    // the guarded candidate refuses, the next one is taken
+    if (!m.step_by(jam{}) || !(m.context().current() == M::State{valve_state::Closed})) return 1;
+
+    std::printf("---- END OF test_load()\n\n\n");
+    return 0;
+  }
+
+  // a range that is not moved from is copied, and adds to what is defined
+  int test_load_copies() {
+    M m;
+    m.state().set(valve_state::Initial).as_initial().build();
+    m.transition().set(valve_state::Open, jam{}, valve_state::Error).build();
+    auto const v = descriptors();
+    m.load(v);
+    if (v[3].guard_name != "failing" || !v[1].entry) return 1;
+
+    auto const &jams = m.transitions().at(M::State{valve_state::Open}).m_.at(name_of<jam>());
+    if (jams.size() != 3 || !(jams[0].to == M::State{valve_state::Error}) || jams[1].guard_name != "failing") return 1;
+    if (!m.step_by(open{}) || !m.step_by(jam{}) || !(m.context().current() == M::State{valve_state::Error})) return 1;
+
+    std::printf("---- END OF test_load_copies()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_load();
+  rc |= fsm_cxx::test::test_load_copies();
+  return rc;
+}
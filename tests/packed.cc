@@ -0,0 +1,125 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-packed.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(mob_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Idle,
+                    Hurt,
+                    Dead)
+
+  FSM_DEFINE_EVENT(spawn);
+  FSM_DEFINE_EVENT(hit);
+  FSM_DEFINE_EVENT(heal);
+
+  struct hp_slot {
+    std::uint16_t hp;
+    std::uint16_t hits;
+  };
+
+  // guards and actions see the slot of the instance being stepped
+  struct mob_context : context_t<state_t<mob_state>, event_t, void, payload_t> {
+    hp_slot *slot{nullptr};
+    void bind_slot(hp_slot &s) { slot = &s; }
+  };
+
+  using M = machine_t<mob_state, event_t, void, payload_t, state_t<mob_state>, mob_context>;
+
+  std::shared_ptr<frozen::definition<M> const> make_def() {
+    M m;
+    m.state().set(mob_state::Initial).as_initial().build();
+    m.state().set(mob_state::Terminated).as_terminated().build();
+    m.state().set(mob_state::Error).as_error().build();
+    m.state().set(mob_state::Hurt).entry_action_named("ouch", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+      c.slot->hp = static_cast<std::uint16_t>(c.slot->hp > 30 ? c.slot->hp - 30 : 0);
+      c.slot->hits++;
+    }).build();
+    m.state().set(mob_state::Idle).entry_action_named("rest", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.slot->hp = 100; }).build();
+    auto alive = [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) -> bool { return c.slot->hp > 30; };
+    m.transition().set(mob_state::Initial, spawn{}, mob_state::Idle).build();
+    m.transition().set(mob_state::Idle, hit{}, mob_state::Hurt).build();
+    m.transition().set(mob_state::Hurt, hit{}, mob_state::Hurt).guard("alive", alive).build();
+    m.transition().set(mob_state::Hurt, hit{}, mob_state::Dead).build();
+    m.transition().set(mob_state::Hurt, heal{}, mob_state::Idle).build();
+    frozen::model md;
+    frozen::registry<M> reg;
+    reg.collect(m);
+    std::string err;
+    if (!frozen::freeze(m, md, &err)) return nullptr;
+    return frozen::make(md.serialize(), reg, &err);
+  }
+
+  int test_packed_pool() {
+    auto def = make_def();
+    if (!def) return 1;
+    using Pool = frozen::packed_pool<M, hp_slot>;
+    static_assert(Pool::bits == 4, "7 states fit in a nibble");
+
+    constexpr std::size_t n = 1000003;
+    Pool pool{def, n};
+    std::cout << "  " << n << " instances in " << pool.bytes() << " bytes (" << Pool::bits << " bits + "
+              << sizeof(hp_slot) << " bytes of slot each)\n";
+    if (pool.bytes() > n * sizeof(hp_slot) + n / 2 + 64) return 1;
+
+    auto const &t = def->table();
+    auto spawn_id = t.event_index<spawn>(), hit_id = t.event_index<hit>(), heal_id = t.event_index<heal>();
+    if (pool.step_all(spawn_id, spawn{}) != n) return 1;
+    // every third instance is hit 4 times, every other one healed between
+    for (std::size_t i = 0; i < n; i += 3)
+      for (int k = 0; k < 4; k++) {
+        pool.step_by(i, hit_id, hit{});
+        if (i % 2 == 0 && k == 1) pool.step_by(i, heal_id, heal{});
+      }
+
+    // neighbours sharing a word are not disturbed
+    for (std::size_t i = 0; i < n; i++) {
+      auto want = i % 3 ? mob_state::Idle : i % 2 ? mob_state::Dead : mob_state::Hurt;
+      if (!(pool.current(i) == M::State{want})) {
+        std::printf("  E. instance %zu\n", i);
+        return 1;
+      }
+    }
+    if (pool.slot(0).hits != 4 || pool.slot(3).hits != 3 || pool.slot(1).hits != 0) return 1;
+
+    // a shrink then a growth starts the new instances afresh
+    pool.resize(5);
+    pool.resize(40);
+    if (!(pool.current(3) == M::State{mob_state::Dead}) || !(pool.current(7) == M::State{mob_state::Initial}) || pool.slot(7).hits != 0)
+      return 1;
+
+    std::printf("---- END OF test_packed_pool()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_packed_pool();
+  return rc;
+}
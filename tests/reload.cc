@@ -0,0 +1,153 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/16.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-reload.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(door_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed,
+                    Locked)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+  FSM_DEFINE_EVENT(lock);
+
+  using M = machine_t<door_state>;
+
+  // v1: open/close; v2 also locks a closed door, and lock reopens it.
+  // A door locked on v2 is stuck while v1 is current.
+  std::shared_ptr<frozen::definition<M> const> make_version(bool v2, std::string *err) {
+    M m;
+    m.state().set(door_state::Initial).as_initial().build();
+    m.state().set(door_state::Terminated).as_terminated().build();
+    m.state().set(door_state::Error).as_error().build();
+    m.transition().set(door_state::Initial, open{}, door_state::Opened).build();
+    m.transition().set(door_state::Opened, close{}, door_state::Closed).build();
+    m.transition().set(door_state::Closed, open{}, door_state::Opened).build();
+    if (v2) {
+      m.transition().set(door_state::Closed, lock{}, door_state::Locked).build();
+      m.transition().set(door_state::Locked, lock{}, door_state::Opened).build();
+    }
+    frozen::model md;
+    if (!frozen::freeze(m, md, err)) return nullptr;
+    frozen::registry<M> reg;
+    return frozen::make(md.serialize(), reg, err);
+  }
+
+  int test_reload_under_load() {
+    std::string err;
+    auto v1 = make_version(false, &err), v2 = make_version(true, &err);
+    if (!v1 || !v2) {
+      std::printf("  E. %s\n", err.c_str());
+      return 1;
+    }
+    std::weak_ptr<frozen::definition<M> const> w1 = v1;
+
+    frozen::live<M> defs{v1};
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::atomic<std::uint64_t> steps{0}, locked{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+      workers.emplace_back([&]() {
+        std::vector<frozen::live_instance<M>> pool;
+        for (int i = 0; i < 64; i++) pool.emplace_back(defs);
+        std::uint64_t n = 0, l = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          for (auto &inst : pool) {
+            inst.step_by(open{});
+            inst.step_by(close{});
+            // a step runs on one version: only v2 (even numbers) knows lock
+            if (inst.step_by(lock{})) {
+              l++;
+              if (inst.version() % 2 != 0 || !(inst.current() == M::State{door_state::Locked} || inst.current() == M::State{door_state::Opened}))
+                bad++;
+              inst.step_by(lock{});
+            }
+            n += 4;
+          }
+        }
+        steps += n;
+        locked += l;
+      });
+    }
+
+    std::uint64_t published = 1;
+    for (int i = 0; i < 2000; i++) {
+      published = defs.publish(i % 2 ? v1 : v2);
+      if (i % 256 == 0) std::this_thread::yield();
+    }
+    stop = true;
+    for (auto &w : workers) w.join();
+
+    std::cout << "  " << steps.load() << " steps (" << locked.load() << " locked) across " << published << " versions\n";
+    if (bad || published != 2001 || locked == 0) return 1;
+
+    // the retired versions are released once nothing runs on them
+    defs.publish(v2);
+    v1.reset();
+    auto left = defs.collect();
+    if (left != 0 || !w1.expired()) {
+      std::printf("  E. %zu left, expired %d\n", left, int(w1.expired()));
+      return 1;
+    }
+
+    std::printf("---- END OF test_reload_under_load()\n\n\n");
+    return 0;
+  }
+
+  int test_reload_orphaned_state() {
+    std::string err;
+    frozen::live<M> defs{make_version(true, &err)};
+    frozen::live_instance<M> inst{defs};
+    inst.step_by(open{});
+    inst.step_by(close{});
+    inst.step_by(lock{});
+    if (!(inst.current() == M::State{door_state::Locked}) || inst.version() != 1) return 1;
+
+    defs.publish(make_version(false, &err)); // v1 has no Locked state
+    Reason r{};
+    if (inst.step_by(lock{}, payload_t{}, &r) || r != Reason::StateNotFound) return 1;
+    inst.reset();
+    if (!inst.step_by(open{}) || inst.version() != 2) return 1;
+
+    std::printf("---- END OF test_reload_orphaned_state()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_reload_under_load();
+  rc |= fsm_cxx::test::test_reload_orphaned_state();
+  return rc;
+}
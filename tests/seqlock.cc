@@ -0,0 +1,145 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-seqlock.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(pump_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Filling,
+                    Draining)
+
+  FSM_DEFINE_EVENT(fill);
+  FSM_DEFINE_EVENT(drain);
+
+  struct pump_context : public context_t<state_t<pump_state>> {
+    std::uint64_t cycles{};
+    std::uint64_t level[6]{}; // all equal to cycles, unless torn
+
+    struct published {
+      std::uint64_t cycles;
+      std::uint64_t level[6];
+    };
+    void publish(published &p) const {
+      p.cycles = cycles;
+      for (int i = 0; i < 6; i++) p.level[i] = level[i];
+    }
+  };
+
+  using M = machine_t<pump_state, event_t, void, payload_t, state_t<pump_state>, pump_context>;
+
+  void define(M &m) {
+    m.state().set(pump_state::Initial).as_initial().build();
+    m.state().set(pump_state::Filling).entry_action([](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+      c.cycles++;
+      for (auto &l : c.level) l = c.cycles;
+    }).build();
+    m.transition().set(pump_state::Initial, fill{}, pump_state::Filling).build();
+    m.transition().set(pump_state::Filling, drain{}, pump_state::Draining).build();
+    m.transition().set(pump_state::Draining, fill{}, pump_state::Filling).build();
+  }
+
+  int test_seqlock_value() {
+    struct pair {
+      std::uint64_t a, b;
+    };
+    util::seqlock<pair> s{pair{1, 1}};
+    std::atomic<bool> done{false};
+    std::atomic<long> torn{0};
+    std::thread reader([&]() {
+      while (!done.load()) {
+        auto v = s.read();
+        if (v.a != v.b) torn++;
+      }
+    });
+    for (std::uint64_t i = 2; i < 200000; i++) s.write(pair{i, i});
+    done = true;
+    reader.join();
+    if (torn != 0 || s.sequence() != 200000 - 2 || s.read().a != 199999) return 1;
+    auto copy = s;
+    if (copy.read().b != 199999) return 1;
+
+    std::printf("---- END OF test_seqlock_value()\n\n\n");
+    return 0;
+  }
+
+  // monitors observe the state and fields while the owner steps
+  int test_observe() {
+    M m;
+    define(m);
+    auto o = m.observe();
+    if (!(o.state == M::State{pump_state::Initial}) || o.fields.cycles != 0) return 1;
+
+    std::atomic<bool> done{false};
+    std::atomic<long> bad{0}, reads{0};
+    std::vector<std::thread> monitors;
+    for (int t = 0; t < 2; t++)
+      monitors.emplace_back([&]() {
+        std::uint64_t last_version = 0, last_cycles = 0;
+        while (!done.load()) {
+          auto v = m.observe();
+          reads++;
+          for (auto l : v.fields.level)
+            if (l != v.fields.cycles) bad++;
+          if (v.version < last_version || v.fields.cycles < last_cycles) bad++;
+          // cycles counts the entries into Filling: Draining always
+          // comes after at least one of them
+          if (v.state == M::State{pump_state::Draining} && v.fields.cycles == 0) bad++;
+          last_version = v.version, last_cycles = v.fields.cycles;
+        }
+      });
+
+    for (int i = 0; i < 100000; i++) {
+      m.step_by(fill{});
+      m.step_by(drain{});
+    }
+    done = true;
+    for (auto &t : monitors) t.join();
+    std::printf("  %ld observations\n", reads.load());
+    if (bad != 0) return 1;
+
+    o = m.observe();
+    if (!(o.state == M::State{pump_state::Draining}) || o.fields.cycles != 100000) return 1;
+    // changes outside of step_by() are published on request
+    m.context().cycles = 7;
+    if (m.observe().fields.cycles != 100000 || m.publish().observe().fields.cycles != 7) return 1;
+    M::Observed x;
+    if (!m.try_observe(x) || x.version != m.observe().version) return 1;
+    m.reset();
+    if (!(m.observe().state == M::State{pump_state::Initial})) return 1;
+
+    std::printf("---- END OF test_observe()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_seqlock_value();
+  rc |= fsm_cxx::test::test_observe();
+  return rc;
+}
@@ -0,0 +1,140 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/17.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-shard.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(door_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  using M = machine_t<door_state>; // no MutexT: the shard owns it
+
+  struct door {
+    M m;
+    int opened{0};
+    std::thread::id owner{};
+    bool shared{false}; // touched by two threads
+  };
+
+  struct msg {
+    bool open;
+  };
+
+  void define(door &d) {
+    d.m.state().set(door_state::Initial).as_initial().build();
+    d.m.state().set(door_state::Terminated).as_terminated().build();
+    d.m.state().set(door_state::Error).as_error().build();
+    d.m.state().set(door_state::Opened).entry_action([&d](M::Event const &, M::Context &, M::State const &, M::Payload const &) { d.opened++; }).build();
+    d.m.transition().set(door_state::Initial, open{}, door_state::Opened).build();
+    d.m.transition().set(door_state::Opened, close{}, door_state::Closed).build();
+    d.m.transition().set(door_state::Closed, open{}, door_state::Opened).build();
+  }
+
+  int test_shard_ownership() {
+    constexpr int producers = 3, instances = 500, rounds = 40;
+    sharded_executor<door, msg>::options opt;
+    opt.shards = 4;
+    opt.inbox_capacity = 256; // small, so that producers hit full inboxes
+    sharded_executor<door, msg> ex{
+        [](std::uint64_t, door &d) { define(d); },
+        [](std::uint64_t, door &d, msg &e) {
+          if (d.owner == std::thread::id{}) d.owner = std::this_thread::get_id();
+          else if (d.owner != std::this_thread::get_id()) d.shared = true;
+          e.open ? d.m.step_by(open{}) : d.m.step_by(close{});
+        },
+        opt};
+
+    // each producer owns a slice of the ids, so per-instance order holds
+    std::vector<std::thread> ps;
+    for (int p = 0; p < producers; p++)
+      ps.emplace_back([&ex, p]() {
+        for (int r = 0; r < rounds; r++)
+          for (std::uint64_t id = p; id < instances; id += producers) {
+            ex.post(id, msg{true});
+            ex.post(id, msg{false});
+          }
+      });
+    for (auto &t : ps) t.join();
+    ex.drain();
+
+    auto occ = ex.occupancy();
+    std::cout << "  " << ex.handled() << " messages on " << ex.shard_count() << " shards, instances per shard:";
+    for (auto n : occ) std::cout << ' ' << n;
+    std::cout << '\n';
+    if (ex.handled() != std::uint64_t(instances) * rounds * 2) return 1;
+
+    ex.stop();
+    std::size_t total = 0, bad = 0;
+    ex.for_each([&](std::uint64_t, door &d) {
+      total++;
+      if (d.shared || d.opened != rounds || !(d.m.context().current() == M::State{door_state::Closed})) bad++;
+    });
+    if (total != instances || bad) return 1;
+
+    std::printf("---- END OF test_shard_ownership()\n\n\n");
+    return 0;
+  }
+
+  int test_mpsc_ring() {
+    util::mpsc_ring<std::uint64_t> q{64};
+    constexpr std::uint64_t per = 20000;
+    std::vector<std::thread> ps;
+    for (std::uint64_t p = 0; p < 3; p++)
+      ps.emplace_back([&q, p]() {
+        for (std::uint64_t i = 0; i < per; i++)
+          while (!q.try_push(p << 32 | i)) std::this_thread::yield();
+      });
+    std::uint64_t last[3] = {0, 0, 0}, got = 0, v;
+    bool ordered = true;
+    while (got < 3 * per) {
+      if (!q.try_pop(v)) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto p = v >> 32, i = v & 0xffffffffu;
+      if (i != last[p]) ordered = false;
+      last[p] = i + 1;
+      got++;
+    }
+    for (auto &t : ps) t.join();
+    if (!ordered || q.try_pop(v)) return 1;
+    std::printf("---- END OF test_mpsc_ring()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_mpsc_ring();
+  rc |= fsm_cxx::test::test_shard_ownership();
+  return rc;
+}
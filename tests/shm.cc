@@ -0,0 +1,223 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/19.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-shm.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(session_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Active,
+                    Crashed,
+                    Jammed)
+
+  FSM_DEFINE_EVENT(bump);
+  FSM_DEFINE_EVENT(crash);
+  FSM_DEFINE_EVENT(jam);
+
+  struct session {
+    std::uint32_t count;
+    std::uint32_t last; // the pid of the last process to bump it
+  };
+
+  struct session_context : context_t<state_t<session_state>, event_t, void, payload_t> {
+    session *slot{nullptr};
+    void bind_slot(session &s) { slot = &s; }
+  };
+
+  using M = machine_t<session_state, event_t, void, payload_t, state_t<session_state>, session_context>;
+  using Pool = frozen::shared_pool<M, session>;
+
+  // the callables, registered the same way in every process
+  frozen::registry<M> make(frozen::image *img) {
+    M m;
+    m.state().set(session_state::Initial).as_initial().build();
+    m.state().set(session_state::Terminated).as_terminated().build();
+    m.state().set(session_state::Error).as_error().build();
+    m.state().set(session_state::Active).entry_action_named("count", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+      // not atomic: correct only if the steps of an instance are serialized
+      auto n = c.slot->count;
+      c.slot->last = static_cast<std::uint32_t>(::getpid());
+      c.slot->count = n + 1;
+    }).build();
+    m.state().set(session_state::Crashed).entry_action_named("die", [](M::Event const &, M::Context &, M::State const &, M::Payload const &) { ::_exit(3); }).build();
+    m.state().set(session_state::Jammed).entry_action_named("jam", [](M::Event const &, M::Context &c, M::State const &, M::Payload const &) {
+      c.slot->count++;
+      throw std::runtime_error("jammed");
+    }).build();
+    m.transition().set(session_state::Initial, bump{}, session_state::Active).build();
+    m.transition().set(session_state::Active, bump{}, session_state::Active).build();
+    m.transition().set(session_state::Active, crash{}, session_state::Crashed).build();
+    m.transition().set(session_state::Active, jam{}, session_state::Jammed).build();
+    frozen::registry<M> reg;
+    reg.collect(m);
+    frozen::model md;
+    if (img && frozen::freeze(m, md)) *img = md.serialize();
+    return reg;
+  }
+
+  std::string region_name(char const *what) { return "/fsm_cxx_test_" + std::string(what) + "_" + std::to_string(::getpid()); }
+
+  // run child() in n processes, each with its own attach(); true if they
+  // all exit with 0
+  template<typename F>
+  bool in_processes(int n, std::string const &name, F child) {
+    std::vector<pid_t> pids;
+    for (int k = 0; k < n; k++) {
+      auto pid = ::fork();
+      if (pid == 0) {
+        std::string err;
+        auto pool = Pool::attach(name, make(nullptr), &err);
+        ::_exit(pool ? child(*pool, k) : 2);
+      }
+      pids.push_back(pid);
+    }
+    bool ok = true;
+    for (auto pid : pids) {
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+  }
+
+  int test_shared_steps() {
+    frozen::image img;
+    auto reg = make(&img);
+    auto name = region_name("steps");
+    std::string err;
+    auto pool = Pool::create(name, img, 8, reg, &err);
+    if (!pool) {
+      std::printf("  E. %s\n", err.c_str());
+      return 1;
+    }
+    if (Pool::create(name, img, 8, reg) || Pool::attach("/fsm_cxx_test_none", reg)) return 1;
+
+    // four processes bump the same eight instances, none is lost
+    constexpr int procs = 4, bumps = 5000;
+    bool ok = in_processes(procs, name, [](Pool &p, int k) {
+      for (int j = 0; j < bumps; j++)
+        if (!p.step_by(static_cast<std::size_t>(j + k) % p.size(), bump{})) return 1;
+      return 0;
+    });
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < pool->size(); i++) {
+      session s{};
+      auto const &st = pool->read(i, s);
+      if (!(st == M::State{session_state::Active}) || s.count != pool->sequence(i) || pool->claimed(i)) return 1;
+      total += s.count;
+    }
+    std::printf("  %llu steps from %d processes\n", (unsigned long long) total, procs);
+    Pool::unlink(name);
+    if (!ok || total != std::uint64_t(procs) * bumps) return 1;
+
+    std::printf("---- END OF test_shared_steps()\n\n\n");
+    return 0;
+  }
+
+  int test_allocate_and_recover() {
+    frozen::image img;
+    auto reg = make(&img);
+    auto name = region_name("alloc");
+    auto pool = Pool::create(name, img, 64, reg);
+    if (!pool) return 1;
+
+    // every process takes 15 instances, no instance is taken twice
+    bool ok = in_processes(4, name, [](Pool &p, int) {
+      for (int j = 0; j < 15; j++)
+        if (p.allocate() == Pool::none) return 1;
+      return 0;
+    });
+    std::set<std::uint32_t> owners;
+    std::size_t taken = 0;
+    for (std::size_t i = 0; i < pool->size(); i++)
+      if (auto o = pool->owner(i)) taken++, owners.insert(o);
+    if (!ok || taken != 60 || owners.size() != 4) return 1;
+    for (int j = 0; j < 4; j++)
+      if (pool->allocate() == Pool::none) return 1;
+    if (pool->allocate() != Pool::none || !pool->release(7) || pool->release(7) || pool->allocate() != 7) return 1;
+
+    // a process dying in a step leaves its instance claimed
+    pool->step_by(7, bump{});
+    ok = in_processes(1, name, [](Pool &p, int) { return p.step_by(7, crash{}) ? 0 : 1; });
+    if (ok || !pool->claimed(7) || pool->recover() != 1 || pool->claimed(7)) return 1;
+    if (!(pool->current(7) == M::State{session_state::Active}) || !pool->step_by(7, bump{})) return 1;
+    session s{};
+    pool->read(7, s);
+    if (s.count != 2) return 1;
+
+    // or the next step finds out by itself, after waiting a while
+    ok = in_processes(1, name, [](Pool &p, int) { return p.step_by(7, crash{}) ? 0 : 1; });
+    if (ok || !pool->claimed(7) || !pool->step_by(7, bump{}) || pool->claimed(7)) return 1;
+    pool->read(7, s);
+    if (s.count != 3) return 1;
+    Pool::unlink(name);
+
+    std::printf("---- END OF test_allocate_and_recover()\n\n\n");
+    return 0;
+  }
+
+  // an action that throws leaves the instance as it was, and free
+  int test_throwing_action() {
+    frozen::image img;
+    auto reg = make(&img);
+    auto name = region_name("throw");
+    auto pool = Pool::create(name, img, 1, reg);
+    if (!pool) return 1;
+    Pool::unlink(name);
+
+    pool->step_by(0, bump{});
+    auto seq = pool->sequence(0);
+    bool thrown = false;
+    try {
+      pool->step_by(0, jam{});
+    } catch (std::runtime_error const &) {
+      thrown = true;
+    }
+    session s{};
+    auto const &st = pool->read(0, s);
+    if (!thrown || pool->claimed(0) || !(st == M::State{session_state::Active}) || s.count != 1 || pool->sequence(0) != seq + 1) return 1;
+    if (!pool->step_by(0, bump{})) return 1;
+    pool->read(0, s);
+    if (s.count != 2) return 1;
+
+    std::printf("---- END OF test_throwing_action()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_shared_steps();
+  rc |= fsm_cxx::test::test_allocate_and_recover();
+  rc |= fsm_cxx::test::test_throwing_action();
+  return rc;
+}
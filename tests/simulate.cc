@@ -0,0 +1,116 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-simulate.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(session_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Sending,
+                    Retrying,
+                    Done,
+                    Failed)
+
+  FSM_DEFINE_EVENT(request);
+  FSM_DEFINE_EVENT(ack);
+  FSM_DEFINE_EVENT(timeout);
+  FSM_DEFINE_EVENT(retry);
+  FSM_DEFINE_EVENT(give_up);
+
+  struct session_context : public context_t<state_t<session_state>> {
+    int actions{};
+  };
+
+  using M = machine_t<session_state, event_t, void, payload_t, state_t<session_state>, session_context>;
+
+  void define(M &m) {
+    m.state().set(session_state::Initial).as_initial().build();
+    m.state().set(session_state::Retrying).entry_action([](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.actions++; }).build();
+    m.transition().set(session_state::Initial, request{}, session_state::Sending).build();
+    m.transition().set(session_state::Sending, ack{}, session_state::Done).build();
+    m.transition().set(session_state::Sending, timeout{}, session_state::Retrying).build();
+    m.transition().set(session_state::Retrying, retry{}, session_state::Sending).build();
+    m.transition().set(session_state::Retrying, give_up{}, session_state::Failed).build();
+  }
+
+  bool near(double a, double b, double tolerance) { return std::fabs(a - b) <= tolerance * std::fabs(b); }
+
+  int test_simulate() {
+    M m;
+    define(m);
+    sim::model<M> md;
+    md.on(session_state::Initial, 1.0, request{});
+    md.on(session_state::Sending, 3.0, ack{}).on(session_state::Sending, 1.0, timeout{});
+    md.on(session_state::Sending, 0.5, request{}); // refused, the visit goes on
+    md.on(session_state::Retrying, 2.0, retry{}).on(session_state::Retrying, 0.5, give_up{});
+    md.on(session_state::Failed, 0.0, retry{}); // no rate, no event: Failed ends the walks
+
+    sim::options opt;
+    opt.walks = 200000;
+    opt.threads = 4;
+    opt.max_steps = 50;
+    auto r = sim::run(m, md, opt);
+
+    auto &retrying = r.states[session_state::Retrying];
+    auto &sending = r.states[session_state::Sending];
+    auto done = r.states[session_state::Done].ends, failed = r.states[session_state::Failed].ends;
+    std::cout << "  walks " << r.walks << ", steps " << r.steps << ", refused " << r.refused << ", truncated " << r.truncated << '\n'
+              << "  length:   " << r.length << '\n'
+              << "  Retrying: " << retrying.dwell << ", occupancy " << retrying.occupancy(r.time) << '\n'
+              << "  Sending:  " << sending.dwell << '\n'
+              << "  done " << done << ", failed " << failed << '\n';
+
+    // the analytic values: a visit of Retrying lasts 1/2.5 on average, of
+    // Sending 1/4, and a session ends Done with probability .75/(1-.25*.8)
+    if (r.walks != opt.walks || !near(retrying.dwell.mean(), 0.4, 0.03) || !near(sending.dwell.mean(), 0.25, 0.03)) return 1;
+    if (!near(double(done) / double(r.walks), 0.9375, 0.01)) return 1;
+    if (r.truncated != 0 || r.refused == 0 || failed + done != r.walks || r.length.quantile(1.0) > r.length.max()) return 1;
+    if (!near(retrying.dwell.quantile(0.5), std::log(2.0) / 2.5, 0.05)) return 1;
+
+    // reproducible for a seed and a thread count; actions skipped
+    auto again = sim::run(m, md, opt);
+    if (again.steps != r.steps || again.time != r.time || m.context().actions != 0) return 1;
+
+    // with the actions on, each copy counts its own Retrying entries
+    opt.walks = 1000;
+    opt.skip_actions = false;
+    opt.threads = 1;
+    if (sim::run(m, md, opt).states[session_state::Retrying].visits == 0) return 1;
+    // walks cut short keep the time spent so far
+    opt.max_steps = 2;
+    auto cut = sim::run(m, md, opt);
+    if (cut.truncated == 0 || cut.length.max() != 2 || !near(cut.time, cut.duration.sum(), 1e-9)) return 1;
+
+    std::printf("---- END OF test_simulate()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_simulate();
+  return rc;
+}
@@ -0,0 +1,165 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/12.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+#include "fsm_cxx/fsm-snapshot.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(conn_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  FSM_DEFINE_EVENT(begin);
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  // a context carrying user data through the snapshot hooks
+  struct conn_context : public context_t<state_t<conn_state>> {
+    std::uint32_t opens{};
+    std::string peer{};
+
+    struct published {
+      std::uint32_t opens;
+    };
+    void publish(published &p) const { p.opens = opens; }
+
+    void snapshot_save(snapshot::writer &w) const {
+      w.put(opens);
+      w.put_string(peer);
+    }
+    bool snapshot_load(snapshot::reader &r) {
+      std::string_view p;
+      if (!r.get(opens) || !r.get_string(p)) return false;
+      peer.assign(p);
+      return true;
+    }
+  };
+
+  using M = machine_t<conn_state, event_t, void, payload_t, state_t<conn_state>, conn_context>;
+
+  void define(M &m) {
+    m.state().set(conn_state::Initial).as_initial().build();
+    m.state().set(conn_state::Opened).entry_action([](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.opens++; }).build();
+    m.transition().set(conn_state::Initial, begin{}, conn_state::Closed).build();
+    m.transition().set(conn_state::Closed, open{}, conn_state::Opened).build();
+    m.transition().set(conn_state::Opened, close{}, conn_state::Closed).build();
+  }
+
+  int test_snapshot_pool() {
+    M proto;
+    define(proto);
+
+    std::vector<M> pool(1000, proto);
+    for (std::size_t i = 0; i < pool.size(); i++) {
+      auto &m = pool[i];
+      m.context().peer = "peer-" + std::to_string(i);
+      m.step_by(begin{});
+      for (std::size_t k = 0; k < i % 5; k++)
+        m.step_by(open{}), m.step_by(close{});
+      if (i % 2) m.step_by(open{});
+    }
+
+    std::stringstream ss;
+    {
+      snapshot::writer w(ss, 4096);
+      w.write_pool(pool.begin(), pool.end());
+      std::printf("  %zu instances written\n", w.count());
+    }
+    auto const bytes = ss.str();
+
+    std::vector<M> restored(pool.size(), proto);
+    snapshot::view v{bytes};
+    if (!v.valid()) {
+      std::printf("  E. invalid snapshot\n");
+      return 1;
+    }
+    auto n = snapshot::restore_pool(v, restored.begin(), restored.end());
+    if (n != pool.size()) {
+      std::printf("  E. restored %zu of %zu\n", n, pool.size());
+      return 1;
+    }
+
+    for (std::size_t i = 0; i < pool.size(); i++) {
+      auto const &a = pool[i].context();
+      auto const &b = restored[i].context();
+      // and observe() sees the restored state and fields at once
+      auto o = restored[i].observe();
+      if (!(a.current() == b.current()) || a.opens != b.opens || a.peer != b.peer || !(o.state == a.current()) || o.fields.opens != a.opens) {
+        std::printf("  E. instance %zu differs\n", i);
+        return 1;
+      }
+    }
+
+    // restored machines keep running
+    restored[0].step_by(open{});
+    if (!(restored[0].context().current() == M::State{conn_state::Opened}))
+      return 1;
+
+    std::printf("---- END OF test_snapshot_pool() | %zu bytes\n\n\n", bytes.size());
+    return 0;
+  }
+
+  int test_snapshot_plain_context() {
+    machine_t<conn_state> m;
+    m.state().set(conn_state::Initial).as_initial().build();
+    m.transition().set(conn_state::Initial, begin{}, conn_state::Closed).build();
+    m.step_by(begin{});
+
+    std::string bytes;
+    {
+      snapshot::writer w(bytes);
+      w.write(m);
+      w.write(m.context());
+    }
+
+    machine_t<conn_state> m2 = m;
+    m2.reset();
+    snapshot::view v{bytes};
+    int count = 0;
+    for (auto const &rec : v) {
+      if (!snapshot::restore(m2, rec) || !rec.context.empty()) return 1;
+      count++;
+    }
+    if (count != 2 || !(m2.context().current() == M::State{conn_state::Closed}))
+      return 1;
+
+    bytes[0] = 'X';
+    if (snapshot::view{bytes}.valid())
+      return 1;
+
+    std::printf("---- END OF test_snapshot_plain_context()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_snapshot_pool();
+  rc |= fsm_cxx::test::test_snapshot_plain_context();
+  return rc;
+}
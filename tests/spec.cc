@@ -0,0 +1,89 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/16.
+//
+
+#include "door.hh"   // generated by fsm-gen from specs/door.scxml
+#include "quoted.hh" // and from specs/quoted.scxml
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  struct door_impl {
+    std::string trace;
+    bool locked{false};
+
+    bool unlocked(fsm_cxx::event_t const &) const { return !locked; }
+    void closed_in(fsm_cxx::event_t const &) { trace += "C+"; }
+    void closed_out(fsm_cxx::event_t const &) { trace += "C-"; }
+    void opened_in(fsm_cxx::event_t const &) { trace += "O+"; }
+    void creak(fsm_cxx::event_t const &) { trace += "~"; }
+    void answer(fsm_cxx::event_t const &) { trace += "?"; }
+    void toggle_lock(fsm_cxx::event_t const &ev) { locked = dynamic_cast<door::lock const *>(&ev) != nullptr; }
+  };
+
+  // the whole table is a constant expression
+  static_assert(door::spec::index[door::spec::initial * door::spec::event_count + door::begin::id].count == 1);
+  static_assert(door::spec::rows[0].to == static_cast<std::uint16_t>(door::state::Closed));
+  static_assert(std::is_trivially_copyable_v<fsm_cxx::spec::row>);
+  // the events know their spec, a machine takes only those
+  static_assert(std::is_same_v<door::open::spec_type, door::spec> && !std::is_same_v<quoted::knock_twice_::spec_type, door::spec>);
+
+  int test_spec_door() {
+    door_impl impl;
+    door::machine<door_impl> m{impl};
+    std::cout << "  " << door::spec::name << ": " << door::spec::state_count << " states, "
+              << door::spec::event_count << " events, " << sizeof(door::spec::rows) / sizeof(door::spec::rows[0]) << " rows\n";
+
+    Reason reason{};
+    if (m.step_by(door::open{}, &reason) || reason != Reason::StateNotFound) return 1;
+    m.step_by(door::begin{});
+    m.step_by(door::lock{});
+    if (m.step_by(door::open{}, &reason) || reason != Reason::FailureGuard) return 1;
+    m.step_by(door::knock{}); // internal: no exit nor entry
+    m.step_by(door::unlock{});
+    m.step_by(door::open{});
+    m.step_by(door::close{});
+    m.step_by(door::end{});
+    std::cout << "  " << impl.trace << ", now " << m.current() << '\n';
+    if (impl.trace != "C+C-C+?C-C+C-~O+C+C-" || !m.terminated() || m.current() != door::state::Terminated)
+      return 1;
+
+    std::printf("---- END OF test_spec_door()\n\n\n");
+    return 0;
+  }
+
+  // names with quotes and backslashes come out as they were written
+  int test_spec_quoted() {
+    struct none {};
+    none impl;
+    quoted::machine<none> m{impl};
+    if (std::string{quoted::spec::name} != "the \"back\" door\\" || std::string{quoted::spec::event_names[0]} != "knock\"twice\\")
+      return 1;
+    if (!m.step_by(quoted::knock_twice_{}) || !m.terminated()) return 1;
+
+    std::printf("---- END OF test_spec_quoted()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_spec_door();
+  rc |= fsm_cxx::test::test_spec_quoted();
+  return rc;
+}
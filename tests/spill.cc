@@ -0,0 +1,153 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+#include "fsm_cxx/fsm-spill.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(conn_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Opened,
+                    Closed)
+
+  FSM_DEFINE_EVENT(begin);
+  FSM_DEFINE_EVENT(open);
+  FSM_DEFINE_EVENT(close);
+
+  // the user data must survive a trip through the spill file
+  struct conn_context : public context_t<state_t<conn_state>> {
+    std::uint32_t opens{};
+    std::string peer{};
+
+    void snapshot_save(snapshot::writer &w) const {
+      w.put(opens);
+      w.put_string(peer);
+    }
+    bool snapshot_load(snapshot::reader &r) {
+      std::string_view p;
+      if (!r.get(opens) || !r.get_string(p)) return false;
+      peer.assign(p);
+      return true;
+    }
+  };
+
+  using M = machine_t<conn_state, event_t, void, payload_t, state_t<conn_state>, conn_context>;
+
+  void define(M &m) {
+    m.state().set(conn_state::Initial).as_initial().build();
+    m.state().set(conn_state::Opened).entry_action([](M::Event const &, M::Context &c, M::State const &, M::Payload const &) { c.opens++; }).build();
+    m.transition().set(conn_state::Initial, begin{}, conn_state::Closed).build();
+    m.transition().set(conn_state::Closed, open{}, conn_state::Opened).build();
+    m.transition().set(conn_state::Opened, close{}, conn_state::Closed).build();
+  }
+
+  int test_spill_store() {
+    constexpr std::size_t keys = 2000, limit = 100;
+    instance_store<M> store{"spill-test.spill", limit, [](std::uint64_t id, M &m) {
+                              define(m);
+                              m.context().peer = "peer-" + std::to_string(id);
+                            }};
+    if (!store) return 1;
+
+    // the reference: every instance kept in memory
+    std::vector<M> ref(keys);
+    for (std::size_t i = 0; i < keys; i++) {
+      define(ref[i]);
+      ref[i].context().peer = "peer-" + std::to_string(i);
+    }
+
+    // a skewed access pattern: a hot 2.5% of the keys gets most events
+    std::uint64_t x = 88172645463325252ULL;
+    auto rnd = [&x]() { return x ^= x << 13, x ^= x >> 7, x ^= x << 17; };
+    for (int k = 0; k < 50000; k++) {
+      auto r = rnd();
+      std::uint64_t id = (r & 3) ? (r >> 8) % (keys / 40) : (r >> 8) % keys;
+      auto what = (r >> 40) % 3;
+      bool a, b;
+      if (what == 0) a = store.step_by(id, begin{}), b = ref[id].step_by(begin{});
+      else if (what == 1) a = store.step_by(id, open{}), b = ref[id].step_by(open{});
+      else a = store.step_by(id, close{}), b = ref[id].step_by(close{});
+      if (a != b) {
+        std::printf("  E. step %d on %llu differs\n", k, (unsigned long long) id);
+        return 1;
+      }
+      if (store.stats().resident > limit) return 1;
+    }
+
+    for (std::uint64_t i = 0; i < keys; i++) {
+      if (!store.contains(i)) continue;
+      auto *m = store.get(i);
+      auto const &a = m->context();
+      auto const &b = ref[i].context();
+      if (!(a.current() == b.current()) || a.opens != b.opens || a.peer != b.peer) {
+        std::printf("  E. instance %llu differs\n", (unsigned long long) i);
+        return 1;
+      }
+    }
+
+    auto s = store.stats();
+    std::cout << "  " << s << '\n';
+    if (s.misses == 0 || s.evictions == 0 || s.hits < s.misses) return 1;
+    if (s.resident + s.spilled != s.created) return 1;
+
+    // lowering the budget spills at once; erase forgets either side
+    store.resident_limit(10);
+    if (store.stats().resident != 10) return 1;
+    store.erase(0);
+    store.erase(keys - 1);
+    if (store.contains(0) || store.contains(keys - 1)) return 1;
+
+    std::printf("---- END OF test_spill_store()\n\n\n");
+    return 0;
+  }
+
+  int test_spill_full() {
+    // an arena that cannot grow: the machines stay, over the budget
+    instance_store<M> store{"/nonexistent-dir/spill-test.spill", 1, [](std::uint64_t, M &m) { define(m); }};
+    if (store) return 1;
+    for (std::uint64_t id = 0; id < 4; id++) {
+      if (!store.step_by(id, begin{}) || !store.step_by(id, open{})) return 1;
+    }
+    store.resident_limit(2);
+    for (std::uint64_t id = 0; id < 4; id++) {
+      auto *m = store.get(id);
+      if (!m || !(m->context().current() == M::State{conn_state::Opened}) || m->context().opens != 1) return 1;
+    }
+    auto s = store.stats();
+    std::cout << "  " << s << '\n';
+    if (s.resident != 4 || s.spilled != 0 || s.evictions != 0) return 1;
+
+    std::printf("---- END OF test_spill_full()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_spill_store();
+  rc |= fsm_cxx::test::test_spill_full();
+  return rc;
+}
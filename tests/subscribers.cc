@@ -0,0 +1,167 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-sm.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(light_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Red,
+                    Green,
+                    Yellow)
+
+  FSM_DEFINE_EVENT(begin);
+  FSM_DEFINE_EVENT(next);
+
+  using M = machine_t<light_state>;
+
+  void define(M &m) {
+    m.state().set(light_state::Initial).as_initial().build();
+    m.transition().set(light_state::Initial, begin{}, light_state::Red).build();
+    m.transition().set(light_state::Red, next{}, light_state::Green).build();
+    m.transition().set(light_state::Green, next{}, light_state::Yellow).build();
+    m.transition().set(light_state::Yellow, next{}, light_state::Red).build();
+  }
+
+  int test_subscribers() {
+    M m;
+    define(m);
+
+    int a = 0, b = 0, bad = 0;
+    auto ha = m.subscribe([&a, &bad](std::string const &, M::Event const &, M::Payload const &, M::State const &from, M::State const &to) {
+      a++;
+      if (from == to) bad++;
+    });
+    auto hb = m.subscribe([&b](std::string const &, M::Event const &, M::Payload const &, M::State const &, M::State const &) { b++; });
+
+    // a batched sink sees the same transitions, by chunks of 8, from the
+    // delivery thread until flush_subscribers() returns
+    std::vector<std::size_t> chunks;
+    std::vector<M::TransitionRecord> seen;
+    auto hc = m.subscribe(8, [&chunks, &seen](M::TransitionRecord const *r, std::size_t n) {
+      chunks.push_back(n);
+      seen.insert(seen.end(), r, r + n);
+    });
+    if (m.subscribers() != 3) return 1;
+
+    m.step_by(begin{});
+    for (int i = 0; i < 20; i++) m.step_by(next{});
+    m.step_by(begin{}); // refused, not published
+    if (a != 21 || b != 21 || bad) return 1;
+    m.flush_subscribers();
+    if (chunks.size() != 3 || chunks[0] != 8 || chunks[1] != 8 || chunks[2] != 5 || seen.size() != 21) return 1;
+    if (!(seen[0].from == M::State{light_state::Initial}) || !(seen[0].to == M::State{light_state::Red}) ||
+        seen[0].event.find("begin") == std::string::npos || !(seen[20].to == M::State{light_state::Yellow}))
+      return 1;
+
+    // removed subscribers are not called any more; the partial chunk of a
+    // batched one is delivered by unsubscribe()
+    if (!m.unsubscribe(hb) || m.unsubscribe(hb)) return 1;
+    m.step_by(next{});
+    if (!m.unsubscribe(hc) || chunks.back() != 1) return 1;
+    m.step_by(next{});
+    if (a != 23 || b != 21 || seen.size() != 22 || m.subscribers() != 1) return 1;
+    m.unsubscribe(ha);
+
+    // a copy has its own buffers
+    m.subscribe(4, [&chunks](M::TransitionRecord const *, std::size_t n) { chunks.push_back(n); });
+    M m2{m};
+    m2.step_by(next{});
+    m2.flush_subscribers();
+    if (chunks.back() != 1) return 1;
+
+    std::printf("---- END OF test_subscribers()\n\n\n");
+    return 0;
+  }
+
+  // a slow batched sink does not hold the steps back: what the ring has
+  // no room for is dropped
+  int test_subscribers_slow() {
+    M m;
+    define(m);
+    std::size_t delivered = 0;
+    m.subscribe(8, [&delivered](M::TransitionRecord const *, std::size_t n) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      delivered += n;
+    });
+
+    m.step_by(begin{});
+    for (int i = 0; i < 9999; i++) m.step_by(next{});
+    m.flush_subscribers();
+    std::printf("  %zu delivered, %llu dropped\n", delivered, (unsigned long long) m.subscribers_dropped());
+    if (m.subscribers_dropped() == 0 || delivered + m.subscribers_dropped() != 10000) return 1;
+
+    std::printf("---- END OF test_subscribers_slow()\n\n\n");
+    return 0;
+  }
+
+  // subscribers come and go while another thread steps the machine
+  int test_subscribers_concurrent() {
+    M m;
+    define(m);
+    m.step_by(begin{});
+
+    std::atomic<bool> done{false};
+    std::atomic<long> calls{0}, late{0};
+    std::thread stepper([&m, &done]() {
+      while (!done.load()) m.step_by(next{});
+    });
+
+    long total = 0;
+    for (int k = 0; k < 2000; k++) {
+      std::atomic<bool> gone{false};
+      auto h = m.subscribe([&calls, &late, &gone](std::string const &, M::Event const &, M::Payload const &, M::State const &, M::State const &) {
+        calls++;
+        if (gone.load()) late++;
+      });
+      long batched = 0;
+      auto hb = m.subscribe(16, [&batched](M::TransitionRecord const *, std::size_t n) { batched += long(n); });
+      std::this_thread::yield();
+      m.unsubscribe(hb);
+      m.unsubscribe(h);
+      gone = true; // no call may begin after unsubscribe() returned
+      total += batched;
+    }
+    done = true;
+    stepper.join();
+
+    std::printf("  %ld calls, %ld batched records\n", calls.load(), total);
+    if (late != 0 || m.subscribers() != 0) return 1;
+
+    std::printf("---- END OF test_subscribers_concurrent()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_subscribers();
+  rc |= fsm_cxx::test::test_subscribers_slow();
+  rc |= fsm_cxx::test::test_subscribers_concurrent();
+  return rc;
+}
@@ -0,0 +1,211 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/18.
+//
+
+#include "fsm_cxx/fsm-common.hh"
+#include "fsm_cxx/fsm-def.hh"
+#include "fsm_cxx/fsm-frozen.hh"
+#include "fsm_cxx/fsm-sm.hh"
+#include "fsm_cxx/fsm-wire.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// counts the heap allocations made while the steps run
+static std::atomic<long> allocations{0};
+void *operator new(std::size_t n) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace fsm_cxx::test {
+
+namespace {
+
+  AWESOME_MAKE_ENUM(session_state,
+                    Empty,
+                    Error,
+                    Initial,
+                    Terminated,
+                    Authenticated,
+                    Trading,
+                    Closed)
+
+  // the wire format: u16 type, u16 length, then the fields
+  enum : std::uint16_t { t_login = 1,
+                         t_order = 2,
+                         t_logout = 3 };
+
+  struct login : wire::event_view<login> {
+    using event_view::event_view;
+    std::uint32_t user() const { return get<std::uint32_t>(0); }
+    std::string_view token() const { return lstr(4); }
+  };
+  struct order : wire::event_view<order> {
+    using event_view::event_view;
+    std::uint64_t id() const { return get<std::uint64_t>(0); }
+    std::int32_t qty() const { return get<std::int32_t>(8); }
+    std::string_view symbol() const { return str(12, 4); }
+  };
+  struct logout : wire::event_view<logout> {
+    using event_view::event_view;
+  };
+
+  struct session_context : public context_t<state_t<session_state>> {
+    std::uint32_t user{};
+    std::int64_t position{};
+  };
+
+  using M = machine_t<session_state, event_t, void, payload_t, state_t<session_state>, session_context>;
+
+  void define(M &m) {
+    m.state().set(session_state::Initial).as_initial().build();
+    m.transition().set(session_state::Initial, login{}, session_state::Authenticated).guard("token_ok", [](M::Event const &ev, M::Context &, M::State const &, M::Payload const &) -> bool {
+      return static_cast<login const &>(ev).token() == "s3cr3t";
+    }).entry_action_named("remember", [](M::Event const &ev, M::Context &c, M::State const &, M::Payload const &) {
+      c.user = static_cast<login const &>(ev).user();
+    }).build();
+    for (auto from : {session_state::Authenticated, session_state::Trading})
+      m.transition().set(from, order{}, session_state::Trading).guard("sane", [](M::Event const &ev, M::Context &, M::State const &, M::Payload const &) -> bool {
+        auto const &o = static_cast<order const &>(ev);
+        return o.qty() != 0 && o.symbol().size() == 4;
+      }).entry_action_named("fill", [](M::Event const &ev, M::Context &c, M::State const &, M::Payload const &) {
+        c.position += static_cast<order const &>(ev).qty();
+      }).build();
+    m.transition().set(session_state::Trading, logout{}, session_state::Closed).build();
+    m.transition().set(session_state::Authenticated, logout{}, session_state::Closed).build();
+  }
+
+  // a buffer of frames, as read from a socket
+  struct stream {
+    std::vector<char> buf;
+    template<typename... F>
+    void put(std::uint16_t type, F... fields) {
+      std::vector<char> body;
+      auto add = [&body](auto v) {
+        if constexpr (std::is_same<decltype(v), char const *>::value) body.insert(body.end(), v, v + std::strlen(v));
+        else {
+          auto const *p = reinterpret_cast<char const *>(&v);
+          body.insert(body.end(), p, p + sizeof(v));
+        }
+      };
+      (void) add; // unused for the frames without fields
+      (add(fields), ...);
+      auto len = static_cast<std::uint16_t>(body.size());
+      buf.insert(buf.end(), reinterpret_cast<char const *>(&type), reinterpret_cast<char const *>(&type) + 2);
+      buf.insert(buf.end(), reinterpret_cast<char const *>(&len), reinterpret_cast<char const *>(&len) + 2);
+      buf.insert(buf.end(), body.begin(), body.end());
+    }
+    // call fn(type, bytes) for each frame
+    template<typename Fn>
+    void each(Fn &&fn) const {
+      for (std::size_t off = 0; off + 4 <= buf.size();) {
+        std::uint16_t type, len;
+        std::memcpy(&type, &buf[off], 2);
+        std::memcpy(&len, &buf[off + 2], 2);
+        fn(type, wire::bytes{&buf[off + 4], len});
+        off += 4 + len;
+      }
+    }
+  };
+
+  stream session_frames(int orders) {
+    stream s;
+    s.put(t_login, std::uint32_t{7}, std::uint16_t{5}, "wrong");
+    s.put(t_login, std::uint32_t{42}, std::uint16_t{6}, "s3cr3t");
+    for (int i = 0; i < orders; i++) s.put(t_order, std::uint64_t(i), std::int32_t(i % 3 - 1), "ACME");
+    s.put(t_order, std::uint64_t{99}, std::int32_t{5}); // truncated: no symbol
+    s.put(t_logout);
+    return s;
+  }
+
+  int test_wire_machine() {
+    M m;
+    define(m);
+    wire::router<M> r;
+    r.on<login>(t_login).on<order>(t_order).on<logout>(t_logout);
+    auto s = session_frames(1000);
+
+    int moved = 0, frames = 0;
+    auto before = allocations.load();
+    s.each([&](std::uint16_t type, wire::bytes b) {
+      moved += r.step(m, type, b);
+      frames++;
+    });
+    auto allocated = allocations.load() - before;
+    std::printf("  %d frames, %d steps, %ld allocations\n", frames, moved, allocated);
+    if (allocated != 0) return 1;
+    // the bad token, the zero quantities and the truncated order are refused
+    std::int64_t expect = 0;
+    for (int i = 0; i < 1000; i++) expect += i % 3 - 1;
+    if (moved != 1 + 667 + 1 || m.context().user != 42 || m.context().position != expect ||
+        !(m.context().current() == M::State{session_state::Closed}))
+      return 1;
+    if (r.step(m, 77, wire::bytes{}) || r.known(77)) return 1;
+
+    std::printf("---- END OF test_wire_machine()\n\n\n");
+    return 0;
+  }
+
+  int test_wire_frozen() {
+    M m;
+    define(m);
+    frozen::model md;
+    frozen::registry<M> reg;
+    reg.collect(m);
+    std::string err;
+    if (!frozen::freeze(m, md, &err)) return 1;
+    auto def = frozen::make(md.serialize(), reg, &err);
+    if (!def) return 1;
+
+    wire::router<M> r;
+    r.on<login>(t_login).on<order>(t_order).on<logout>(t_logout);
+    if (r.bind(*def) != 0) return 1;
+
+    // frames copied into queue entries outlive the socket buffer
+    std::vector<wire::frame<64>> queue;
+    {
+      auto s = session_frames(100);
+      s.each([&queue](std::uint16_t type, wire::bytes b) {
+        queue.emplace_back();
+        queue.back().assign(type, b);
+      });
+    }
+    frozen::instance<M> in{def};
+    int moved = 0;
+    auto before = allocations.load();
+    for (auto const &f : queue) moved += r.step(in, f);
+    if (allocations.load() != before) return 1;
+    if (moved != 1 + 67 + 1 || !(in.current() == M::State{session_state::Closed}) || in.context().user != 42) return 1;
+
+    wire::frame<8> small;
+    if (small.assign(t_login, wire::bytes{"too long for it", 15})) return 1;
+
+    std::printf("---- END OF test_wire_frozen()\n\n\n");
+    return 0;
+  }
+
+} // namespace
+
+} // namespace fsm_cxx::test
+
+int main() {
+  int rc = 0;
+  rc |= fsm_cxx::test::test_wire_machine();
+  rc |= fsm_cxx::test::test_wire_frozen();
+  return rc;
+}
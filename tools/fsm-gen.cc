@@ -0,0 +1,638 @@
+// fsm_cxx Library
+// Copyright © 2021 Hedzr Yeh.
+//
+// This file is released under the terms of the MIT license.
+// Read /LICENSE for more information.
+
+//
+// Created by Hedzr Yeh on 2021/10/16.
+//
+
+// fsm-gen: compiles an SCXML-like spec into a header for fsm-spec.hh.
+//
+//   fsm-gen <spec.scxml> <out.hh> [namespace]
+//
+// The accepted subset is flat (no compound nor parallel states):
+//
+//   <scxml initial="Closed" name="door">
+//     <state id="Closed">
+//       <onentry><script>lamp_off</script></onentry>
+//       <transition event="open" target="Opened" cond="unlocked"/>
+//       <transition event="knock"><script>answer</script></transition>
+//     </state>
+//     <state id="Opened"> ... </state>
+//     <final id="Gone"/>
+//   </scxml>
+//
+// Executable content is a sequence of <script>name</script>, each one
+// naming a member function of the implementation class; cond names a
+// guard member function. A transition without target is internal. The
+// event attribute may list several events separated by spaces. Errors
+// are reported as file:line: message and make the tool exit with 1.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+  struct node {
+    std::string name;
+    std::map<std::string, std::string> attrs;
+    std::vector<std::unique_ptr<node>> children;
+    std::string text;
+    int line{};
+
+    std::string attr(std::string const &k) const {
+      auto it = attrs.find(k);
+      return it == attrs.end() ? std::string{} : it->second;
+    }
+    bool has(std::string const &k) const { return attrs.count(k) != 0; }
+  };
+
+  std::string file_name;
+  int errors = 0;
+
+  void error(int line, std::string const &msg) {
+    std::cerr << file_name << ':' << line << ": error: " << msg << '\n';
+    errors++;
+  }
+
+  // a small XML reader: elements, attributes, text, comments, CDATA,
+  // processing instructions and the predefined entities; enough for
+  // hand-written specs, not a validating parser.
+  class xml_reader {
+  public:
+    explicit xml_reader(std::string s)
+        : _s(std::move(s)) {}
+
+    std::unique_ptr<node> parse() {
+      std::unique_ptr<node> root;
+      while (_skip_misc(), _i < _s.size()) {
+        if (_s[_i] != '<') return _fail("text outside of the root element");
+        if (root) return _fail("more than one root element");
+        root = _element();
+        if (!root) return nullptr;
+      }
+      if (!root) return _fail("no root element");
+      return root;
+    }
+
+  private:
+    std::unique_ptr<node> _fail(std::string const &msg) {
+      error(_line, msg);
+      return nullptr;
+    }
+
+    bool _starts(char const *p) const { return _s.compare(_i, std::char_traits<char>::length(p), p) == 0; }
+    void _advance(std::size_t n = 1) {
+      for (; n && _i < _s.size(); n--, _i++)
+        if (_s[_i] == '\n') _line++;
+    }
+    bool _skip_to(char const *p) {
+      while (_i < _s.size() && !_starts(p)) _advance();
+      if (_i >= _s.size()) return false;
+      _advance(std::char_traits<char>::length(p));
+      return true;
+    }
+    void _skip_space() {
+      while (_i < _s.size() && std::isspace(static_cast<unsigned char>(_s[_i]))) _advance();
+    }
+    void _skip_misc() {
+      for (;;) {
+        _skip_space();
+        if (_starts("<?")) _skip_to("?>");
+        else if (_starts("<!--")) _skip_to("-->");
+        else if (_starts("<!")) _skip_to(">");
+        else break;
+      }
+    }
+    static std::string _local(std::string const &qname) {
+      auto p = qname.find(':');
+      return p == std::string::npos ? qname : qname.substr(p + 1);
+    }
+    std::string _name() {
+      auto b = _i;
+      while (_i < _s.size() && (std::isalnum(static_cast<unsigned char>(_s[_i])) || std::string_view{"_-.:"}.find(_s[_i]) != std::string_view::npos)) _advance();
+      return _s.substr(b, _i - b);
+    }
+    std::string _decode(std::string const &raw) {
+      std::string out;
+      for (std::size_t k = 0; k < raw.size(); k++) {
+        if (raw[k] != '&') {
+          out += raw[k];
+          continue;
+        }
+        auto semi = raw.find(';', k);
+        auto ent = semi == std::string::npos ? std::string{} : raw.substr(k + 1, semi - k - 1);
+        if (ent == "lt") out += '<';
+        else if (ent == "gt") out += '>';
+        else if (ent == "amp") out += '&';
+        else if (ent == "quot") out += '"';
+        else if (ent == "apos") out += '\'';
+        else {
+          error(_line, "unknown entity &" + ent + ";");
+          semi = k;
+        }
+        k = semi;
+      }
+      return out;
+    }
+
+    std::unique_ptr<node> _element() {
+      auto n = std::make_unique<node>();
+      n->line = _line;
+      _advance(); // '<'
+      n->name = _local(_name());
+      if (n->name.empty()) return _fail("bad element name");
+      for (;;) {
+        _skip_space();
+        if (_starts("/>")) {
+          _advance(2);
+          return n;
+        }
+        if (_starts(">")) {
+          _advance();
+          break;
+        }
+        auto k = _local(_name());
+        _skip_space();
+        if (k.empty() || !_starts("=")) return _fail("bad attribute in <" + n->name + ">");
+        _advance();
+        _skip_space();
+        if (_i >= _s.size() || (_s[_i] != '"' && _s[_i] != '\'')) return _fail("attribute value must be quoted");
+        auto q = _s[_i];
+        _advance();
+        auto b = _i;
+        while (_i < _s.size() && _s[_i] != q) _advance();
+        if (_i >= _s.size()) return _fail("unterminated attribute value");
+        n->attrs[k] = _decode(_s.substr(b, _i - b));
+        _advance();
+      }
+      for (;;) {
+        if (_i >= _s.size()) return _fail("<" + n->name + "> is not closed");
+        if (_starts("<!--")) _skip_to("-->");
+        else if (_starts("<![CDATA[")) {
+          _advance(9);
+          auto b = _i;
+          if (!_skip_to("]]>")) return _fail("unterminated CDATA");
+          n->text += _s.substr(b, _i - 3 - b);
+        } else if (_starts("<?")) _skip_to("?>");
+        else if (_starts("</")) {
+          _advance(2);
+          auto e = _local(_name());
+          _skip_space();
+          if (e != n->name || !_starts(">")) return _fail("expected </" + n->name + ">");
+          _advance();
+          return n;
+        } else if (_starts("<")) {
+          auto c = _element();
+          if (!c) return nullptr;
+          n->children.push_back(std::move(c));
+        } else {
+          auto b = _i;
+          while (_i < _s.size() && _s[_i] != '<') _advance();
+          n->text += _decode(_s.substr(b, _i - b));
+        }
+      }
+    }
+
+  private:
+    std::string _s;
+    std::size_t _i{};
+    int _line{1};
+  };
+
+  std::string trim(std::string const &s) {
+    auto b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return {};
+    return s.substr(b, s.find_last_not_of(" \t\r\n") - b + 1);
+  }
+
+  std::vector<std::string> split(std::string const &s) {
+    std::vector<std::string> out;
+    std::istringstream is{s};
+    for (std::string w; is >> w;) out.push_back(w);
+    return out;
+  }
+
+  bool is_identifier(std::string const &s) {
+    if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0]))) return false;
+    for (auto c : s)
+      if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    return true;
+  }
+
+  // why s cannot name something in the generated header, or nullptr:
+  // keywords, reserved identifiers, the standard macros a header may
+  // pull in, and the names given (also in scope) are tried in order
+  char const *unusable(std::string const &s, std::initializer_list<char const *> taken = {}) {
+    static char const *const keywords[] = {
+            "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case",
+            "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval",
+            "constexpr", "constinit", "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype",
+            "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern",
+            "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new",
+            "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
+            "register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+            "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+            "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+            "wchar_t", "while", "xor", "xor_eq"};
+    static char const *const macros[] = {"assert", "errno", "EOF", "NULL", "offsetof", "stderr", "stdin", "stdout"};
+    if (!is_identifier(s)) return "is not a C++ identifier";
+    for (auto k : keywords)
+      if (s == k) return "is a C++ keyword";
+    if (s.find("__") != std::string::npos || (s[0] == '_' && s.size() > 1 && std::isupper(static_cast<unsigned char>(s[1]))))
+      return "is reserved to the implementation";
+    for (auto m : macros)
+      if (s == m) return "is a standard macro";
+    for (auto t : taken)
+      if (s == t) return "is used by the generated header";
+    return nullptr;
+  }
+
+  // the dense indices and counts of the generated tables are uint16, and
+  // 0xffff is fsm_cxx::spec::none
+  constexpr std::size_t max_count = 0xffff;
+
+  // "door.open" becomes door_open
+  std::string event_identifier(std::string const &s) {
+    std::string out;
+    for (auto c : s) out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    if (out.empty() || std::isdigit(static_cast<unsigned char>(out[0]))) out = "ev_" + out;
+    return out;
+  }
+
+  // s as the body of a C++ string literal: quotes, backslashes and the
+  // bytes that are not printable are escaped, in octal so that no
+  // following digit runs into them
+  std::string literal(std::string const &s) {
+    std::string out;
+    for (auto c : s) {
+      auto u = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (u < 0x20 || u == 0x7f) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\%03o", u);
+        out += buf;
+      } else
+        out += c;
+    }
+    return out;
+  }
+
+  struct transition {
+    int line;
+    std::size_t from, to;
+    std::size_t event;
+    std::string cond;
+    std::vector<std::string> actions;
+    bool internal;
+  };
+
+  struct spec {
+    std::string name;
+    std::vector<std::string> states;
+    std::vector<std::string> events; // identifiers
+    std::vector<std::string> event_names;
+    std::vector<std::vector<std::string>> entry, exit;
+    std::vector<transition> trans;
+    std::size_t initial{};
+    std::size_t final_state{~std::size_t{}};
+
+    std::size_t state_of(std::string const &s) const {
+      for (std::size_t i = 0; i < states.size(); i++)
+        if (states[i] == s) return i;
+      return ~std::size_t{};
+    }
+    std::size_t event_of(std::string const &raw, int line) {
+      auto id = event_identifier(raw);
+      for (std::size_t i = 0; i < events.size(); i++)
+        if (events[i] == id) {
+          if (event_names[i] != raw) error(line, "events '" + event_names[i] + "' and '" + raw + "' map to the same identifier");
+          return i;
+        }
+      // each event is a struct with the members id and spec_type, next
+      // to the state enum, the spec struct and the machine alias
+      if (auto why = unusable(id, {"state", "spec", "machine", "id", "spec_type", "fsm_cxx", "std"}))
+        error(line, "event '" + raw + "' " + why);
+      if (events.size() == max_count) error(line, "too many events, at most " + std::to_string(max_count));
+      events.push_back(id);
+      event_names.push_back(raw);
+      return events.size() - 1;
+    }
+  };
+
+  // the length of actions[]: every sequence of every state and
+  // transition, a transition's once per event
+  std::size_t action_count = 0;
+  void check_action_count(int line) {
+    static bool said = false;
+    if (action_count <= max_count || said) return;
+    error(line, "too many actions, at most " + std::to_string(max_count));
+    said = true;
+  }
+
+  std::vector<std::string> scripts(node const &n) {
+    std::vector<std::string> out;
+    for (auto const &c : n.children) {
+      if (c->name != "script") {
+        error(c->line, "<" + c->name + "> is not supported as executable content, use <script>name</script>");
+        continue;
+      }
+      auto s = trim(c->text);
+      if (auto why = unusable(s)) error(c->line, "<script> must name a member function, '" + s + "' " + why);
+      action_count++;
+      check_action_count(c->line);
+      out.push_back(s);
+    }
+    return out;
+  }
+
+  bool load(node const &root, spec &sp) {
+    if (root.name != "scxml") {
+      error(root.line, "the root element must be <scxml>");
+      return false;
+    }
+    sp.name = root.attr("name");
+
+    // pass 1: the states
+    for (auto const &c : root.children) {
+      if (c->name == "datamodel") continue;
+      if (c->name != "state" && c->name != "final") {
+        error(c->line, "<" + c->name + "> is not supported here");
+        continue;
+      }
+      auto id = c->attr("id");
+      if (auto why = unusable(id)) {
+        error(c->line, "state id '" + id + "' " + why);
+        continue;
+      }
+      if (sp.states.size() == max_count) {
+        error(c->line, "too many states, at most " + std::to_string(max_count));
+        continue;
+      }
+      if (sp.state_of(id) != ~std::size_t{}) {
+        error(c->line, "duplicate state '" + id + "'");
+        continue;
+      }
+      sp.states.push_back(id);
+      if (c->name == "final") {
+        if (sp.final_state != ~std::size_t{}) error(c->line, "only one <final> state is supported");
+        sp.final_state = sp.states.size() - 1;
+      }
+    }
+    if (sp.states.empty()) {
+      error(root.line, "no states");
+      return false;
+    }
+    sp.entry.resize(sp.states.size());
+    sp.exit.resize(sp.states.size());
+
+    if (root.has("initial")) {
+      sp.initial = sp.state_of(root.attr("initial"));
+      if (sp.initial == ~std::size_t{}) {
+        error(root.line, "unknown initial state '" + root.attr("initial") + "'");
+        sp.initial = 0;
+      }
+    }
+
+    // pass 2: the content of each state
+    std::vector<std::string> guards; // distinct, counted against none
+    for (auto const &c : root.children) {
+      auto from = sp.state_of(c->attr("id"));
+      if (from == ~std::size_t{}) continue;
+      for (auto const &k : c->children) {
+        if (k->name == "onentry") {
+          auto v = scripts(*k);
+          sp.entry[from].insert(sp.entry[from].end(), v.begin(), v.end());
+        } else if (k->name == "onexit") {
+          auto v = scripts(*k);
+          sp.exit[from].insert(sp.exit[from].end(), v.begin(), v.end());
+        } else if (k->name == "transition") {
+          if (from == sp.final_state) {
+            error(k->line, "a <final> state cannot have transitions");
+            continue;
+          }
+          auto evs = split(k->attr("event"));
+          if (evs.empty()) {
+            error(k->line, "eventless transitions are not supported");
+            continue;
+          }
+          transition t{k->line, from, from, 0, trim(k->attr("cond")), scripts(*k), !k->has("target")};
+          if (!t.internal) {
+            t.to = sp.state_of(trim(k->attr("target")));
+            if (t.to == ~std::size_t{}) {
+              error(k->line, "unknown target '" + k->attr("target") + "'");
+              continue;
+            }
+          }
+          if (!t.cond.empty()) {
+            if (auto why = unusable(t.cond)) error(k->line, "cond must name a guard member function, '" + t.cond + "' " + why);
+            else if (std::find(guards.begin(), guards.end(), t.cond) == guards.end()) {
+              if (guards.size() == max_count - 1) error(k->line, "too many guards, at most " + std::to_string(max_count - 1));
+              guards.push_back(t.cond);
+            }
+          }
+          if (k->has("type") && k->attr("type") != "external" && k->attr("type") != "internal")
+            error(k->line, "bad transition type '" + k->attr("type") + "'");
+          action_count += (evs.size() - 1) * t.actions.size();
+          check_action_count(k->line);
+          for (auto const &e : evs) {
+            t.event = sp.event_of(e, k->line);
+            if (sp.trans.size() == max_count) error(k->line, "too many transitions, at most " + std::to_string(max_count));
+            sp.trans.push_back(t);
+          }
+        } else if (k->name == "state" || k->name == "parallel" || k->name == "history")
+          error(k->line, "nested <" + k->name + "> is not supported");
+        else
+          error(k->line, "<" + k->name + "> is not supported here");
+      }
+    }
+
+    // rows after an unguarded row of the same (state, event) never fire
+    for (std::size_t i = 0; i < sp.trans.size(); i++) {
+      if (!sp.trans[i].cond.empty()) continue;
+      for (std::size_t j = i + 1; j < sp.trans.size(); j++)
+        if (sp.trans[j].from == sp.trans[i].from && sp.trans[j].event == sp.trans[i].event)
+          error(sp.trans[j].line, "transition is shadowed by the unguarded one at line " + std::to_string(sp.trans[i].line));
+    }
+    return errors == 0;
+  }
+
+  void emit_actions(std::ostream &os, std::vector<std::string> const &names, std::string const &kind) {
+    os << "    template<class Impl, class Evt>\n"
+       << "    static " << (kind == "guard" ? "bool" : "void") << ' ' << kind << "(std::uint16_t i, Impl &impl, Evt const &ev) {\n"
+       << "      switch (i) {\n";
+    for (std::size_t i = 0; i < names.size(); i++)
+      os << "      case " << i << ": " << (kind == "guard" ? "return " : "") << "impl." << names[i] << "(ev);"
+         << (kind == "guard" ? "" : " break;") << '\n';
+    os << "      default: (void) impl, (void) ev;" << (kind == "guard" ? " return false;" : "") << '\n'
+       << "      }\n"
+       << "    }\n";
+  }
+
+  void emit(std::ostream &os, spec const &sp, std::string const &ns, std::string const &src) {
+    std::vector<std::string> guards, acts;
+    auto intern = [](std::vector<std::string> &v, std::string const &s) {
+      for (std::size_t i = 0; i < v.size(); i++)
+        if (v[i] == s) return i;
+      v.push_back(s);
+      return v.size() - 1;
+    };
+
+    // the action sequences, entry and exit first
+    std::vector<std::size_t> actions;
+    auto seq = [&](std::vector<std::string> const &v) {
+      std::ostringstream s;
+      s << "{" << actions.size() << ", " << v.size() << "}";
+      for (auto const &a : v) actions.push_back(intern(acts, a));
+      return s.str();
+    };
+    std::vector<std::string> entry, exit;
+    for (std::size_t i = 0; i < sp.states.size(); i++) entry.push_back(seq(sp.entry[i]));
+    for (std::size_t i = 0; i < sp.states.size(); i++) exit.push_back(seq(sp.exit[i]));
+
+    // rows sorted by (from, event), document order kept within
+    std::vector<transition const *> rows;
+    for (auto const &t : sp.trans) rows.push_back(&t);
+    std::stable_sort(rows.begin(), rows.end(), [](transition const *a, transition const *b) {
+      return a->from != b->from ? a->from < b->from : a->event < b->event;
+    });
+    std::vector<std::string> row_text;
+    for (auto const *t : rows) {
+      std::ostringstream s;
+      s << "{" << t->from << ", " << t->event << ", " << t->to << ", "
+        << (t->cond.empty() ? std::string{"fsm_cxx::spec::none"} : std::to_string(intern(guards, t->cond))) << ", "
+        << seq(t->actions) << ", " << (t->internal ? "true" : "false") << "}, // line " << t->line;
+      row_text.push_back(s.str());
+    }
+
+    auto guard_macro = "__FSM_GEN_" + event_identifier(ns) + "_HH";
+    for (auto &c : guard_macro) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+
+    os << "// generated by fsm-gen from " << src << ", do not edit.\n\n"
+       << "#ifndef " << guard_macro << "\n#define " << guard_macro << "\n\n"
+       << "#include \"fsm_cxx/fsm-spec.hh\"\n\n"
+       << "#include <cstdint>\n\n"
+       << "namespace " << ns << " {\n\n";
+
+    os << "  AWESOME_MAKE_ENUM(state";
+    for (auto const &s : sp.states) os << ",\n                    " << s;
+    os << ")\n\n";
+
+    // the events name their spec, so that a machine refuses the events
+    // of another one
+    os << "  struct spec;\n";
+    for (std::size_t i = 0; i < sp.events.size(); i++)
+      os << "  struct " << sp.events[i] << " : fsm_cxx::event_type<" << sp.events[i] << "> {\n"
+         << "    using spec_type = spec;\n"
+         << "    static constexpr std::uint16_t id = " << i << ";\n"
+         << "  };\n";
+    os << '\n';
+
+    auto n_states = sp.states.size(), n_events = sp.events.size();
+    os << "  struct spec {\n"
+       << "    using state_type = state;\n"
+       << "    static constexpr std::uint16_t state_count = " << n_states << ";\n"
+       << "    static constexpr std::uint16_t event_count = " << n_events << ";\n"
+       << "    static constexpr std::uint16_t initial = " << sp.initial << ";\n"
+       << "    static constexpr std::uint16_t final_state = "
+       << (sp.final_state == ~std::size_t{} ? std::string{"fsm_cxx::spec::none"} : std::to_string(sp.final_state)) << ";\n";
+    os << "    static constexpr char const *name = \"" << literal(sp.name) << "\";\n";
+    os << "    static constexpr char const *state_names[] = {";
+    for (std::size_t i = 0; i < n_states; i++) os << (i ? ", " : "") << '"' << sp.states[i] << '"';
+    os << "};\n    static constexpr char const *event_names[] = {";
+    for (std::size_t i = 0; i < n_events; i++) os << (i ? ", " : "") << '"' << literal(sp.event_names[i]) << '"';
+    os << (n_events ? "" : "\"\"") << "};\n";
+
+    os << "    static constexpr fsm_cxx::spec::row rows[] = {\n";
+    for (auto const &r : row_text) os << "        " << r << '\n';
+    if (row_text.empty()) os << "        {0, 0, 0, fsm_cxx::spec::none, {0, 0}, true}, // no transitions\n";
+    os << "    };\n";
+
+    os << "    static constexpr fsm_cxx::spec::span index[] = {\n";
+    for (std::size_t s = 0, k = 0; s < n_states; s++) {
+      os << "        ";
+      for (std::size_t e = 0; e < n_events; e++) {
+        auto b = k;
+        while (k < rows.size() && rows[k]->from == s && rows[k]->event == e) k++;
+        os << "{" << b << ", " << k - b << "}, ";
+      }
+      os << "// " << sp.states[s] << '\n';
+    }
+    if (n_events == 0) os << "        {0, 0},\n";
+    os << "    };\n";
+
+    os << "    static constexpr fsm_cxx::spec::span entry[] = {";
+    for (std::size_t i = 0; i < n_states; i++) os << (i ? ", " : "") << entry[i];
+    os << "};\n    static constexpr fsm_cxx::spec::span exit[] = {";
+    for (std::size_t i = 0; i < n_states; i++) os << (i ? ", " : "") << exit[i];
+    os << "};\n    static constexpr std::uint16_t actions[] = {";
+    for (std::size_t i = 0; i < actions.size(); i++) os << (i ? ", " : "") << actions[i];
+    os << (actions.empty() ? "0" : "") << "};\n\n";
+
+    emit_actions(os, guards, "guard");
+    emit_actions(os, acts, "action");
+    os << "  };\n\n"
+       << "  static_assert(fsm_cxx::spec::valid<spec>(), \"" << literal(src) << ": inconsistent table\");\n\n"
+       << "  template<class Impl>\n"
+       << "  using machine = fsm_cxx::spec::machine<spec, Impl>;\n\n"
+       << "} // namespace " << ns << "\n\n"
+       << "#endif // " << guard_macro << '\n';
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3 || argc > 4) {
+    std::cerr << "usage: fsm-gen <spec.scxml> <out.hh> [namespace]\n";
+    return 2;
+  }
+  file_name = argv[1];
+  std::ifstream in{file_name, std::ios::binary};
+  if (!in) {
+    std::cerr << file_name << ": cannot open\n";
+    return 1;
+  }
+  std::ostringstream buf;
+  buf << in.rdbuf();
+
+  auto root = xml_reader{buf.str()}.parse();
+  spec sp;
+  if (!root || !load(*root, sp)) return 1;
+
+  std::string ns = argc > 3 ? argv[3] : sp.name;
+  if (auto why = unusable(ns, {"fsm_cxx", "std"})) {
+    std::cerr << file_name << ": the namespace '" << ns << "' " << why << ", name it with <scxml name=...> or on the command line\n";
+    return 1;
+  }
+  std::ostringstream out;
+  auto src = file_name.substr(file_name.find_last_of("/\\") + 1);
+  emit(out, sp, ns, src);
+
+  // leave an unchanged header alone, so that its dependents are not rebuilt
+  std::ifstream old{argv[2], std::ios::binary};
+  std::ostringstream old_buf;
+  if (old) old_buf << old.rdbuf();
+  if (!old || old_buf.str() != out.str()) {
+    std::ofstream f{argv[2], std::ios::binary | std::ios::trunc};
+    f << out.str();
+    if (!f) {
+      std::cerr << argv[2] << ": cannot write\n";
+      return 1;
+    }
+  }
+  return 0;
+}
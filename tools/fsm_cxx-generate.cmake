@@ -0,0 +1,36 @@
+# fsm_cxx_generate(<target> <spec> [NAMESPACE <ns>] [OUTPUT <header>])
+#
+# Compiles an SCXML-like spec with fsm-gen at build time and adds the
+# generated header to <target>. The header is written to OUTPUT, by
+# default <spec-name>.hh in the current binary directory, which is put
+# on the include path of <target>. NAMESPACE overrides the name given
+# by <scxml name=...>. See tools/fsm-gen.cc for the accepted subset.
+#
+# It runs the fsm-gen target of the build tree, or the fsm_cxx::fsm-gen
+# installed with the package (find_package(fsm_cxx)).
+function(fsm_cxx_generate target spec)
+    cmake_parse_arguments(ARG "" "NAMESPACE;OUTPUT" "" ${ARGN})
+    if (TARGET fsm-gen)
+        set(_gen fsm-gen)
+        set(_gen_dep fsm-gen)
+    elseif (TARGET fsm_cxx::fsm-gen)
+        set(_gen fsm_cxx::fsm-gen)
+        set(_gen_dep $<TARGET_FILE:fsm_cxx::fsm-gen>)
+    else ()
+        message(FATAL_ERROR "fsm_cxx_generate: no fsm-gen, build fsm_cxx with FSM_CXX_BUILD_TOOLS")
+    endif ()
+    get_filename_component(_spec ${spec} ABSOLUTE)
+    get_filename_component(_name ${spec} NAME_WE)
+    if (NOT ARG_OUTPUT)
+        set(ARG_OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/${_name}.hh)
+    endif ()
+    get_filename_component(_dir ${ARG_OUTPUT} DIRECTORY)
+    add_custom_command(
+            OUTPUT ${ARG_OUTPUT}
+            COMMAND ${_gen} ${_spec} ${ARG_OUTPUT} ${ARG_NAMESPACE}
+            DEPENDS ${_gen_dep} ${_spec}
+            COMMENT "fsm-gen ${spec}"
+            VERBATIM)
+    target_sources(${target} PRIVATE ${ARG_OUTPUT})
+    target_include_directories(${target} PRIVATE ${_dir})
+endfunction()